@@ -7,65 +7,148 @@ in kernel space, and executed by the eBPF VM.
 
 This file defines two rules:
 
-- cc_build_ebpf - that simply compiles a .c file into a .pic.o file
+- cc_build_ebpf - that simply compiles a .c file into a .o file
   containing eBPF bytecode.
 
 - cc_ebpf - that uses cc_build_ebpf and cc_embed to actually make the
   eBPF bytecode available as a std::string_view into a cpp file.
 
+and a test to go with them:
+
+- cc_ebpf_budget_test - that loads the bytecode of a cc_ebpf target and
+  fails if the verifier finds it too complex, or too slow to load.
+
 See the documentation for each rule and the examples under tests/ for
 more details.
 """
 
 load("@bazel_tools//tools/cpp:toolchain_utils.bzl", "find_cpp_toolchain")
-load("@bazel_tools//tools/build_defs/cc:action_names.bzl", "C_COMPILE_ACTION_NAME")
 load("//build:embed.bzl", "cc_embed")
 
+# Instruction sets clang can generate, by -mcpu name: v2 adds the "less
+# than" jumps, v3 32 bit ALU operations and jumps (ALU32 and JMP32, kernel
+# 5.1 and later), which save the shifts zero extending 32 bit values and
+# keep their bounds tighter for the verifier. "probe" picks the best the
+# kernel of the build machine supports.
+_CPUS = ["v1", "v2", "v3", "probe"]
+
+# Used when neither the target nor --define=ebpf_cpu=... picks one.
+_DEFAULT_CPU = "v3"
+
+# Options every eBPF object is compiled with. -O2 is not a choice: the
+# verifier rejects most unoptimized code, which spills every value to the
+# stack and back.
+_COPTS = [
+    "-target",
+    "bpf",
+    "-O2",
+    "-Wall",
+    "-fno-stack-protector",
+    "-fno-jump-tables",
+]
+
+def _cpu(ctx):
+  """Returns the -mcpu value to build the target with."""
+  cpu = ctx.attr.cpu or ctx.var.get("ebpf_cpu", _DEFAULT_CPU)
+  if cpu not in _CPUS:
+    fail("cpu must be one of %s, not '%s'" % (_CPUS, cpu))
+  return cpu
+
+def _include_paths(ctx, includes):
+  """Returns 'includes', relative to the package, from source and output roots."""
+  package = ctx.label.package
+  if ctx.label.workspace_root:
+    package = ctx.label.workspace_root + "/" + package
+  paths = []
+  for include in includes:
+    path = package + "/" + include if include != "." else package
+    paths.extend([path, ctx.bin_dir.path + "/" + path])
+  return paths
+
 def _cc_build_ebpf(ctx):
   cc_toolchain = find_cpp_toolchain(ctx)
 
-  # cc_common is the sklark library used to access C/C++ build primitives
-  # in bazel, more details here:
-  #   https://docs.bazel.build/versions/master/skylark/lib/cc_common.html
-  feature_configuration = cc_common.configure_features(
-     ctx = ctx,
-     cc_toolchain = cc_toolchain,
-     requested_features = ctx.features,
-     unsupported_features = ctx.disabled_features,
-  )
   compilation_contexts = []
-  linking_contexts = []
   for dep in ctx.attr.deps:
     if not CcInfo in dep:
       fail("All dependencies must be C or C++ targets - exporting CcInfo") 
 
     compilation_contexts.append(dep[CcInfo].compilation_context)
-    linking_contexts.append(dep[CcInfo].linking_context)
-
-  # TODO: some of the options here are technically wrong: they use the
-  # default toolchain provided by bazel, and just add flags on top of the
-  # default options. But the default options might not work here, a dedicated
-  # toolchain is required, will be submitted in a separate PR.
-  compilation_context, compilation_outputs = cc_common.compile(
-      name = ctx.label.name,
-      actions = ctx.actions,
-      feature_configuration = feature_configuration,
-      cc_toolchain = cc_toolchain,
-      public_hdrs = ctx.files.hdrs,
-      srcs = ctx.files.srcs,
-      includes = ctx.attr.includes,
-      defines = ctx.attr.defines,
-      user_compile_flags = ["--target=bpf"] + ctx.attr.copts,
-      compilation_contexts = compilation_contexts,
+
+  # The options of the host toolchain are not used: hardening, sanitizers
+  # (--config=asan adds -fsanitize=address to every compile action),
+  # -fPIC, -O0 in fastbuild or the host -march mean nothing to the eBPF
+  # backend, or make it fail. Only its clang is, with options of our own.
+  args = ctx.actions.args()
+  args.add_all(_COPTS)
+  args.add("-mcpu=" + _cpu(ctx))
+  if ctx.attr.btf:
+    # clang describes the types of the object in .BTF and .BTF.ext when
+    # generating debug information: what the kernel needs to print maps and
+    # annotate verifier logs with source lines, and what libbpf needs to
+    # relocate CO-RE accesses. No pahole pass is needed, the types of a
+    # single translation unit are already deduplicated.
+    args.add("-g")
+  args.add_all(ctx.attr.defines, format_each = "-D%s")
+  args.add_all(_include_paths(ctx, ctx.attr.includes), format_each = "-I%s")
+  root = ctx.label.workspace_root or "."
+  args.add_all([root, ctx.bin_dir.path + "/" + root], format_each = "-iquote%s")
+  for context in compilation_contexts:
+    args.add_all(context.defines, format_each = "-D%s")
+    args.add_all(context.quote_includes, format_each = "-iquote%s")
+    args.add_all(context.includes, format_each = "-I%s")
+    args.add_all(context.system_includes, format_each = "-isystem%s")
+  args.add_all(ctx.attr.copts)
+
+  inputs = depset(
+      direct = ctx.files.srcs + ctx.files.hdrs,
+      transitive = [context.headers for context in compilation_contexts] +
+                   [cc_toolchain.all_files],
   )
 
+  objects = []
+  debug_objects = []
+  for src in ctx.files.srcs:
+    # Named after the source, as with cc_common.compile before: cc_embed
+    # names its variable after the object.
+    stem = ctx.label.name + "/" + src.basename[:-len(src.extension) - 1]
+    compiled = ctx.actions.declare_file(stem + (".debug.o" if ctx.attr.btf else ".o"))
+    ctx.actions.run(
+        executable = cc_toolchain.compiler_executable,
+        arguments = [args, "-c", src.path, "-o", compiled.path],
+        inputs = inputs,
+        outputs = [compiled],
+        mnemonic = "EbpfCompile",
+        progress_message = "Compiling eBPF %s" % src.short_path,
+    )
+    if not ctx.attr.btf:
+      objects.append(compiled)
+      continue
+
+    # Drop the DWARF -g generated too: BTF is all the loader uses, and the
+    # DWARF is most of the object, and of the binary it is embedded in.
+    # The unstripped object is in the "debug" output group, for
+    # llvm-objdump -S.
+    stripped = ctx.actions.declare_file(stem + ".o")
+    ctx.actions.run(
+        executable = cc_toolchain.objcopy_executable,
+        arguments = ["--strip-debug", compiled.path, stripped.path],
+        inputs = depset(direct = [compiled], transitive = [cc_toolchain.all_files]),
+        outputs = [stripped],
+        mnemonic = "EbpfStrip",
+        progress_message = "Stripping eBPF %s" % src.short_path,
+    )
+    objects.append(stripped)
+    debug_objects.append(compiled)
+
   # The bpf code has been compiled by the toolchain, so why not return CcInfo?
   # BPF code cannot really be linked together (not supported) and there's not
   # much we can do with it beside... loading it.
   # Using DefaultInfo guarantees it is treated as a blob of bytes by the rest
   # of bazel. We should consider returning a CcInfo if this ever changes.
   return [
-      DefaultInfo(files = depset(items = compilation_outputs.pic_objects)),
+      DefaultInfo(files = depset(items = objects)),
+      OutputGroupInfo(debug = depset(items = debug_objects)),
   ]
 
 cc_build_ebpf = rule(
@@ -91,7 +174,15 @@ cc_build_ebpf = rule(
                + "Similar to using -D <string> with the compiler."
        ),
        "copts": attr.string_list(
-           doc = "Additional options passed to the compiler."
+           doc = "Additional options passed to the compiler, after ours."
+       ),
+       "cpu": attr.string(
+           doc = "Instruction set to generate: v1, v2, v3 or probe. "
+               + "Defaults to --define=ebpf_cpu=..., or v3."
+       ),
+       "btf": attr.bool(
+           default = True,
+           doc = "Whether to describe the types of the object in BTF."
        ),
        "_cc_toolchain": attr.label(
            default = Label("@bazel_tools//tools/cpp:current_cc_toolchain")
@@ -108,12 +199,24 @@ Example:
     srcs = ["sample.c"]
   )
 
-Will result in a "sample.pic.o" being generated containing
-the eBPF bytecode compiled off sample.c.
+Will result in a "sample/sample.o" being generated containing
+the eBPF bytecode compiled off sample.c, with -O2, BTF and the v3
+instruction set.
+
+Programs for kernels older than 5.1 need an older instruction set,
+either for a target:
+
+  cc_build_ebpf(
+    name = "sample_v2",
+    srcs = ["sample.c"],
+    cpu = "v2",
+  )
+
+or for the whole build, with bazel build --define=ebpf_cpu=v2.
 """,
 )
 
-def cc_ebpf(name, **kwargs):
+def cc_ebpf(name, compress = False, section = "", **kwargs):
   """Compiles C code into eBPF, and embeds it into an object file.
 
   Use this macro to create eBPF bytecode and have it available from your
@@ -123,7 +226,54 @@ def cc_ebpf(name, **kwargs):
   cc_embed target using it.
 
   Args:
+    compress: embed the bytecode compressed, see cc_embed.
+    section: ELF section to embed the bytecode in, page aligned, see cc_embed.
     **kwargs: parameters are passed unchanged to cc_build_ebpf.
   """
   cc_build_ebpf(name = name + "-built-ebpf", **kwargs)
-  cc_embed(name = name, namespace = "ebpf", data = [":" + name + "-built-ebpf"])
+  cc_embed(name = name, namespace = "ebpf", data = [":" + name + "-built-ebpf"],
+           compress = compress, section = section)
+
+def cc_ebpf_budget_test(name, ebpf, max_processed_insns = 131072,
+                        max_total_states = 0, max_load_time_ms = 0,
+                        log_level = 0, **kwargs):
+  """Tests the programs of a cc_ebpf target verify within a budget.
+
+  Loads each program of the target on its own, and fails if the verifier
+  processed more instructions, kept more states, or took longer than
+  allowed: programs growing towards the limits of the verifier fail here,
+  rather than on a kernel in production. What the verifier reported is in
+  the test log. Loading programs needs CAP_SYS_ADMIN.
+
+  Example:
+    cc_ebpf_budget_test(
+      name = "router_budget_test",
+      ebpf = ":router",
+      max_processed_insns = 50000,
+    )
+
+  Args:
+    ebpf: the cc_ebpf target, e.g. ":router".
+    max_processed_insns: instructions the verifier may process per
+      program, 0 for no bound. Defaults to the limit of kernels before 5.2.
+    max_total_states: states the verifier may keep per program, 0 for no
+      bound. Counted since linux 5.2 only.
+    max_load_time_ms: milliseconds loading a program may take, 0 for no
+      bound. Mind the build machines the test runs on.
+    log_level: level of the verifier log to print, see
+      lib/verifier/verifier.h, 0 for none.
+    **kwargs: parameters are passed unchanged to cc_test, e.g. tags.
+  """
+  native.cc_test(
+      name = name,
+      data = [ebpf + "-built-ebpf"],
+      args = [
+          "--max-insns=%d" % max_processed_insns,
+          "--max-states=%d" % max_total_states,
+          "--max-load-ms=%d" % max_load_time_ms,
+          "--log-level=%d" % log_level,
+          "$(locations %s-built-ebpf)" % ebpf,
+      ],
+      deps = ["//lib/verifier:budget_test_main"],
+      **kwargs
+  )
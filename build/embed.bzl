@@ -44,6 +44,19 @@ like:
       std::cout << embedded::file_txt << std::endl;
     }
 
+With compress = True, files are embedded LZ4 compressed, and the header
+defines functions instead, returning the std::string_view of the file
+decompressed on first call:
+
+      std::cout << embedded::file_txt() << std::endl;
+
+With section = "name", files are placed in the ELF section "name", each
+page aligned and padded, rather than one after the other in .data. The
+header then also defines "embedded::targetname_index", an array of
+embed::SectionAsset: name, offset in the section, data and hash of each
+file, to madvise() their pages with embed::PrefetchAsset() and
+embed::ReleaseAsset().
+
 See the tests/ directory for more details.
 """
 
@@ -129,45 +142,118 @@ def _cc_embed(ctx):
           libinputs.append(lib.interface_library)
     inputs = depset(direct=libinputs, transitive=[target.files for target in ctx.attr.data])
 
-    objfile = ctx.actions.declare_file(ctx.label.name + ".o")
+    # Files to link in, compressed or not, and the variables naming them.
+    embeds = []
+    for i in inputs.to_list():
+      var = _clean_string(_strip_extensions(i.path.split("/")[-1], ctx.attr.strip))
+      if not ctx.attr.compress:
+        embeds.append(struct(file = i, var = var))
+        continue
+      compressed = ctx.actions.declare_file("{}-lz4/{}.lz4".format(ctx.label.name, _clean_string(i.path)))
+      ctx.actions.run(
+          executable = ctx.executable._compressor,
+          progress_message = "Compressing %s into %s" % (i.path, compressed.path),
+          arguments = [i.path, compressed.path],
+          inputs = [i],
+          outputs = [compressed],
+      )
+      embeds.append(struct(file = compressed, var = var))
+    embedded = [e.file for e in embeds]
 
-    # TODO: ld_executable API is deprecated in theory, but there is no replacement yet.
-    # See https://github.com/bazelbuild/bazel/issues/8802.
-    linker = cc_toolchain.ld_executable
+    objfile = ctx.actions.declare_file(ctx.label.name + ".o")
 
-    # The linker command line changes between clang and gcc.
-    # Further, the elf_amd64 string should be computed from the actual platform
-    # used, not hard coded.
-    # TODO: as multi toolchain support is added, use the gcc linker - which
-    #       should create the correct object format out of the box.
-    args = ctx.actions.args()
-    args.add_all(inputs)
-    ctx.actions.run(
-        executable = linker,
-        progress_message = "Magically embedding %s into %s" % ([i.path for i in inputs.to_list()], objfile.path),
-        arguments = ["-r", "-b", "binary", "-m", "elf_amd64", args, "-o", objfile.path],
-        inputs = depset(
-            items = inputs.to_list(), 
-            transitive = [cc_toolchain.all_files],
-        ),
-        outputs = [objfile],
-    )
+    if ctx.attr.section:
+      # ld -b binary places files in .data, one after the other: assemble
+      # them into a section of their own instead, page aligned.
+      assembly = ctx.actions.declare_file(ctx.label.name + ".S")
+      args = ctx.actions.args()
+      args.add_all([ctx.attr.section, assembly])
+      for e in embeds:
+        args.add_all(["_binary_" + _clean_string(e.file.path), e.file])
+      ctx.actions.run(
+          executable = ctx.executable._assembler,
+          progress_message = "Placing %s in section %s" % ([i.path for i in embedded], ctx.attr.section),
+          arguments = [args],
+          inputs = embedded,
+          outputs = [assembly],
+      )
+      ctx.actions.run(
+          executable = cc_toolchain.compiler_executable,
+          progress_message = "Assembling %s into %s" % (assembly.path, objfile.path),
+          arguments = ["-c", assembly.path, "-o", objfile.path],
+          inputs = depset(
+              direct = [assembly] + embedded,
+              transitive = [cc_toolchain.all_files],
+          ),
+          outputs = [objfile],
+      )
+    else:
+      # TODO: ld_executable API is deprecated in theory, but there is no replacement yet.
+      # See https://github.com/bazelbuild/bazel/issues/8802.
+      linker = cc_toolchain.ld_executable
+
+      # The linker command line changes between clang and gcc.
+      # Further, the elf_amd64 string should be computed from the actual platform
+      # used, not hard coded.
+      # TODO: as multi toolchain support is added, use the gcc linker - which
+      #       should create the correct object format out of the box.
+      args = ctx.actions.args()
+      args.add_all(embedded)
+      ctx.actions.run(
+          executable = linker,
+          progress_message = "Magically embedding %s into %s" % ([i.path for i in embedded], objfile.path),
+          arguments = ["-r", "-b", "binary", "-m", "elf_amd64", args, "-o", objfile.path],
+          inputs = depset(
+              items = embedded, 
+              transitive = [cc_toolchain.all_files],
+          ),
+          outputs = [objfile],
+      )
 
     ### Step 2: generate .h file with the variables needed.
     hfile = ctx.actions.declare_file(ctx.label.name + ".h")
     symbols = []
     accessors = []
-    for i in inputs.to_list():
-      clean = _clean_string(i.path)
+    index = []
+    for e in embeds:
+      clean = _clean_string(e.file.path)
       subs = {
         "start": "_binary_{}_start".format(clean),
         "end": "_binary_{}_end".format(clean),
-        "var": _clean_string(_strip_extensions(i.path.split("/")[-1], ctx.attr.strip)),
+        "hash": "_binary_{}_hash".format(clean),
+        "var": e.var,
+        "section": ctx.attr.section,
       }
 
       symbols.append("extern const char {start};".format(**subs))
       symbols.append("extern const char {end};".format(**subs))
-      accessors.append("inline const std::string_view {var}(&{start}, &{end} - &{start});".format(**subs))
+      if ctx.attr.section:
+        symbols.append("extern const uint64_t {hash};".format(**subs))
+        index.append("  {{\"{var}\", static_cast<size_t>(&{start} - __start_{section}), std::string_view(&{start}, &{end} - &{start}), {hash}}},".format(**subs))
+      if ctx.attr.compress:
+        # Function local statics are initialized once, thread safely.
+        accessors.append("\n".join([
+          "inline std::string_view {var}() {{",
+          "  static const std::string_view asset = embed::DecompressEmbeddedAsset(&{start}, &{end});",
+          "  return asset;",
+          "}}",
+        ]).format(**subs))
+      else:
+        accessors.append("inline const std::string_view {var}(&{start}, &{end} - &{start});".format(**subs))
+
+    includes = []
+    if ctx.attr.compress:
+      includes.append('# include "build/embed_compression.h"')
+    if ctx.attr.section:
+      includes.append('# include "build/embed_section.h"')
+      # Defined by the linker, for sections named like C identifiers.
+      symbols.append("extern const char __start_{section}[];".format(section = ctx.attr.section))
+      symbols.append("extern const char __stop_{section}[];".format(section = ctx.attr.section))
+      name = _clean_string(ctx.label.name)
+      accessors.append("// The section, with the assets of every target placed in it.")
+      accessors.append("inline const std::string_view {name}_section(__start_{section}, __stop_{section} - __start_{section});".format(name = name, section = ctx.attr.section))
+      accessors.append("// The assets of this target, to prefetch or release.")
+      accessors.append("inline const embed::SectionAsset {name}_index[] = {{\n{index}\n}};".format(name = name, index = "\n".join(index)))
 
     # This is the string used for #ifdef, eg, #ifdef LIB_EBPF_SIMPLE_H_
     ifguard = _clean_path(hfile.path).upper() + "_"
@@ -176,6 +262,7 @@ def _cc_embed(ctx):
       output = hfile,
       substitutions = {
         "IFGUARD": ifguard,
+        "INCLUDES": "\n".join(includes),
         "NAMESPACE": ctx.attr.namespace,
         "SYMBOLS": "\n".join(symbols),
         "ACCESSORS": "\n".join(accessors),
@@ -243,10 +330,19 @@ def _cc_embed(ctx):
         headers = depset([hfile])
     )
     linking_context = cc_common.create_linking_context(libraries_to_link = [library_to_link])
+    cc_info = CcInfo(compilation_context = compilation_context, linking_context = linking_context)
+    runtime = []
+    if ctx.attr.compress:
+      # The accessors need the decompressor.
+      runtime.append(ctx.attr._compression[CcInfo])
+    if ctx.attr.section:
+      runtime.append(ctx.attr._section[CcInfo])
+    if runtime:
+      cc_info = cc_common.merge_cc_infos(cc_infos = [cc_info] + runtime)
 
     return [
         DefaultInfo(files = depset([hfile])),
-        CcInfo(compilation_context = compilation_context, linking_context = linking_context),
+        cc_info,
     ]
 
 cc_embed = rule(
@@ -265,6 +361,35 @@ cc_embed = rule(
            default = [".o", ".pic"],
            doc = "Extensions to strip to generate variable names, processed in order."
        ),
+       "compress": attr.bool(
+           default = False,
+           doc = "Embed the files LZ4 compressed, decompressed on first use: " +
+                 "smaller binaries and less to page in at startup, for the " +
+                 "cost of a copy of each file used on the heap.",
+       ),
+       "section": attr.string(
+           default = "",
+           doc = "ELF section to place the files in, each on pages of its " +
+                 "own, with an index of them in the header: for madvise(), " +
+                 "and page aligned buffers. Must be a C identifier; targets " +
+                 "naming the same section share it.",
+       ),
+       "_assembler": attr.label(
+           default = Label("//build:embed_assembler"),
+           executable = True,
+           cfg = "host",
+       ),
+       "_section": attr.label(
+           default = Label("//build:embed_section"),
+       ),
+       "_compressor": attr.label(
+           default = Label("//build:embed_compressor"),
+           executable = True,
+           cfg = "host",
+       ),
+       "_compression": attr.label(
+           default = Label("//build:embed_compression"),
+       ),
        "_template": attr.label(
            default = Label("//build:embed.h.tpl"),
            allow_single_file = True,
@@ -293,6 +418,12 @@ Will result in:
   2) A "targetname.h" created, containing a std::string_view
      named "embedded::file_txt" with the raw content of the file.
 
+With compress = True, "embedded::file_txt" is a function returning the
+std::string_view, decompressing the file on its first call.
+
+With section = "assets", the files are page aligned in the ELF section
+"assets", and the header has an index of them, "embedded::targetname_index".
+
 The rule uses magic compiler tricks to get the file into an object
 file directly.
 """,
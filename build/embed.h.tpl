@@ -3,6 +3,7 @@
 # define IFGUARD
 
 # include <string_view>
+INCLUDES
 
 // Do not use those symbols directly. Name and type may change without notice.
 // Use the string_view object and interface below instead.
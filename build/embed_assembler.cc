@@ -0,0 +1,67 @@
+// Writes the assembly placing assets in a section for
+// cc_embed(section = ...):
+//
+//   embed_assembler <section> <output.S> [<symbol> <asset>]...
+//
+// Each asset is included page aligned and padded, between <symbol>_start
+// and <symbol>_end, and the AssetHash() of its contents is <symbol>_hash.
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "build/embed_section.h"
+
+int main(int argc, char** argv) {
+  if (argc < 3 || argc % 2 != 1) {
+    std::cerr << "usage: " << argv[0]
+              << " <section> <output.S> [<symbol> <asset>]...\n";
+    return 1;
+  }
+  const std::string section = argv[1];
+  std::ostringstream data;
+  std::ostringstream hashes;
+  for (int i = 3; i < argc; i += 2) {
+    const std::string symbol = argv[i];
+    const std::string path = argv[i + 1];
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      std::cerr << "cannot open " << path << "\n";
+      return 1;
+    }
+    std::ostringstream asset;
+    // Copying an empty asset fails 'asset': check 'in' instead.
+    asset << in.rdbuf();
+    if (in.bad()) {
+      std::cerr << "cannot read " << path << "\n";
+      return 1;
+    }
+
+    data << "  .balign " << embed::kSectionAlignment << "\n"
+         << "  .globl " << symbol << "_start\n"
+         << symbol << "_start:\n"
+         << "  .incbin \"" << path << "\"\n"
+         << "  .globl " << symbol << "_end\n"
+         << symbol << "_end:\n"
+         << "  .balign " << embed::kSectionAlignment << "\n";
+    hashes << "  .balign 8\n"
+           << "  .globl " << symbol << "_hash\n"
+           << symbol << "_hash:\n"
+           << "  .quad 0x" << std::hex << embed::AssetHash(asset.str())
+           << std::dec << "\n";
+  }
+
+  std::ofstream out(argv[2], std::ios::trunc);
+  out << "/*** This file is automatically generated. DO NOT EDIT. ***/\n"
+      << "  .section " << section << ", \"a\", @progbits\n"
+      << data.str() << "  .section .rodata\n"
+      << hashes.str()
+      // Or the linker makes the stack of the binary executable.
+      << "  .section .note.GNU-stack, \"\", @progbits\n";
+  if (!out) {
+    std::cerr << "cannot write " << argv[2] << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,219 @@
+#include "build/embed_compression.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace embed {
+namespace {
+
+// Constants of the LZ4 block format: matches are at least kMinMatch bytes
+// long, at most kMaxOffset bytes back; the last kLastLiterals bytes are
+// literals, and the last match starts kMatchLimit bytes from the end or
+// earlier.
+constexpr size_t kMinMatch = 4;
+constexpr size_t kMaxOffset = 65535;
+constexpr size_t kLastLiterals = 5;
+constexpr size_t kMatchLimit = 12;
+constexpr int kHashBits = 16;
+constexpr size_t kSizeBytes = 8;
+
+uint32_t Read32(const char* const data) {
+  uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+uint32_t Hash(const uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+// Append 'length' in the 255 + ... + 255 + rest encoding of the LZ4 block
+// format, for lengths not fitting their 4 bits of the token.
+void AppendLength(size_t length, std::string* const out) {
+  for (; length >= 255; length -= 255) {
+    out->push_back(static_cast<char>(255));
+  }
+  out->push_back(static_cast<char>(length));
+}
+
+// Append a sequence: the literals in 'literals', followed by a match of
+// 'length' bytes 'offset' bytes back, none if 'length' is 0.
+void AppendSequence(const std::string_view literals, const size_t offset,
+                    const size_t length, std::string* const out) {
+  const size_t match = length == 0 ? 0 : length - kMinMatch;
+  out->push_back(static_cast<char>(std::min<size_t>(literals.size(), 15) << 4 |
+                                   std::min<size_t>(match, 15)));
+  if (literals.size() >= 15) {
+    AppendLength(literals.size() - 15, out);
+  }
+  out->append(literals);
+  if (length == 0) {
+    return;
+  }
+  out->push_back(static_cast<char>(offset & 0xff));
+  out->push_back(static_cast<char>(offset >> 8));
+  if (match >= 15) {
+    AppendLength(match - 15, out);
+  }
+}
+
+// Read a length continued past its 4 bits of the token at *in.
+bool ReadLength(std::string_view* const in, size_t* const length) {
+  uint8_t byte;
+  do {
+    if (in->empty()) {
+      return false;
+    }
+    byte = in->front();
+    in->remove_prefix(1);
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// Read the size of the asset 'compressed' holds, consuming it.
+bool ReadSize(std::string_view* const compressed, uint64_t* const size) {
+  if (compressed->size() < kSizeBytes) {
+    return false;
+  }
+  *size = 0;
+  for (size_t i = kSizeBytes; i-- > 0;) {
+    *size = *size << 8 | static_cast<uint8_t>((*compressed)[i]);
+  }
+  compressed->remove_prefix(kSizeBytes);
+  // Each compressed byte expands to at most 255 bytes, which bounds what
+  // the size can be before allocating it.
+  return *size / 255 <= compressed->size();
+}
+
+// Decode the LZ4 block 'compressed' into the 'size' bytes at 'asset'.
+bool Decode(std::string_view compressed, char* const asset,
+            const size_t size) {
+  size_t out = 0;
+  while (true) {
+    if (compressed.empty()) {
+      return false;
+    }
+    const uint8_t token = compressed.front();
+    compressed.remove_prefix(1);
+
+    size_t literals = token >> 4;
+    if (literals == 15 && !ReadLength(&compressed, &literals)) {
+      return false;
+    }
+    if (literals > compressed.size() || literals > size - out) {
+      return false;
+    }
+    std::memcpy(asset + out, compressed.data(), literals);
+    compressed.remove_prefix(literals);
+    out += literals;
+    if (compressed.empty()) {
+      break;
+    }
+
+    if (compressed.size() < 2) {
+      return false;
+    }
+    const size_t offset = static_cast<uint8_t>(compressed[0]) |
+                          static_cast<uint8_t>(compressed[1]) << 8;
+    compressed.remove_prefix(2);
+    size_t length = token & 15;
+    if (length == 15 && !ReadLength(&compressed, &length)) {
+      return false;
+    }
+    length += kMinMatch;
+    if (offset == 0 || offset > out || length > size - out) {
+      return false;
+    }
+    // Matches may overlap what they produce: a run of a byte is a match
+    // one byte back.
+    if (offset >= length) {
+      std::memcpy(asset + out, asset + out - offset, length);
+    } else {
+      for (size_t i = 0; i < length; ++i) {
+        asset[out + i] = asset[out - offset + i];
+      }
+    }
+    out += length;
+  }
+  return out == size;
+}
+
+}  // namespace
+
+std::string CompressAsset(const std::string_view asset) {
+  std::string out(kSizeBytes, '\0');
+  uint64_t size = asset.size();
+  for (size_t i = 0; i < kSizeBytes; ++i, size >>= 8) {
+    out[i] = static_cast<char>(size & 0xff);
+  }
+
+  // Greedy matching against the last position of each hashed 4 bytes,
+  // which does well on ELF objects: long runs of zeros, repeated headers.
+  const char* const data = asset.data();
+  size_t anchor = 0;
+  if (asset.size() > kMatchLimit) {
+    std::vector<uint32_t> last(1 << kHashBits,
+                               std::numeric_limits<uint32_t>::max());
+    const size_t limit = asset.size() - kMatchLimit;
+    for (size_t i = 0; i <= limit;) {
+      const uint32_t sequence = Read32(data + i);
+      uint32_t* const slot = &last[Hash(sequence)];
+      const size_t candidate = *slot;
+      *slot = i;
+      if (candidate == std::numeric_limits<uint32_t>::max() ||
+          i - candidate > kMaxOffset || Read32(data + candidate) != sequence) {
+        ++i;
+        continue;
+      }
+      size_t length = kMinMatch;
+      while (i + length < asset.size() - kLastLiterals &&
+             data[candidate + length] == data[i + length]) {
+        ++length;
+      }
+      AppendSequence(asset.substr(anchor, i - anchor), i - candidate, length,
+                     &out);
+      i += length;
+      anchor = i;
+    }
+  }
+  AppendSequence(asset.substr(anchor), 0, 0, &out);
+  return out;
+}
+
+std::optional<std::string> DecompressAsset(std::string_view compressed) {
+  uint64_t size;
+  if (!ReadSize(&compressed, &size)) {
+    return std::nullopt;
+  }
+  std::string asset(size, '\0');
+  if (!Decode(compressed, &asset[0], size)) {
+    return std::nullopt;
+  }
+  return asset;
+}
+
+std::string_view DecompressEmbeddedAsset(const char* const start,
+                                         const char* const end) {
+  std::string_view compressed(start, end - start);
+  uint64_t size = 0;
+  std::unique_ptr<char[]> asset;
+  if (ReadSize(&compressed, &size)) {
+    asset.reset(new char[size]);
+  }
+  if (asset == nullptr || !Decode(compressed, asset.get(), size)) {
+    std::fprintf(stderr, "embedded asset at %p is corrupt\n",
+                 static_cast<const void*>(start));
+    std::abort();
+  }
+  // Never freed: the accessors keep the asset for the life of the process.
+  return std::string_view(asset.release(), size);
+}
+
+}  // namespace embed
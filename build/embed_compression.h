@@ -0,0 +1,29 @@
+#ifndef BUILD_EMBED_COMPRESSION_H_
+#define BUILD_EMBED_COMPRESSION_H_
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Compression of the assets of cc_embed(compress = True): the LZ4 block
+// format, behind the size of the asset as 8 little endian bytes. LZ4
+// decompresses at memory speed, so an asset costs little more on first
+// use than the page-ins it saves.
+
+namespace embed {
+
+// 'asset' compressed, as embedded.
+std::string CompressAsset(std::string_view asset);
+
+// The asset 'compressed' holds, std::nullopt if malformed.
+std::optional<std::string> DecompressAsset(std::string_view compressed);
+
+// The asset embedded compressed between 'start' and 'end', decompressed in
+// a buffer that lives as long as the process. Aborts if malformed, which
+// only a broken build can cause. Accessors generated by cc_embed call it
+// once per asset, on first use.
+std::string_view DecompressEmbeddedAsset(const char* start, const char* end);
+
+}  // namespace embed
+
+#endif  // BUILD_EMBED_COMPRESSION_H_
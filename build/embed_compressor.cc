@@ -0,0 +1,34 @@
+// Compresses an asset for cc_embed(compress = True):
+//
+//   embed_compressor <asset> <output>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "build/embed_compression.h"
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " <asset> <output>\n";
+    return 1;
+  }
+  std::ifstream in(argv[1], std::ios::binary);
+  std::ostringstream asset;
+  if (!in) {
+    std::cerr << "cannot open " << argv[1] << "\n";
+    return 1;
+  }
+  // Copying an empty asset fails 'asset': check 'in' instead.
+  asset << in.rdbuf();
+  if (in.bad()) {
+    std::cerr << "cannot read " << argv[1] << "\n";
+    return 1;
+  }
+  std::ofstream out(argv[2], std::ios::binary | std::ios::trunc);
+  if (!(out << embed::CompressAsset(asset.str()))) {
+    std::cerr << "cannot write " << argv[2] << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,44 @@
+#include "build/embed_section.h"
+
+#include <sys/mman.h>
+
+#include <cerrno>
+
+namespace embed {
+namespace {
+
+// madvise() the pages of 'data', a page aligned and padded asset.
+int Advise(const std::string_view data, const int advice) {
+  const uintptr_t start = reinterpret_cast<uintptr_t>(data.data());
+  const size_t size = (data.size() + kSectionAlignment - 1) /
+                      kSectionAlignment * kSectionAlignment;
+  if (start % kSectionAlignment != 0) {
+    return EINVAL;
+  }
+  if (size == 0) {
+    return 0;
+  }
+  return madvise(reinterpret_cast<void*>(start), size, advice) == 0 ? 0
+                                                                    : errno;
+}
+
+}  // namespace
+
+uint64_t AssetHash(const std::string_view data) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (const char c : data) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+int PrefetchAsset(const SectionAsset& asset) {
+  return Advise(asset.data, MADV_WILLNEED);
+}
+
+int ReleaseAsset(const SectionAsset& asset) {
+  return Advise(asset.data, MADV_DONTNEED);
+}
+
+}  // namespace embed
@@ -0,0 +1,40 @@
+#ifndef BUILD_EMBED_SECTION_H_
+#define BUILD_EMBED_SECTION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Assets of cc_embed(section = "name"): each starts on a page of its own,
+// in the ELF section "name", and is padded to the end of its last page,
+// so its pages hold nothing else and can be advised about without a
+// thought for their neighbours.
+
+namespace embed {
+
+// Alignment, and padding, of assets in sections: the page size of x86-64.
+constexpr size_t kSectionAlignment = 4096;
+
+// An entry of the index the rule generates for the assets of a target.
+struct SectionAsset {
+  std::string_view name;  // of the variable of the asset
+  size_t offset;          // from the start of the section
+  std::string_view data;  // as embedded, compressed or not
+  uint64_t hash;          // AssetHash() of 'data', computed at build time
+};
+
+// FNV-1a, 64 bits, of 'data'.
+uint64_t AssetHash(std::string_view data);
+
+// Have the kernel read the pages of 'asset' from the binary ahead of use,
+// madvise(MADV_WILLNEED). Returns 0, or the errno of madvise().
+int PrefetchAsset(const SectionAsset& asset);
+
+// Drop the pages of 'asset', once used, madvise(MADV_DONTNEED): reading
+// it again reads them back from the binary. Returns 0, or the errno of
+// madvise().
+int ReleaseAsset(const SectionAsset& asset);
+
+}  // namespace embed
+
+#endif  // BUILD_EMBED_SECTION_H_
@@ -7,3 +7,8 @@ TEST(EmbedTest, SimpleTest) {
   // File is in ELF, we cannot really check it. Verify at least it is ELF.
   EXPECT_EQ(0, ebpf::ebpf_sample.find("\x7f""ELF", 0));
 }
+
+TEST(EmbedTest, HasBtfWithoutDwarf) {
+  EXPECT_NE(std::string_view::npos, ebpf::ebpf_sample.find(".BTF"));
+  EXPECT_EQ(std::string_view::npos, ebpf::ebpf_sample.find(".debug_info"));
+}
@@ -0,0 +1,9 @@
+#include "gtest/gtest.h"
+#include "build/tests/ebpf_sample_v1.h"
+
+#include <string_view>
+
+TEST(EmbedTest, HasNoBtf) {
+  EXPECT_EQ(0, ebpf::ebpf_sample.find("\x7f""ELF", 0));
+  EXPECT_EQ(std::string_view::npos, ebpf::ebpf_sample.find(".BTF"));
+}
@@ -0,0 +1,29 @@
+#include "gtest/gtest.h"
+#include "build/embed_compression.h"
+#include "build/tests/embed_test.h"
+#include "build/tests/compressed.h"
+
+#include <string>
+#include <string_view>
+
+TEST(EmbedTest, CompressedTest) {
+  EXPECT_EQ(std::string(std::string_view(mediocrity, std::size(mediocrity) - 1)), embedded::mediocrity_txt());
+  EXPECT_EQ(std::string(std::string_view(perseverance, std::size(perseverance) - 1)), embedded::perseverance_txt());
+  // Decompressed once, on the first call.
+  EXPECT_EQ(embedded::mediocrity_txt().data(), embedded::mediocrity_txt().data());
+}
+
+TEST(EmbedTest, CompressionTest) {
+  std::string repeated;
+  for (int i = 0; i < 1000; ++i) {
+    repeated += std::string(i % 300, '\0') + mediocrity;
+  }
+  for (const std::string& asset : {std::string(), std::string("short"), std::string(perseverance), repeated}) {
+    const std::string compressed = embed::CompressAsset(asset);
+    EXPECT_EQ(asset, embed::DecompressAsset(compressed));
+    for (size_t size = 0; size < compressed.size(); size += 1 + compressed.size() / 64) {
+      EXPECT_FALSE(embed::DecompressAsset(compressed.substr(0, size)).has_value());
+    }
+  }
+  EXPECT_LT(embed::CompressAsset(repeated).size(), repeated.size() / 10);
+}
@@ -0,0 +1,47 @@
+#include "gtest/gtest.h"
+#include "build/embed_section.h"
+#include "build/tests/embed_test.h"
+#include "build/tests/sectioned.h"
+#include "build/tests/sectioned_compressed.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+TEST(EmbedTest, SectionTest) {
+  EXPECT_EQ(std::string(std::string_view(mediocrity, std::size(mediocrity) - 1)), embedded::mediocrity_txt);
+  EXPECT_EQ(std::string(std::string_view(perseverance, std::size(perseverance) - 1)), embedded::perseverance_txt);
+  EXPECT_EQ(std::string(std::string_view(mediocrity, std::size(mediocrity) - 1)), compressed::mediocrity_txt());
+
+  // Both targets share the section, each file on pages of its own.
+  std::set<size_t> pages;
+  std::vector<embed::SectionAsset> assets(std::begin(embedded::sectioned_index), std::end(embedded::sectioned_index));
+  assets.insert(assets.end(), std::begin(compressed::sectioned_compressed_index), std::end(compressed::sectioned_compressed_index));
+  ASSERT_EQ(3, assets.size());
+  EXPECT_EQ("perseverance_txt", assets[0].name);
+  EXPECT_EQ(embedded::perseverance_txt, assets[0].data);
+  EXPECT_EQ("mediocrity_txt", assets[2].name);
+  for (const auto& asset : assets) {
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(asset.data.data()) % embed::kSectionAlignment);
+    EXPECT_EQ(0, asset.offset % embed::kSectionAlignment);
+    EXPECT_EQ(embedded::sectioned_section.data() + asset.offset, asset.data.data());
+    EXPECT_LE(asset.offset + asset.data.size(), embedded::sectioned_section.size());
+    EXPECT_EQ(embed::AssetHash(asset.data), asset.hash);
+    EXPECT_TRUE(pages.insert(asset.offset / embed::kSectionAlignment).second);
+  }
+  EXPECT_EQ(embedded::sectioned_section, compressed::sectioned_compressed_section);
+}
+
+TEST(EmbedTest, SectionAdviceTest) {
+  const std::string expected(embedded::mediocrity_txt);
+  for (const auto& asset : embedded::sectioned_index) {
+    EXPECT_EQ(0, embed::PrefetchAsset(asset));
+    EXPECT_EQ(0, embed::ReleaseAsset(asset));
+  }
+  // Released pages read back from the binary.
+  EXPECT_EQ(expected, embedded::mediocrity_txt);
+  EXPECT_EQ(EINVAL, embed::ReleaseAsset({"unaligned", 0, embedded::mediocrity_txt.substr(1), 0}));
+}
@@ -0,0 +1,83 @@
+#include "daemon/flags.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+
+namespace ebpd {
+
+void PrintUsage(const char* const name) {
+  std::cerr << "usage: " << name << " <interface> [--queues=N]"
+            << " [--cpus=CPU,CPU,...] [--busy-poll] [--interval=SECONDS]"
+            << std::endl;
+}
+
+namespace {
+
+// Parse the decimal number at the start of 'text' into 'value', leaving
+// 'end' after it. Returns false if there is none, or it overflows an int.
+bool ParseInt(const char* const text, int* const value,
+              const char** const end) {
+  if (*text < '0' || *text > '9') {
+    return false;
+  }
+  char* number_end;
+  errno = 0;
+  const long number = std::strtol(text, &number_end, 10);
+  if (errno || number > INT_MAX) {
+    return false;
+  }
+  *value = number;
+  *end = number_end;
+  return true;
+}
+
+// Parse all of 'text', a decimal number, into 'value'.
+bool ParseInt(const char* const text, int* const value) {
+  const char* end;
+  return ParseInt(text, value, &end) && *end == '\0';
+}
+
+}  // namespace
+
+bool ParseFlags(const int argc, char** const argv, Flags* const flags) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.rfind("--queues=", 0) == 0) {
+      if (!ParseInt(arg.c_str() + 9, &flags->queues)) {
+        return false;
+      }
+    } else if (arg.rfind("--cpus=", 0) == 0) {
+      const char* cpu = arg.c_str() + 7;
+      while (true) {
+        int value;
+        if (!ParseInt(cpu, &value, &cpu)) {
+          return false;
+        }
+        flags->cpus.push_back(value);
+        if (*cpu == '\0') {
+          break;
+        }
+        if (*cpu != ',') {
+          return false;
+        }
+        ++cpu;
+      }
+    } else if (arg == "--busy-poll") {
+      flags->busy_poll = true;
+    } else if (arg.rfind("--interval=", 0) == 0) {
+      if (!ParseInt(arg.c_str() + 11, &flags->interval)) {
+        return false;
+      }
+    } else if (arg[0] != '-' && flags->interface.empty()) {
+      flags->interface = arg;
+    } else {
+      return false;
+    }
+  }
+  return !flags->interface.empty() && flags->queues > 0 &&
+         flags->interval > 0;
+}
+
+}  // namespace ebpd
@@ -0,0 +1,28 @@
+#ifndef DAEMON_FLAGS_H_
+#define DAEMON_FLAGS_H_
+
+#include <string>
+#include <vector>
+
+namespace ebpd {
+
+struct Flags {
+  std::string interface;
+  int queues = 1;
+  // CPU of the worker of each queue, in queue order. Queues past the end
+  // run anywhere.
+  std::vector<int> cpus;
+  bool busy_poll = false;
+  // Seconds between reports.
+  int interval = 1;
+};
+
+void PrintUsage(const char* name);
+
+// Parse the command line of the daemon into 'flags'. Returns false on
+// unknown or malformed flags, or without an interface.
+bool ParseFlags(int argc, char** argv, Flags* flags);
+
+}  // namespace ebpd
+
+#endif  // DAEMON_FLAGS_H_
@@ -1,11 +1,138 @@
+#include <net/if.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include "daemon/flags.h"
+#include "daemon/report.h"
+#include "lib/ebpd.h"
+#include "lib/ebpf/xsk_redirect.h"
+#include "lib/posix/file_descriptor.h"
+#include "lib/xdp_loader.h"
+#include "lib/xsk/spsc_ring.h"
+#include "lib/xsk/worker.h"
+
+namespace {
+
+// What workers hand off to the control plane for every batch.
+struct BatchSummary {
+  uint32_t packets;
+  uint32_t bytes;
+};
+
+struct QueueState {
+  std::unique_ptr<xsk::SpscRing<BatchSummary>> handoff;
+  std::unique_ptr<xsk::Worker> worker;
+  xsk::WorkerStats last;
+  uint64_t bytes = 0;
+};
+
+std::atomic<bool> stop(false);
+
+void Report(const int queue, QueueState* const state, const int interval) {
+  std::array<BatchSummary, 256> summaries;
+  size_t count;
+  while ((count = state->handoff->Pop(base::MakeSpan(summaries))) > 0) {
+    for (size_t i = 0; i < count; ++i) {
+      state->bytes += summaries[i].bytes;
+    }
+  }
+  const auto stats = GetStats(*state->worker);
+  std::cout << ebpd::FormatQueueReport(queue, state->last, stats, state->bytes,
+                                       interval)
+            << std::endl;
+  state->last = stats;
+  state->bytes = 0;
+
+  const auto status = GetExitStatus(*state->worker);
+  if (IsError(status)) {
+    std::cerr << "queue " << queue << " stopped: " << GetText(status)
+              << std::endl;
+  }
+}
+
+}  // namespace
 
 int main(int argc, char** argv) {
-  std::string who = "world";
-  if (argc > 1) {
-    who = argv[1];
+  ebpd::Flags flags;
+  if (!ebpd::ParseFlags(argc, argv, &flags)) {
+    ebpd::PrintUsage(argv[0]);
+    return 1;
+  }
+  const int ifindex = if_nametoindex(flags.interface.c_str());
+  if (ifindex == 0) {
+    std::cerr << "unknown interface " << flags.interface << std::endl;
+    return 1;
+  }
+
+  InitEbpdLib();
+  XdpHandle xdph = LoadAndAttachXdpBuffer(ebpf::xsk_redirect, "xsk_redirect",
+                                          ifindex, XdpMode::kAuto);
+  if (!xdph) {
+    std::cerr << "failed to attach xdp program to " << flags.interface
+              << std::endl;
+    return 1;
+  }
+  const int xskmap = xdph->GetMapFd("xsks");
+  if (xskmap < 0) {
+    std::cerr << "xdp program has no xsks map" << std::endl;
+    return 1;
+  }
+
+  std::vector<QueueState> queues(flags.queues);
+  for (int queue = 0; queue < flags.queues; ++queue) {
+    auto& state = queues[queue];
+    state.handoff = std::make_unique<xsk::SpscRing<BatchSummary>>(4096);
+    auto* const handoff = state.handoff.get();
+
+    xsk::WorkerOptions options;
+    options.ifindex = ifindex;
+    options.queue = queue;
+    options.xskmap = posix::FileDescriptor(xskmap);
+    options.busy_poll = flags.busy_poll;
+    if (queue < static_cast<int>(flags.cpus.size())) {
+      options.cpu = flags.cpus[queue];
+    }
+    auto worker_or = xsk::StartWorker(
+        options, [handoff](const base::Span<const xsk::XdpDesc> descs,
+                           const xsk::Umem&) {
+          BatchSummary summary = {static_cast<uint32_t>(GetSize(descs)), 0};
+          for (const auto* desc = GetBase(descs); desc != GetLimit(descs);
+               ++desc) {
+            summary.bytes += desc->len;
+          }
+          // Dropped if the control plane falls behind: packet rates stay
+          // exact, they come from the worker's stats, but bytes and Mbps
+          // then fall short.
+          handoff->Push(base::MakeSpan(&summary, 1));
+        });
+    if (IsError(worker_or)) {
+      std::cerr << "failed to start worker on queue " << queue << ": "
+                << GetText(GetStatus(worker_or)) << std::endl;
+      return 1;
+    }
+    state.worker = std::move(GetValue(worker_or));
+  }
+
+  signal(SIGINT, [](int) { stop = true; });
+  signal(SIGTERM, [](int) { stop = true; });
+  while (!stop) {
+    for (int i = 0; i < flags.interval * 10 && !stop; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    for (int queue = 0; queue < flags.queues; ++queue) {
+      Report(queue, &queues[queue], flags.interval);
+    }
   }
-  std::cout << "hello " << who << std::endl;
+  // Workers stop before the program and its map go away.
+  queues.clear();
   return 0;
 }
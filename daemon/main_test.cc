@@ -1,5 +1,98 @@
+#include <string>
+#include <vector>
+
+#include "daemon/flags.h"
+#include "daemon/report.h"
 #include "gtest/gtest.h"
 
-TEST(MainTest, TestExample) {
-  EXPECT_EQ("foo", "foo");
+namespace ebpd {
+namespace {
+
+// Parse 'args', without the program name, into 'flags'.
+bool Parse(std::vector<std::string> args, Flags* const flags) {
+  args.insert(args.begin(), "ebpd");
+  std::vector<char*> argv;
+  for (auto& arg : args) {
+    argv.push_back(&arg[0]);
+  }
+  return ParseFlags(argv.size(), argv.data(), flags);
 }
+
+TEST(ParseFlagsTest, Defaults) {
+  Flags flags;
+  ASSERT_TRUE(Parse({"eth0"}, &flags));
+  EXPECT_EQ("eth0", flags.interface);
+  EXPECT_EQ(1, flags.queues);
+  EXPECT_TRUE(flags.cpus.empty());
+  EXPECT_FALSE(flags.busy_poll);
+  EXPECT_EQ(1, flags.interval);
+}
+
+TEST(ParseFlagsTest, ParsesAll) {
+  Flags flags;
+  ASSERT_TRUE(Parse({"--queues=4", "eth1", "--cpus=2,3,5", "--busy-poll",
+                     "--interval=10"},
+                    &flags));
+  EXPECT_EQ("eth1", flags.interface);
+  EXPECT_EQ(4, flags.queues);
+  EXPECT_EQ(std::vector<int>({2, 3, 5}), flags.cpus);
+  EXPECT_TRUE(flags.busy_poll);
+  EXPECT_EQ(10, flags.interval);
+}
+
+TEST(ParseFlagsTest, RejectsBadFlags) {
+  Flags flags;
+  EXPECT_FALSE(Parse({}, &flags));
+  EXPECT_FALSE(Parse({"--queues=2"}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "eth1"}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--unknown"}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--queues=0"}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--interval=0"}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--cpus=1,x"}, &flags));
+}
+
+TEST(ParseFlagsTest, RejectsMalformedNumbers) {
+  Flags flags;
+  EXPECT_FALSE(Parse({"eth0", "--queues=4x"}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--queues="}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--queues=-1"}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--queues=99999999999"}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--interval=abc"}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--interval=1s"}, &flags));
+}
+
+TEST(ParseFlagsTest, RejectsEmptyCpus) {
+  Flags flags;
+  EXPECT_FALSE(Parse({"eth0", "--cpus="}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--cpus=1,"}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--cpus=,1"}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--cpus=1,,2"}, &flags));
+  EXPECT_FALSE(Parse({"eth0", "--cpus=1;2"}, &flags));
+}
+
+TEST(FormatQueueReportTest, ReportsRates) {
+  xsk::WorkerStats last;
+  last.packets = 1000;
+  last.batches = 100;
+  last.polls = 200;
+  last.idle_polls = 100;
+  xsk::WorkerStats now;
+  now.packets = 21000;  // 20000 more, in 1000 batches
+  now.batches = 1100;
+  now.polls = 1200;  // 1000 more, 250 idle
+  now.idle_polls = 350;
+  EXPECT_EQ("queue 3: 10000 pps, 12.0 Mbps, avg batch 20.0, idle 25.0%",
+            FormatQueueReport(3, last, now, 3000000, 2));
+}
+
+TEST(FormatQueueReportTest, ReportsIdleQueues) {
+  xsk::WorkerStats stats;
+  stats.packets = 5;
+  stats.batches = 1;
+  stats.polls = 10;
+  EXPECT_EQ("queue 0: 0 pps, 0.0 Mbps, avg batch 0.0, idle 0.0%",
+            FormatQueueReport(0, stats, stats, 0, 1));
+}
+
+}  // namespace
+}  // namespace ebpd
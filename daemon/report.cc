@@ -0,0 +1,23 @@
+#include "daemon/report.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace ebpd {
+
+std::string FormatQueueReport(const int queue, const xsk::WorkerStats& last,
+                              const xsk::WorkerStats& now,
+                              const uint64_t bytes, const int interval) {
+  const uint64_t packets = now.packets - last.packets;
+  const uint64_t batches = now.batches - last.batches;
+  const uint64_t polls = now.polls - last.polls;
+  const uint64_t idle = now.idle_polls - last.idle_polls;
+  std::ostringstream line;
+  line << std::fixed << std::setprecision(1) << "queue " << queue << ": "
+       << packets / interval << " pps, " << bytes * 8 / 1e6 / interval
+       << " Mbps, avg batch " << (batches ? double(packets) / batches : 0.0)
+       << ", idle " << (polls ? 100.0 * idle / polls : 0.0) << "%";
+  return line.str();
+}
+
+}  // namespace ebpd
@@ -0,0 +1,21 @@
+#ifndef DAEMON_REPORT_H_
+#define DAEMON_REPORT_H_
+
+#include <cstdint>
+#include <string>
+
+#include "lib/xsk/worker.h"
+
+namespace ebpd {
+
+// The line the daemon prints about queue 'queue' every 'interval' seconds:
+// rates from the stats of its worker, 'last' at the previous report and
+// 'now', and from the 'bytes' it handed off in between, with the average
+// batch size and the share of idle polls.
+std::string FormatQueueReport(int queue, const xsk::WorkerStats& last,
+                              const xsk::WorkerStats& now, uint64_t bytes,
+                              int interval);
+
+}  // namespace ebpd
+
+#endif  // DAEMON_REPORT_H_
@@ -2,6 +2,7 @@
 #define _LIB_BASE_SPAN_H_
 
 #include <array>
+#include <cstddef>
 #include <vector>
 
 #include "lib/base/invariant.h"
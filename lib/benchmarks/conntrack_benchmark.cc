@@ -0,0 +1,226 @@
+// Measures the cost of the connection tracking map of lib/ebpf/conntrack.c
+// at sizes worth sizing it for: inserts, lookups, sweeps and kernel memory
+// per connection, with the shared and the per-CPU LRU lists.
+//
+// Needs root (CAP_BPF) and enough locked memory for the largest map:
+// about 150 bytes per entry, 1.5 GB for 10M entries. With per-CPU lists, the
+// entries inserted from this one CPU only fill its share of the map: numbers
+// are those of a map of entries / CPUs connections.
+//
+// usage: conntrack_benchmark [--entries=N,N,...] [--batch=N] [--lookups=N]
+
+#include <linux/bpf.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "lib/base/span.h"
+#include "lib/bpf/map.h"
+#include "lib/conntrack.h"
+#include "lib/ebpf/conntrack_maps.h"
+
+namespace {
+
+struct Flags {
+  std::vector<uint32_t> entries = {1000000, 10000000};
+  size_t batch = 4096;
+  size_t lookups = 1000000;
+};
+
+void PrintUsage(const char* name) {
+  std::cerr << "usage: " << name << " [--entries=N,N,...] [--batch=N]"
+            << " [--lookups=N]" << std::endl;
+}
+
+bool ParseFlags(const int argc, char** const argv, Flags* const flags) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.rfind("--entries=", 0) == 0) {
+      flags->entries.clear();
+      const char* entries = arg.c_str() + 10;
+      while (*entries) {
+        char* end;
+        const long value = std::strtol(entries, &end, 10);
+        if (end == entries || value <= 0) {
+          return false;
+        }
+        flags->entries.push_back(value);
+        entries = *end == ',' ? end + 1 : end;
+      }
+    } else if (arg.rfind("--batch=", 0) == 0) {
+      flags->batch = std::atoi(arg.c_str() + 8);
+    } else if (arg.rfind("--lookups=", 0) == 0) {
+      flags->lookups = std::atoi(arg.c_str() + 10);
+    } else {
+      return false;
+    }
+  }
+  return !flags->entries.empty() && flags->batch > 0;
+}
+
+using Clock = std::chrono::steady_clock;
+
+double NanosPer(const Clock::time_point start, const size_t count) {
+  const std::chrono::duration<double, std::nano> elapsed =
+      Clock::now() - start;
+  return count ? elapsed.count() / count : 0;
+}
+
+uint64_t GetMonotonicTime() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * uint64_t{1000000000} + now.tv_nsec;
+}
+
+// A distinct IPv4 TCP connection for each 'i'.
+ebpd_ct_key MakeKey(const uint32_t i) {
+  ebpd_ct_key key = {};
+  key.saddr[0] = 10;
+  key.saddr[1] = i >> 16;
+  key.saddr[2] = i >> 8;
+  key.saddr[3] = i;
+  key.daddr[0] = 192;
+  key.daddr[1] = 168;
+  key.sport = i >> 24;
+  key.dport = 80;
+  key.proto = 6;
+  key.family = EBPD_CT_IPV4;
+  return key;
+}
+
+// Return the memory the kernel charges for the map behind 'fd', 0 if
+// unknown.
+uint64_t GetMemlock(const posix::FileDescriptor fd) {
+  std::ifstream fdinfo("/proc/self/fdinfo/" + std::to_string(GetValue(fd)));
+  std::string field;
+  while (fdinfo >> field) {
+    if (field == "memlock:") {
+      uint64_t bytes = 0;
+      fdinfo >> bytes;
+      return bytes;
+    }
+  }
+  return 0;
+}
+
+struct Result {
+  double insert_ns = 0;
+  double batch_lookup_ns = 0;
+  double lookup_ns = 0;
+  double sweep_ns = 0;
+  double bytes_per_entry = 0;
+};
+
+bool Run(const Flags& flags, const uint32_t entries, const uint32_t map_flags,
+         Result* const result) {
+  auto map_or = bpf::CreateMap<ebpd_ct_key, ebpd_ct_entry>(
+      BPF_MAP_TYPE_LRU_HASH, entries, map_flags);
+  if (IsError(map_or)) {
+    std::cerr << "cannot create map: " << GetText(GetStatus(map_or))
+              << std::endl;
+    return false;
+  }
+  auto& map = GetValue(map_or);
+  result->bytes_per_entry =
+      static_cast<double>(GetMemlock(GetFileDescriptor(map))) / entries;
+
+  // Half the connections idle for a minute, expired by the sweep.
+  std::vector<ebpd_ct_key> keys(flags.batch);
+  std::vector<ebpd_ct_entry> values(flags.batch);
+  const uint64_t now = GetMonotonicTime();
+  auto start = Clock::now();
+  for (uint32_t i = 0; i < entries; i += flags.batch) {
+    const size_t count = std::min<size_t>(flags.batch, entries - i);
+    for (size_t j = 0; j < count; ++j) {
+      keys[j] = MakeKey(i + j);
+      values[j] = {};
+      values[j].last_seen = (i + j) % 2 ? now - 60000000000 : now;
+      values[j].state = EBPD_CT_NEW;
+    }
+    const auto status = GetStatus(
+        map.UpdateBatch(base::MakeSpan(keys.data(), count),
+                        base::MakeSpan(values.data(), count)));
+    if (IsError(status)) {
+      std::cerr << "cannot insert: " << GetText(status) << std::endl;
+      return false;
+    }
+  }
+  result->insert_ns = NanosPer(start, entries);
+
+  start = Clock::now();
+  size_t read = 0;
+  bpf::MapCursor<ebpd_ct_key> cursor;
+  while (!IsDone(cursor)) {
+    auto count_or = map.LookupBatch(&cursor, base::MakeSpan(keys),
+                                    base::MakeSpan(values));
+    if (IsError(count_or)) {
+      std::cerr << "cannot read: " << GetText(GetStatus(count_or))
+                << std::endl;
+      return false;
+    }
+    read += GetValue(count_or);
+  }
+  result->batch_lookup_ns = NanosPer(start, read);
+
+  std::mt19937 random(entries);
+  start = Clock::now();
+  for (size_t i = 0; i < flags.lookups; ++i) {
+    (void)map.Lookup(MakeKey(random() % entries));
+  }
+  result->lookup_ns = NanosPer(start, flags.lookups);
+
+  ConntrackSweeperOptions options;
+  options.batch_size = flags.batch;
+  auto sweeper_or =
+      CreateConntrackSweeper(GetFileDescriptor(map), options);
+  if (IsError(sweeper_or)) {
+    return false;
+  }
+  start = Clock::now();
+  const auto stats_or = GetValue(sweeper_or).SweepAll();
+  if (IsError(stats_or)) {
+    std::cerr << "cannot sweep: " << GetText(GetStatus(stats_or))
+              << std::endl;
+    return false;
+  }
+  result->sweep_ns = NanosPer(start, GetValue(stats_or).scanned);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Flags flags;
+  if (!ParseFlags(argc, argv, &flags)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  std::cout << std::setw(10) << "entries" << std::setw(8) << "lru"
+            << std::setw(12) << "insert ns" << std::setw(12) << "read ns"
+            << std::setw(12) << "lookup ns" << std::setw(12) << "sweep ns"
+            << std::setw(14) << "bytes/entry" << std::endl;
+  for (const uint32_t entries : flags.entries) {
+    for (const uint32_t map_flags : {0u, uint32_t{BPF_F_NO_COMMON_LRU}}) {
+      Result result;
+      if (!Run(flags, entries, map_flags, &result)) {
+        return 1;
+      }
+      std::cout << std::fixed << std::setprecision(1) << std::setw(10)
+                << entries << std::setw(8) << (map_flags ? "percpu" : "shared")
+                << std::setw(12) << result.insert_ns << std::setw(12)
+                << result.batch_lookup_ns << std::setw(12) << result.lookup_ns
+                << std::setw(12) << result.sweep_ns << std::setw(14)
+                << result.bytes_per_entry << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include "lib/benchmarks/programs.h"
+
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+
+#include "lib/ebpf/conntrack.h"
+#include "lib/ebpf/counter.h"
+#include "lib/ebpf/cpu_redirect.h"
+#include "lib/ebpf/router.h"
+#include "lib/ebpf/sample.h"
+#include "lib/posix/errno.h"
+
+namespace {
+
+struct Program {
+  const char* name;
+  const std::string_view* elf;
+};
+
+// Programs built in. Their maps start empty: the router passes everything
+// without routes, cpu_redirect without CPUs.
+const Program kPrograms[] = {
+    {"conntrack", &ebpf::conntrack},
+    {"counter", &ebpf::counter},
+    {"cpu_redirect", &ebpf::cpu_redirect},
+    {"router", &ebpf::router},
+    {"sample", &ebpf::sample},
+};
+
+}  // namespace
+
+std::vector<std::string_view> GetBuiltinProgramNames() {
+  std::vector<std::string_view> names;
+  for (const auto& program : kPrograms) {
+    names.push_back(program.name);
+  }
+  return names;
+}
+
+error::StatusOr<BenchmarkProgram> ReadBenchmarkProgram(
+    const std::string& prog, const std::string_view default_name) {
+  for (const auto& program : kPrograms) {
+    if (prog == program.name) {
+      return BenchmarkProgram{program.name, std::string(*program.elf)};
+    }
+  }
+  std::ifstream file(prog, std::ios::binary);
+  std::ostringstream contents;
+  if (!(contents << file.rdbuf())) {
+    return error::Status(posix::MakeCodeFromErrno(ENOENT),
+                         "cannot read " + prog);
+  }
+  return BenchmarkProgram{std::string(default_name), contents.str()};
+}
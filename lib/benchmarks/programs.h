@@ -0,0 +1,29 @@
+#ifndef LIB_BENCHMARKS_PROGRAMS_H_
+#define LIB_BENCHMARKS_PROGRAMS_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lib/error/status_or.h"
+
+// The xdp programs benchmarks run: those built in, by name, or any xdp ELF
+// object, by path.
+
+struct BenchmarkProgram {
+  // Name of the program built in, 'default_name' for objects read from files.
+  std::string name;
+  // Its ELF object.
+  std::string elf;
+};
+
+// Names of the programs built in, e.g. "router".
+std::vector<std::string_view> GetBuiltinProgramNames();
+
+// Return the program built in named 'prog', or else read the ELF object
+// stored at path 'prog', named 'default_name'. Fails with ENOENT if there
+// is neither.
+error::StatusOr<BenchmarkProgram> ReadBenchmarkProgram(
+    const std::string& prog, std::string_view default_name);
+
+#endif  // LIB_BENCHMARKS_PROGRAMS_H_
@@ -0,0 +1,206 @@
+#include "lib/benchmarks/xdp_benchmark.h"
+
+#include <linux/bpf.h>
+
+#include <algorithm>
+#include <cerrno>
+
+#include "lib/base/span.h"
+#include "lib/bpf/test_run.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/posix/errno.h"
+
+namespace {
+
+constexpr size_t kEthSize = 14;
+constexpr size_t kIpv4Size = 20;
+constexpr size_t kIpv6Size = 40;
+constexpr size_t kUdpSize = 8;
+constexpr size_t kTcpSize = 20;
+constexpr uint8_t kProtoTcp = 6;
+constexpr uint8_t kProtoUdp = 17;
+
+void Put16(uint8_t* const p, const uint16_t value) {
+  p[0] = value >> 8;
+  p[1] = value;
+}
+
+// Return the ones' complement sum of 'size' bytes at 'data' added to 'sum',
+// not folded.
+uint32_t Sum(const uint8_t* const data, const size_t size, uint32_t sum = 0) {
+  for (size_t i = 0; i + 1 < size; i += 2) {
+    sum += data[i] << 8 | data[i + 1];
+  }
+  if (size % 2) {
+    sum += data[size - 1] << 8;
+  }
+  return sum;
+}
+
+uint16_t Fold(uint32_t sum) {
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return ~sum;
+}
+
+std::vector<uint8_t> MakePacket(const Traffic traffic, const uint32_t flow,
+                                const size_t size) {
+  const bool ipv6 = traffic == Traffic::kUdp6 || traffic == Traffic::kTcp6;
+  const bool tcp = traffic == Traffic::kTcp4 || traffic == Traffic::kTcp6;
+  const size_t l3_size = ipv6 ? kIpv6Size : kIpv4Size;
+  const size_t l4_size = tcp ? kTcpSize : kUdpSize;
+  std::vector<uint8_t> packet(
+      std::max(size, kEthSize + l3_size + l4_size));
+  const size_t l4_length = packet.size() - kEthSize - l3_size;
+  const uint8_t proto = tcp ? kProtoTcp : kProtoUdp;
+
+  uint8_t* const eth = packet.data();
+  const uint8_t dst[] = {0x02, 0, 0, 0, 0, 0x02};
+  const uint8_t src[] = {0x02, 0, 0, 0, 0, 0x01};
+  std::copy(dst, dst + 6, eth);
+  std::copy(src, src + 6, eth + 6);
+  Put16(eth + 12, ipv6 ? 0x86dd : 0x0800);
+
+  // Pseudo header sum of the transport checksum.
+  uint8_t* const ip = eth + kEthSize;
+  uint32_t sum = proto + l4_length;
+  if (ipv6) {
+    ip[0] = 0x60;
+    Put16(ip + 4, l4_length);
+    ip[6] = proto;
+    ip[7] = 64;
+    const uint8_t saddr[] = {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0,
+                             0, 0, 0, 0, 0, 0, 0, 0};
+    std::copy(saddr, saddr + 16, ip + 8);
+    ip[21] = flow >> 16;
+    ip[22] = flow >> 8;
+    ip[23] = flow;
+    std::copy(saddr, saddr + 16, ip + 24);
+    ip[29] = 1;
+    ip[39] = 1;
+    sum = Sum(ip + 8, 32, sum);
+  } else {
+    ip[0] = 0x45;
+    Put16(ip + 2, packet.size() - kEthSize);
+    ip[8] = 64;
+    ip[9] = proto;
+    ip[12] = 10;
+    ip[13] = flow >> 16;
+    ip[14] = flow >> 8;
+    ip[15] = flow;
+    ip[16] = 192;
+    ip[18] = 2;
+    ip[19] = 1;
+    Put16(ip + 10, Fold(Sum(ip, kIpv4Size)));
+    sum = Sum(ip + 12, 8, sum);
+  }
+
+  uint8_t* const l4 = ip + l3_size;
+  Put16(l4, 1024 + flow % 60000);
+  Put16(l4 + 2, tcp ? 80 : 5000);
+  if (tcp) {
+    l4[7] = 1;      // Sequence number.
+    l4[12] = 0x50;  // Data offset, 5 words.
+    l4[13] = 0x10;  // ACK, mid-connection.
+    Put16(l4 + 14, 65535);
+    Put16(l4 + 16, Fold(Sum(l4, l4_length, sum)));
+  } else {
+    Put16(l4 + 4, l4_length);
+    uint16_t check = Fold(Sum(l4, l4_length, sum));
+    Put16(l4 + 6, check ? check : 0xffff);
+  }
+  return packet;
+}
+
+// Time 'run', running the program on a packet a number of times and
+// returning its verdict and mean run time, on each of 'packets'.
+template <typename Run>
+error::StatusOr<XdpBenchmarkResult> Benchmark(
+    const std::vector<std::vector<uint8_t>>& packets, const Run& run,
+    const XdpBenchmarkOptions& options) {
+  XdpBenchmarkResult result;
+  if (packets.empty()) {
+    return result;
+  }
+  result.min = result.min.max();
+  for (const auto& packet : packets) {
+    ASSIGN_OR_RETURN(const auto first, run(packet, 1));
+    ++result.verdicts[first.retval];
+    ASSIGN_OR_RETURN(const auto timed, run(packet, options.repeat));
+    const std::chrono::duration<double, std::nano> duration = timed.duration;
+    result.mean += duration;
+    result.min = std::min(result.min, duration);
+    result.max = std::max(result.max, duration);
+  }
+  result.mean /= packets.size();
+  return result;
+}
+
+}  // namespace
+
+error::StatusOr<Traffic> ParseTraffic(const std::string_view name) {
+  if (name == "udp4") {
+    return Traffic::kUdp4;
+  }
+  if (name == "tcp4") {
+    return Traffic::kTcp4;
+  }
+  if (name == "udp6") {
+    return Traffic::kUdp6;
+  }
+  if (name == "tcp6") {
+    return Traffic::kTcp6;
+  }
+  return error::Status(posix::MakeCodeFromErrno(EINVAL),
+                       "unknown traffic, want udp4, tcp4, udp6 or tcp6");
+}
+
+std::vector<std::vector<uint8_t>> MakeTraffic(const Traffic traffic,
+                                              const size_t flows,
+                                              const size_t size) {
+  std::vector<std::vector<uint8_t>> packets;
+  packets.reserve(flows);
+  for (size_t flow = 0; flow < flows; ++flow) {
+    packets.push_back(MakePacket(traffic, flow, size));
+  }
+  return packets;
+}
+
+std::string_view GetXdpVerdictName(const uint32_t verdict) {
+  switch (verdict) {
+    case XDP_ABORTED:
+      return "ABORTED";
+    case XDP_DROP:
+      return "DROP";
+    case XDP_PASS:
+      return "PASS";
+    case XDP_TX:
+      return "TX";
+    case XDP_REDIRECT:
+      return "REDIRECT";
+  }
+  return "UNKNOWN";
+}
+
+error::StatusOr<XdpBenchmarkResult> RunXdpBenchmark(
+    const posix::FileDescriptor prog,
+    const std::vector<std::vector<uint8_t>>& packets,
+    const XdpBenchmarkOptions& options) {
+  return Benchmark(packets, [prog](const std::vector<uint8_t>& packet,
+                                   const uint32_t repeat) {
+    return bpf::TestRun(prog, base::MakeSpan(packet), repeat);
+  }, options);
+}
+
+error::StatusOr<XdpBenchmarkResult> RunXdpBenchmark(
+    vm::Vm* const vm, const uint32_t id,
+    const std::vector<std::vector<uint8_t>>& packets,
+    const XdpBenchmarkOptions& options) {
+  return Benchmark(packets, [vm, id](const std::vector<uint8_t>& packet,
+                                     const uint32_t repeat) {
+    vm::XdpRunOptions run_options;
+    run_options.repeat = repeat;
+    return vm->RunXdp(id, base::MakeSpan(packet), run_options);
+  }, options);
+}
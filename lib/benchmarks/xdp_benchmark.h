@@ -0,0 +1,66 @@
+#ifndef LIB_BENCHMARKS_XDP_BENCHMARK_H_
+#define LIB_BENCHMARKS_XDP_BENCHMARK_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string_view>
+#include <vector>
+
+#include "lib/error/status_or.h"
+#include "lib/posix/file_descriptor.h"
+#include "lib/vm/vm.h"
+
+// Synthetic traffic: ethernet frames of one protocol over many flows.
+enum class Traffic {
+  kUdp4,
+  kTcp4,
+  kUdp6,
+  kTcp6,
+};
+
+// Parse 'name', one of "udp4", "tcp4", "udp6" or "tcp6". Fails with EINVAL
+// on other names.
+error::StatusOr<Traffic> ParseTraffic(std::string_view name);
+
+// Return 'flows' packets of 'traffic', one per flow (source address and
+// port), of 'size' bytes or just their headers if larger. Checksums are
+// valid.
+std::vector<std::vector<uint8_t>> MakeTraffic(Traffic traffic, size_t flows,
+                                              size_t size);
+
+// Return the name of xdp verdict 'verdict', e.g. "PASS", or "UNKNOWN".
+std::string_view GetXdpVerdictName(uint32_t verdict);
+
+struct XdpBenchmarkOptions {
+  // Runs of the program per packet, timed together by the kernel.
+  uint32_t repeat = 10000;
+};
+
+struct XdpBenchmarkResult {
+  // Run time of the program per packet, averaged over the packets, and that
+  // of the cheapest and most expensive packet.
+  std::chrono::duration<double, std::nano> mean{0};
+  std::chrono::duration<double, std::nano> min{0};
+  std::chrono::duration<double, std::nano> max{0};
+  // Number of packets by verdict.
+  std::map<uint32_t, size_t> verdicts;
+};
+
+// Time xdp program 'prog' on each of 'packets' with BPF_PROG_TEST_RUN. The
+// verdict of each packet is that of its first run: later repeats see the
+// packet as the previous run left it, e.g. with a decremented TTL.
+//
+// Runs happen on the calling CPU, against the program's maps as they are:
+// fill them in first for programs doing nothing without them.
+error::StatusOr<XdpBenchmarkResult> RunXdpBenchmark(
+    posix::FileDescriptor prog, const std::vector<std::vector<uint8_t>>& packets,
+    const XdpBenchmarkOptions& options = XdpBenchmarkOptions());
+
+// Same, running program 'id' of 'vm' in userspace: without privileges, and
+// under a profiler with the JIT.
+error::StatusOr<XdpBenchmarkResult> RunXdpBenchmark(
+    vm::Vm* vm, uint32_t id, const std::vector<std::vector<uint8_t>>& packets,
+    const XdpBenchmarkOptions& options = XdpBenchmarkOptions());
+
+#endif  // LIB_BENCHMARKS_XDP_BENCHMARK_H_
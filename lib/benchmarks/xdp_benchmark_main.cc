@@ -0,0 +1,193 @@
+// Times an xdp program on canned packets with BPF_PROG_TEST_RUN, without a
+// link or traffic generator: runs anywhere the program loads, e.g. in CI.
+//
+// usage: xdp_benchmark --prog=NAME|FILE.o [--section=SECTION]
+//            [--pcap=FILE | --traffic=udp4|tcp4|udp6|tcp6 [--flows=N]
+//            [--size=BYTES]] [--repeat=N] [--max-ns=NS]
+//            [--vm=interpreter|jit]
+//
+// NAME is one of the programs built in, see lib/benchmarks/programs.h;
+// FILE.o any xdp ELF object. Prints the mean, fastest and slowest per-packet
+// time and the verdicts, and fails with --max-ns if the mean is above it.
+//
+// With --vm the program runs in userspace, see lib/vm: without root, and
+// under perf with the JIT. Times are not the kernel's, compare them with
+// each other only.
+
+#include <cerrno>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "lib/benchmarks/programs.h"
+#include "lib/benchmarks/xdp_benchmark.h"
+#include "lib/ebpd.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/pcap/reader.h"
+#include "lib/posix/errno.h"
+#include "lib/vm/vm.h"
+#include "lib/xdp_loader.h"
+
+namespace {
+
+struct Flags {
+  std::string prog;
+  std::string section;
+  std::string pcap;
+  std::string traffic = "udp4";
+  size_t flows = 64;
+  size_t size = 64;
+  uint32_t repeat = 10000;
+  double max_ns = 0;
+  std::string vm;
+};
+
+void PrintUsage(const char* name) {
+  std::cerr << "usage: " << name << " --prog=NAME|FILE.o [--section=SECTION]"
+            << " [--pcap=FILE | --traffic=udp4|tcp4|udp6|tcp6 [--flows=N]"
+            << " [--size=BYTES]] [--repeat=N] [--max-ns=NS]"
+            << " [--vm=interpreter|jit]" << std::endl;
+  std::cerr << "built in programs:";
+  for (const auto name : GetBuiltinProgramNames()) {
+    std::cerr << " " << name;
+  }
+  std::cerr << std::endl;
+}
+
+bool ParseFlags(const int argc, char** const argv, Flags* const flags) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.rfind("--prog=", 0) == 0) {
+      flags->prog = arg.substr(7);
+    } else if (arg.rfind("--section=", 0) == 0) {
+      flags->section = arg.substr(10);
+    } else if (arg.rfind("--pcap=", 0) == 0) {
+      flags->pcap = arg.substr(7);
+    } else if (arg.rfind("--traffic=", 0) == 0) {
+      flags->traffic = arg.substr(10);
+    } else if (arg.rfind("--flows=", 0) == 0) {
+      flags->flows = std::atoi(arg.c_str() + 8);
+    } else if (arg.rfind("--size=", 0) == 0) {
+      flags->size = std::atoi(arg.c_str() + 7);
+    } else if (arg.rfind("--repeat=", 0) == 0) {
+      flags->repeat = std::atoi(arg.c_str() + 9);
+    } else if (arg.rfind("--max-ns=", 0) == 0) {
+      flags->max_ns = std::atof(arg.c_str() + 9);
+    } else if (arg.rfind("--vm=", 0) == 0) {
+      flags->vm = arg.substr(5);
+    } else {
+      return false;
+    }
+  }
+  return !flags->prog.empty() && flags->flows > 0 && flags->repeat > 0 &&
+         (flags->vm.empty() || flags->vm == "interpreter" ||
+          flags->vm == "jit");
+}
+
+// Time the program in 'buffer' in the kernel.
+error::StatusOr<XdpBenchmarkResult> RunInKernel(
+    const std::string& buffer, const std::string& name, const Flags& flags,
+    const std::vector<std::vector<uint8_t>>& packets,
+    const XdpBenchmarkOptions& options) {
+  InitEbpdLib();
+  const XdpHandle xdph = LoadXdpBuffer(buffer, name);
+  if (!xdph) {
+    return error::Status(posix::MakeCodeFromErrno(EINVAL),
+                         "cannot load " + flags.prog);
+  }
+  const int prog_fd = xdph->GetProgFd(flags.section);
+  if (prog_fd < 0) {
+    return error::Status(posix::MakeCodeFromErrno(ENOENT),
+                         "no program in section '" + flags.section + "'");
+  }
+  return RunXdpBenchmark(posix::FileDescriptor(prog_fd), packets, options);
+}
+
+// Time the program in 'buffer' in userspace.
+error::StatusOr<XdpBenchmarkResult> RunInVm(
+    const std::string& buffer, const Flags& flags,
+    const std::vector<std::vector<uint8_t>>& packets,
+    const XdpBenchmarkOptions& options) {
+  vm::VmOptions vm_options;
+  vm_options.engine =
+      flags.vm == "jit" ? vm::Engine::kJit : vm::Engine::kInterpreter;
+  ASSIGN_OR_RETURN(auto vm, vm::CreateVm(buffer, vm_options));
+  ASSIGN_OR_RETURN(const uint32_t id, vm.GetProgramId(flags.section));
+  return RunXdpBenchmark(&vm, id, packets, options);
+}
+
+bool LoadPackets(const Flags& flags,
+                 std::vector<std::vector<uint8_t>>* const packets) {
+  if (flags.pcap.empty()) {
+    const auto traffic_or = ParseTraffic(flags.traffic);
+    if (IsError(traffic_or)) {
+      std::cerr << GetText(GetStatus(traffic_or)) << std::endl;
+      return false;
+    }
+    *packets = MakeTraffic(GetValue(traffic_or), flags.flows, flags.size);
+    return true;
+  }
+  auto capture_or = pcap::ReadPcapFile(flags.pcap);
+  if (IsError(capture_or)) {
+    std::cerr << flags.pcap << ": " << GetText(GetStatus(capture_or))
+              << std::endl;
+    return false;
+  }
+  for (auto& packet : GetValue(capture_or)) {
+    packets->push_back(std::move(packet.data));
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Flags flags;
+  if (!ParseFlags(argc, argv, &flags)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  std::vector<std::vector<uint8_t>> packets;
+  if (!LoadPackets(flags, &packets)) {
+    return 1;
+  }
+  const auto program_or = ReadBenchmarkProgram(flags.prog, "xdp_benchmark");
+  if (IsError(program_or)) {
+    std::cerr << GetText(GetStatus(program_or)) << std::endl;
+    return 1;
+  }
+  const std::string& buffer = GetValue(program_or).elf;
+  const std::string& name = GetValue(program_or).name;
+
+  XdpBenchmarkOptions options;
+  options.repeat = flags.repeat;
+  const auto result_or =
+      flags.vm.empty()
+          ? RunInKernel(buffer, name, flags, packets, options)
+          : RunInVm(buffer, flags, packets, options);
+  if (IsError(result_or)) {
+    std::cerr << "test run failed: " << GetText(GetStatus(result_or))
+              << std::endl;
+    return 1;
+  }
+  const auto& result = GetValue(result_or);
+  std::cout << std::fixed << std::setprecision(1) << flags.prog << ": "
+            << packets.size() << " packets x " << flags.repeat
+            << " runs, ns/packet mean " << result.mean.count() << " min "
+            << result.min.count() << " max " << result.max.count()
+            << std::endl;
+  std::cout << "verdicts:";
+  for (const auto& [verdict, count] : result.verdicts) {
+    std::cout << " " << GetXdpVerdictName(verdict) << "=" << count;
+  }
+  std::cout << std::endl;
+
+  if (flags.max_ns > 0 && result.mean.count() > flags.max_ns) {
+    std::cerr << "mean " << result.mean.count() << " ns/packet above "
+              << flags.max_ns << std::endl;
+    return 2;
+  }
+  return 0;
+}
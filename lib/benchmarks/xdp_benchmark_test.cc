@@ -0,0 +1,98 @@
+#include "lib/benchmarks/xdp_benchmark.h"
+
+#include <linux/bpf.h>
+#include <unistd.h>
+
+#include <set>
+
+#include "gtest/gtest.h"
+#include "lib/ebpf/counter.h"
+#include "lib/posix/errno.h"
+#include "lib/tests/xdp_test_utils.h"
+
+namespace {
+
+// Return the folded ones' complement sum of 'size' bytes at 'data' plus
+// 'sum', 0xffff over data with a valid checksum.
+uint16_t Checksum(const uint8_t* const data, const size_t size,
+                  uint32_t sum = 0) {
+  for (size_t i = 0; i < size; i += 2) {
+    sum += data[i] << 8 | (i + 1 < size ? data[i + 1] : 0);
+  }
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return sum;
+}
+
+TEST(XdpBenchmarkTest, ParsesTraffic) {
+  EXPECT_EQ(Traffic::kTcp6, GetValue(ParseTraffic("tcp6")));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(ParseTraffic("icmp")), EINVAL));
+}
+
+TEST(XdpBenchmarkTest, MakesValidIpv4Packets) {
+  const auto packets = MakeTraffic(Traffic::kUdp4, 100, 128);
+  ASSERT_EQ(100, packets.size());
+  std::set<std::vector<uint8_t>> distinct(packets.begin(), packets.end());
+  EXPECT_EQ(100, distinct.size());
+  for (const auto& packet : packets) {
+    ASSERT_EQ(128, packet.size());
+    const uint8_t* const ip = packet.data() + 14;
+    EXPECT_EQ(0xffff, Checksum(ip, 20));
+    const uint32_t pseudo = Checksum(ip + 12, 8) + ip[9] + 128 - 34;
+    EXPECT_EQ(0xffff, Checksum(ip + 20, 128 - 34, pseudo));
+  }
+}
+
+TEST(XdpBenchmarkTest, MakesValidIpv6Packets) {
+  // Too small for the headers: just the headers.
+  const auto packets = MakeTraffic(Traffic::kTcp6, 3, 10);
+  ASSERT_EQ(3, packets.size());
+  for (const auto& packet : packets) {
+    ASSERT_EQ(14 + 40 + 20, packet.size());
+    const uint8_t* const ip = packet.data() + 14;
+    EXPECT_EQ(6, ip[6]);
+    const uint32_t pseudo = Checksum(ip + 8, 32) + 6 + 20;
+    EXPECT_EQ(0xffff, Checksum(ip + 40, 20, pseudo));
+  }
+}
+
+TEST(XdpBenchmarkTest, TimesPrograms) {
+  const int prog_fd = LoadTrivialXdpProg(XDP_DROP);
+  ASSERT_LE(0, prog_fd);
+  XdpBenchmarkOptions options;
+  options.repeat = 100;
+  const auto result_or =
+      RunXdpBenchmark(posix::FileDescriptor(prog_fd),
+                      MakeTraffic(Traffic::kTcp4, 8, 64), options);
+  close(prog_fd);
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  const auto& result = GetValue(result_or);
+  EXPECT_EQ(1, result.verdicts.size());
+  EXPECT_EQ(8, result.verdicts.at(XDP_DROP));
+  EXPECT_LE(result.min, result.mean);
+  EXPECT_LE(result.mean, result.max);
+}
+
+TEST(XdpBenchmarkTest, TimesProgramsInVms) {
+  auto vm_or = vm::CreateVm(ebpf::counter);
+  ASSERT_TRUE(IsOk(vm_or)) << GetText(GetStatus(vm_or));
+  auto& vm = GetValue(vm_or);
+  XdpBenchmarkOptions options;
+  options.repeat = 10;
+  const auto result_or = RunXdpBenchmark(
+      &vm, GetValue(vm.GetProgramId()), MakeTraffic(Traffic::kUdp4, 4, 64),
+      options);
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  EXPECT_EQ(4, GetValue(result_or).verdicts.at(XDP_PASS));
+  const auto packets_or = vm.GetMap("packets")->Lookup<uint64_t>(0u);
+  ASSERT_TRUE(IsOk(packets_or));
+  EXPECT_EQ(4 * (1 + 10), GetValue(packets_or));
+}
+
+TEST(XdpBenchmarkTest, NamesVerdicts) {
+  EXPECT_EQ("REDIRECT", GetXdpVerdictName(XDP_REDIRECT));
+  EXPECT_EQ("UNKNOWN", GetXdpVerdictName(42));
+}
+
+}  // namespace
@@ -0,0 +1,195 @@
+// Replays a packet capture through an xdp program and writes the packets it
+// leaves, as rewritten, to one capture per verdict: PREFIX.pass.pcap,
+// PREFIX.drop.pcap, PREFIX.tx.pcap, PREFIX.redirect.pcap, ...
+//
+// usage: xdp_replay --prog=NAME|FILE.o [--section=SECTION] --pcap=FILE
+//            --out=PREFIX [--veth [--native]]
+//
+// NAME is one of the programs built in, see lib/benchmarks/programs.h;
+// FILE.o any xdp ELF object. By default packets go through
+// BPF_PROG_TEST_RUN. With --veth they go over a veth pair in a network
+// namespace of their own, through the program attached in generic mode, or
+// in driver mode with --native: slower, but through the kernel paths real
+// traffic takes. Over a veth pair, dropped, aborted and redirected packets
+// cannot be told apart and are only counted.
+
+#include <linux/if_link.h>
+#include <net/if.h>
+#include <sched.h>
+
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "lib/benchmarks/programs.h"
+#include "lib/benchmarks/xdp_benchmark.h"
+#include "lib/ebpd.h"
+#include "lib/ebpd_link.h"
+#include "lib/pcap/reader.h"
+#include "lib/pcap/replay.h"
+#include "lib/pcap/writer.h"
+#include "lib/posix/errno.h"
+#include "lib/xdp_loader.h"
+
+namespace {
+
+struct Flags {
+  std::string prog;
+  std::string section;
+  std::string pcap;
+  std::string out;
+  bool veth = false;
+  bool native = false;
+};
+
+void PrintUsage(const char* name) {
+  std::cerr << "usage: " << name << " --prog=NAME|FILE.o [--section=SECTION]"
+            << " --pcap=FILE --out=PREFIX [--veth [--native]]" << std::endl;
+  std::cerr << "built in programs:";
+  for (const auto name : GetBuiltinProgramNames()) {
+    std::cerr << " " << name;
+  }
+  std::cerr << std::endl;
+}
+
+bool ParseFlags(const int argc, char** const argv, Flags* const flags) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.rfind("--prog=", 0) == 0) {
+      flags->prog = arg.substr(7);
+    } else if (arg.rfind("--section=", 0) == 0) {
+      flags->section = arg.substr(10);
+    } else if (arg.rfind("--pcap=", 0) == 0) {
+      flags->pcap = arg.substr(7);
+    } else if (arg.rfind("--out=", 0) == 0) {
+      flags->out = arg.substr(6);
+    } else if (arg == "--veth") {
+      flags->veth = true;
+    } else if (arg == "--native") {
+      flags->native = true;
+    } else {
+      return false;
+    }
+  }
+  return !flags->prog.empty() && !flags->pcap.empty() && !flags->out.empty() &&
+         (flags->veth || !flags->native);
+}
+
+// Load the program named or stored at 'prog'. Returns nullptr on failure.
+XdpHandle LoadProgram(const std::string& prog) {
+  const auto program_or = ReadBenchmarkProgram(prog, "xdp_replay");
+  if (IsError(program_or)) {
+    std::cerr << GetText(GetStatus(program_or)) << std::endl;
+    return nullptr;
+  }
+  return LoadXdpBuffer(GetValue(program_or).elf, GetValue(program_or).name);
+}
+
+// Replay 'packets' over a veth pair created in a new network namespace, with
+// 'prog_fd' attached to the receiving end.
+error::StatusOr<pcap::ReplayResult> ReplayThroughVeth(
+    const Flags& flags, const int prog_fd,
+    const std::vector<pcap::Packet>& packets) {
+  if (unshare(CLONE_NEWNET) != 0) {
+    return posix::CaptureErrnoAsStatus("unshare() failed");
+  }
+  // Keep IPv6 neighbor discovery out of the captures.
+  std::ofstream("/proc/sys/net/ipv6/conf/default/disable_ipv6") << "1";
+  if (system("ip link add replay0 type veth peer name replay1"
+             " && ip link set replay0 up && ip link set replay1 up") != 0) {
+    return error::Status(posix::MakeCodeFromErrno(EIO),
+                         "cannot create veth pair");
+  }
+  const int ifindex = if_nametoindex("replay1");
+  const int peer_ifindex = if_nametoindex("replay0");
+  const int rv = ebpd_link_set_xdp(
+      ifindex, prog_fd, flags.native ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE);
+  if (rv < 0) {
+    return error::Status(posix::MakeCodeFromErrno(-rv),
+                         "cannot attach program");
+  }
+  return pcap::ReplayThroughLink(ifindex, peer_ifindex, packets);
+}
+
+// Return the name of the capture of packets with 'verdict'.
+std::string GetPcapPath(const std::string& prefix, const uint32_t verdict) {
+  std::string name(GetXdpVerdictName(verdict));
+  if (name == "UNKNOWN") {
+    name = std::to_string(verdict);
+  }
+  for (char& c : name) {
+    c = std::tolower(c);
+  }
+  return prefix + "." + name + ".pcap";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Flags flags;
+  if (!ParseFlags(argc, argv, &flags)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  const auto packets_or = pcap::ReadPcapFile(flags.pcap);
+  if (IsError(packets_or)) {
+    std::cerr << flags.pcap << ": " << GetText(GetStatus(packets_or))
+              << std::endl;
+    return 1;
+  }
+  const auto& packets = GetValue(packets_or);
+  InitEbpdLib();
+  const XdpHandle xdph = LoadProgram(flags.prog);
+  if (!xdph) {
+    std::cerr << "cannot load " << flags.prog << std::endl;
+    return 1;
+  }
+  const int prog_fd = xdph->GetProgFd(flags.section);
+  if (prog_fd < 0) {
+    std::cerr << "no program in section '" << flags.section << "'"
+              << std::endl;
+    return 1;
+  }
+
+  const auto result_or =
+      flags.veth ? ReplayThroughVeth(flags, prog_fd, packets)
+                 : pcap::ReplayTestRun(posix::FileDescriptor(prog_fd), packets);
+  if (IsError(result_or)) {
+    std::cerr << "replay failed: " << GetText(GetStatus(result_or))
+              << std::endl;
+    return 1;
+  }
+  const auto& result = GetValue(result_or);
+  const std::chrono::duration<double> elapsed = result.elapsed;
+  std::cout << std::fixed << std::setprecision(1) << flags.prog << ": "
+            << packets.size() << " packets in " << elapsed.count() * 1000
+            << " ms, " << packets.size() / elapsed.count() << " packets/s"
+            << std::endl;
+  std::cout << "verdicts:";
+  for (const auto& [verdict, verdict_packets] : result.packets) {
+    std::cout << " " << GetXdpVerdictName(verdict) << "="
+              << verdict_packets.size();
+  }
+  if (flags.veth) {
+    std::cout << " lost=" << result.lost;
+  } else {
+    std::cout << " rejected=" << result.rejected;
+  }
+  std::cout << std::endl;
+
+  for (const auto& [verdict, verdict_packets] : result.packets) {
+    const std::string path = GetPcapPath(flags.out, verdict);
+    const auto status = pcap::WritePcapFile(path, verdict_packets);
+    if (IsError(status)) {
+      std::cerr << path << ": " << GetText(status) << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,71 @@
+#include "lib/bpf/cpus.h"
+
+#include <cerrno>
+#include <charconv>
+#include <fstream>
+#include <string>
+
+#include "lib/error/assign_or_return.h"
+#include "lib/posix/errno.h"
+
+namespace bpf {
+namespace {
+
+constexpr char kPossibleCpusPath[] = "/sys/devices/system/cpu/possible";
+
+error::Status MakeParseError() {
+  return error::Status(posix::MakeCodeFromErrno(EINVAL),
+                       "malformed cpu list");
+}
+
+error::StatusOr<int> ReadPossibleCpuCount() {
+  std::ifstream file(kPossibleCpusPath);
+  std::string list;
+  if (!std::getline(file, list)) {
+    return error::Status(posix::MakeCodeFromErrno(EIO),
+                         "cannot read /sys/devices/system/cpu/possible");
+  }
+  return ParseCpuListCount(list);
+}
+
+}  // namespace
+
+error::StatusOr<int> ParseCpuListCount(std::string_view list) {
+  int count = 0;
+  while (!list.empty()) {
+    int first = 0;
+    int last = 0;
+    const char* const end = list.data() + list.size();
+    auto result = std::from_chars(list.data(), end, first);
+    if (result.ec != std::errc()) {
+      return MakeParseError();
+    }
+    last = first;
+    if (result.ptr != end && *result.ptr == '-') {
+      result = std::from_chars(result.ptr + 1, end, last);
+      if (result.ec != std::errc() || last < first) {
+        return MakeParseError();
+      }
+    }
+    count += last - first + 1;
+    list.remove_prefix(result.ptr - list.data());
+    if (!list.empty() && list.front() == ',') {
+      list.remove_prefix(1);
+    } else if (!list.empty() && list.front() != '\n') {
+      return MakeParseError();
+    } else {
+      break;
+    }
+  }
+  if (count == 0) {
+    return MakeParseError();
+  }
+  return count;
+}
+
+error::StatusOr<int> GetPossibleCpuCount() {
+  static const auto count = ReadPossibleCpuCount();
+  return count;
+}
+
+}  // namespace bpf
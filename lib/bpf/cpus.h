@@ -0,0 +1,23 @@
+#ifndef LIB_BPF_CPUS_H_
+#define LIB_BPF_CPUS_H_
+
+#include <string_view>
+
+#include "lib/error/status_or.h"
+
+namespace bpf {
+
+// Return the number of possible CPUs, which is the number of values per-cpu
+// maps hold for every key. Not to be confused with online CPUs: CPUs that can
+// be hotplugged count too.
+//
+// Parsed from /sys/devices/system/cpu/possible once and cached.
+error::StatusOr<int> GetPossibleCpuCount();
+
+// Return the number of CPUs described by a kernel cpu list such as "0-3,8".
+// Exposed for testing.
+error::StatusOr<int> ParseCpuListCount(std::string_view list);
+
+}  // namespace bpf
+
+#endif  // LIB_BPF_CPUS_H_
@@ -0,0 +1,28 @@
+#include "lib/bpf/cpus.h"
+
+#include "gtest/gtest.h"
+
+using namespace bpf;
+
+TEST(CpusTest, ParseSingle) { EXPECT_EQ(1, GetValue(ParseCpuListCount("0"))); }
+
+TEST(CpusTest, ParseRange) {
+  EXPECT_EQ(128, GetValue(ParseCpuListCount("0-127\n")));
+}
+
+TEST(CpusTest, ParseList) {
+  EXPECT_EQ(7, GetValue(ParseCpuListCount("0-3,8,10-11")));
+}
+
+TEST(CpusTest, ParseMalformed) {
+  EXPECT_TRUE(IsError(ParseCpuListCount("")));
+  EXPECT_TRUE(IsError(ParseCpuListCount("x")));
+  EXPECT_TRUE(IsError(ParseCpuListCount("3-1")));
+  EXPECT_TRUE(IsError(ParseCpuListCount("0-3;")));
+}
+
+TEST(CpusTest, Possible) {
+  const auto count = GetPossibleCpuCount();
+  ASSERT_TRUE(IsOk(count));
+  EXPECT_LE(1, GetValue(count));
+}
@@ -0,0 +1,430 @@
+#ifndef LIB_BPF_MAP_H_
+#define LIB_BPF_MAP_H_
+
+#include <fcntl.h>
+#include <linux/bpf.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "lib/base/invariant.h"
+#include "lib/base/span.h"
+#include "lib/bpf/syscall.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/errno.h"
+#include "lib/posix/syscall.h"
+#include "lib/posix/unique_file_descriptor.h"
+
+namespace bpf {
+namespace impl {
+
+// Untyped map operations shared by the typed map views. 'key' and 'value'
+// must point to buffers of the map's key and value size.
+
+inline error::Status LookupElement(const posix::FileDescriptor fd,
+                                   const void* key, void* value) {
+  auto attr = MakeAttr();
+  attr.map_fd = GetValue(fd);
+  attr.key = ToAttrPointer(key);
+  attr.value = ToAttrPointer(value);
+  return GetStatus(Bpf(BPF_MAP_LOOKUP_ELEM, &attr));
+}
+
+inline error::Status UpdateElement(const posix::FileDescriptor fd,
+                                   const void* key, const void* value,
+                                   const uint64_t flags) {
+  auto attr = MakeAttr();
+  attr.map_fd = GetValue(fd);
+  attr.key = ToAttrPointer(key);
+  attr.value = ToAttrPointer(value);
+  attr.flags = flags;
+  return GetStatus(Bpf(BPF_MAP_UPDATE_ELEM, &attr));
+}
+
+inline error::Status DeleteElement(const posix::FileDescriptor fd,
+                                   const void* key) {
+  auto attr = MakeAttr();
+  attr.map_fd = GetValue(fd);
+  attr.key = ToAttrPointer(key);
+  return GetStatus(Bpf(BPF_MAP_DELETE_ELEM, &attr));
+}
+
+// 'key' == nullptr returns the first key.
+inline error::Status GetNextKey(const posix::FileDescriptor fd,
+                                const void* key, void* next_key) {
+  auto attr = MakeAttr();
+  attr.map_fd = GetValue(fd);
+  attr.key = ToAttrPointer(key);
+  attr.next_key = ToAttrPointer(next_key);
+  return GetStatus(Bpf(BPF_MAP_GET_NEXT_KEY, &attr));
+}
+
+// Run a batch command over up to '*count' elements. On return '*count' holds
+// the number of elements processed, which may be non-zero on error.
+inline error::Status RunBatch(const int cmd, const posix::FileDescriptor fd,
+                              void* const in_batch, void* const out_batch,
+                              const void* keys, const void* values,
+                              uint32_t* const count,
+                              const uint64_t elem_flags) {
+  auto attr = MakeAttr<BatchAttr>();
+  attr.map_fd = GetValue(fd);
+  attr.in_batch = ToAttrPointer(in_batch);
+  attr.out_batch = ToAttrPointer(out_batch);
+  attr.keys = ToAttrPointer(keys);
+  attr.values = ToAttrPointer(values);
+  attr.count = *count;
+  attr.elem_flags = elem_flags;
+  const auto status = GetStatus(Bpf(cmd, &attr));
+  *count = attr.count;
+  return status;
+}
+
+// Whether the kernel implements the batch commands for a map: they are
+// missing before linux 5.6, and for map types without them (e.g. LPM tries,
+// deletes from arrays). Probed once per command with an empty batch, which
+// the kernel accepts without doing anything where the command exists, rather
+// than inferred from failures: EINVAL also rejects flags batches do not take.
+// Callers fall back to per element commands without support.
+class BatchSupport {
+ public:
+  bool IsSupported(const posix::FileDescriptor fd, const int cmd) {
+    INVARIANT_GE(cmd, kMapLookupBatch);
+    INVARIANT_LE(cmd, kMapDeleteBatch);
+    State& state = states_[cmd - kMapLookupBatch];
+    if (state == State::kUnknown) {
+      uint32_t count = 0;
+      const auto status =
+          RunBatch(cmd, fd, nullptr, nullptr, nullptr, nullptr, &count, 0);
+      state = IsOk(status) ? State::kSupported : State::kUnsupported;
+    }
+    return state == State::kSupported;
+  }
+
+ private:
+  enum class State : uint8_t { kUnknown, kSupported, kUnsupported };
+
+  State states_[kMapDeleteBatch - kMapLookupBatch + 1] = {};
+};
+
+struct MapInfo {
+  uint32_t type;
+  uint32_t key_size;
+  uint32_t value_size;
+  uint32_t max_entries;
+  uint32_t map_flags;
+};
+
+inline error::StatusOr<MapInfo> GetMapInfo(const posix::FileDescriptor fd) {
+  bpf_map_info info;
+  std::memset(&info, 0, sizeof(info));
+  auto attr = MakeAttr();
+  attr.info.bpf_fd = GetValue(fd);
+  attr.info.info_len = sizeof(info);
+  attr.info.info = ToAttrPointer(&info);
+  RETURN_IF_ERROR(GetStatus(Bpf(BPF_OBJ_GET_INFO_BY_FD, &attr)));
+  return MapInfo{info.type, info.key_size, info.value_size, info.max_entries,
+                 info.map_flags};
+}
+
+inline error::StatusOr<posix::UniqueFileDescriptor> CreateMap(
+    const bpf_map_type type, const uint32_t key_size, const uint32_t value_size,
+    const uint32_t max_entries, const uint32_t map_flags) {
+  auto attr = MakeAttr();
+  attr.map_type = type;
+  attr.key_size = key_size;
+  attr.value_size = value_size;
+  attr.max_entries = max_entries;
+  attr.map_flags = map_flags;
+  ASSIGN_OR_RETURN(const int fd, Bpf(BPF_MAP_CREATE, &attr));
+  return posix::UniqueFileDescriptor(posix::FileDescriptor(fd));
+}
+
+// Duplicate a map file descriptor owned by someone else (e.g. a loaded
+// bpf_object) so its lifetime can be managed independently.
+inline error::StatusOr<posix::UniqueFileDescriptor> DuplicateMap(
+    const posix::FileDescriptor fd) {
+  const int dup = ::fcntl(GetValue(fd), F_DUPFD_CLOEXEC, 0);
+  RETURN_IF_ERROR(posix::OkStatusOrCaptureErrnoIf(-1 == dup, "fcntl() failed"));
+  return posix::UniqueFileDescriptor(posix::FileDescriptor(dup));
+}
+
+// Batch token buffer. Hash maps use a 32 bit bucket index, other map types
+// the key itself.
+template <typename K>
+constexpr size_t kBatchTokenSize = std::max(sizeof(K), sizeof(uint32_t));
+
+// State of a batched iteration, see MapCursor.
+struct CursorState {
+  bool started = false;
+  bool done = false;
+};
+
+// Read the next batch of up to 'max_count' elements at 'cursor' / 'token'.
+// Keys are written 'key_size' bytes apart and values 'value_size' bytes
+// apart. Without batch support one key is read at a time and 'token' holds
+// the last key read.
+inline error::StatusOr<size_t> LookupBatch(
+    const posix::FileDescriptor fd, CursorState* const cursor,
+    void* const token, void* const keys, const size_t key_size,
+    void* const values, const size_t value_size, const size_t max_count,
+    BatchSupport* const batch_support) {
+  if (cursor->done) {
+    return size_t{0};
+  }
+  if (batch_support->IsSupported(fd, kMapLookupBatch)) {
+    uint32_t count = max_count;
+    const auto status =
+        RunBatch(kMapLookupBatch, fd, cursor->started ? token : nullptr, token,
+                 keys, values, &count, 0);
+    if (IsError(status) && !posix::IsErrno(status, ENOENT)) {
+      return status;
+    }
+    cursor->started = true;
+    cursor->done = IsError(status);
+    return size_t{count};
+  }
+  size_t count = 0;
+  while (count < max_count) {
+    uint8_t* const key = static_cast<uint8_t*>(keys) + count * key_size;
+    const auto next_status =
+        GetNextKey(fd, cursor->started ? token : nullptr, key);
+    if (posix::IsErrno(next_status, ENOENT)) {
+      cursor->done = true;
+      break;
+    }
+    RETURN_IF_ERROR(next_status);
+    cursor->started = true;
+    std::memcpy(token, key, key_size);
+    const auto status = LookupElement(
+        fd, key, static_cast<uint8_t*>(values) + count * value_size);
+    if (posix::IsErrno(status, ENOENT)) {
+      continue;  // Deleted concurrently.
+    }
+    RETURN_IF_ERROR(status);
+    ++count;
+  }
+  return count;
+}
+
+}  // namespace impl
+
+// Position of a batched iteration over a map keyed by K. A default
+// constructed cursor starts at the beginning of the map.
+template <typename K>
+class MapCursor {
+ private:
+  // Return true iff the iteration reached the end of the map.
+  friend bool IsDone(const MapCursor& cursor) { return cursor.state_.done; }
+
+  // Return the iteration state.
+  friend impl::CursorState* GetState(MapCursor* const cursor) {
+    return &cursor->state_;
+  }
+
+  // Return the opaque token passed to and from the kernel.
+  friend void* GetToken(MapCursor* const cursor) { return cursor->token_; }
+
+  impl::CursorState state_;
+  alignas(8) uint8_t token_[impl::kBatchTokenSize<K>] = {};
+};
+
+// Typed view of a bpf map with keys of type K and values of type V, owning the
+// map file descriptor. K and V must match the map's key and value size and
+// layout exactly, including padding, which is compared byte for byte by the
+// kernel; zero initialize keys before filling them in.
+//
+// Single element operations cost one syscall each. The *Batch operations move
+// many elements per syscall (linux 5.6+) and transparently fall back to one
+// syscall per element on older kernels or map types without batch support.
+//
+// Lookups of absent keys return a status with errno ENOENT, check with
+// posix::IsErrno(status, ENOENT).
+//
+// Example usage:
+//
+// ASSIGN_OR_RETURN(auto routes,
+//                  CreateMap<uint32_t, Nexthop>(BPF_MAP_TYPE_HASH, 1 << 20));
+// RETURN_IF_ERROR(GetStatus(routes.UpdateBatch(base::MakeSpan(prefixes),
+//                                              base::MakeSpan(nexthops))));
+// ASSIGN_OR_RETURN(const Nexthop nh, routes.Lookup(prefix));
+//
+template <typename K, typename V>
+class BpfMap {
+ public:
+  static_assert(std::is_trivially_copyable_v<K>, "keys are copied as bytes");
+  static_assert(std::is_trivially_copyable_v<V>, "values are copied as bytes");
+
+  using Cursor = MapCursor<K>;
+
+  BpfMap() = default;
+
+  // Take ownership of 'fd', which must refer to a map matching K and V. Prefer
+  // CreateMap() or OpenMap() which check this.
+  explicit BpfMap(posix::UniqueFileDescriptor fd) : fd_(std::move(fd)) {}
+
+  // Default move constructor.
+  BpfMap(BpfMap&&) = default;
+
+  // Default move assignment operator.
+  BpfMap& operator=(BpfMap&&) = default;
+
+  // Return the value stored under 'key'.
+  error::StatusOr<V> Lookup(const K& key) const {
+    V value;
+    RETURN_IF_ERROR(impl::LookupElement(GetValue(fd_), &key, &value));
+    return value;
+  }
+
+  // Store 'value' under 'key'. 'flags' is one of BPF_ANY, BPF_NOEXIST or
+  // BPF_EXIST.
+  error::Status Update(const K& key, const V& value,
+                       const uint64_t flags = BPF_ANY) {
+    return impl::UpdateElement(GetValue(fd_), &key, &value, flags);
+  }
+
+  // Remove 'key' from the map.
+  error::Status Delete(const K& key) {
+    return impl::DeleteElement(GetValue(fd_), &key);
+  }
+
+  // Return the key following 'key', or the first key if 'key' is nullptr.
+  // Returns ENOENT past the last key.
+  error::StatusOr<K> GetNextKey(const K* const key) const {
+    K next;
+    RETURN_IF_ERROR(impl::GetNextKey(GetValue(fd_), key, &next));
+    return next;
+  }
+
+  // Read the next batch of up to GetSize('keys') elements at 'cursor' into
+  // 'keys' and 'values' and advance 'cursor'. Returns the number of elements
+  // read, which may be zero even before IsDone('cursor') (e.g. empty hash
+  // buckets). Hash maps return ENOSPC if a single bucket does not fit.
+  error::StatusOr<size_t> LookupBatch(Cursor* const cursor,
+                                      const base::Span<K> keys,
+                                      const base::Span<V> values) const {
+    INVARIANT_EQ(GetSize(keys), GetSize(values));
+    return impl::LookupBatch(GetValue(fd_), GetState(cursor),
+                             GetToken(cursor), GetBase(keys), sizeof(K),
+                             GetBase(values), sizeof(V), GetSize(keys),
+                             &batch_support_);
+  }
+
+  // Store all 'values' under the corresponding 'keys'. Returns the number of
+  // elements stored; on error some elements may have been stored already.
+  // 'flags' is one of BPF_ANY, BPF_NOEXIST or BPF_EXIST: batches only take
+  // BPF_ANY, the others cost one syscall per element.
+  error::StatusOr<size_t> UpdateBatch(const base::Span<const K> keys,
+                                      const base::Span<const V> values,
+                                      const uint64_t flags = BPF_ANY) {
+    INVARIANT_EQ(GetSize(keys), GetSize(values));
+    if (IsEmpty(keys)) {
+      return size_t{0};
+    }
+    if (flags == BPF_ANY &&
+        batch_support_.IsSupported(GetValue(fd_), kMapUpdateBatch)) {
+      uint32_t count = GetSize(keys);
+      RETURN_IF_ERROR(impl::RunBatch(kMapUpdateBatch, GetValue(fd_), nullptr,
+                                     nullptr, GetBase(keys), GetBase(values),
+                                     &count, flags));
+      return size_t{count};
+    }
+    for (size_t i = 0; i < GetSize(keys); ++i) {
+      RETURN_IF_ERROR(impl::UpdateElement(GetValue(fd_), GetBase(keys) + i,
+                                          GetBase(values) + i, flags));
+    }
+    return GetSize(keys);
+  }
+
+  // Remove all 'keys' from the map. Fails with ENOENT on the first absent
+  // key; on error some keys may have been removed already.
+  error::StatusOr<size_t> DeleteBatch(const base::Span<const K> keys) {
+    if (IsEmpty(keys)) {
+      return size_t{0};
+    }
+    if (batch_support_.IsSupported(GetValue(fd_), kMapDeleteBatch)) {
+      uint32_t count = GetSize(keys);
+      RETURN_IF_ERROR(impl::RunBatch(kMapDeleteBatch, GetValue(fd_), nullptr,
+                                     nullptr, GetBase(keys), nullptr, &count,
+                                     0));
+      return size_t{count};
+    }
+    for (size_t i = 0; i < GetSize(keys); ++i) {
+      RETURN_IF_ERROR(impl::DeleteElement(GetValue(fd_), GetBase(keys) + i));
+    }
+    return GetSize(keys);
+  }
+
+  // Read the whole map into 'keys' and 'values', 'batch_size' elements per
+  // syscall. Concurrent updates may or may not be observed.
+  error::Status LookupAll(std::vector<K>* const keys,
+                          std::vector<V>* const values,
+                          size_t batch_size = 4096) const {
+    keys->clear();
+    values->clear();
+    Cursor cursor;
+    while (!IsDone(cursor)) {
+      const size_t offset = keys->size();
+      keys->resize(offset + batch_size);
+      values->resize(offset + batch_size);
+      auto count_or = LookupBatch(
+          &cursor, base::MakeSpan(keys->data() + offset, batch_size),
+          base::MakeSpan(values->data() + offset, batch_size));
+      if (posix::IsErrno(GetStatus(count_or), ENOSPC)) {
+        batch_size *= 2;  // A hash bucket larger than the batch.
+        count_or = size_t{0};
+      }
+      RETURN_IF_ERROR(GetStatus(count_or));
+      keys->resize(offset + GetValue(count_or));
+      values->resize(offset + GetValue(count_or));
+    }
+    return error::kOkStatus;
+  }
+
+ private:
+  // Return the file descriptor of 'map', still owned by 'map'.
+  friend posix::FileDescriptor GetFileDescriptor(const BpfMap& map) {
+    return GetValue(map.fd_);
+  }
+
+  // Return true iff batch command 'cmd' is used on 'map', e.g.
+  // kMapUpdateBatch for UpdateBatch(..., BPF_ANY).
+  friend bool UsesBatch(const BpfMap& map, const int cmd) {
+    return map.batch_support_.IsSupported(GetValue(map.fd_), cmd);
+  }
+
+  posix::UniqueFileDescriptor fd_;
+
+  mutable impl::BatchSupport batch_support_;
+};
+
+// Create a new map of 'type' keyed by K and holding V.
+template <typename K, typename V>
+error::StatusOr<BpfMap<K, V>> CreateMap(const bpf_map_type type,
+                                        const uint32_t max_entries,
+                                        const uint32_t map_flags = 0) {
+  ASSIGN_OR_RETURN(auto fd, impl::CreateMap(type, sizeof(K), sizeof(V),
+                                            max_entries, map_flags));
+  return BpfMap<K, V>(std::move(fd));
+}
+
+// Open a typed view of the map behind 'fd', which stays owned by the caller
+// (e.g. XdpLoader::GetMapFd()). Fails with EINVAL if K or V do not match the
+// map's key and value size.
+template <typename K, typename V>
+error::StatusOr<BpfMap<K, V>> OpenMap(const posix::FileDescriptor fd) {
+  ASSIGN_OR_RETURN(const auto info, impl::GetMapInfo(fd));
+  if (info.key_size != sizeof(K) || info.value_size != sizeof(V)) {
+    return error::Status(posix::MakeCodeFromErrno(EINVAL),
+                         "map key or value size mismatch");
+  }
+  ASSIGN_OR_RETURN(auto dup, impl::DuplicateMap(fd));
+  return BpfMap<K, V>(std::move(dup));
+}
+
+}  // namespace bpf
+
+#endif  // LIB_BPF_MAP_H_
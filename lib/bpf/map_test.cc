@@ -0,0 +1,136 @@
+#include "lib/bpf/map.h"
+
+#include <numeric>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace bpf;
+
+// These tests create real maps and need CAP_BPF (or root).
+
+struct Key {
+  uint32_t addr;
+  uint16_t port;
+  uint16_t proto;
+};
+
+TEST(BpfMapTest, CreateLookupUpdateDelete) {
+  auto map_or = CreateMap<Key, uint64_t>(BPF_MAP_TYPE_HASH, 16);
+  ASSERT_TRUE(IsOk(map_or));
+  auto& map = GetValue(map_or);
+  const Key key = {1, 2, 3};
+  EXPECT_TRUE(posix::IsErrno(GetStatus(map.Lookup(key)), ENOENT));
+  EXPECT_TRUE(IsOk(map.Update(key, 42)));
+  EXPECT_EQ(42, GetValue(map.Lookup(key)));
+  EXPECT_TRUE(posix::IsErrno(map.Update(key, 43, BPF_NOEXIST), EEXIST));
+  EXPECT_TRUE(IsOk(map.Delete(key)));
+  EXPECT_TRUE(posix::IsErrno(map.Delete(key), ENOENT));
+}
+
+TEST(BpfMapTest, GetNextKey) {
+  auto map_or = CreateMap<uint32_t, uint32_t>(BPF_MAP_TYPE_ARRAY, 2);
+  ASSERT_TRUE(IsOk(map_or));
+  auto& map = GetValue(map_or);
+  EXPECT_EQ(0, GetValue(map.GetNextKey(nullptr)));
+  const uint32_t zero = 0;
+  EXPECT_EQ(1, GetValue(map.GetNextKey(&zero)));
+  const uint32_t one = 1;
+  EXPECT_TRUE(posix::IsErrno(GetStatus(map.GetNextKey(&one)), ENOENT));
+}
+
+TEST(BpfMapTest, Batch) {
+  constexpr uint32_t kEntries = 10000;
+  auto map_or = CreateMap<uint32_t, uint64_t>(BPF_MAP_TYPE_HASH, kEntries);
+  ASSERT_TRUE(IsOk(map_or));
+  auto& map = GetValue(map_or);
+
+  std::vector<uint32_t> keys(kEntries);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::vector<uint64_t> values(keys.begin(), keys.end());
+  auto updated = map.UpdateBatch(base::MakeSpan(keys), base::MakeSpan(values));
+  ASSERT_TRUE(IsOk(updated));
+  EXPECT_EQ(kEntries, GetValue(updated));
+
+  std::vector<uint32_t> read_keys;
+  std::vector<uint64_t> read_values;
+  ASSERT_TRUE(IsOk(map.LookupAll(&read_keys, &read_values, 64)));
+  ASSERT_EQ(kEntries, read_keys.size());
+  for (size_t i = 0; i < read_keys.size(); ++i) {
+    EXPECT_EQ(read_keys[i], read_values[i]);
+  }
+
+  auto deleted = map.DeleteBatch(
+      base::MakeSpan(static_cast<const uint32_t*>(keys.data()), kEntries / 2));
+  ASSERT_TRUE(IsOk(deleted));
+  EXPECT_EQ(kEntries / 2, GetValue(deleted));
+  ASSERT_TRUE(IsOk(map.LookupAll(&read_keys, &read_values)));
+  EXPECT_EQ(kEntries / 2, read_keys.size());
+}
+
+TEST(BpfMapTest, BatchFallback) {
+  // LPM tries implement no batch commands on older kernels: the per element
+  // fallback is used there.
+  struct LpmKey {
+    uint32_t prefixlen;
+    uint32_t addr;
+  };
+  auto map_or = CreateMap<LpmKey, uint32_t>(BPF_MAP_TYPE_LPM_TRIE, 16,
+                                            BPF_F_NO_PREALLOC);
+  ASSERT_TRUE(IsOk(map_or));
+  auto& map = GetValue(map_or);
+  const std::vector<LpmKey> keys = {{8, 10}, {16, 10}, {24, 10}};
+  const std::vector<uint32_t> values = {1, 2, 3};
+  auto updated = map.UpdateBatch(base::MakeSpan(keys), base::MakeSpan(values));
+  ASSERT_TRUE(IsOk(updated));
+  EXPECT_EQ(3, GetValue(updated));
+  std::vector<LpmKey> read_keys;
+  std::vector<uint32_t> read_values;
+  ASSERT_TRUE(IsOk(map.LookupAll(&read_keys, &read_values)));
+  EXPECT_EQ(3, read_keys.size());
+  auto deleted = map.DeleteBatch(base::MakeSpan(keys));
+  ASSERT_TRUE(IsOk(deleted));
+  EXPECT_EQ(3, GetValue(deleted));
+}
+
+TEST(BpfMapTest, BatchUpdateFlags) {
+  auto map_or = CreateMap<uint32_t, uint64_t>(BPF_MAP_TYPE_HASH, 16);
+  ASSERT_TRUE(IsOk(map_or));
+  auto& map = GetValue(map_or);
+  const std::vector<uint32_t> keys = {1, 2, 3};
+  const std::vector<uint64_t> values = {10, 20, 30};
+  ASSERT_TRUE(IsOk(map.UpdateBatch(base::MakeSpan(keys.data(), 1),
+                                   base::MakeSpan(values.data(), 1))));
+
+  // Batches take no BPF_NOEXIST: the update goes element by element, and
+  // leaves the batch commands in use.
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(map.UpdateBatch(base::MakeSpan(keys), base::MakeSpan(values),
+                                BPF_NOEXIST)),
+      EEXIST));
+  EXPECT_TRUE(UsesBatch(map, kMapUpdateBatch));
+  auto updated = map.UpdateBatch(base::MakeSpan(keys.data() + 1, 2),
+                                 base::MakeSpan(values.data() + 1, 2),
+                                 BPF_NOEXIST);
+  ASSERT_TRUE(IsOk(updated));
+  EXPECT_EQ(2, GetValue(updated));
+  EXPECT_EQ(30, GetValue(map.Lookup(3)));
+  EXPECT_TRUE(UsesBatch(map, kMapUpdateBatch));
+  EXPECT_TRUE(UsesBatch(map, kMapLookupBatch));
+}
+
+TEST(BpfMapTest, BatchSupportIsPerCommand) {
+  auto array_or = CreateMap<uint32_t, uint64_t>(BPF_MAP_TYPE_ARRAY, 4);
+  ASSERT_TRUE(IsOk(array_or));
+  EXPECT_TRUE(UsesBatch(GetValue(array_or), kMapUpdateBatch));
+  // Array elements cannot be deleted, in batches or not.
+  EXPECT_FALSE(UsesBatch(GetValue(array_or), kMapDeleteBatch));
+}
+
+TEST(BpfMapTest, OpenMapChecksSizes) {
+  auto map_or = CreateMap<uint32_t, uint64_t>(BPF_MAP_TYPE_ARRAY, 4);
+  ASSERT_TRUE(IsOk(map_or));
+  const auto fd = GetFileDescriptor(GetValue(map_or));
+  EXPECT_TRUE(IsOk(OpenMap<uint32_t, uint64_t>(fd)));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(OpenMap<uint32_t, uint32_t>(fd)), EINVAL));
+}
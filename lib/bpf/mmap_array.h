@@ -0,0 +1,123 @@
+#ifndef LIB_BPF_MMAP_ARRAY_H_
+#define LIB_BPF_MMAP_ARRAY_H_
+
+#include <linux/bpf.h>
+#include <sys/mman.h>
+
+#include <cstdint>
+#include <type_traits>
+
+#include "lib/base/span.h"
+#include "lib/bpf/map.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/errno.h"
+#include "lib/posix/mmap.h"
+#include "lib/posix/unique_file_descriptor.h"
+
+namespace bpf {
+
+// BPF_F_MMAPABLE (linux 5.5), newer than the oldest uapi headers we build
+// against.
+constexpr uint32_t kMapFlagMmapable = 1U << 10;
+
+// Memory mapped BPF_MAP_TYPE_ARRAY created with BPF_F_MMAPABLE, giving direct,
+// syscall free access to its elements. Owns both the map file descriptor and
+// the mapping, so the span stays valid exactly as long as the MmapArray.
+//
+// Elements are shared with bpf programs without any synchronization: use
+// atomic operations on both sides (e.g. __sync_fetch_and_add() in the
+// program, __atomic_load_n() here) for counters, and publish multi-word
+// entries with a sequence number or a double buffer.
+//
+// The kernel lays array elements out 8 bytes apart, so T must be a multiple of
+// 8 bytes in size to be viewed as a plain array.
+//
+// Example usage:
+//
+// ASSIGN_OR_RETURN(auto stats, OpenMmapArray<PortStats>(fd));
+// for (const auto& port : GetSpan(stats)) ...
+//
+template <typename T>
+class MmapArray {
+ public:
+  static_assert(std::is_trivially_copyable_v<T>, "elements are shared bytes");
+  static_assert(sizeof(T) % 8 == 0, "array elements are 8 byte aligned");
+
+  MmapArray() = default;
+
+  // Take ownership of 'fd' and 'mapping' of it holding 'size' elements. Prefer
+  // CreateMmapArray() or OpenMmapArray() which check this.
+  MmapArray(posix::UniqueFileDescriptor fd, posix::UniqueMapping mapping,
+            const size_t size)
+      : fd_(std::move(fd)), mapping_(std::move(mapping)), size_(size) {}
+
+  // Default move constructor.
+  MmapArray(MmapArray&&) = default;
+
+  // Default move assignment operator.
+  MmapArray& operator=(MmapArray&&) = default;
+
+ private:
+  // Return the elements of 'array'.
+  friend base::Span<T> GetSpan(const MmapArray& array) {
+    return base::MakeSpan(reinterpret_cast<T*>(GetBase(GetValue(array.mapping_))),
+                          array.size_);
+  }
+
+  // Return the file descriptor of 'array', still owned by 'array'.
+  friend posix::FileDescriptor GetFileDescriptor(const MmapArray& array) {
+    return GetValue(array.fd_);
+  }
+
+  // Destruction order matters little (the mapping holds its own reference on
+  // the map) but unmapping first keeps the map alive no longer than needed.
+  posix::UniqueFileDescriptor fd_;
+  posix::UniqueMapping mapping_;
+  size_t size_ = 0;
+};
+
+namespace impl {
+
+template <typename T>
+error::StatusOr<MmapArray<T>> MapArray(posix::UniqueFileDescriptor fd,
+                                       const size_t size, const int prot) {
+  ASSIGN_OR_RETURN(
+      auto mapping,
+      posix::Mmap(posix::RoundUpToPageSize(sizeof(T) * size), prot, MAP_SHARED,
+                  GetValue(fd), 0));
+  return MmapArray<T>(std::move(fd), std::move(mapping), size);
+}
+
+}  // namespace impl
+
+// Create a new mmapable array of 'size' elements of type T, zero initialized.
+template <typename T>
+error::StatusOr<MmapArray<T>> CreateMmapArray(const uint32_t size) {
+  ASSIGN_OR_RETURN(auto fd,
+                   impl::CreateMap(BPF_MAP_TYPE_ARRAY, sizeof(uint32_t),
+                                   sizeof(T), size, kMapFlagMmapable));
+  return impl::MapArray<T>(std::move(fd), size, PROT_READ | PROT_WRITE);
+}
+
+// Map the array behind 'fd', which stays owned by the caller (e.g.
+// XdpLoader::GetMapFd() for an array declared with BPF_F_MMAPABLE). Maps
+// frozen with BPF_MAP_FREEZE can only be mapped read only ('writable' false).
+// Fails with EINVAL if the map is not an mmapable array of T.
+template <typename T>
+error::StatusOr<MmapArray<T>> OpenMmapArray(const posix::FileDescriptor fd,
+                                            const bool writable = true) {
+  ASSIGN_OR_RETURN(const auto info, impl::GetMapInfo(fd));
+  if (info.type != BPF_MAP_TYPE_ARRAY || !(info.map_flags & kMapFlagMmapable) ||
+      info.value_size != sizeof(T)) {
+    return error::Status(posix::MakeCodeFromErrno(EINVAL),
+                         "not an mmapable array of matching value size");
+  }
+  ASSIGN_OR_RETURN(auto dup, impl::DuplicateMap(fd));
+  return impl::MapArray<T>(std::move(dup), info.max_entries,
+                           writable ? PROT_READ | PROT_WRITE : PROT_READ);
+}
+
+}  // namespace bpf
+
+#endif  // LIB_BPF_MMAP_ARRAY_H_
@@ -0,0 +1,59 @@
+#include "lib/bpf/mmap_array.h"
+
+#include "gtest/gtest.h"
+
+using namespace bpf;
+
+// These tests create real maps and need CAP_BPF (or root), linux 5.5+.
+
+struct Stats {
+  uint64_t packets;
+  uint64_t bytes;
+};
+
+TEST(MmapArrayTest, CreateZeroed) {
+  auto array_or = CreateMmapArray<Stats>(1000);
+  ASSERT_TRUE(IsOk(array_or));
+  const auto span = GetSpan(GetValue(array_or));
+  ASSERT_EQ(1000, GetSize(span));
+  for (const Stats* s = GetBase(span); s != GetLimit(span); ++s) {
+    EXPECT_EQ(0, s->packets);
+  }
+}
+
+TEST(MmapArrayTest, SharedWithSyscalls) {
+  auto array_or = CreateMmapArray<Stats>(16);
+  ASSERT_TRUE(IsOk(array_or));
+  auto& array = GetValue(array_or);
+  auto map_or = OpenMap<uint32_t, Stats>(GetFileDescriptor(array));
+  ASSERT_TRUE(IsOk(map_or));
+  auto& map = GetValue(map_or);
+
+  // Writes through the span are visible to map lookups...
+  GetBase(GetSpan(array))[3] = {5, 500};
+  EXPECT_EQ(500, GetValue(map.Lookup(3)).bytes);
+
+  // ...and map updates are visible through the span.
+  ASSERT_TRUE(IsOk(map.Update(15, {7, 700})));
+  EXPECT_EQ(7, GetBase(GetSpan(array))[15].packets);
+}
+
+TEST(MmapArrayTest, OpenOutlivesOwner) {
+  MmapArray<Stats> view;
+  {
+    auto array_or = CreateMmapArray<Stats>(4);
+    ASSERT_TRUE(IsOk(array_or));
+    GetBase(GetSpan(GetValue(array_or)))[1] = {1, 2};
+    auto view_or = OpenMmapArray<Stats>(GetFileDescriptor(GetValue(array_or)));
+    ASSERT_TRUE(IsOk(view_or));
+    view = std::move(GetValue(view_or));
+  }
+  EXPECT_EQ(2, GetBase(GetSpan(view))[1].bytes);
+}
+
+TEST(MmapArrayTest, OpenRejectsOtherMaps) {
+  auto map_or = CreateMap<uint32_t, Stats>(BPF_MAP_TYPE_ARRAY, 4);
+  ASSERT_TRUE(IsOk(map_or));
+  const auto fd = GetFileDescriptor(GetValue(map_or));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(OpenMmapArray<Stats>(fd)), EINVAL));
+}
@@ -0,0 +1,198 @@
+#ifndef LIB_BPF_PERCPU_MAP_H_
+#define LIB_BPF_PERCPU_MAP_H_
+
+#include <linux/bpf.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "lib/base/invariant.h"
+#include "lib/base/span.h"
+#include "lib/bpf/cpus.h"
+#include "lib/bpf/map.h"
+#include "lib/bpf/reduce.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/unique_file_descriptor.h"
+
+namespace bpf {
+
+// Typed view of a per-cpu bpf map (BPF_MAP_TYPE_PERCPU_ARRAY, PERCPU_HASH,
+// LRU_PERCPU_HASH) with keys of type K and values of type V, owning the map
+// file descriptor.
+//
+// The kernel keeps one copy of V per possible CPU. Lookup(), LookupBatch() and
+// LookupAll() return the sum of all copies, reduced with SumPerCpuValues(), so
+// V must be made of uint64_t counters (see IsSummable). LookupPerCpu() and
+// UpdatePerCpu() give access to the individual copies.
+//
+// Batched reads go through a scratch buffer of num_cpus values per key owned by
+// the map, so a PerCpuMap must not be read from several threads at once.
+//
+// Example usage:
+//
+// struct Counters { uint64_t packets; uint64_t bytes; };
+// ASSIGN_OR_RETURN(auto counters, OpenPerCpuMap<FlowKey, Counters>(fd));
+// std::vector<FlowKey> flows;
+// std::vector<Counters> totals;
+// RETURN_IF_ERROR(counters.LookupAll(&flows, &totals));
+//
+template <typename K, typename V>
+class PerCpuMap {
+ public:
+  static_assert(std::is_trivially_copyable_v<K>, "keys are copied as bytes");
+  static_assert(IsSummable<V>, "V must be made of uint64_t counters");
+
+  using Cursor = MapCursor<K>;
+
+  PerCpuMap() = default;
+
+  // Take ownership of 'fd', which must refer to a per-cpu map matching K and
+  // V, holding 'num_cpus' copies of each value. Prefer CreatePerCpuMap() or
+  // OpenPerCpuMap() which check this.
+  PerCpuMap(posix::UniqueFileDescriptor fd, const size_t num_cpus)
+      : fd_(std::move(fd)), num_cpus_(num_cpus) {}
+
+  // Default move constructor.
+  PerCpuMap(PerCpuMap&&) = default;
+
+  // Default move assignment operator.
+  PerCpuMap& operator=(PerCpuMap&&) = default;
+
+  // Read the copy of each CPU stored under 'key' into 'per_cpu', which must
+  // hold GetNumCpus() values.
+  error::Status LookupPerCpu(const K& key, const base::Span<V> per_cpu) const {
+    INVARIANT_EQ(num_cpus_, GetSize(per_cpu));
+    return impl::LookupElement(GetValue(fd_), &key, GetBase(per_cpu));
+  }
+
+  // Return the sum across CPUs of the values stored under 'key'.
+  error::StatusOr<V> Lookup(const K& key) const {
+    EnsureScratch(1);
+    const auto per_cpu = base::MakeSpan(scratch_.data(), num_cpus_);
+    RETURN_IF_ERROR(LookupPerCpu(key, per_cpu));
+    V sum;
+    SumPerCpuValues<V>(per_cpu, num_cpus_, base::MakeSpan(&sum, 1));
+    return sum;
+  }
+
+  // Store the copy of each CPU in 'per_cpu' under 'key'.
+  error::Status UpdatePerCpu(const K& key, const base::Span<const V> per_cpu,
+                             const uint64_t flags = BPF_ANY) {
+    INVARIANT_EQ(num_cpus_, GetSize(per_cpu));
+    return impl::UpdateElement(GetValue(fd_), &key, GetBase(per_cpu), flags);
+  }
+
+  // Store 'value' under 'key' on every CPU, typically to reset counters.
+  error::Status UpdateAll(const K& key, const V& value,
+                          const uint64_t flags = BPF_ANY) {
+    std::vector<V> per_cpu(num_cpus_, value);
+    return UpdatePerCpu(key, base::MakeSpan(per_cpu), flags);
+  }
+
+  // Remove 'key' from the map.
+  error::Status Delete(const K& key) {
+    return impl::DeleteElement(GetValue(fd_), &key);
+  }
+
+  // Read the next batch of up to GetSize('keys') keys at 'cursor' into 'keys'
+  // and the sum across CPUs of their values into 'sums', and advance
+  // 'cursor'. Same contract as BpfMap::LookupBatch().
+  error::StatusOr<size_t> LookupBatch(Cursor* const cursor,
+                                      const base::Span<K> keys,
+                                      const base::Span<V> sums) const {
+    INVARIANT_EQ(GetSize(keys), GetSize(sums));
+    EnsureScratch(GetSize(keys));
+    ASSIGN_OR_RETURN(
+        const size_t count,
+        impl::LookupBatch(GetValue(fd_), GetState(cursor), GetToken(cursor),
+                          GetBase(keys), sizeof(K), scratch_.data(),
+                          sizeof(V) * num_cpus_, GetSize(keys),
+                          &batch_support_));
+    SumPerCpuValues<V>(base::MakeSpan(scratch_.data(), count * num_cpus_),
+                       num_cpus_, base::MakeSpan(GetBase(sums), count));
+    return count;
+  }
+
+  // Read all keys of the map and the sum across CPUs of their values,
+  // 'batch_size' keys per syscall. Reuses the capacity of 'keys' and 'sums',
+  // so polling with the same vectors does not allocate in steady state.
+  error::Status LookupAll(std::vector<K>* const keys,
+                          std::vector<V>* const sums,
+                          size_t batch_size = 4096) const {
+    keys->clear();
+    sums->clear();
+    Cursor cursor;
+    while (!IsDone(cursor)) {
+      const size_t offset = keys->size();
+      keys->resize(offset + batch_size);
+      sums->resize(offset + batch_size);
+      auto count_or = LookupBatch(
+          &cursor, base::MakeSpan(keys->data() + offset, batch_size),
+          base::MakeSpan(sums->data() + offset, batch_size));
+      if (posix::IsErrno(GetStatus(count_or), ENOSPC)) {
+        batch_size *= 2;  // A hash bucket larger than the batch.
+        count_or = size_t{0};
+      }
+      RETURN_IF_ERROR(GetStatus(count_or));
+      keys->resize(offset + GetValue(count_or));
+      sums->resize(offset + GetValue(count_or));
+    }
+    return error::kOkStatus;
+  }
+
+ private:
+  // Return the file descriptor of 'map', still owned by 'map'.
+  friend posix::FileDescriptor GetFileDescriptor(const PerCpuMap& map) {
+    return GetValue(map.fd_);
+  }
+
+  // Return the number of copies the kernel keeps of each value.
+  friend size_t GetNumCpus(const PerCpuMap& map) { return map.num_cpus_; }
+
+  // Grow the scratch buffer to hold the per-cpu values of 'count' keys.
+  void EnsureScratch(const size_t count) const {
+    if (scratch_.size() < count * num_cpus_) {
+      scratch_.resize(count * num_cpus_);
+    }
+  }
+
+  posix::UniqueFileDescriptor fd_;
+  size_t num_cpus_ = 0;
+
+  // Raw per-cpu values as read from the kernel, before reduction.
+  mutable std::vector<V> scratch_;
+
+  mutable impl::BatchSupport batch_support_;
+};
+
+// Create a new per-cpu map of 'type' keyed by K and holding V.
+template <typename K, typename V>
+error::StatusOr<PerCpuMap<K, V>> CreatePerCpuMap(const bpf_map_type type,
+                                                 const uint32_t max_entries,
+                                                 const uint32_t map_flags = 0) {
+  ASSIGN_OR_RETURN(const int num_cpus, GetPossibleCpuCount());
+  ASSIGN_OR_RETURN(auto fd, impl::CreateMap(type, sizeof(K), sizeof(V),
+                                            max_entries, map_flags));
+  return PerCpuMap<K, V>(std::move(fd), num_cpus);
+}
+
+// Open a typed view of the per-cpu map behind 'fd', which stays owned by the
+// caller. Fails with EINVAL if K or V do not match the map's key and value
+// size.
+template <typename K, typename V>
+error::StatusOr<PerCpuMap<K, V>> OpenPerCpuMap(const posix::FileDescriptor fd) {
+  ASSIGN_OR_RETURN(const auto info, impl::GetMapInfo(fd));
+  if (info.key_size != sizeof(K) || info.value_size != sizeof(V)) {
+    return error::Status(posix::MakeCodeFromErrno(EINVAL),
+                         "map key or value size mismatch");
+  }
+  ASSIGN_OR_RETURN(const int num_cpus, GetPossibleCpuCount());
+  ASSIGN_OR_RETURN(auto dup, impl::DuplicateMap(fd));
+  return PerCpuMap<K, V>(std::move(dup), num_cpus);
+}
+
+}  // namespace bpf
+
+#endif  // LIB_BPF_PERCPU_MAP_H_
@@ -0,0 +1,73 @@
+#include "lib/bpf/percpu_map.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace bpf;
+
+// These tests create real maps and need CAP_BPF (or root).
+
+struct Counters {
+  uint64_t packets;
+  uint64_t bytes;
+};
+
+TEST(PerCpuMapTest, LookupSums) {
+  auto map_or = CreatePerCpuMap<uint32_t, Counters>(BPF_MAP_TYPE_PERCPU_HASH, 4);
+  ASSERT_TRUE(IsOk(map_or));
+  auto& map = GetValue(map_or);
+  const size_t num_cpus = GetNumCpus(map);
+  std::vector<Counters> per_cpu(num_cpus);
+  for (size_t c = 0; c < num_cpus; ++c) {
+    per_cpu[c] = {c + 1, 100 * (c + 1)};
+  }
+  ASSERT_TRUE(IsOk(map.UpdatePerCpu(7, base::MakeSpan(per_cpu))));
+  const auto sum = map.Lookup(7);
+  ASSERT_TRUE(IsOk(sum));
+  EXPECT_EQ(num_cpus * (num_cpus + 1) / 2, GetValue(sum).packets);
+  EXPECT_EQ(100 * num_cpus * (num_cpus + 1) / 2, GetValue(sum).bytes);
+
+  std::vector<Counters> read(num_cpus);
+  ASSERT_TRUE(IsOk(map.LookupPerCpu(7, base::MakeSpan(read))));
+  EXPECT_EQ(per_cpu.back().bytes, read.back().bytes);
+}
+
+TEST(PerCpuMapTest, UpdateAllResets) {
+  auto map_or =
+      CreatePerCpuMap<uint32_t, Counters>(BPF_MAP_TYPE_PERCPU_ARRAY, 4);
+  ASSERT_TRUE(IsOk(map_or));
+  auto& map = GetValue(map_or);
+  ASSERT_TRUE(IsOk(map.UpdateAll(1, {3, 4})));
+  EXPECT_EQ(3 * GetNumCpus(map), GetValue(map.Lookup(1)).packets);
+  ASSERT_TRUE(IsOk(map.UpdateAll(1, {0, 0})));
+  EXPECT_EQ(0, GetValue(map.Lookup(1)).bytes);
+}
+
+TEST(PerCpuMapTest, LookupAll) {
+  constexpr uint32_t kEntries = 1000;
+  auto map_or =
+      CreatePerCpuMap<uint32_t, Counters>(BPF_MAP_TYPE_PERCPU_HASH, kEntries);
+  ASSERT_TRUE(IsOk(map_or));
+  auto& map = GetValue(map_or);
+  for (uint32_t k = 0; k < kEntries; ++k) {
+    ASSERT_TRUE(IsOk(map.UpdateAll(k, {k, 2 * k})));
+  }
+  std::vector<uint32_t> keys;
+  std::vector<Counters> sums;
+  ASSERT_TRUE(IsOk(map.LookupAll(&keys, &sums, 100)));
+  ASSERT_EQ(kEntries, keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(keys[i] * GetNumCpus(map), sums[i].packets);
+    EXPECT_EQ(2 * keys[i] * GetNumCpus(map), sums[i].bytes);
+  }
+}
+
+TEST(PerCpuMapTest, OpenChecksSizes) {
+  auto map_or =
+      CreatePerCpuMap<uint32_t, Counters>(BPF_MAP_TYPE_PERCPU_ARRAY, 4);
+  ASSERT_TRUE(IsOk(map_or));
+  const auto fd = GetFileDescriptor(GetValue(map_or));
+  EXPECT_TRUE(IsOk(OpenPerCpuMap<uint32_t, Counters>(fd)));
+  EXPECT_TRUE(IsError(OpenPerCpuMap<uint32_t, uint64_t>(fd)));
+}
@@ -0,0 +1,89 @@
+#ifndef LIB_BPF_REDIRECT_MAP_H_
+#define LIB_BPF_REDIRECT_MAP_H_
+
+#include <linux/bpf.h>
+
+#include <cerrno>
+#include <cstdint>
+
+#include "lib/bpf/cpus.h"
+#include "lib/bpf/map.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/errno.h"
+
+namespace bpf {
+
+// Map type and expected attach types newer than the oldest uapi headers we
+// build against. Values are ABI and never change.
+constexpr bpf_map_type kMapTypeDevMapHash =
+    static_cast<bpf_map_type>(25);  // linux 5.4
+constexpr uint32_t kAttachXdpDevMap = 33;  // linux 5.8
+constexpr uint32_t kAttachXdpCpuMap = 35;  // linux 5.9
+
+// Value of the 'prog' field of entries without a second-stage program.
+constexpr int32_t kNoProgram = -1;
+
+// Entry of a BPF_MAP_TYPE_DEVMAP or DEVMAP_HASH map. Packets redirected to it
+// are queued per device and transmitted in bulk at the end of the driver's
+// poll, rather than one at a time.
+//
+// 'prog' is the fd of a program to run on the packets before they go out
+// (linux 5.8), loaded with expected attach type kAttachXdpDevMap, e.g. from
+// an "xdp_devmap" section by XdpLoader, or kNoProgram. Lookups return its id
+// instead, 0 for none.
+struct DevMapEntry {
+  uint32_t ifindex;
+  int32_t prog;
+};
+
+// Entry of a BPF_MAP_TYPE_CPUMAP map, keyed by CPU. Packets redirected to it
+// are queued, up to 'queue_size' of them, for a kernel thread on that CPU
+// which builds their skbs and hands them to the stack in bulk.
+//
+// 'prog' is the fd of a program to run on the packets on that CPU first,
+// loaded with expected attach type kAttachXdpCpuMap, e.g. from an
+// "xdp_cpumap" section, or kNoProgram. Lookups return its id instead.
+//
+// Needs linux 5.9, even without programs: older kernels only take the
+// queue size as value, and reject CPUMAP maps of this entry.
+struct CpuMapEntry {
+  uint32_t queue_size;
+  int32_t prog;
+};
+
+using DevMap = BpfMap<uint32_t, DevMapEntry>;
+using CpuMap = BpfMap<uint32_t, CpuMapEntry>;
+
+// Create a BPF_MAP_TYPE_DEVMAP_HASH map (linux 5.4) of up to 'max_entries'
+// devices under any keys, e.g. their ifindex however large.
+inline error::StatusOr<DevMap> CreateDevMapHash(const uint32_t max_entries) {
+  return CreateMap<uint32_t, DevMapEntry>(kMapTypeDevMapHash, max_entries);
+}
+
+// Create a BPF_MAP_TYPE_DEVMAP map of devices under keys 0 to
+// 'max_entries' - 1.
+inline error::StatusOr<DevMap> CreateDevMap(const uint32_t max_entries) {
+  return CreateMap<uint32_t, DevMapEntry>(BPF_MAP_TYPE_DEVMAP, max_entries);
+}
+
+// Create a BPF_MAP_TYPE_CPUMAP map with a slot per possible CPU, all empty:
+// CPUs only get a kernel thread once an entry is stored under them. Fails
+// with ENOTSUP before linux 5.9, see CpuMapEntry.
+inline error::StatusOr<CpuMap> CreateCpuMap() {
+  ASSIGN_OR_RETURN(const int num_cpus, GetPossibleCpuCount());
+  auto map_or = CreateMap<uint32_t, CpuMapEntry>(BPF_MAP_TYPE_CPUMAP, num_cpus);
+  // Tell kernels without programs on CPUMAP entries by the queue size only
+  // map they still create.
+  if (posix::IsErrno(GetStatus(map_or), EINVAL) &&
+      IsOk(impl::CreateMap(BPF_MAP_TYPE_CPUMAP, sizeof(uint32_t),
+                           sizeof(uint32_t), num_cpus, 0))) {
+    return error::Status(posix::MakeCodeFromErrno(ENOTSUP),
+                         "CPUMAP entries with programs need linux 5.9");
+  }
+  return map_or;
+}
+
+}  // namespace bpf
+
+#endif  // LIB_BPF_REDIRECT_MAP_H_
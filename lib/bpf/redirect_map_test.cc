@@ -0,0 +1,161 @@
+#include "lib/bpf/redirect_map.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/bpf/syscall.h"
+#include "lib/bpf/test_run.h"
+
+using namespace bpf;
+
+// These tests create real maps and need CAP_BPF (or root).
+
+namespace {
+
+// The loopback device, always there to redirect to.
+constexpr uint32_t kLoopback = 1;
+
+// Load a program made of 'insns' with expected attach type 'attach_type'.
+// Returns its fd, or the error.
+error::StatusOr<posix::UniqueFileDescriptor> LoadXdpProg(
+    const std::vector<bpf_insn>& insns, const uint32_t attach_type) {
+  static const char license[] = "GPL";
+  auto attr = MakeAttr();
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = ToAttrPointer(insns.data());
+  attr.insn_cnt = insns.size();
+  attr.license = ToAttrPointer(license);
+  attr.expected_attach_type = attach_type;
+  ASSIGN_OR_RETURN(const int fd, Bpf(BPF_PROG_LOAD, &attr));
+  return posix::UniqueFileDescriptor(posix::FileDescriptor(fd));
+}
+
+// A program returning XDP_PASS.
+std::vector<bpf_insn> MakePassProg() {
+  std::vector<bpf_insn> insns(2);
+  insns[0].code = BPF_ALU64 | BPF_MOV | BPF_K;  // r0 = XDP_PASS
+  insns[0].dst_reg = BPF_REG_0;
+  insns[0].imm = XDP_PASS;
+  insns[1].code = BPF_JMP | BPF_EXIT;
+  return insns;
+}
+
+// A program redirecting every packet to entry 'key' of 'map_fd'.
+std::vector<bpf_insn> MakeRedirectProg(const posix::FileDescriptor map_fd,
+                                       const uint32_t key) {
+  std::vector<bpf_insn> insns(6);
+  insns[0].code = BPF_LD | BPF_DW | BPF_IMM;  // r1 = map_fd (2 insns)
+  insns[0].dst_reg = BPF_REG_1;
+  insns[0].src_reg = BPF_PSEUDO_MAP_FD;
+  insns[0].imm = GetValue(map_fd);
+  insns[2].code = BPF_ALU64 | BPF_MOV | BPF_K;  // r2 = key
+  insns[2].dst_reg = BPF_REG_2;
+  insns[2].imm = key;
+  insns[3].code = BPF_ALU64 | BPF_MOV | BPF_K;  // r3 = 0
+  insns[3].dst_reg = BPF_REG_3;
+  insns[4].code = BPF_JMP | BPF_CALL;  // r0 = bpf_redirect_map(r1, r2, r3)
+  insns[4].imm = BPF_FUNC_redirect_map;
+  insns[5].code = BPF_JMP | BPF_EXIT;
+  return insns;
+}
+
+// Run 'prog' once on a dummy packet. Returns its verdict.
+error::StatusOr<uint32_t> RunProg(const posix::UniqueFileDescriptor& prog) {
+  const std::vector<uint8_t> packet(64);
+  ASSIGN_OR_RETURN(const auto result,
+                   TestRun(GetValue(prog), base::MakeSpan(packet)));
+  return result.retval;
+}
+
+}  // namespace
+
+TEST(RedirectMapTest, DevMapHashTakesAnyKey) {
+  auto map_or = CreateDevMapHash(4);
+  ASSERT_TRUE(IsOk(map_or));
+  auto& map = GetValue(map_or);
+  EXPECT_TRUE(IsOk(map.Update(1 << 30, {kLoopback, kNoProgram})));
+  const auto entry_or = map.Lookup(1 << 30);
+  ASSERT_TRUE(IsOk(entry_or));
+  EXPECT_EQ(kLoopback, GetValue(entry_or).ifindex);
+  EXPECT_EQ(0, GetValue(entry_or).prog);
+
+  // Keys are bounded by entries, not values.
+  EXPECT_TRUE(IsOk(map.Update(1, {kLoopback, kNoProgram})));
+  EXPECT_TRUE(IsOk(map.Update(2, {kLoopback, kNoProgram})));
+  EXPECT_TRUE(IsOk(map.Update(3, {kLoopback, kNoProgram})));
+  EXPECT_FALSE(IsOk(map.Update(4, {kLoopback, kNoProgram})));
+  EXPECT_TRUE(IsOk(map.Delete(1 << 30)));
+}
+
+TEST(RedirectMapTest, DevMapRejectsMissingDevices) {
+  auto map_or = CreateDevMap(4);
+  ASSERT_TRUE(IsOk(map_or));
+  EXPECT_FALSE(IsOk(GetValue(map_or).Update(0, {0x7fffffff, kNoProgram})));
+  EXPECT_TRUE(IsOk(GetValue(map_or).Update(0, {kLoopback, kNoProgram})));
+}
+
+TEST(RedirectMapTest, DevMapRunsSecondStagePrograms) {
+  auto map_or = CreateDevMapHash(4);
+  ASSERT_TRUE(IsOk(map_or));
+  auto& map = GetValue(map_or);
+
+  // Only programs loaded for devmap entries are accepted.
+  auto plain_or = LoadXdpProg(MakePassProg(), 0);
+  ASSERT_TRUE(IsOk(plain_or));
+  EXPECT_FALSE(IsOk(map.Update(
+      7, {kLoopback, GetValue(GetValue(GetValue(plain_or)))})));
+
+  auto prog_or = LoadXdpProg(MakePassProg(), kAttachXdpDevMap);
+  ASSERT_TRUE(IsOk(prog_or)) << GetText(GetStatus(prog_or));
+  ASSERT_TRUE(IsOk(
+      map.Update(7, {kLoopback, GetValue(GetValue(GetValue(prog_or)))})));
+  const auto entry_or = map.Lookup(7);
+  ASSERT_TRUE(IsOk(entry_or));
+  EXPECT_NE(0, GetValue(entry_or).prog);  // Its id.
+}
+
+TEST(RedirectMapTest, CpuMapQueues) {
+  auto map_or = CreateCpuMap();
+  ASSERT_TRUE(IsOk(map_or));
+  auto& map = GetValue(map_or);
+  ASSERT_TRUE(IsOk(map.Update(0, {192, kNoProgram})));
+  auto entry_or = map.Lookup(0);
+  ASSERT_TRUE(IsOk(entry_or));
+  EXPECT_EQ(192, GetValue(entry_or).queue_size);
+  EXPECT_EQ(0, GetValue(entry_or).prog);
+
+  auto prog_or = LoadXdpProg(MakePassProg(), kAttachXdpCpuMap);
+  ASSERT_TRUE(IsOk(prog_or)) << GetText(GetStatus(prog_or));
+  ASSERT_TRUE(
+      IsOk(map.Update(0, {64, GetValue(GetValue(GetValue(prog_or)))})));
+  entry_or = map.Lookup(0);
+  ASSERT_TRUE(IsOk(entry_or));
+  EXPECT_EQ(64, GetValue(entry_or).queue_size);
+  EXPECT_NE(0, GetValue(entry_or).prog);
+  EXPECT_TRUE(IsOk(map.Delete(0)));
+}
+
+TEST(RedirectMapTest, ProgramsRedirectToEntries) {
+  auto dev_map_or = CreateDevMapHash(4);
+  ASSERT_TRUE(IsOk(dev_map_or));
+  auto& dev_map = GetValue(dev_map_or);
+  auto cpu_map_or = CreateCpuMap();
+  ASSERT_TRUE(IsOk(cpu_map_or));
+  auto& cpu_map = GetValue(cpu_map_or);
+
+  auto to_dev_or = LoadXdpProg(
+      MakeRedirectProg(GetFileDescriptor(dev_map), 1000), 0);
+  ASSERT_TRUE(IsOk(to_dev_or));
+  auto to_cpu_or =
+      LoadXdpProg(MakeRedirectProg(GetFileDescriptor(cpu_map), 0), 0);
+  ASSERT_TRUE(IsOk(to_cpu_or));
+
+  // Without an entry, the redirect fails.
+  EXPECT_EQ(XDP_ABORTED, GetValue(RunProg(GetValue(to_dev_or))));
+  EXPECT_EQ(XDP_ABORTED, GetValue(RunProg(GetValue(to_cpu_or))));
+
+  ASSERT_TRUE(IsOk(dev_map.Update(1000, {kLoopback, kNoProgram})));
+  ASSERT_TRUE(IsOk(cpu_map.Update(0, {128, kNoProgram})));
+  EXPECT_EQ(XDP_REDIRECT, GetValue(RunProg(GetValue(to_dev_or))));
+  EXPECT_EQ(XDP_REDIRECT, GetValue(RunProg(GetValue(to_cpu_or))));
+}
@@ -0,0 +1,115 @@
+#ifndef LIB_BPF_REDUCE_H_
+#define LIB_BPF_REDUCE_H_
+
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <type_traits>
+
+#include "lib/base/invariant.h"
+#include "lib/base/span.h"
+
+namespace bpf {
+namespace impl {
+
+// Vector of 4 64 bit lanes. Lowered to AVX2 when enabled, to pairs of SSE2
+// operations otherwise, always to something better than scalar adds.
+typedef uint64_t U64x4 __attribute__((vector_size(32)));
+
+constexpr size_t kU64x4Lanes = sizeof(U64x4) / sizeof(uint64_t);
+
+// Sum 'num_cpus' consecutive copies of a value made of 'kWords' uint64_t
+// counters, starting at 'in', into 'out'.
+//
+// Summing copy by copy adds 'kWords' counters at a time, which wastes most of
+// a vector register for small values. Instead the copies are treated as one
+// flat array and added kChunk words at a time, kChunk being a multiple of both
+// 'kWords' and the vector width: word i of a chunk always belongs to counter
+// i % kWords, so after the loop each counter is the sum of its lanes.
+template <size_t kWords>
+inline void SumPerCpuValue(const uint64_t* const in, const size_t num_cpus,
+                           uint64_t* const out) {
+  constexpr size_t kChunk = std::lcm(kWords, 2 * kU64x4Lanes);
+  constexpr size_t kVectors = kChunk / kU64x4Lanes;
+  constexpr size_t kCpusPerChunk = kChunk / kWords;
+
+  U64x4 acc[kVectors] = {};
+  const size_t chunks = num_cpus / kCpusPerChunk;
+  const uint64_t* p = in;
+  for (size_t c = 0; c < chunks; ++c, p += kChunk) {
+    for (size_t v = 0; v < kVectors; ++v) {
+      U64x4 x;
+      std::memcpy(&x, p + v * kU64x4Lanes, sizeof(x));  // Unaligned load.
+      acc[v] += x;
+    }
+  }
+
+  uint64_t sum[kWords] = {};
+  for (size_t v = 0; v < kVectors; ++v) {
+    for (size_t l = 0; l < kU64x4Lanes; ++l) {
+      sum[(v * kU64x4Lanes + l) % kWords] += acc[v][l];
+    }
+  }
+  // Remaining copies that do not fill a chunk.
+  for (size_t c = chunks * kCpusPerChunk; c < num_cpus; ++c, p += kWords) {
+    for (size_t w = 0; w < kWords; ++w) {
+      sum[w] += p[w];
+    }
+  }
+  std::memcpy(out, sum, sizeof(sum));
+}
+
+// Chunks larger than this (odd, wide values) are summed word by word instead.
+constexpr size_t kMaxChunkWords = 64;
+
+template <size_t kWords>
+inline void SumPerCpuValueScalar(const uint64_t* const in,
+                                 const size_t num_cpus, uint64_t* const out) {
+  uint64_t sum[kWords] = {};
+  for (size_t c = 0; c < num_cpus; ++c) {
+    for (size_t w = 0; w < kWords; ++w) {
+      sum[w] += in[c * kWords + w];
+    }
+  }
+  std::memcpy(out, sum, sizeof(sum));
+}
+
+}  // namespace impl
+
+// Return true iff values of type V can be summed across CPUs by
+// SumPerCpuValues(): V must be made of uint64_t counters only, which also
+// means the kernel does not pad per-cpu copies of V.
+template <typename V>
+constexpr bool IsSummable =
+    std::is_trivially_copyable_v<V> && sizeof(V) % sizeof(uint64_t) == 0;
+
+// Reduce per-cpu map values into one value per key by summing every uint64_t
+// counter of V across CPUs. 'in' holds GetSize('out') groups of 'num_cpus'
+// consecutive copies of V, as returned by per-cpu map lookups.
+//
+// The result is written to the contiguous 'out', which callers typically keep
+// around between polls to stay cache hot.
+template <typename V>
+inline void SumPerCpuValues(const base::Span<const V> in, const size_t num_cpus,
+                            const base::Span<V> out) {
+  static_assert(IsSummable<V>, "V must be made of uint64_t counters");
+  constexpr size_t kWords = sizeof(V) / sizeof(uint64_t);
+  INVARIANT_EQ(GetSize(in), GetSize(out) * num_cpus);
+
+  const uint64_t* src = reinterpret_cast<const uint64_t*>(GetBase(in));
+  uint64_t* dst = reinterpret_cast<uint64_t*>(GetBase(out));
+  for (size_t i = 0; i < GetSize(out); ++i) {
+    if constexpr (std::lcm(kWords, 2 * impl::kU64x4Lanes) <=
+                  impl::kMaxChunkWords) {
+      impl::SumPerCpuValue<kWords>(src, num_cpus, dst);
+    } else {
+      impl::SumPerCpuValueScalar<kWords>(src, num_cpus, dst);
+    }
+    src += kWords * num_cpus;
+    dst += kWords;
+  }
+}
+
+}  // namespace bpf
+
+#endif  // LIB_BPF_REDUCE_H_
@@ -0,0 +1,57 @@
+#include "lib/bpf/reduce.h"
+
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace bpf;
+
+template <size_t kWords>
+struct Counters {
+  uint64_t words[kWords];
+};
+
+// Compare SumPerCpuValues() against a naive sum for values of 'kWords'
+// counters, across CPU counts that do and don't fill whole chunks.
+template <size_t kWords>
+void CheckSum() {
+  using V = Counters<kWords>;
+  std::mt19937_64 rng(kWords);
+  for (const size_t num_cpus : {1, 2, 3, 7, 8, 64, 127, 128, 255}) {
+    constexpr size_t kKeys = 5;
+    std::vector<V> in(kKeys * num_cpus);
+    for (auto& v : in) {
+      for (auto& w : v.words) {
+        w = rng();
+      }
+    }
+    std::vector<V> out(kKeys);
+    SumPerCpuValues<V>(base::MakeSpan(in), num_cpus, base::MakeSpan(out));
+    for (size_t k = 0; k < kKeys; ++k) {
+      for (size_t w = 0; w < kWords; ++w) {
+        uint64_t expected = 0;
+        for (size_t c = 0; c < num_cpus; ++c) {
+          expected += in[k * num_cpus + c].words[w];
+        }
+        ASSERT_EQ(expected, out[k].words[w])
+            << "words " << kWords << " cpus " << num_cpus << " key " << k;
+      }
+    }
+  }
+}
+
+TEST(ReduceTest, OneWord) { CheckSum<1>(); }
+TEST(ReduceTest, TwoWords) { CheckSum<2>(); }
+TEST(ReduceTest, ThreeWords) { CheckSum<3>(); }
+TEST(ReduceTest, FourWords) { CheckSum<4>(); }
+TEST(ReduceTest, FiveWords) { CheckSum<5>(); }
+TEST(ReduceTest, SixteenWords) { CheckSum<16>(); }
+TEST(ReduceTest, NineWordsScalar) { CheckSum<9>(); }
+
+TEST(ReduceTest, Empty) {
+  std::vector<uint64_t> in;
+  std::vector<uint64_t> out;
+  SumPerCpuValues<uint64_t>(base::Span<const uint64_t>(), 4, base::Span<uint64_t>());
+  EXPECT_TRUE(out.empty());
+}
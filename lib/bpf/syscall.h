@@ -0,0 +1,81 @@
+#ifndef LIB_BPF_SYSCALL_H_
+#define LIB_BPF_SYSCALL_H_
+
+#include <linux/bpf.h>
+#include <sys/syscall.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "lib/error/status_or.h"
+#include "lib/posix/syscall.h"
+
+namespace bpf {
+
+// bpf(2) commands newer than the oldest uapi headers we build against.
+// Values are ABI and never change.
+constexpr int kMapLookupBatch = 24;           // linux 5.6
+constexpr int kMapLookupAndDeleteBatch = 25;  // linux 5.6
+constexpr int kMapUpdateBatch = 26;           // linux 5.6
+constexpr int kMapDeleteBatch = 27;           // linux 5.6
+
+// The kernel leaks its internal ENOTSUPP (not EOPNOTSUPP) to userspace when a
+// map type does not implement a command.
+constexpr int kErrnoNotSupported = 524;
+
+// Layout of the 'batch' member of union bpf_attr (linux 5.6), spelled out so
+// batch commands do not depend on the uapi headers we happen to build
+// against. The kernel zero extends attributes shorter than its own.
+struct BatchAttr {
+  uint64_t in_batch;
+  uint64_t out_batch;
+  uint64_t keys;
+  uint64_t values;
+  uint32_t count;
+  uint32_t map_fd;
+  uint64_t elem_flags;
+  uint64_t flags;
+};
+
+// Layout of the BPF_PROG_LOAD member of union bpf_attr up to
+// 'expected_attach_type' (linux 4.17), spelled out for the same reason.
+struct ProgLoadAttr {
+  uint32_t prog_type;
+  uint32_t insn_cnt;
+  uint64_t insns;
+  uint64_t license;
+  uint32_t log_level;
+  uint32_t log_size;
+  uint64_t log_buf;
+  uint32_t kern_version;
+  uint32_t prog_flags;
+  char prog_name[16];
+  uint32_t prog_ifindex;
+  uint32_t expected_attach_type;
+};
+
+// Return a pointer as the 64 bit integer bpf(2) attributes expect.
+template <typename T>
+inline uint64_t ToAttrPointer(T* const ptr) {
+  return reinterpret_cast<uintptr_t>(ptr);
+}
+
+// Thin bpf(2) wrapper. Returns the non-negative result of the command (a new
+// file descriptor for commands that create objects) or the errno as status.
+template <typename AttrT>
+inline error::StatusOr<int> Bpf(const int cmd, AttrT* const attr) {
+  return posix::Syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+// Return a zero initialized bpf(2) attribute. The kernel rejects attributes
+// with garbage in unused fields.
+template <typename AttrT = union bpf_attr>
+inline AttrT MakeAttr() {
+  AttrT attr;
+  std::memset(&attr, 0, sizeof(attr));
+  return attr;
+}
+
+}  // namespace bpf
+
+#endif  // LIB_BPF_SYSCALL_H_
@@ -0,0 +1,58 @@
+#ifndef LIB_BPF_TEST_RUN_H_
+#define LIB_BPF_TEST_RUN_H_
+
+#include <linux/bpf.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "lib/base/span.h"
+#include "lib/bpf/syscall.h"
+#include "lib/error/return_if_error.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/file_descriptor.h"
+
+namespace bpf {
+
+// Room left past the end of test packets, for programs growing them.
+constexpr size_t kTestRunTailroom = 4096;
+
+struct TestRunResult {
+  // Return value of the program, e.g. its XDP verdict.
+  uint32_t retval = 0;
+  // Mean run time of the program, as measured by the kernel.
+  std::chrono::nanoseconds duration{0};
+  // The packet as the program left it.
+  std::vector<uint8_t> packet;
+};
+
+// Run program 'prog' 'repeat' times on a copy of 'packet' in the kernel with
+// BPF_PROG_TEST_RUN, without attaching it anywhere. Works on xdp, tc and
+// socket filter programs.
+//
+// Repeats run back to back on the same copy: changes the program makes to
+// the packet, e.g. decrementing the TTL, are seen by the next repeat. Run
+// once to look at what a program does, many times to time it.
+inline error::StatusOr<TestRunResult> TestRun(
+    const posix::FileDescriptor prog, const base::Span<const uint8_t> packet,
+    const uint32_t repeat = 1) {
+  TestRunResult result;
+  result.packet.resize(GetSize(packet) + kTestRunTailroom);
+  auto attr = MakeAttr();
+  attr.test.prog_fd = GetValue(prog);
+  attr.test.data_in = ToAttrPointer(GetBase(packet));
+  attr.test.data_size_in = GetSize(packet);
+  attr.test.data_out = ToAttrPointer(result.packet.data());
+  attr.test.data_size_out = result.packet.size();
+  attr.test.repeat = repeat;
+  RETURN_IF_ERROR(GetStatus(Bpf(BPF_PROG_TEST_RUN, &attr)));
+  result.retval = attr.test.retval;
+  result.duration = std::chrono::nanoseconds(attr.test.duration);
+  result.packet.resize(attr.test.data_size_out);
+  return result;
+}
+
+}  // namespace bpf
+
+#endif  // LIB_BPF_TEST_RUN_H_
@@ -0,0 +1,94 @@
+#include "lib/bpf/test_run.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/posix/errno.h"
+#include "lib/posix/unique_file_descriptor.h"
+
+using namespace bpf;
+
+// These tests load real programs and need CAP_BPF (or root).
+
+namespace {
+
+error::StatusOr<posix::UniqueFileDescriptor> LoadXdpProg(
+    const std::vector<bpf_insn>& insns) {
+  static const char license[] = "GPL";
+  auto attr = MakeAttr();
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = ToAttrPointer(insns.data());
+  attr.insn_cnt = insns.size();
+  attr.license = ToAttrPointer(license);
+  ASSIGN_OR_RETURN(const int fd, Bpf(BPF_PROG_LOAD, &attr));
+  return posix::UniqueFileDescriptor(posix::FileDescriptor(fd));
+}
+
+bpf_insn MakeInsn(const uint8_t code, const uint8_t dst, const uint8_t src,
+                  const int16_t off, const int32_t imm) {
+  bpf_insn insn = {};
+  insn.code = code;
+  insn.dst_reg = dst;
+  insn.src_reg = src;
+  insn.off = off;
+  insn.imm = imm;
+  return insn;
+}
+
+// A program incrementing the first byte of packets and returning XDP_TX.
+std::vector<bpf_insn> MakeIncrementProg() {
+  return {
+      // r2 = ctx->data, r3 = ctx->data_end
+      MakeInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, 0, 0),
+      MakeInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_1, 4, 0),
+      // r0 = XDP_TX
+      MakeInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_TX),
+      // if r2 + 1 > r3 goto exit
+      MakeInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+      MakeInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, 1),
+      MakeInsn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 3, 0),
+      // ++*(u8 *)r2
+      MakeInsn(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 0, 0),
+      MakeInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_5, 0, 0, 1),
+      MakeInsn(BPF_STX | BPF_MEM | BPF_B, BPF_REG_2, BPF_REG_5, 0, 0),
+      MakeInsn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+  };
+}
+
+}  // namespace
+
+TEST(TestRunTest, ReturnsVerdictAndPacket) {
+  auto prog_or = LoadXdpProg(MakeIncrementProg());
+  ASSERT_TRUE(IsOk(prog_or)) << GetText(GetStatus(prog_or));
+  const std::vector<uint8_t> packet = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                       13, 14};
+  const auto result_or = TestRun(GetValue(GetValue(prog_or)),
+                                 base::MakeSpan(packet));
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  const auto& result = GetValue(result_or);
+  EXPECT_EQ(XDP_TX, result.retval);
+  ASSERT_EQ(packet.size(), result.packet.size());
+  EXPECT_EQ(2, result.packet[0]);
+  EXPECT_TRUE(std::equal(packet.begin() + 1, packet.end(),
+                         result.packet.begin() + 1));
+}
+
+TEST(TestRunTest, TimesRepeats) {
+  auto prog_or = LoadXdpProg(MakeIncrementProg());
+  ASSERT_TRUE(IsOk(prog_or));
+  const std::vector<uint8_t> packet(64);
+  const auto result_or = TestRun(GetValue(GetValue(prog_or)),
+                                 base::MakeSpan(packet), 1000);
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  EXPECT_EQ(XDP_TX, GetValue(result_or).retval);
+  EXPECT_LT(0, GetValue(result_or).duration.count());
+}
+
+TEST(TestRunTest, FailsOnBadPrograms) {
+  const std::vector<uint8_t> packet(64);
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(TestRun(posix::FileDescriptor(-1), base::MakeSpan(packet))),
+      EBADF));
+}
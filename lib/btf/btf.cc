@@ -0,0 +1,315 @@
+#include "lib/btf/btf.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+#include "lib/posix/errno.h"
+
+namespace btf {
+namespace {
+
+constexpr uint16_t kMagic = 0xeb9f;
+constexpr uint8_t kVersion = 1;
+// Type chains longer than this are loops, as in the kernel.
+constexpr int kMaxChain = 32;
+
+error::Status MakeStatus(const int e, const std::string_view text) {
+  return error::Status(posix::MakeCodeFromErrno(e), text);
+}
+
+// struct btf_header.
+struct Header {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t flags;
+  uint32_t header_length;
+  uint32_t type_offset;
+  uint32_t type_length;
+  uint32_t string_offset;
+  uint32_t string_length;
+};
+
+// Reads consecutive 32 bit words of the type section.
+class WordReader {
+ public:
+  explicit WordReader(const std::string_view data) : data_(data) {}
+
+  bool empty() const { return offset_ == data_.size(); }
+
+  // Read the next word to 'word'. Returns false at the end of the section.
+  bool Read(uint32_t* const word) {
+    if (data_.size() - offset_ < sizeof(*word)) {
+      return false;
+    }
+    std::memcpy(word, data_.data() + offset_, sizeof(*word));
+    offset_ += sizeof(*word);
+    return true;
+  }
+
+  // Skip 'count' words. Returns false past the end of the section.
+  bool Skip(const uint64_t count) {
+    if ((data_.size() - offset_) / sizeof(uint32_t) < count) {
+      return false;
+    }
+    offset_ += count * sizeof(uint32_t);
+    return true;
+  }
+
+ private:
+  const std::string_view data_;
+  size_t offset_ = 0;
+};
+
+bool IsModifier(const Kind kind) {
+  return kind == Kind::kTypedef || kind == Kind::kVolatile ||
+         kind == Kind::kConst || kind == Kind::kRestrict ||
+         kind == Kind::kTypeTag;
+}
+
+}  // namespace
+
+const Type* Btf::GetType(const uint32_t id) const {
+  return id < types_.size() ? &types_[id] : nullptr;
+}
+
+uint32_t Btf::SkipModifiers(uint32_t id) const {
+  for (int i = 0; i < kMaxChain; ++i) {
+    const Type* const type = GetType(id);
+    if (type == nullptr || !IsModifier(type->kind)) {
+      return id;
+    }
+    id = type->type;
+  }
+  return id;
+}
+
+uint64_t Btf::GetSize(uint32_t id) const {
+  uint64_t elements = 1;
+  for (int i = 0; i < kMaxChain; ++i) {
+    const Type* const type = GetType(SkipModifiers(id));
+    if (type == nullptr) {
+      return 0;
+    }
+    switch (type->kind) {
+      case Kind::kInt:
+      case Kind::kStruct:
+      case Kind::kUnion:
+      case Kind::kEnum:
+      case Kind::kEnum64:
+      case Kind::kFloat:
+      case Kind::kDatasec:
+        return elements * type->size;
+      case Kind::kPtr:
+        return elements * sizeof(uint64_t);
+      case Kind::kArray:
+        elements *= type->elements;
+        id = type->type;
+        break;
+      default:
+        return 0;
+    }
+  }
+  return 0;
+}
+
+std::vector<uint32_t> Btf::FindTypes(const std::string_view name) const {
+  std::vector<uint32_t> ids;
+  const auto range = names_.equal_range(name);
+  for (auto it = range.first; it != range.second; ++it) {
+    ids.push_back(it->second);
+  }
+  return ids;
+}
+
+std::vector<uint32_t> Btf::FindFlavors(const std::string_view name) const {
+  std::vector<uint32_t> ids;
+  for (auto it = names_.lower_bound(name);
+       it != names_.end() && it->first.substr(0, name.size()) == name; ++it) {
+    const std::string_view suffix = it->first.substr(name.size());
+    if (suffix.empty() || suffix.rfind("___", 0) == 0) {
+      ids.push_back(it->second);
+    }
+  }
+  return ids;
+}
+
+std::string_view Btf::GetString(const uint32_t offset) const {
+  if (offset >= strings_.size()) {
+    return {};
+  }
+  const std::string_view string = strings_.substr(offset);
+  return string.substr(0, string.find('\0'));
+}
+
+error::StatusOr<Btf> ParseBtf(std::string data) {
+  Header header;
+  if (data.size() < sizeof(header)) {
+    return MakeStatus(EINVAL, "truncated BTF header");
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != kMagic) {
+    return MakeStatus(EINVAL, "not BTF, or not in host byte order");
+  }
+  if (header.version != kVersion) {
+    return MakeStatus(ENOTSUP, "unknown BTF version");
+  }
+  const uint64_t size = data.size();
+  const uint64_t type_begin = uint64_t{header.header_length} +
+                              header.type_offset;
+  const uint64_t string_begin = uint64_t{header.header_length} +
+                                header.string_offset;
+  if (header.header_length < sizeof(header) ||
+      type_begin + header.type_length > size ||
+      string_begin + header.string_length > size ||
+      type_begin % sizeof(uint32_t) != 0) {
+    return MakeStatus(EINVAL, "BTF sections out of bounds");
+  }
+
+  Btf btf;
+  btf.data_ = std::make_shared<const std::string>(std::move(data));
+  const std::string_view all(*btf.data_);
+  btf.strings_ = all.substr(string_begin, header.string_length);
+  if (!btf.strings_.empty() && btf.strings_.back() != '\0') {
+    return MakeStatus(EINVAL, "BTF strings not terminated");
+  }
+  btf.types_.emplace_back();  // void
+
+  WordReader reader(all.substr(type_begin, header.type_length));
+  while (!reader.empty()) {
+    uint32_t name;
+    uint32_t info;
+    uint32_t size_or_type;
+    if (!reader.Read(&name) || !reader.Read(&info) ||
+        !reader.Read(&size_or_type)) {
+      return MakeStatus(EINVAL, "truncated BTF type");
+    }
+    Type type;
+    type.kind = static_cast<Kind>(info >> 24 & 0x1f);
+    type.name = btf.GetString(name);
+    const uint32_t count = info & 0xffff;
+    const bool flag = info >> 31;
+
+    bool ok = true;
+    switch (type.kind) {
+      case Kind::kInt: {
+        uint32_t encoding = 0;
+        ok = reader.Read(&encoding);
+        type.size = size_or_type;
+        type.is_signed = encoding >> 24 & 1;
+        type.bit_offset = encoding >> 16 & 0xff;
+        type.bits = encoding & 0xff;
+        break;
+      }
+      case Kind::kArray: {
+        uint32_t index_type;
+        ok = reader.Read(&type.type) && reader.Read(&index_type) &&
+             reader.Read(&type.elements);
+        break;
+      }
+      case Kind::kStruct:
+      case Kind::kUnion:
+        type.size = size_or_type;
+        type.members.resize(count);
+        for (auto& member : type.members) {
+          uint32_t member_name;
+          uint32_t offset;
+          ok = reader.Read(&member_name) && reader.Read(&member.type) &&
+               reader.Read(&offset);
+          if (!ok) {
+            break;
+          }
+          member.name = btf.GetString(member_name);
+          member.bit_offset = flag ? offset & 0xffffff : offset;
+          member.bitfield_size = flag ? offset >> 24 : 0;
+        }
+        break;
+      case Kind::kEnum:
+        type.size = size_or_type;
+        type.is_signed = !flag;
+        type.enumerators.resize(count);
+        for (auto& enumerator : type.enumerators) {
+          uint32_t enumerator_name;
+          uint32_t value;
+          ok = reader.Read(&enumerator_name) && reader.Read(&value);
+          if (!ok) {
+            break;
+          }
+          enumerator.name = btf.GetString(enumerator_name);
+          enumerator.value = flag ? int64_t{value}
+                                  : int64_t{static_cast<int32_t>(value)};
+        }
+        break;
+      case Kind::kEnum64:
+        type.size = size_or_type;
+        type.is_signed = !flag;
+        type.enumerators.resize(count);
+        for (auto& enumerator : type.enumerators) {
+          uint32_t enumerator_name;
+          uint32_t low;
+          uint32_t high;
+          ok = reader.Read(&enumerator_name) && reader.Read(&low) &&
+               reader.Read(&high);
+          if (!ok) {
+            break;
+          }
+          enumerator.name = btf.GetString(enumerator_name);
+          enumerator.value =
+              static_cast<int64_t>(uint64_t{high} << 32 | low);
+        }
+        break;
+      case Kind::kFuncProto:
+        type.type = size_or_type;
+        ok = reader.Skip(2 * uint64_t{count});
+        break;
+      case Kind::kVar:
+        type.type = size_or_type;
+        ok = reader.Skip(1);
+        break;
+      case Kind::kDatasec:
+        type.size = size_or_type;
+        ok = reader.Skip(3 * uint64_t{count});
+        break;
+      case Kind::kDeclTag:
+        type.type = size_or_type;
+        ok = reader.Skip(1);
+        break;
+      case Kind::kFloat:
+        type.size = size_or_type;
+        break;
+      case Kind::kPtr:
+      case Kind::kFwd:
+      case Kind::kTypedef:
+      case Kind::kVolatile:
+      case Kind::kConst:
+      case Kind::kRestrict:
+      case Kind::kFunc:
+      case Kind::kTypeTag:
+        type.type = size_or_type;
+        break;
+      default:
+        return MakeStatus(ENOTSUP, "unknown BTF kind");
+    }
+    if (!ok) {
+      return MakeStatus(EINVAL, "truncated BTF type");
+    }
+    if (!type.name.empty()) {
+      btf.names_.emplace(type.name, btf.types_.size());
+    }
+    btf.types_.push_back(std::move(type));
+  }
+  return btf;
+}
+
+error::StatusOr<Btf> ReadBtfFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::ostringstream contents;
+  if (!(contents << file.rdbuf())) {
+    return MakeStatus(EIO, "cannot read BTF file");
+  }
+  return ParseBtf(contents.str());
+}
+
+}  // namespace btf
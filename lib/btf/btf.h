@@ -0,0 +1,119 @@
+#ifndef LIB_BTF_BTF_H_
+#define LIB_BTF_BTF_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lib/error/status_or.h"
+
+namespace btf {
+
+// BTF_KIND_*, from linux/btf.h: missing from the headers we build against.
+enum class Kind : uint8_t {
+  kVoid = 0,
+  kInt = 1,
+  kPtr = 2,
+  kArray = 3,
+  kStruct = 4,
+  kUnion = 5,
+  kEnum = 6,
+  kFwd = 7,
+  kTypedef = 8,
+  kVolatile = 9,
+  kConst = 10,
+  kRestrict = 11,
+  kFunc = 12,
+  kFuncProto = 13,
+  kVar = 14,
+  kDatasec = 15,
+  kFloat = 16,
+  kDeclTag = 17,
+  kTypeTag = 18,
+  kEnum64 = 19,
+};
+
+// A member of a struct or union.
+struct Member {
+  std::string_view name;
+  uint32_t type = 0;
+  uint32_t bit_offset = 0;
+  // Size in bits of a bitfield, 0 if the member is not one.
+  uint32_t bitfield_size = 0;
+};
+
+// An enumerator of an enum.
+struct Enumerator {
+  std::string_view name;
+  int64_t value = 0;
+};
+
+// A type. Fields not used by its kind are left empty.
+struct Type {
+  Kind kind = Kind::kVoid;
+  std::string_view name;
+  // Size in bytes of ints, floats, structs, unions, enums and data
+  // sections.
+  uint32_t size = 0;
+  // Type referred to by pointers, typedefs, modifiers, tags, functions,
+  // variables and function prototypes (the return type), and type of the
+  // elements of arrays.
+  uint32_t type = 0;
+  // Ints and enums: whether signed. Ints: the bits of 'size' holding the
+  // value.
+  bool is_signed = false;
+  uint32_t bit_offset = 0;
+  uint32_t bits = 0;
+  // Arrays: number of elements.
+  uint32_t elements = 0;
+  // Structs and unions.
+  std::vector<Member> members;
+  // Enums.
+  std::vector<Enumerator> enumerators;
+};
+
+// Type information, as found in the .BTF section of an eBPF object or in
+// /sys/kernel/btf/vmlinux. Type 0 is void, types are numbered from 1.
+class Btf {
+ public:
+  // Type 'id', nullptr if there is no such type.
+  const Type* GetType(uint32_t id) const;
+  // Number of types, void included: ids are below it.
+  uint32_t GetTypeCount() const { return types_.size(); }
+  // 'id', without its typedefs, modifiers (const, volatile, restrict) and
+  // type tags.
+  uint32_t SkipModifiers(uint32_t id) const;
+  // Size in bytes of values of type 'id', 0 if it has none (void,
+  // functions).
+  uint64_t GetSize(uint32_t id) const;
+  // Types named 'name', of any kind, in id order.
+  std::vector<uint32_t> FindTypes(std::string_view name) const;
+  // Types named 'name' or 'name___<suffix>', the "flavors" programs give
+  // the kernel types they describe to tell versions apart, in name order.
+  std::vector<uint32_t> FindFlavors(std::string_view name) const;
+  // The string at 'offset' of the string section, empty if out of bounds.
+  std::string_view GetString(uint32_t offset) const;
+
+ private:
+  friend error::StatusOr<Btf> ParseBtf(std::string data);
+
+  std::shared_ptr<const std::string> data_;
+  std::string_view strings_;
+  std::vector<Type> types_;
+  std::multimap<std::string_view, uint32_t> names_;
+};
+
+// Parse 'data', BTF in the byte order of the host. Fails with EINVAL if
+// malformed, and with ENOTSUP on kinds newer than those above.
+error::StatusOr<Btf> ParseBtf(std::string data);
+
+// Read and parse the BTF at 'path', e.g. /sys/kernel/btf/vmlinux. Fails
+// with EIO if it cannot be read.
+error::StatusOr<Btf> ReadBtfFile(const std::string& path);
+
+}  // namespace btf
+
+#endif  // LIB_BTF_BTF_H_
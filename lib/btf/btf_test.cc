@@ -0,0 +1,72 @@
+#include "lib/btf/btf.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/btf/btf_test_utils.h"
+#include "lib/posix/errno.h"
+
+namespace btf {
+namespace {
+
+TEST(ParseBtfTest, ParsesTypes) {
+  BtfBuilder builder;
+  const uint32_t u32 = builder.AddInt("u32", 4);
+  const uint32_t s64 = builder.AddInt("s64", 8, true);
+  const uint32_t array = builder.AddArray(u32, 3);
+  const uint32_t pid_t = builder.AddTypedef("pid_t", builder.AddConst(s64));
+  const uint32_t task = builder.AddStruct(
+      "task", 32,
+      {{"pid", pid_t, 0}, {"ids", array, 64}, {"flag", u32, 160, 1}});
+  const uint32_t flavor = builder.AddStruct("task___v2", 8, {{"pid", s64, 0}});
+  const uint32_t state =
+      builder.AddEnum("state", {{"RUNNING", 0}, {"DEAD", -1}});
+
+  const auto btf_or = ParseBtf(builder.Build());
+  ASSERT_TRUE(IsOk(btf_or)) << GetText(GetStatus(btf_or));
+  const Btf& btf = GetValue(btf_or);
+  EXPECT_EQ(state + 1, btf.GetTypeCount());
+  EXPECT_EQ(nullptr, btf.GetType(state + 1));
+
+  const Type* const type = btf.GetType(task);
+  ASSERT_NE(nullptr, type);
+  EXPECT_EQ(Kind::kStruct, type->kind);
+  EXPECT_EQ("task", type->name);
+  ASSERT_EQ(3, type->members.size());
+  EXPECT_EQ("ids", type->members[1].name);
+  EXPECT_EQ(64, type->members[1].bit_offset);
+  EXPECT_EQ(0, type->members[1].bitfield_size);
+  EXPECT_EQ(160, type->members[2].bit_offset);
+  EXPECT_EQ(1, type->members[2].bitfield_size);
+
+  EXPECT_EQ(s64, btf.SkipModifiers(pid_t));
+  EXPECT_TRUE(btf.GetType(s64)->is_signed);
+  EXPECT_EQ(8, btf.GetSize(pid_t));
+  EXPECT_EQ(12, btf.GetSize(array));
+  EXPECT_EQ(32, btf.GetSize(task));
+  EXPECT_EQ(-1, btf.GetType(state)->enumerators[1].value);
+
+  EXPECT_EQ(std::vector<uint32_t>{task}, btf.FindTypes("task"));
+  EXPECT_EQ((std::vector<uint32_t>{task, flavor}), btf.FindFlavors("task"));
+  EXPECT_TRUE(btf.FindFlavors("tas").empty());
+}
+
+TEST(ParseBtfTest, FailsOnMalformedBtf) {
+  BtfBuilder builder;
+  builder.AddStruct("task", 4, {{"pid", builder.AddInt("int", 4), 0}});
+  const std::string btf = builder.Build();
+
+  EXPECT_TRUE(posix::IsErrno(GetStatus(ParseBtf("")), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(ParseBtf(std::string(24, '\0'))),
+                             EINVAL));
+  EXPECT_TRUE(
+      posix::IsErrno(GetStatus(ParseBtf(btf.substr(0, btf.size() - 1))),
+                     EINVAL));
+  std::string truncated = btf;
+  truncated[12] -= 4;  // type section length
+  EXPECT_TRUE(posix::IsErrno(GetStatus(ParseBtf(truncated)), EINVAL));
+}
+
+}  // namespace
+}  // namespace btf
@@ -0,0 +1,197 @@
+#ifndef LIB_BTF_BTF_TEST_UTILS_H_
+#define LIB_BTF_BTF_TEST_UTILS_H_
+
+#include <elf.h>
+#include <linux/bpf.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Helpers for tests that need BTF, and objects carrying it, without a BPF
+// compiler.
+
+namespace btf {
+
+// Builds BTF, type by type. Add* return the id of the type added.
+class BtfBuilder {
+ public:
+  struct Field {
+    std::string_view name;
+    uint32_t type;
+    uint32_t bit_offset;
+    uint32_t bitfield_size = 0;
+  };
+
+  // Offset of 'string' in the string section, added if not there yet.
+  uint32_t AddString(const std::string_view string) {
+    if (string.empty()) {
+      return 0;
+    }
+    const std::string terminated = std::string(string) + '\0';
+    const size_t offset = strings_.find(terminated);
+    if (offset != std::string::npos &&
+        (offset == 0 || strings_[offset - 1] == '\0')) {
+      return offset;
+    }
+    strings_ += terminated;
+    return strings_.size() - terminated.size();
+  }
+
+  uint32_t AddInt(const std::string_view name, const uint32_t size,
+                  const bool is_signed = false) {
+    AddType(name, 1, 0, false, size);
+    words_.push_back((is_signed ? 1u << 24 : 0) | 8 * size);
+    return id_++;
+  }
+
+  uint32_t AddPtr(const uint32_t type) {
+    AddType({}, 2, 0, false, type);
+    return id_++;
+  }
+
+  uint32_t AddArray(const uint32_t type, const uint32_t elements) {
+    AddType({}, 3, 0, false, 0);
+    words_.insert(words_.end(), {type, type, elements});
+    return id_++;
+  }
+
+  // A struct, or a union. Members are bitfields if any of them is one.
+  uint32_t AddStruct(const std::string_view name, const uint32_t size,
+                     const std::vector<Field>& fields,
+                     const bool is_union = false) {
+    bool has_bitfields = false;
+    for (const auto& field : fields) {
+      has_bitfields = has_bitfields || field.bitfield_size != 0;
+    }
+    AddType(name, is_union ? 5 : 4, fields.size(), has_bitfields, size);
+    for (const auto& field : fields) {
+      words_.insert(words_.end(),
+                    {AddString(field.name), field.type,
+                     field.bitfield_size << 24 | field.bit_offset});
+    }
+    return id_++;
+  }
+
+  uint32_t AddEnum(
+      const std::string_view name,
+      const std::vector<std::pair<std::string_view, int32_t>>& values) {
+    AddType(name, 6, values.size(), false, sizeof(int32_t));
+    for (const auto& [value_name, value] : values) {
+      words_.insert(words_.end(),
+                    {AddString(value_name), static_cast<uint32_t>(value)});
+    }
+    return id_++;
+  }
+
+  uint32_t AddTypedef(const std::string_view name, const uint32_t type) {
+    AddType(name, 8, 0, false, type);
+    return id_++;
+  }
+
+  uint32_t AddConst(const uint32_t type) {
+    AddType({}, 10, 0, false, type);
+    return id_++;
+  }
+
+  // The BTF of the types added, with a struct btf_header.
+  std::string Build() const {
+    const uint32_t types = words_.size() * sizeof(uint32_t);
+    const uint32_t header[] = {0x0001eb9f, 24, 0, types, types,
+                               static_cast<uint32_t>(strings_.size())};
+    std::string btf(reinterpret_cast<const char*>(header), sizeof(header));
+    btf.append(reinterpret_cast<const char*>(words_.data()), types);
+    return btf + strings_;
+  }
+
+ private:
+  void AddType(const std::string_view name, const uint32_t kind,
+               const uint32_t count, const bool flag,
+               const uint32_t size_or_type) {
+    words_.insert(words_.end(),
+                  {AddString(name),
+                   (flag ? 1u << 31 : 0) | kind << 24 | count,
+                   size_or_type});
+  }
+
+  std::vector<uint32_t> words_;
+  std::string strings_ = std::string(1, '\0');
+  uint32_t id_ = 1;
+};
+
+// A CO-RE relocation record of .BTF.ext.
+struct CoreRelocation {
+  uint32_t insn_offset;
+  uint32_t type;
+  uint32_t access;  // offset in the strings of the BTF
+  uint32_t kind;
+};
+
+// A .BTF.ext section holding 'relocations' of section 'section' (an offset
+// in the strings of the BTF) only.
+inline std::string MakeBtfExt(const uint32_t section,
+                              const std::vector<CoreRelocation>& relocations) {
+  std::vector<uint32_t> words = {sizeof(CoreRelocation), section,
+                                 static_cast<uint32_t>(relocations.size())};
+  for (const auto& relocation : relocations) {
+    words.insert(words.end(), {relocation.insn_offset, relocation.type,
+                               relocation.access, relocation.kind});
+  }
+  const uint32_t size = words.size() * sizeof(uint32_t);
+  const uint32_t header[] = {0x0001eb9f, 32, 0, 0, 0, 0, 0, size};
+  std::string ext(reinterpret_cast<const char*>(header), sizeof(header));
+  return ext.append(reinterpret_cast<const char*>(words.data()), size);
+}
+
+inline std::string MakeCode(const std::vector<bpf_insn>& insns) {
+  return std::string(reinterpret_cast<const char*>(insns.data()),
+                     insns.size() * sizeof(bpf_insn));
+}
+
+// A relocatable ELF object of sections 'sections', by name.
+inline std::string MakeObject(
+    const std::vector<std::pair<std::string, std::string>>& sections) {
+  std::string names(1, '\0');
+  std::vector<Elf64_Shdr> headers(1);
+  std::string elf(sizeof(Elf64_Ehdr), '\0');
+  const auto add = [&](const std::string& name, const std::string& data,
+                       const uint32_t type) {
+    Elf64_Shdr header = {};
+    header.sh_name = names.size();
+    header.sh_type = type;
+    header.sh_offset = elf.size();
+    header.sh_size = data.size();
+    headers.push_back(header);
+    names += name + '\0';
+    elf += data;
+    elf.resize((elf.size() + 7) / 8 * 8);
+  };
+  for (const auto& [name, data] : sections) {
+    add(name, data, SHT_PROGBITS);
+  }
+  add(".shstrtab", names + ".shstrtab" + '\0', SHT_STRTAB);
+
+  Elf64_Ehdr header = {};
+  std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+  header.e_ident[EI_CLASS] = ELFCLASS64;
+  header.e_ident[EI_DATA] = ELFDATA2LSB;
+  header.e_ident[EI_VERSION] = EV_CURRENT;
+  header.e_type = ET_REL;
+  header.e_machine = 247;  // EM_BPF
+  header.e_version = EV_CURRENT;
+  header.e_ehsize = sizeof(header);
+  header.e_shoff = elf.size();
+  header.e_shentsize = sizeof(Elf64_Shdr);
+  header.e_shnum = headers.size();
+  header.e_shstrndx = headers.size() - 1;
+  std::memcpy(&elf[0], &header, sizeof(header));
+  return elf.append(reinterpret_cast<const char*>(headers.data()),
+                    headers.size() * sizeof(Elf64_Shdr));
+}
+
+}  // namespace btf
+
+#endif  // LIB_BTF_BTF_TEST_UTILS_H_
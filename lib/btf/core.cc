@@ -0,0 +1,712 @@
+#include "lib/btf/core.h"
+
+#include <elf.h>
+#include <linux/bpf.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+
+namespace btf {
+namespace {
+
+constexpr uint16_t kExtMagic = 0xeb9f;
+// Records of LLVM 9 stop before the kind: they are all field offsets.
+constexpr uint32_t kMinRecordSize = 3 * sizeof(uint32_t);
+// Helper the instructions of relocations which cannot be applied call,
+// 0xbad2310 ("bad relo") as in libbpf.
+constexpr int32_t kPoisonHelper = 0xbad2310;
+// Anonymous members nested deeper than this are not searched.
+constexpr int kMaxDepth = 32;
+
+error::Status MakeStatus(const int e, const std::string_view text) {
+  return error::Status(posix::MakeCodeFromErrno(e), text);
+}
+
+// Copy 'T' at 'offset' of 'data' to 'value'. Returns false if out of bounds.
+template <typename T>
+bool Read(const std::string_view data, const uint64_t offset, T* const value) {
+  if (offset > data.size() || data.size() - offset < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(value, data.data() + offset, sizeof(T));
+  return true;
+}
+
+struct Section {
+  std::string_view name;
+  uint64_t offset = 0;
+  std::string_view data;
+};
+
+error::StatusOr<std::vector<Section>> ParseSections(
+    const std::string_view elf) {
+  Elf64_Ehdr header;
+  if (!Read(elf, 0, &header) ||
+      std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0) {
+    return MakeStatus(EINVAL, "not an ELF object");
+  }
+  if (header.e_ident[EI_CLASS] != ELFCLASS64 ||
+      header.e_ident[EI_DATA] != ELFDATA2LSB ||
+      header.e_shentsize != sizeof(Elf64_Shdr)) {
+    return MakeStatus(EINVAL, "not a 64 bit little endian ELF object");
+  }
+  std::vector<Elf64_Shdr> headers(header.e_shnum);
+  for (size_t i = 0; i < headers.size(); ++i) {
+    if (!Read(elf, header.e_shoff + i * sizeof(Elf64_Shdr), &headers[i])) {
+      return MakeStatus(EINVAL, "truncated section headers");
+    }
+  }
+  if (header.e_shstrndx >= headers.size()) {
+    return MakeStatus(EINVAL, "no section names");
+  }
+
+  std::vector<Section> sections(headers.size());
+  for (size_t i = 0; i < headers.size(); ++i) {
+    const Elf64_Shdr& section = headers[i];
+    if (section.sh_type == SHT_NOBITS) {
+      continue;
+    }
+    if (section.sh_offset > elf.size() ||
+        elf.size() - section.sh_offset < section.sh_size) {
+      return MakeStatus(EINVAL, "section out of bounds");
+    }
+    sections[i].offset = section.sh_offset;
+    sections[i].data = elf.substr(section.sh_offset, section.sh_size);
+  }
+  const std::string_view names = sections[header.e_shstrndx].data;
+  for (size_t i = 0; i < headers.size(); ++i) {
+    if (headers[i].sh_name < names.size()) {
+      const std::string_view name = names.substr(headers[i].sh_name);
+      sections[i].name = name.substr(0, name.find('\0'));
+    }
+  }
+  return sections;
+}
+
+const Section* FindSection(const std::vector<Section>& sections,
+                           const std::string_view name) {
+  for (const auto& section : sections) {
+    if (section.name == name) {
+      return &section;
+    }
+  }
+  return nullptr;
+}
+
+// struct btf_ext_header, up to the CO-RE relocations.
+struct ExtHeader {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t flags;
+  uint32_t header_length;
+  uint32_t func_info_offset;
+  uint32_t func_info_length;
+  uint32_t line_info_offset;
+  uint32_t line_info_length;
+  uint32_t core_relocation_offset;
+  uint32_t core_relocation_length;
+};
+
+// The CO-RE relocations of .BTF.ext section 'ext', empty if none.
+error::StatusOr<std::string_view> GetCoreRelocations(
+    const std::string_view ext) {
+  ExtHeader header = {};
+  if (!Read(ext, 0, &header.magic) || header.magic != kExtMagic ||
+      !Read(ext, offsetof(ExtHeader, header_length), &header.header_length) ||
+      header.header_length > ext.size()) {
+    return MakeStatus(EINVAL, "malformed .BTF.ext header");
+  }
+  if (header.header_length < sizeof(header)) {
+    return std::string_view();  // Older than CO-RE.
+  }
+  Read(ext, 0, &header);
+  const std::string_view data = ext.substr(header.header_length);
+  if (header.core_relocation_offset > data.size() ||
+      data.size() - header.core_relocation_offset <
+          header.core_relocation_length) {
+    return MakeStatus(EINVAL, "CO-RE relocations out of bounds");
+  }
+  return data.substr(header.core_relocation_offset,
+                     header.core_relocation_length);
+}
+
+struct Relocation {
+  // Section of the instruction, and its offset in bytes there.
+  std::string_view section;
+  uint32_t insn_offset = 0;
+  // Root type of the access, in the BTF of the object.
+  uint32_t type = 0;
+  // Indices of the access, e.g. "0:1:2".
+  std::string_view access;
+  RelocationKind kind = RelocationKind::kFieldByteOffset;
+};
+
+error::StatusOr<std::vector<Relocation>> ParseRelocations(
+    const std::string_view data, const Btf& local) {
+  std::vector<Relocation> relocations;
+  if (data.empty()) {
+    return relocations;
+  }
+  uint32_t record_size;
+  if (!Read(data, 0, &record_size) || record_size < kMinRecordSize) {
+    return MakeStatus(EINVAL, "malformed CO-RE relocations");
+  }
+  uint64_t offset = sizeof(record_size);
+  while (offset < data.size()) {
+    uint32_t section;
+    uint32_t count;
+    if (!Read(data, offset, &section) ||
+        !Read(data, offset + sizeof(section), &count)) {
+      return MakeStatus(EINVAL, "truncated CO-RE relocations");
+    }
+    offset += sizeof(section) + sizeof(count);
+    for (uint32_t i = 0; i < count; ++i, offset += record_size) {
+      if (data.size() - std::min<uint64_t>(offset, data.size()) <
+          record_size) {
+        return MakeStatus(EINVAL, "truncated CO-RE relocations");
+      }
+      Relocation relocation;
+      relocation.section = local.GetString(section);
+      uint32_t access;
+      Read(data, offset, &relocation.insn_offset);
+      Read(data, offset + 4, &relocation.type);
+      Read(data, offset + 8, &access);
+      relocation.access = local.GetString(access);
+      if (record_size > kMinRecordSize) {
+        Read(data, offset + 12, &relocation.kind);
+      }
+      relocations.push_back(relocation);
+    }
+  }
+  return relocations;
+}
+
+error::StatusOr<std::vector<uint32_t>> ParseAccess(std::string_view access) {
+  std::vector<uint32_t> indices;
+  while (true) {
+    const size_t end = access.find(':');
+    const std::string_view digits = access.substr(0, end);
+    uint64_t index = 0;
+    for (const char digit : digits) {
+      if (digit < '0' || digit > '9' ||
+          (index = index * 10 + (digit - '0')) >
+              std::numeric_limits<uint32_t>::max()) {
+        return MakeStatus(EINVAL, "malformed CO-RE access");
+      }
+    }
+    if (digits.empty()) {
+      return MakeStatus(EINVAL, "malformed CO-RE access");
+    }
+    indices.push_back(index);
+    if (end == std::string_view::npos) {
+      return indices;
+    }
+    access.remove_prefix(end + 1);
+  }
+}
+
+// 'name' without its '___<suffix>' flavor.
+std::string_view GetEssentialName(const std::string_view name) {
+  return name.substr(0, name.find("___"));
+}
+
+bool IsComposite(const Type& type) {
+  return type.kind == Kind::kStruct || type.kind == Kind::kUnion;
+}
+
+bool IsEnum(const Type& type) {
+  return type.kind == Kind::kEnum || type.kind == Kind::kEnum64;
+}
+
+bool HaveSameKind(const Type& a, const Type& b) {
+  return a.kind == b.kind || (IsEnum(a) && IsEnum(b));
+}
+
+// A field an access leads to.
+struct Field {
+  uint32_t type = 0;
+  uint64_t bit_offset = 0;
+  uint32_t bitfield_size = 0;
+};
+
+// A step of an access past its root: an element of an array, or a named
+// member of a struct or union, wherever it is in the target.
+struct Step {
+  bool is_element = false;
+  uint32_t index = 0;
+  std::string_view name;
+};
+
+// Turn integers narrower than their size, the bitfields of BTF without
+// the kind flag, into bitfields.
+void NormalizeBitfield(const Btf& btf, Field* const field) {
+  const Type* const type = btf.GetType(btf.SkipModifiers(field->type));
+  if (field->bitfield_size == 0 && type != nullptr &&
+      type->kind == Kind::kInt && type->bits != 8 * type->size) {
+    field->bit_offset += type->bit_offset;
+    field->bitfield_size = type->bits;
+  }
+}
+
+// Follow 'indices' from 'root' in the BTF of the object, to 'field', and
+// record the steps to follow in the target.
+error::Status ResolveLocal(const Btf& btf, const uint32_t root,
+                           const std::vector<uint32_t>& indices,
+                           Field* const field, std::vector<Step>* const steps) {
+  field->type = root;
+  field->bit_offset = indices[0] * btf.GetSize(root) * 8;
+  for (size_t i = 1; i < indices.size(); ++i) {
+    const Type* const type = btf.GetType(btf.SkipModifiers(field->type));
+    if (type != nullptr && IsComposite(*type) &&
+        indices[i] < type->members.size()) {
+      const Member& member = type->members[indices[i]];
+      field->type = member.type;
+      field->bit_offset += member.bit_offset;
+      field->bitfield_size = member.bitfield_size;
+      if (!member.name.empty()) {
+        steps->push_back({false, 0, member.name});
+      }
+    } else if (type != nullptr && type->kind == Kind::kArray) {
+      field->type = type->type;
+      field->bit_offset += indices[i] * btf.GetSize(type->type) * 8;
+      field->bitfield_size = 0;
+      steps->push_back({true, indices[i], {}});
+    } else {
+      return MakeStatus(EINVAL, "CO-RE access out of its type");
+    }
+  }
+  NormalizeBitfield(btf, field);
+  return error::Status();
+}
+
+// Find member 'name' of struct or union 'id', in it or in its anonymous
+// members, adding its offset to 'bit_offset'. Returns nullptr if none.
+const Member* FindMember(const Btf& btf, const uint32_t id,
+                         const std::string_view name,
+                         uint64_t* const bit_offset, const int depth = 0) {
+  const Type* const type = btf.GetType(btf.SkipModifiers(id));
+  if (type == nullptr || !IsComposite(*type)) {
+    return nullptr;
+  }
+  for (const auto& member : type->members) {
+    if (member.name == name) {
+      *bit_offset += member.bit_offset;
+      return &member;
+    }
+    if (member.name.empty() && depth < kMaxDepth) {
+      uint64_t inner = *bit_offset + member.bit_offset;
+      const Member* const found =
+          FindMember(btf, member.type, name, &inner, depth + 1);
+      if (found != nullptr) {
+        *bit_offset = inner;
+        return found;
+      }
+    }
+  }
+  return nullptr;
+}
+
+// Follow 'steps' from 'root' in the target, to 'field'. Returns false if
+// they lead nowhere there.
+bool ResolveTarget(const Btf& btf, const uint32_t root, const uint32_t first,
+                   const std::vector<Step>& steps, Field* const field) {
+  field->type = root;
+  field->bit_offset = first * btf.GetSize(root) * 8;
+  for (const auto& step : steps) {
+    if (step.is_element) {
+      const Type* const type = btf.GetType(btf.SkipModifiers(field->type));
+      // Arrays of no elements are flexible.
+      if (type == nullptr || type->kind != Kind::kArray ||
+          (type->elements != 0 && step.index >= type->elements)) {
+        return false;
+      }
+      field->type = type->type;
+      field->bit_offset += step.index * btf.GetSize(type->type) * 8;
+      field->bitfield_size = 0;
+    } else {
+      const Member* const member =
+          FindMember(btf, field->type, step.name, &field->bit_offset);
+      if (member == nullptr) {
+        return false;
+      }
+      field->type = member->type;
+      field->bitfield_size = member->bitfield_size;
+    }
+  }
+  NormalizeBitfield(btf, field);
+  return true;
+}
+
+// Whether fields of types 'local_id' and 'target_id' can be accessed the
+// same way, as libbpf decides.
+bool AreCompatible(const Btf& local, const uint32_t local_id,
+                   const Btf& target, const uint32_t target_id,
+                   const int depth = 0) {
+  const Type* const a = local.GetType(local.SkipModifiers(local_id));
+  const Type* const b = target.GetType(target.SkipModifiers(target_id));
+  if (a == nullptr || b == nullptr || depth > kMaxDepth) {
+    return false;
+  }
+  if (IsComposite(*a) && IsComposite(*b)) {
+    return true;
+  }
+  if (!HaveSameKind(*a, *b)) {
+    return false;
+  }
+  switch (a->kind) {
+    case Kind::kPtr:
+    case Kind::kFloat:
+      return true;
+    case Kind::kFwd:
+    case Kind::kEnum:
+    case Kind::kEnum64:
+      return GetEssentialName(a->name) == GetEssentialName(b->name);
+    case Kind::kInt:
+      return a->bit_offset == 0 && b->bit_offset == 0;
+    case Kind::kArray:
+      return AreCompatible(local, a->type, target, b->type, depth + 1);
+    default:
+      return false;
+  }
+}
+
+// The value of 'field' of 'btf' a field relocation of 'kind' asks for, and
+// the size of the memory accesses to it in 'access_size'. Loads and stores
+// of fields which are not bitfields nor composite have that size.
+error::StatusOr<uint64_t> GetFieldValue(const Btf& btf, const Field& field,
+                                        const RelocationKind kind,
+                                        uint32_t* const access_size) {
+  const Type* const type = btf.GetType(btf.SkipModifiers(field.type));
+  uint64_t byte_size = btf.GetSize(field.type);
+  uint64_t byte_offset = field.bit_offset / 8;
+  uint64_t bit_size = 8 * byte_size;
+  if (field.bitfield_size != 0) {
+    // The smallest naturally aligned load holding the whole bitfield.
+    bit_size = field.bitfield_size;
+    byte_offset = byte_size ? field.bit_offset / 8 / byte_size * byte_size : 0;
+    while (byte_size != 0 &&
+           field.bit_offset + bit_size - 8 * byte_offset > 8 * byte_size) {
+      if (byte_size >= 8) {
+        return MakeStatus(EINVAL, "CO-RE bitfield too wide");
+      }
+      byte_size *= 2;
+      byte_offset = field.bit_offset / 8 / byte_size * byte_size;
+    }
+  } else if (field.bit_offset % 8 != 0) {
+    return MakeStatus(EINVAL, "CO-RE field not byte aligned");
+  }
+  *access_size = 0;
+  if (field.bitfield_size == 0 && type != nullptr &&
+      (type->kind == Kind::kInt || IsEnum(*type) || type->kind == Kind::kPtr)) {
+    *access_size = byte_size;
+  }
+
+  switch (kind) {
+    case RelocationKind::kFieldByteOffset:
+      return uint64_t{byte_offset};
+    case RelocationKind::kFieldByteSize:
+      return uint64_t{byte_size};
+    case RelocationKind::kFieldExists:
+      return uint64_t{1};
+    case RelocationKind::kFieldSigned:
+      return uint64_t{type != nullptr &&
+                      (type->kind == Kind::kInt || IsEnum(*type)) &&
+                      type->is_signed};
+    case RelocationKind::kFieldLeftShift:
+      return uint64_t{64 - (field.bit_offset + bit_size - 8 * byte_offset)};
+    case RelocationKind::kFieldRightShift:
+      return uint64_t{64 - bit_size};
+    default:
+      return MakeStatus(ENOTSUP, "unknown CO-RE relocation kind");
+  }
+}
+
+// The instruction changes of a relocation.
+struct Result {
+  // Value the instruction has, and the one it is to have.
+  uint64_t local = 0;
+  uint64_t target = 0;
+  // Whether to replace the instruction by a call to kPoisonHelper.
+  bool poison = false;
+  // Sizes of the field accessed, to change loads and stores of it to, 0
+  // if not to change them.
+  uint32_t local_size = 0;
+  uint32_t target_size = 0;
+};
+
+bool IsFieldKind(const RelocationKind kind) {
+  return kind <= RelocationKind::kFieldRightShift;
+}
+
+bool IsExistence(const RelocationKind kind) {
+  return kind == RelocationKind::kFieldExists ||
+         kind == RelocationKind::kTypeExists ||
+         kind == RelocationKind::kEnumeratorExists;
+}
+
+// Merge 'candidate', the result of one target type, into 'result'.
+error::Status Merge(const Result& candidate,
+                    std::optional<Result>* const result) {
+  if (!result->has_value()) {
+    *result = candidate;
+    return error::Status();
+  }
+  if ((*result)->target != candidate.target ||
+      (*result)->target_size != candidate.target_size) {
+    return MakeStatus(EINVAL, "CO-RE relocation matches ambiguously");
+  }
+  return error::Status();
+}
+
+error::StatusOr<Result> Resolve(const Relocation& relocation, const Btf& local,
+                                const Btf& target) {
+  const Type* const root = local.GetType(relocation.type);
+  if (relocation.type == 0 || root == nullptr) {
+    return MakeStatus(EINVAL, "CO-RE relocation of an unknown type");
+  }
+  ASSIGN_OR_RETURN(const auto indices, ParseAccess(relocation.access));
+  const RelocationKind kind = relocation.kind;
+  const std::string_view name = GetEssentialName(root->name);
+  if (name.empty() && kind != RelocationKind::kTypeIdLocal) {
+    return MakeStatus(EINVAL, "CO-RE relocation of an anonymous type");
+  }
+
+  Result local_result;
+  std::optional<Result> result;
+  if (IsFieldKind(kind)) {
+    Field field;
+    std::vector<Step> steps;
+    RETURN_IF_ERROR(ResolveLocal(local, relocation.type, indices, &field,
+                                 &steps));
+    ASSIGN_OR_RETURN(local_result.local,
+                     GetFieldValue(local, field, kind,
+                                   &local_result.local_size));
+    for (const uint32_t id : target.FindFlavors(name)) {
+      Field target_field;
+      if (!HaveSameKind(*root, *target.GetType(id)) ||
+          !ResolveTarget(target, id, indices[0], steps, &target_field) ||
+          !AreCompatible(local, field.type, target, target_field.type)) {
+        continue;
+      }
+      Result candidate = local_result;
+      ASSIGN_OR_RETURN(candidate.target,
+                       GetFieldValue(target, target_field, kind,
+                                     &candidate.target_size));
+      if (kind != RelocationKind::kFieldByteOffset ||
+          candidate.local_size == 0 || candidate.target_size == 0) {
+        candidate.local_size = candidate.target_size = 0;
+      }
+      RETURN_IF_ERROR(Merge(candidate, &result));
+    }
+  } else if (kind <= RelocationKind::kTypeSize) {
+    if (indices != std::vector<uint32_t>{0}) {
+      return MakeStatus(EINVAL, "malformed CO-RE access");
+    }
+    if (kind == RelocationKind::kTypeIdLocal) {
+      local_result.local = local_result.target = relocation.type;
+      return local_result;
+    }
+    local_result.local = kind == RelocationKind::kTypeSize
+                             ? local.GetSize(relocation.type)
+                             : kind == RelocationKind::kTypeExists
+                                   ? 1
+                                   : relocation.type;
+    for (const uint32_t id : target.FindFlavors(name)) {
+      if (!HaveSameKind(*root, *target.GetType(id))) {
+        continue;
+      }
+      Result candidate = local_result;
+      candidate.target = kind == RelocationKind::kTypeSize
+                             ? target.GetSize(id)
+                             : kind == RelocationKind::kTypeExists ? 1 : id;
+      RETURN_IF_ERROR(Merge(candidate, &result));
+    }
+  } else if (kind <= RelocationKind::kEnumeratorValue) {
+    const Type* const type =
+        local.GetType(local.SkipModifiers(relocation.type));
+    if (type == nullptr || !IsEnum(*type) || indices.size() != 1 ||
+        indices[0] >= type->enumerators.size()) {
+      return MakeStatus(EINVAL, "malformed CO-RE access");
+    }
+    const Enumerator& enumerator = type->enumerators[indices[0]];
+    local_result.local = kind == RelocationKind::kEnumeratorExists
+                             ? 1
+                             : static_cast<uint64_t>(enumerator.value);
+    for (const uint32_t id : target.FindFlavors(name)) {
+      const Type* const candidate_type = target.GetType(id);
+      if (!IsEnum(*candidate_type)) {
+        continue;
+      }
+      for (const auto& candidate_enumerator : candidate_type->enumerators) {
+        if (candidate_enumerator.name != enumerator.name) {
+          continue;
+        }
+        Result candidate = local_result;
+        candidate.target =
+            kind == RelocationKind::kEnumeratorExists
+                ? 1
+                : static_cast<uint64_t>(candidate_enumerator.value);
+        RETURN_IF_ERROR(Merge(candidate, &result));
+      }
+    }
+  } else {
+    return MakeStatus(ENOTSUP, "unknown CO-RE relocation kind");
+  }
+
+  if (result.has_value()) {
+    return *result;
+  }
+  // Nothing in the target: absent, or to fail verification if used.
+  local_result.target = 0;
+  local_result.poison = !IsExistence(kind);
+  local_result.local_size = 0;
+  return local_result;
+}
+
+// Size code of loads and stores of 'bytes' bytes, -1 if there is none.
+int GetSizeCode(const uint32_t bytes) {
+  switch (bytes) {
+    case 1:
+      return BPF_B;
+    case 2:
+      return BPF_H;
+    case 4:
+      return BPF_W;
+    case 8:
+      return BPF_DW;
+  }
+  return -1;
+}
+
+// Apply 'result' to 'insns', the first of 'count' instructions left in the
+// section.
+error::Status Patch(const Result& result, bpf_insn* const insns,
+                    const size_t count) {
+  bpf_insn& insn = insns[0];
+  const bool is_wide_load = insn.code == (BPF_LD | BPF_IMM | BPF_DW);
+  if (is_wide_load && count < 2) {
+    return MakeStatus(EINVAL, "truncated CO-RE relocated instruction");
+  }
+  if (result.poison) {
+    const bpf_insn poison = {BPF_JMP | BPF_CALL, 0, 0, 0, kPoisonHelper};
+    if (is_wide_load) {
+      insns[1] = poison;
+    }
+    insn = poison;
+    return error::Status();
+  }
+
+  switch (BPF_CLASS(insn.code)) {
+    case BPF_ALU:
+    case BPF_ALU64:
+      if (BPF_SRC(insn.code) != BPF_K ||
+          insn.imm != static_cast<int32_t>(result.local)) {
+        break;
+      }
+      if (result.target > std::numeric_limits<uint32_t>::max()) {
+        return MakeStatus(EINVAL, "CO-RE relocated value out of range");
+      }
+      insn.imm = result.target;
+      return error::Status();
+
+    case BPF_LDX:
+    case BPF_ST:
+    case BPF_STX:
+      if (insn.off != static_cast<int64_t>(result.local)) {
+        break;
+      }
+      if (result.target > std::numeric_limits<int16_t>::max()) {
+        return MakeStatus(EINVAL, "CO-RE relocated offset out of range");
+      }
+      insn.off = result.target;
+      if (result.local_size != result.target_size) {
+        const int size = GetSizeCode(result.target_size);
+        if (BPF_SIZE(insn.code) != GetSizeCode(result.local_size) ||
+            size < 0) {
+          return MakeStatus(EINVAL, "CO-RE relocated access of a bad size");
+        }
+        insn.code = BPF_CLASS(insn.code) | BPF_MODE(insn.code) | size;
+      }
+      return error::Status();
+
+    case BPF_LD:
+      if (!is_wide_load ||
+          (static_cast<uint32_t>(insn.imm) |
+           uint64_t{static_cast<uint32_t>(insns[1].imm)} << 32) !=
+              result.local) {
+        break;
+      }
+      insn.imm = static_cast<uint32_t>(result.target);
+      insns[1].imm = static_cast<uint32_t>(result.target >> 32);
+      return error::Status();
+  }
+  return MakeStatus(EINVAL, "CO-RE relocation of an unexpected instruction");
+}
+
+}  // namespace
+
+error::StatusOr<Btf> ParseObjectBtf(const std::string_view elf) {
+  ASSIGN_OR_RETURN(const auto sections, ParseSections(elf));
+  const Section* const section = FindSection(sections, ".BTF");
+  if (section == nullptr) {
+    return MakeStatus(ENOENT, "no .BTF section");
+  }
+  return ParseBtf(std::string(section->data));
+}
+
+error::StatusOr<bool> HasCoreRelocations(const std::string_view elf) {
+  ASSIGN_OR_RETURN(const auto sections, ParseSections(elf));
+  const Section* const ext = FindSection(sections, ".BTF.ext");
+  if (ext == nullptr) {
+    return false;
+  }
+  ASSIGN_OR_RETURN(const auto relocations, GetCoreRelocations(ext->data));
+  return !relocations.empty();
+}
+
+error::StatusOr<std::string> RelocateObject(const std::string_view elf,
+                                            const Btf& target) {
+  ASSIGN_OR_RETURN(const auto sections, ParseSections(elf));
+  const Section* const ext = FindSection(sections, ".BTF.ext");
+  if (ext == nullptr) {
+    return std::string(elf);
+  }
+  ASSIGN_OR_RETURN(const auto data, GetCoreRelocations(ext->data));
+  if (data.empty()) {
+    return std::string(elf);
+  }
+  ASSIGN_OR_RETURN(const Btf local, ParseObjectBtf(elf));
+  ASSIGN_OR_RETURN(const auto relocations, ParseRelocations(data, local));
+
+  std::string relocated(elf);
+  for (const auto& relocation : relocations) {
+    const Section* const section = FindSection(sections, relocation.section);
+    if (section == nullptr || relocation.insn_offset % sizeof(bpf_insn) ||
+        relocation.insn_offset >= section->data.size()) {
+      return MakeStatus(EINVAL, "CO-RE relocation out of the code");
+    }
+    ASSIGN_OR_RETURN(const Result result, Resolve(relocation, local, target));
+
+    // Patch a copy: the object may not be aligned.
+    const size_t count =
+        (section->data.size() - relocation.insn_offset) / sizeof(bpf_insn);
+    bpf_insn insns[2];
+    char* const code =
+        &relocated[section->offset + relocation.insn_offset];
+    std::memcpy(insns, code, std::min<size_t>(count, 2) * sizeof(bpf_insn));
+    RETURN_IF_ERROR(Patch(result, insns, count));
+    std::memcpy(code, insns, std::min<size_t>(count, 2) * sizeof(bpf_insn));
+  }
+  return relocated;
+}
+
+}  // namespace btf
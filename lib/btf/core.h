@@ -0,0 +1,61 @@
+#ifndef LIB_BTF_CORE_H_
+#define LIB_BTF_CORE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "lib/btf/btf.h"
+#include "lib/error/status_or.h"
+
+namespace btf {
+
+// What a CO-RE relocation asks for, enum bpf_core_relo_kind: where a field
+// is, whether a field, type or enumerator exists, how big a type is, ...
+enum class RelocationKind : uint32_t {
+  kFieldByteOffset = 0,
+  kFieldByteSize = 1,
+  kFieldExists = 2,
+  kFieldSigned = 3,
+  kFieldLeftShift = 4,
+  kFieldRightShift = 5,
+  kTypeIdLocal = 6,
+  kTypeIdTarget = 7,
+  kTypeExists = 8,
+  kTypeSize = 9,
+  kEnumeratorExists = 10,
+  kEnumeratorValue = 11,
+};
+
+// Canonical path of the BTF of the running kernel, on kernels built with
+// CONFIG_DEBUG_INFO_BTF (5.4 and later).
+constexpr char kKernelBtfPath[] = "/sys/kernel/btf/vmlinux";
+
+// Parse the .BTF section of 'elf', an eBPF ELF object. Fails with ENOENT if
+// it has none, see ParseBtf() for the rest.
+error::StatusOr<Btf> ParseObjectBtf(std::string_view elf);
+
+// Whether 'elf', an eBPF ELF object, has CO-RE relocations: accesses to
+// kernel types compiled with __builtin_preserve_access_index() and the
+// like, which RelocateObject() must adjust before loading. Fails with
+// EINVAL if malformed.
+error::StatusOr<bool> HasCoreRelocations(std::string_view elf);
+
+// Return 'elf' with its CO-RE relocations applied for 'target', the BTF of
+// the kernel it is to be loaded in: the layout of the kernel types the
+// object was compiled against (its .BTF) is replaced by theirs in 'target'.
+// Types match by name, ignoring '___<suffix>' flavors, and fields by name
+// and nesting.
+//
+// Existence checks of what 'target' lacks are answered 0. Other accesses
+// to what it lacks are replaced by calls to an invalid helper, which the
+// verifier rejects unless they are never reached, as libbpf does.
+//
+// Fails with EINVAL if malformed, or if a relocation matches types of
+// 'target' differently, and with ENOTSUP on relocation kinds not above.
+error::StatusOr<std::string> RelocateObject(std::string_view elf,
+                                            const Btf& target);
+
+}  // namespace btf
+
+#endif  // LIB_BTF_CORE_H_
@@ -0,0 +1,279 @@
+#include "lib/btf/core.h"
+
+#include <elf.h>
+#include <linux/bpf.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/btf/btf_test_utils.h"
+#include "lib/posix/errno.h"
+
+namespace btf {
+namespace {
+
+constexpr uint32_t kFieldByteOffset = 0;
+constexpr uint32_t kFieldExists = 2;
+constexpr uint32_t kFieldLeftShift = 4;
+constexpr uint32_t kFieldRightShift = 5;
+constexpr uint32_t kTypeIdTarget = 7;
+constexpr uint32_t kTypeExists = 8;
+constexpr uint32_t kTypeSize = 9;
+constexpr uint32_t kEnumeratorExists = 10;
+constexpr uint32_t kEnumeratorValue = 11;
+
+bpf_insn MakeInsn(const uint8_t code, const uint8_t dst, const uint8_t src,
+                  const int16_t off, const int32_t imm) {
+  bpf_insn insn = {};
+  insn.code = code;
+  insn.dst_reg = dst;
+  insn.src_reg = src;
+  insn.off = off;
+  insn.imm = imm;
+  return insn;
+}
+
+bpf_insn Load32(const int16_t off) {
+  return MakeInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_0, BPF_REG_1, off, 0);
+}
+
+bpf_insn Mov(const int32_t imm) {
+  return MakeInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, imm);
+}
+
+bool IsPoisoned(const bpf_insn& insn) {
+  return insn.code == (BPF_JMP | BPF_CALL) && insn.imm == 0xbad2310;
+}
+
+// An object of program 'insns' in section "xdp", with 'relocations' of
+// types of 'local'.
+std::string MakeProgram(BtfBuilder* const local,
+                        const std::vector<bpf_insn>& insns,
+                        const std::vector<CoreRelocation>& relocations) {
+  const uint32_t section = local->AddString("xdp");
+  return MakeObject({{"xdp", MakeCode(insns)},
+                     {".BTF", local->Build()},
+                     {".BTF.ext", MakeBtfExt(section, relocations)}});
+}
+
+// The first 'count' instructions of an object of MakeProgram().
+std::vector<bpf_insn> GetCode(const std::string& elf, const size_t count) {
+  std::vector<bpf_insn> insns(count);
+  std::memcpy(insns.data(), elf.data() + sizeof(Elf64_Ehdr),
+              count * sizeof(bpf_insn));
+  return insns;
+}
+
+Btf MustParse(const BtfBuilder& builder) {
+  auto btf_or = ParseBtf(builder.Build());
+  EXPECT_TRUE(IsOk(btf_or)) << GetText(GetStatus(btf_or));
+  return IsOk(btf_or) ? std::move(GetValue(btf_or)) : Btf();
+}
+
+std::vector<bpf_insn> MustRelocate(const std::string& elf, const Btf& target,
+                                   const size_t count) {
+  const auto relocated_or = RelocateObject(elf, target);
+  EXPECT_TRUE(IsOk(relocated_or)) << GetText(GetStatus(relocated_or));
+  if (!IsOk(relocated_or)) {
+    return std::vector<bpf_insn>(count);
+  }
+  EXPECT_EQ(elf.size(), GetValue(relocated_or).size());
+  return GetCode(GetValue(relocated_or), count);
+}
+
+TEST(RelocateObjectTest, RelocatesFieldAccesses) {
+  BtfBuilder local;
+  const uint32_t local_int = local.AddInt("int", 4, true);
+  const uint32_t local_task = local.AddStruct(
+      "task", 12,
+      {{"pid", local_int, 0},
+       {"tgid", local_int, 32},
+       {"flags", local_int, 64}});
+  const uint32_t pid = local.AddString("0:0");
+  const uint32_t tgid = local.AddString("0:1");
+  const uint32_t flags = local.AddString("0:2");
+  const std::string elf = MakeProgram(
+      &local,
+      {Load32(4), Load32(8),
+       MakeInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_1, 0, 0, 0), Mov(1)},
+      {{0, local_task, tgid, kFieldByteOffset},
+       {8, local_task, flags, kFieldByteOffset},
+       {16, local_task, pid, kFieldByteOffset},
+       {24, local_task, tgid, kFieldExists}});
+
+  BtfBuilder target;
+  const uint32_t target_int = target.AddInt("int", 4, true);
+  const uint32_t target_long = target.AddInt("long", 8, true);
+  target.AddStruct("task", 32,
+                   {{"state", target_long, 0},
+                    {"tgid", target_int, 64},
+                    {"pid", target_int, 96},
+                    {"flags", target_long, 128}});
+
+  const auto insns = MustRelocate(elf, MustParse(target), 4);
+  EXPECT_EQ(8, insns[0].off);
+  EXPECT_EQ(BPF_W, BPF_SIZE(insns[0].code));
+  // Loads of fields which grew grow with them.
+  EXPECT_EQ(16, insns[1].off);
+  EXPECT_EQ(BPF_DW, BPF_SIZE(insns[1].code));
+  EXPECT_EQ(BPF_LDX | BPF_MEM, insns[1].code & ~BPF_DW);
+  EXPECT_EQ(12, insns[2].imm);
+  EXPECT_EQ(1, insns[3].imm);
+}
+
+TEST(RelocateObjectTest, MatchesFlavorsAndAnonymousMembers) {
+  BtfBuilder local;
+  const uint32_t local_int = local.AddInt("int", 4, true);
+  const uint32_t local_task =
+      local.AddStruct("task___old", 4, {{"pid", local_int, 0}});
+  const uint32_t pid = local.AddString("0:0");
+  const std::string elf = MakeProgram(
+      &local, {Load32(0)}, {{0, local_task, pid, kFieldByteOffset}});
+
+  BtfBuilder target;
+  const uint32_t target_int = target.AddInt("int", 4, true);
+  const uint32_t ids =
+      target.AddStruct("", 8, {{"tgid", target_int, 0},
+                               {"pid", target_int, 32}});
+  target.AddStruct("task", 16, {{"state", target_int, 0}, {"", ids, 64}});
+
+  EXPECT_EQ(12, MustRelocate(elf, MustParse(target), 1)[0].off);
+}
+
+TEST(RelocateObjectTest, PoisonsAccessesToWhatIsMissing) {
+  BtfBuilder local;
+  const uint32_t local_int = local.AddInt("int", 4, true);
+  const uint32_t local_task = local.AddStruct(
+      "task", 8, {{"pid", local_int, 0}, {"cgroup", local_int, 32}});
+  const uint32_t local_gone = local.AddStruct("gone", 4, {{"x", local_int, 0}});
+  const uint32_t cgroup = local.AddString("0:1");
+  const uint32_t root = local.AddString("0");
+  const uint32_t x = local.AddString("0:0");
+  const std::string elf = MakeProgram(
+      &local, {Mov(1), Load32(4), Mov(1), Load32(0)},
+      {{0, local_task, cgroup, kFieldExists},
+       {8, local_task, cgroup, kFieldByteOffset},
+       {16, local_gone, root, kTypeExists},
+       {24, local_gone, x, kFieldByteOffset}});
+
+  BtfBuilder target;
+  target.AddStruct("task", 4, {{"pid", target.AddInt("int", 4, true), 0}});
+
+  const auto insns = MustRelocate(elf, MustParse(target), 4);
+  EXPECT_EQ(0, insns[0].imm);
+  EXPECT_TRUE(IsPoisoned(insns[1]));
+  EXPECT_EQ(0, insns[2].imm);
+  EXPECT_TRUE(IsPoisoned(insns[3]));
+}
+
+TEST(RelocateObjectTest, RelocatesBitfields) {
+  BtfBuilder local;
+  const uint32_t local_u32 = local.AddInt("u32", 4);
+  const uint32_t local_bits = local.AddStruct(
+      "bits", 4, {{"a", local_u32, 0, 3}, {"b", local_u32, 3, 5}});
+  const uint32_t b = local.AddString("0:1");
+  const std::string elf = MakeProgram(
+      &local, {Mov(0), Mov(56), Mov(59)},
+      {{0, local_bits, b, kFieldByteOffset},
+       {8, local_bits, b, kFieldLeftShift},
+       {16, local_bits, b, kFieldRightShift}});
+
+  BtfBuilder target;
+  const uint32_t target_u32 = target.AddInt("u32", 4);
+  target.AddStruct("bits", 8, {{"x", target_u32, 0}, {"b", target_u32, 39, 5}});
+
+  const auto insns = MustRelocate(elf, MustParse(target), 3);
+  EXPECT_EQ(4, insns[0].imm);
+  EXPECT_EQ(64 - (39 + 5 - 32), insns[1].imm);
+  EXPECT_EQ(64 - 5, insns[2].imm);
+}
+
+TEST(RelocateObjectTest, RelocatesTypesAndEnumerators) {
+  BtfBuilder local;
+  const uint32_t local_int = local.AddInt("int", 4, true);
+  const uint32_t local_task =
+      local.AddStruct("task", 4, {{"pid", local_int, 0}});
+  const uint32_t local_state = local.AddEnum(
+      "state", {{"RUNNING", 0}, {"DEAD", 2}, {"ZOMBIE", 3}});
+  const uint32_t root = local.AddString("0");
+  const uint32_t dead = local.AddString("1");
+  const uint32_t zombie = local.AddString("2");
+  const std::string elf = MakeProgram(
+      &local,
+      {Mov(4), Mov(2), Mov(1),
+       MakeInsn(BPF_LD | BPF_IMM | BPF_DW, BPF_REG_0, 0, 0, local_task),
+       MakeInsn(0, 0, 0, 0, 0)},
+      {{0, local_task, root, kTypeSize},
+       {8, local_state, dead, kEnumeratorValue},
+       {16, local_state, zombie, kEnumeratorExists},
+       {24, local_task, root, kTypeIdTarget}});
+
+  BtfBuilder target;
+  const uint32_t target_int = target.AddInt("int", 4, true);
+  target.AddEnum("state", {{"RUNNING", 0}, {"DEAD", 4}});
+  const uint32_t target_task = target.AddStruct(
+      "task", 16, {{"state", target_int, 0}, {"pid", target_int, 32}});
+
+  const auto insns = MustRelocate(elf, MustParse(target), 5);
+  EXPECT_EQ(16, insns[0].imm);
+  EXPECT_EQ(4, insns[1].imm);
+  EXPECT_EQ(0, insns[2].imm);
+  EXPECT_EQ(target_task, insns[3].imm);
+  EXPECT_EQ(0, insns[4].imm);
+}
+
+TEST(RelocateObjectTest, FailsOnAmbiguousOrUnexpectedRelocations) {
+  BtfBuilder local;
+  const uint32_t local_int = local.AddInt("int", 4, true);
+  const uint32_t local_task =
+      local.AddStruct("task", 4, {{"pid", local_int, 0}});
+  const uint32_t pid = local.AddString("0:0");
+  BtfBuilder unexpected = local;
+  const std::string elf = MakeProgram(
+      &local, {Load32(0)}, {{0, local_task, pid, kFieldByteOffset}});
+
+  BtfBuilder target;
+  const uint32_t target_int = target.AddInt("int", 4, true);
+  target.AddStruct("task", 4, {{"pid", target_int, 0}});
+  target.AddStruct("task___v2", 8,
+                   {{"x", target_int, 0}, {"pid", target_int, 32}});
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(RelocateObject(elf, MustParse(target))), EINVAL));
+
+  // The load is not at the offset of the field.
+  const std::string moved = MakeProgram(
+      &unexpected, {Load32(4)}, {{0, local_task, pid, kFieldByteOffset}});
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(RelocateObject(moved, MustParse(local))), EINVAL));
+}
+
+TEST(RelocateObjectTest, LeavesObjectsWithoutRelocationsAlone) {
+  BtfBuilder local;
+  const uint32_t local_task =
+      local.AddStruct("task", 4, {{"pid", local.AddInt("int", 4), 0}});
+  const std::string btf = local.Build();
+  const std::string elf =
+      MakeObject({{"xdp", MakeCode({Mov(2)})}, {".BTF", btf}});
+
+  auto has_or = HasCoreRelocations(elf);
+  ASSERT_TRUE(IsOk(has_or));
+  EXPECT_FALSE(GetValue(has_or));
+  const auto relocated_or = RelocateObject(elf, MustParse(local));
+  ASSERT_TRUE(IsOk(relocated_or));
+  EXPECT_EQ(elf, GetValue(relocated_or));
+
+  const uint32_t pid = local.AddString("0:0");
+  has_or = HasCoreRelocations(MakeProgram(
+      &local, {Load32(0)}, {{0, local_task, pid, kFieldByteOffset}}));
+  ASSERT_TRUE(IsOk(has_or));
+  EXPECT_TRUE(GetValue(has_or));
+
+  EXPECT_TRUE(posix::IsErrno(GetStatus(HasCoreRelocations("not ELF")), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(ParseObjectBtf(elf.substr(0, 0))),
+                             EINVAL));
+}
+
+}  // namespace
+}  // namespace btf
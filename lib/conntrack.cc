@@ -0,0 +1,141 @@
+#include "lib/conntrack.h"
+
+#include <time.h>
+
+#include <cerrno>
+#include <string_view>
+
+#include "lib/base/span.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+
+namespace {
+
+error::Status MakeStatus(const int e, const std::string_view text) {
+  return error::Status(posix::MakeCodeFromErrno(e), text);
+}
+
+// Return the time in the clock of bpf_ktime_get_ns(), in nanoseconds.
+uint64_t GetMonotonicTime() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * uint64_t{1000000000} + now.tv_nsec;
+}
+
+}  // namespace
+
+std::chrono::nanoseconds GetTimeout(const ConntrackTimeouts& timeouts,
+                                    const uint32_t state) {
+  switch (state) {
+    case EBPD_CT_NEW:
+      return timeouts.unreplied;
+    case EBPD_CT_REPLIED:
+      return timeouts.replied;
+    case EBPD_CT_SYN_SENT:
+    case EBPD_CT_SYN_RECV:
+      return timeouts.tcp_handshake;
+    case EBPD_CT_ESTABLISHED:
+      return timeouts.tcp_established;
+    case EBPD_CT_FIN_WAIT:
+      return timeouts.tcp_fin_wait;
+    case EBPD_CT_CLOSING:
+      return timeouts.tcp_closing;
+  }
+  return timeouts.unreplied;
+}
+
+error::Status ConntrackSweeper::Remove(const std::vector<ebpd_ct_key>& keys) {
+  if (keys.empty()) {
+    return error::kOkStatus;
+  }
+  const auto status = GetStatus(map_.DeleteBatch(base::MakeSpan(keys)));
+  if (!posix::IsErrno(status, ENOENT)) {
+    return status;
+  }
+  // Some were evicted or removed concurrently: the batch stopped at the first
+  // of them, go through the rest one by one.
+  for (const auto& key : keys) {
+    const auto key_status = map_.Delete(key);
+    if (IsError(key_status) && !posix::IsErrno(key_status, ENOENT)) {
+      return key_status;
+    }
+  }
+  return error::kOkStatus;
+}
+
+error::StatusOr<ConntrackSweepStats> ConntrackSweeper::Sweep(
+    const size_t max_scanned) {
+  if (keys_.size() < options_.batch_size) {
+    keys_.resize(options_.batch_size);
+    entries_.resize(options_.batch_size);
+  }
+  const uint64_t now = GetMonotonicTime();
+  ConntrackSweepStats stats;
+  std::vector<ebpd_ct_key> expired;
+  do {
+    auto count_or = map_.LookupBatch(&cursor_, base::MakeSpan(keys_),
+                                     base::MakeSpan(entries_));
+    while (posix::IsErrno(GetStatus(count_or), ENOSPC)) {
+      // A hash bucket larger than the batch.
+      keys_.resize(keys_.size() * 2);
+      entries_.resize(entries_.size() * 2);
+      count_or = map_.LookupBatch(&cursor_, base::MakeSpan(keys_),
+                                  base::MakeSpan(entries_));
+    }
+    ASSIGN_OR_RETURN(const size_t count, count_or);
+    RETURN_IF_ERROR(Remove(deferred_));
+    deferred_.clear();
+
+    expired.clear();
+    for (size_t i = 0; i < count; ++i) {
+      const ebpd_ct_entry& entry = entries_[i];
+      const uint64_t timeout =
+          GetTimeout(options_.timeouts, entry.state).count();
+      if (entry.last_seen > now || now - entry.last_seen <= timeout) {
+        continue;
+      }
+      if (i == count - 1 && !IsDone(cursor_)) {
+        deferred_.push_back(keys_[i]);
+      } else {
+        expired.push_back(keys_[i]);
+      }
+      ++stats.expired;
+    }
+    RETURN_IF_ERROR(Remove(expired));
+    stats.scanned += count;
+  } while (!IsDone(cursor_) && stats.scanned < max_scanned);
+
+  if (IsDone(cursor_)) {
+    cursor_ = bpf::MapCursor<ebpd_ct_key>();
+    stats.done = true;
+  }
+  return stats;
+}
+
+error::StatusOr<ConntrackSweepStats> ConntrackSweeper::SweepAll() {
+  ConntrackSweepStats total;
+  while (!total.done) {
+    ASSIGN_OR_RETURN(const auto stats, Sweep(options_.batch_size));
+    total.scanned += stats.scanned;
+    total.expired += stats.expired;
+    total.done = stats.done;
+  }
+  return total;
+}
+
+error::StatusOr<ConntrackSweeper> CreateConntrackSweeper(
+    const posix::FileDescriptor map, const ConntrackSweeperOptions& options) {
+  ASSIGN_OR_RETURN(auto connections,
+                   (bpf::OpenMap<ebpd_ct_key, ebpd_ct_entry>(map)));
+  return ConntrackSweeper(std::move(connections), options);
+}
+
+error::StatusOr<ConntrackSweeper> CreateConntrackSweeper(
+    const XdpLoader& conntrack, const ConntrackSweeperOptions& options) {
+  const int map = conntrack.GetMapFd(kConntrackMapName);
+  if (map < 0) {
+    return MakeStatus(ENOENT, "conntrack map not found");
+  }
+  return CreateConntrackSweeper(posix::FileDescriptor(map), options);
+}
@@ -0,0 +1,125 @@
+#ifndef LIB_CONNTRACK_H_
+#define LIB_CONNTRACK_H_
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "lib/bpf/map.h"
+#include "lib/ebpf/conntrack_maps.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/file_descriptor.h"
+#include "lib/xdp_loader.h"
+
+// Name of the map of lib/ebpf/conntrack.c.
+constexpr char kConntrackMapName[] = "connections";
+
+// How long connections live without packets, by state. Shorter for states
+// cheap to get into, e.g. by a SYN flood, than for established connections.
+struct ConntrackTimeouts {
+  std::chrono::nanoseconds unreplied = std::chrono::seconds(30);  // NEW
+  std::chrono::nanoseconds replied = std::chrono::seconds(180);
+  std::chrono::nanoseconds tcp_handshake = std::chrono::seconds(60);
+  std::chrono::nanoseconds tcp_established = std::chrono::hours(1);
+  std::chrono::nanoseconds tcp_fin_wait = std::chrono::seconds(120);
+  std::chrono::nanoseconds tcp_closing = std::chrono::seconds(10);
+};
+
+// Return the timeout of connections in 'state', one of ebpd_ct_state.
+// Unknown states get the shortest one, 'unreplied'.
+std::chrono::nanoseconds GetTimeout(const ConntrackTimeouts& timeouts,
+                                    uint32_t state);
+
+struct ConntrackSweeperOptions {
+  // Connections read, and expired ones removed, per bpf() call.
+  size_t batch_size = 4096;
+  ConntrackTimeouts timeouts;
+};
+
+// What a ConntrackSweeper::Sweep() call did.
+struct ConntrackSweepStats {
+  size_t scanned = 0;
+  size_t expired = 0;
+  // True iff the sweep reached the end of the map; the next one starts over.
+  bool done = false;
+};
+
+// Removes idle connections from the map of lib/ebpf/conntrack.c.
+//
+// The LRU map already makes room for new connections when full, but evicts
+// the least recently used ones regardless of their state, and only once
+// full; sweeping applies the timeouts and keeps room available.
+//
+// The map is walked in batches: the kernel holds a hash bucket lock at a
+// time, never the whole map, so the datapath keeps running during sweeps.
+// Sweep() walks part of the map per call, for callers spreading a full pass
+// over time, e.g. a few batches every second.
+//
+// A connection seeing a packet between being read and being removed is
+// removed all the same; its next packet recreates it, TCP ones as
+// ESTABLISHED.
+//
+// Example usage:
+//
+// ASSIGN_OR_RETURN(auto sweeper, CreateConntrackSweeper(*conntrack));
+// for (;;) {
+//   ASSIGN_OR_RETURN(const auto stats, sweeper.Sweep(65536));
+//   ...
+//   sleep(1);
+// }
+//
+class ConntrackSweeper {
+ public:
+  ConntrackSweeper() = default;
+
+  // Take ownership of the map of a conntrack program. Prefer
+  // CreateConntrackSweeper().
+  ConntrackSweeper(bpf::BpfMap<ebpd_ct_key, ebpd_ct_entry> map,
+                   const ConntrackSweeperOptions& options)
+      : map_(std::move(map)), options_(options) {}
+
+  // Default move constructor.
+  ConntrackSweeper(ConntrackSweeper&&) = default;
+
+  // Default move assignment operator.
+  ConntrackSweeper& operator=(ConntrackSweeper&&) = default;
+
+  // Continue the walk of the map, reading at least one batch and up to about
+  // 'max_scanned' connections, and remove those idle past their timeout.
+  error::StatusOr<ConntrackSweepStats> Sweep(size_t max_scanned);
+
+  // Sweep the whole map, from wherever the last Sweep() stopped.
+  error::StatusOr<ConntrackSweepStats> SweepAll();
+
+ private:
+  // Remove 'keys', ignoring those gone already.
+  error::Status Remove(const std::vector<ebpd_ct_key>& keys);
+
+  bpf::BpfMap<ebpd_ct_key, ebpd_ct_entry> map_;
+  ConntrackSweeperOptions options_;
+
+  // Position of the walk.
+  bpf::MapCursor<ebpd_ct_key> cursor_;
+
+  // Expired connection the walk is positioned on, removed after reading the
+  // next batch: iterating without batch support restarts from the first key
+  // when the current one is gone.
+  std::vector<ebpd_ct_key> deferred_;
+
+  // Buffers of a batch.
+  std::vector<ebpd_ct_key> keys_;
+  std::vector<ebpd_ct_entry> entries_;
+};
+
+// Sweep the map behind 'map', which stays owned by the caller. Fails with
+// EINVAL if it is not the map of lib/ebpf/conntrack.c.
+error::StatusOr<ConntrackSweeper> CreateConntrackSweeper(
+    posix::FileDescriptor map,
+    const ConntrackSweeperOptions& options = ConntrackSweeperOptions());
+
+// Sweep the map of 'conntrack', a loaded lib/ebpf/conntrack.c.
+error::StatusOr<ConntrackSweeper> CreateConntrackSweeper(
+    const XdpLoader& conntrack,
+    const ConntrackSweeperOptions& options = ConntrackSweeperOptions());
+
+#endif  // LIB_CONNTRACK_H_
@@ -0,0 +1,367 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include "lib/ebpd_link.h"
+
+/*
+ * IFLA_XDP_* attributes newer than the oldest uapi headers we build
+ * against. Values are ABI and never change.
+ */
+#define EBPD_IFLA_XDP_DRV_PROG_ID   5
+#define EBPD_IFLA_XDP_SKB_PROG_ID   6
+#define EBPD_IFLA_XDP_HW_PROG_ID    7
+#define EBPD_IFLA_XDP_EXPECTED_FD   8
+#define EBPD_XDP_FLAGS_REPLACE      (1U << 4)
+
+#define EBPD_NL_BUFSIZE 32768
+
+struct ebpd_nl_req {
+    struct nlmsghdr  nh;
+    struct ifinfomsg ifinfo;
+    char             attrbuf[64];
+};
+
+static struct rtattr *
+ebpd_nl_add_attr (struct nlmsghdr *nh, int type, const void *data, int len)
+{
+    struct rtattr *rta = (struct rtattr *)
+        ((char *) nh + NLMSG_ALIGN(nh->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    if (len) {
+        memcpy(RTA_DATA(rta), data, len);
+    }
+    nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+    return rta;
+}
+
+static void
+ebpd_nl_end_nest (struct nlmsghdr *nh, struct rtattr *nest)
+{
+    nest->rta_len = (char *) nh + nh->nlmsg_len - (char *) nest;
+}
+
+static int
+ebpd_nl_open (void)
+{
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    int one = 1;
+    int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sock < 0) {
+        return -errno;
+    }
+    /* Extended ack is best effort; older kernels don't know about it */
+    setsockopt(sock, SOL_NETLINK, NETLINK_EXT_ACK, &one, sizeof(one));
+    if (bind(sock, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+        int ret = -errno;
+        close(sock);
+        return ret;
+    }
+    return sock;
+}
+
+/*
+ * Send a request and walk the replies, handing every non-error
+ * message to parse (if any). Returns 0 or a negative errno.
+ */
+static int
+ebpd_nl_talk (struct nlmsghdr *req,
+              int (*parse)(struct nlmsghdr *nh, void *arg), void *arg)
+{
+    char buf[EBPD_NL_BUFSIZE];
+    int sock = ebpd_nl_open();
+    if (sock < 0) {
+        return sock;
+    }
+    req->nlmsg_seq = 1;
+    int ret = 0;
+    if (send(sock, req, req->nlmsg_len, 0) < 0) {
+        ret = -errno;
+        goto out;
+    }
+    for (;;) {
+        ssize_t len = recv(sock, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ret = -errno;
+            goto out;
+        }
+        struct nlmsghdr *nh = (struct nlmsghdr *) buf;
+        for (; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_seq != req->nlmsg_seq) {
+                continue;
+            }
+            switch (nh->nlmsg_type) {
+            case NLMSG_ERROR:
+                ret = ((struct nlmsgerr *) NLMSG_DATA(nh))->error;
+                goto out;
+            case NLMSG_DONE:
+                goto out;
+            default:
+                if (parse) {
+                    ret = parse(nh, arg);
+                    if (ret) {
+                        goto out;
+                    }
+                }
+                /* Non-multipart replies are not followed by DONE */
+                if (!(nh->nlmsg_flags & NLM_F_MULTI)) {
+                    goto out;
+                }
+                break;
+            }
+        }
+    }
+out:
+    close(sock);
+    return ret;
+}
+
+static void
+ebpd_nl_init_link_req (struct ebpd_nl_req *req, int type, int flags,
+                       int ifindex)
+{
+    memset(req, 0, sizeof(*req));
+    req->nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req->nh.nlmsg_type = type;
+    req->nh.nlmsg_flags = NLM_F_REQUEST | flags;
+    req->ifinfo.ifi_family = AF_UNSPEC;
+    req->ifinfo.ifi_index = ifindex;
+}
+
+static int
+ebpd_nl_set_xdp (int ifindex, int prog_fd, int expected_fd, __u32 flags)
+{
+    struct ebpd_nl_req req;
+    ebpd_nl_init_link_req(&req, RTM_SETLINK, NLM_F_ACK, ifindex);
+
+    struct rtattr *nest = ebpd_nl_add_attr(&req.nh, IFLA_XDP | NLA_F_NESTED,
+                                           NULL, 0);
+    ebpd_nl_add_attr(&req.nh, IFLA_XDP_FD, &prog_fd, sizeof(prog_fd));
+    if (flags) {
+        ebpd_nl_add_attr(&req.nh, IFLA_XDP_FLAGS, &flags, sizeof(flags));
+    }
+    if (flags & EBPD_XDP_FLAGS_REPLACE) {
+        ebpd_nl_add_attr(&req.nh, EBPD_IFLA_XDP_EXPECTED_FD, &expected_fd,
+                         sizeof(expected_fd));
+    }
+    ebpd_nl_end_nest(&req.nh, nest);
+    return ebpd_nl_talk(&req.nh, NULL, NULL);
+}
+
+int
+ebpd_link_set_xdp (int ifindex, int prog_fd, __u32 flags)
+{
+    return ebpd_nl_set_xdp(ifindex, prog_fd, -1, flags);
+}
+
+static int
+ebpd_nl_parse_xdp (struct nlmsghdr *nh, void *arg)
+{
+    struct ebpd_xdp_link_info *info = arg;
+    struct ifinfomsg *ifinfo = NLMSG_DATA(nh);
+    __u32 prog_id = 0;
+
+    if (nh->nlmsg_type != RTM_NEWLINK) {
+        return 0;
+    }
+    int len = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifinfo));
+    struct rtattr *rta = IFLA_RTA(ifinfo);
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if ((rta->rta_type & ~NLA_F_NESTED) != IFLA_XDP) {
+            continue;
+        }
+        int xlen = RTA_PAYLOAD(rta);
+        struct rtattr *xrta = RTA_DATA(rta);
+        for (; RTA_OK(xrta, xlen); xrta = RTA_NEXT(xrta, xlen)) {
+            switch (xrta->rta_type) {
+            case IFLA_XDP_ATTACHED:
+                info->attach_mode = *(__u8 *) RTA_DATA(xrta);
+                break;
+            case IFLA_XDP_PROG_ID:
+                prog_id = *(__u32 *) RTA_DATA(xrta);
+                break;
+            case EBPD_IFLA_XDP_DRV_PROG_ID:
+                info->drv_prog_id = *(__u32 *) RTA_DATA(xrta);
+                break;
+            case EBPD_IFLA_XDP_SKB_PROG_ID:
+                info->skb_prog_id = *(__u32 *) RTA_DATA(xrta);
+                break;
+            case EBPD_IFLA_XDP_HW_PROG_ID:
+                info->hw_prog_id = *(__u32 *) RTA_DATA(xrta);
+                break;
+            }
+        }
+    }
+    /*
+     * Kernels without multi-attach only report the id of the single
+     * attached program; file it under its mode.
+     */
+    switch (info->attach_mode) {
+    case XDP_ATTACHED_DRV:
+        if (!info->drv_prog_id) {
+            info->drv_prog_id = prog_id;
+        }
+        break;
+    case XDP_ATTACHED_SKB:
+        if (!info->skb_prog_id) {
+            info->skb_prog_id = prog_id;
+        }
+        break;
+    case XDP_ATTACHED_HW:
+        if (!info->hw_prog_id) {
+            info->hw_prog_id = prog_id;
+        }
+        break;
+    }
+    return 0;
+}
+
+int
+ebpd_link_get_xdp (int ifindex, struct ebpd_xdp_link_info *info)
+{
+    struct ebpd_nl_req req;
+    ebpd_nl_init_link_req(&req, RTM_GETLINK, 0, ifindex);
+    memset(info, 0, sizeof(*info));
+    return ebpd_nl_talk(&req.nh, ebpd_nl_parse_xdp, info);
+}
+
+static int
+ebpd_prog_id (int prog_fd, __u32 *prog_id)
+{
+    struct bpf_prog_info prog_info;
+    union bpf_attr attr;
+
+    memset(&prog_info, 0, sizeof(prog_info));
+    memset(&attr, 0, sizeof(attr));
+    attr.info.bpf_fd = prog_fd;
+    attr.info.info_len = sizeof(prog_info);
+    attr.info.info = (__u64) (unsigned long) &prog_info;
+    if (syscall(__NR_bpf, BPF_OBJ_GET_INFO_BY_FD, &attr, sizeof(attr))) {
+        return -errno;
+    }
+    *prog_id = prog_info.id;
+    return 0;
+}
+
+int
+ebpd_link_xdp_mode (int ifindex, int prog_fd, __u8 *attach_mode)
+{
+    struct ebpd_xdp_link_info info;
+    __u32 prog_id = 0;
+
+    int ret = ebpd_prog_id(prog_fd, &prog_id);
+    if (ret) {
+        return ret;
+    }
+    ret = ebpd_link_get_xdp(ifindex, &info);
+    if (ret) {
+        return ret;
+    }
+    if (info.drv_prog_id == prog_id) {
+        *attach_mode = XDP_ATTACHED_DRV;
+    } else if (info.skb_prog_id == prog_id) {
+        *attach_mode = XDP_ATTACHED_SKB;
+    } else if (info.hw_prog_id == prog_id) {
+        *attach_mode = XDP_ATTACHED_HW;
+    } else {
+        *attach_mode = XDP_ATTACHED_NONE;
+    }
+    return 0;
+}
+
+int
+ebpd_link_detach_xdp (int ifindex, int prog_fd)
+{
+    __u8 attach_mode = XDP_ATTACHED_NONE;
+    __u32 flags = 0;
+
+    int ret = ebpd_link_xdp_mode(ifindex, prog_fd, &attach_mode);
+    if (ret) {
+        return ret;
+    }
+    switch (attach_mode) {
+    case XDP_ATTACHED_DRV:
+        flags = XDP_FLAGS_DRV_MODE;
+        break;
+    case XDP_ATTACHED_SKB:
+        flags = XDP_FLAGS_SKB_MODE;
+        break;
+    case XDP_ATTACHED_HW:
+        flags = XDP_FLAGS_HW_MODE;
+        break;
+    default:
+        return 0;
+    }
+    return ebpd_link_set_xdp(ifindex, -1, flags);
+}
+
+/*
+ * Whether the kernel knows XDP_FLAGS_REPLACE (and IFLA_XDP_EXPECTED_FD),
+ * added in 5.7. Older kernels reject unknown flags with EINVAL, while
+ * newer ones treat flags without a program fd as a no-op, so sending
+ * just the flag tells them apart. The answer is cached. Returns 1, 0
+ * or a negative errno.
+ */
+static int
+ebpd_nl_has_xdp_replace (int ifindex)
+{
+    static int has_replace = -1;
+    __u32 flags = EBPD_XDP_FLAGS_REPLACE;
+    struct ebpd_nl_req req;
+
+    if (has_replace >= 0) {
+        return has_replace;
+    }
+    ebpd_nl_init_link_req(&req, RTM_SETLINK, NLM_F_ACK, ifindex);
+    struct rtattr *nest = ebpd_nl_add_attr(&req.nh, IFLA_XDP | NLA_F_NESTED,
+                                           NULL, 0);
+    ebpd_nl_add_attr(&req.nh, IFLA_XDP_FLAGS, &flags, sizeof(flags));
+    ebpd_nl_end_nest(&req.nh, nest);
+    int ret = ebpd_nl_talk(&req.nh, NULL, NULL);
+    if (ret && ret != -EINVAL) {
+        return ret;
+    }
+    has_replace = !ret;
+    return has_replace;
+}
+
+int
+ebpd_link_replace_xdp (int ifindex, int prog_fd, int old_prog_fd, __u32 flags)
+{
+    __u8 attach_mode = XDP_ATTACHED_NONE;
+
+    flags &= ~XDP_FLAGS_UPDATE_IF_NOEXIST;
+    int ret = ebpd_nl_has_xdp_replace(ifindex);
+    if (ret < 0) {
+        return ret;
+    }
+    if (ret) {
+        return ebpd_nl_set_xdp(ifindex, prog_fd, old_prog_fd,
+                               flags | EBPD_XDP_FLAGS_REPLACE);
+    }
+    /*
+     * Without XDP_FLAGS_REPLACE the swap itself is still atomic, only
+     * the compare is not: check the expected program is attached, and
+     * accept the small race against other writers of the link.
+     */
+    ret = ebpd_link_xdp_mode(ifindex, old_prog_fd, &attach_mode);
+    if (ret) {
+        return ret;
+    }
+    if (attach_mode == XDP_ATTACHED_NONE ||
+        ((flags & XDP_FLAGS_SKB_MODE) && attach_mode != XDP_ATTACHED_SKB) ||
+        ((flags & XDP_FLAGS_DRV_MODE) && attach_mode != XDP_ATTACHED_DRV) ||
+        ((flags & XDP_FLAGS_HW_MODE) && attach_mode != XDP_ATTACHED_HW)) {
+        return -EEXIST;
+    }
+    return ebpd_nl_set_xdp(ifindex, prog_fd, -1, flags);
+}
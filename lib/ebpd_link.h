@@ -0,0 +1,64 @@
+#ifndef LIB_EBPD_LINK_H_
+#define LIB_EBPD_LINK_H_
+
+#include <linux/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Link (network interface) level XDP utilities, built on rtnetlink */
+
+/*
+ * XDP programs attached to a link, as reported by the kernel.
+ * attach_mode is one of XDP_ATTACHED_*; per-mode ids are 0 when
+ * nothing is attached in that mode.
+ */
+struct ebpd_xdp_link_info {
+    __u8  attach_mode;
+    __u32 drv_prog_id;
+    __u32 skb_prog_id;
+    __u32 hw_prog_id;
+};
+
+/*
+ * API to attach an xdp program to a link
+ * prog_fd - program to attach, or -1 to detach whatever is attached
+ * flags - XDP_FLAGS_* selecting the mode (SKB/DRV/HW) and update policy
+ */
+extern int ebpd_link_set_xdp (int ifindex, int prog_fd, __u32 flags);
+
+/*
+ * API to query the xdp programs attached to a link
+ */
+extern int ebpd_link_get_xdp (int ifindex, struct ebpd_xdp_link_info *info);
+
+/*
+ * API to find the mode a program is attached in on a link
+ * attach_mode - set to XDP_ATTACHED_DRV/SKB/HW, or XDP_ATTACHED_NONE
+ *               if the program is not attached to the link
+ */
+extern int ebpd_link_xdp_mode (int ifindex, int prog_fd, __u8 *attach_mode);
+
+/*
+ * API to detach a program from a link, in whichever mode it is attached.
+ * Programs attached by someone else are left alone; returns 0 if the
+ * program was not attached.
+ */
+extern int ebpd_link_detach_xdp (int ifindex, int prog_fd);
+
+/*
+ * API to atomically swap the xdp program on a link, provided old_prog_fd
+ * is the program currently attached in the mode selected by flags.
+ * Packets see either the old or the new program, never none.
+ * Returns -EEXIST if a different program is attached.
+ */
+extern int ebpd_link_replace_xdp (int ifindex, int prog_fd, int old_prog_fd,
+                                  __u32 flags);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif  // LIB_EBPD_LINK_H_
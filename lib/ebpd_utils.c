@@ -1,8 +1,40 @@
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
 #include <linux/err.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bpf/bpf.h"
 #include "bpf/libbpf.h"
 #include "lib/ebpd_utils.h"
 
+/*
+ * libbpf keeps every open object in a global list, which opening and
+ * closing objects change without a lock. Both happen under this one;
+ * loading objects, the slow part, runs in parallel.
+ */
+static pthread_mutex_t ebpd_objects_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct bpf_object *
+ebpd_open_buffer (void *buf, int buf_size, const char *name)
+{
+    pthread_mutex_lock(&ebpd_objects_lock);
+    struct bpf_object *obj = bpf_object__open_buffer(buf, buf_size, name);
+    pthread_mutex_unlock(&ebpd_objects_lock);
+    return obj;
+}
+
+static void
+ebpd_close (struct bpf_object *obj)
+{
+    pthread_mutex_lock(&ebpd_objects_lock);
+    bpf_object__close(obj);
+    pthread_mutex_unlock(&ebpd_objects_lock);
+}
+
 int
 ebpd_load_xdp_prog (const char *filepath, int ifindex, void **handle)
 {
@@ -14,7 +46,10 @@ ebpd_load_xdp_prog (const char *filepath, int ifindex, void **handle)
     };
     int prog_fd = -1;
 
+    /* Opens, loads and on failure closes: all of it under the lock */
+    pthread_mutex_lock(&ebpd_objects_lock);
     int ret = bpf_prog_load_xattr(&load_attr, &obj, &prog_fd);
+    pthread_mutex_unlock(&ebpd_objects_lock);
     if (ret) {
         printf("Error loading file(%s) (%d): %s\n",
                filepath, ret, strerror(-ret));
@@ -25,45 +60,342 @@ ebpd_load_xdp_prog (const char *filepath, int ifindex, void **handle)
     return 0;
 }
 
-int
-ebpd_load_xdp_buffer (void *buf, int buf_size, const char *name, void **handle)
+/*
+ * Create 'path' if missing, as a directory only we can access
+ */
+static int
+ebpd_mkdir (const char *path)
 {
-    struct bpf_object *obj = bpf_object__open_buffer(buf, buf_size, name);
-    if (IS_ERR_OR_NULL(obj)) {
-        return PTR_ERR(obj);
+    if (mkdir(path, 0700) && errno != EEXIST) {
+        return -errno;
     }
-    printf("BPF buffer opened, obj: %p\n", obj);
+    return 0;
+}
+
+static int
+ebpd_pin_path (char *path, const char *pin_dir, const char *name)
+{
+    int len = snprintf(path, PATH_MAX, "%s/%s", pin_dir, name);
+    return len < 0 || len >= PATH_MAX ? -ENAMETOOLONG : 0;
+}
+
+/*
+ * Whether libbpf picks the size of the map at load time instead of taking
+ * max_entries from the elf: perf event arrays declared without entries
+ * get one per possible cpu
+ */
+static int
+ebpd_map_sized_on_load (const struct bpf_map_def *def)
+{
+    return def->type == BPF_MAP_TYPE_PERF_EVENT_ARRAY && !def->max_entries;
+}
+
+/*
+ * Whether the map behind fd was created with the definition in the elf;
+ * reusing a map of another layout would corrupt it
+ */
+static int
+ebpd_map_matches (int fd, const struct bpf_map_def *def)
+{
+    struct bpf_map_info info = {};
+    __u32 info_len = sizeof(info);
+
+    if (bpf_obj_get_info_by_fd(fd, &info, &info_len)) {
+        return 0;
+    }
+    return info.type == def->type &&
+           info.key_size == def->key_size &&
+           info.value_size == def->value_size &&
+           (info.max_entries == def->max_entries ||
+            ebpd_map_sized_on_load(def)) &&
+           info.map_flags == def->map_flags;
+}
+
+/*
+ * Make the maps of an opened, not yet loaded object reuse the maps pinned
+ * in pin_dir, if any. Pins of maps whose definition changed are removed:
+ * their contents cannot be carried over.
+ */
+static int
+ebpd_reuse_pinned_maps (struct bpf_object *obj, const char *pin_dir)
+{
+    struct bpf_map *map = NULL;
+    char path[PATH_MAX];
+
+    bpf_object__for_each_map(map, obj) {
+        int ret = ebpd_pin_path(path, pin_dir, bpf_map__name(map));
+        if (ret) {
+            return ret;
+        }
+        int fd = bpf_obj_get(path);
+        if (fd < 0) {
+            if (errno == ENOENT) {
+                continue;
+            }
+            return -errno;
+        }
+        if (!ebpd_map_matches(fd, bpf_map__def(map))) {
+            printf("BPF map %s definition changed, discarding pinned map\n", path);
+            close(fd);
+            if (unlink(path)) {
+                return -errno;
+            }
+            continue;
+        }
+        /* reuse_fd duplicates fd */
+        ret = bpf_map__reuse_fd(map, fd);
+        close(fd);
+        if (ret) {
+            return ret;
+        }
+        printf("BPF map %s reused\n", path);
+    }
+    return 0;
+}
+
+/*
+ * Pin the maps of a loaded object in pin_dir. Maps reused from there are
+ * already pinned.
+ */
+static int
+ebpd_pin_maps (struct bpf_object *obj, const char *pin_dir)
+{
+    struct bpf_map *map = NULL;
+    char path[PATH_MAX];
+
+    bpf_object__for_each_map(map, obj) {
+        int ret = ebpd_pin_path(path, pin_dir, bpf_map__name(map));
+        if (ret) {
+            return ret;
+        }
+        if (bpf_obj_pin(bpf_map__fd(map), path) && errno != EEXIST) {
+            return -errno;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Make the maps of an opened, not yet loaded object named in reuse use the
+ * given fds instead of creating their own. Names the object does not have
+ * are skipped.
+ */
+static int
+ebpd_reuse_maps (struct bpf_object *obj, const struct ebpd_map_reuse *reuse,
+                 int reuse_count)
+{
+    for (int i = 0; i < reuse_count; i++) {
+        struct bpf_map *map = bpf_object__find_map_by_name(obj, reuse[i].name);
+        if (IS_ERR_OR_NULL(map)) {
+            continue;
+        }
+        int ret = bpf_map__reuse_fd(map, reuse[i].fd);
+        if (ret) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Expected attach types of second-stage programs, newer than the uapi headers
+ * we build against
+ */
+#define EBPD_XDP_DEVMAP 33
+#define EBPD_XDP_CPUMAP 35
+
+static int
+ebpd_has_prefix (const char *str, const char *prefix)
+{
+    return !strncmp(str, prefix, strlen(prefix));
+}
+
+/*
+ * Whether CPUMAP entries can carry a program (linux 5.9): older kernels
+ * only take a queue size as value, and reject CPUMAP maps of larger values
+ */
+static int
+ebpd_has_cpumap_progs (void)
+{
+    int fd = bpf_create_map(BPF_MAP_TYPE_CPUMAP, sizeof(__u32),
+                            2 * sizeof(__u32), 1, 0);
+    if (fd < 0) {
+        /* Leave failures for other reasons to the load */
+        return errno != EINVAL;
+    }
+    close(fd);
+    return 1;
+}
+
+static int
+ebpd_load_object (struct bpf_object *obj, const char *pin_dir,
+                  const struct ebpd_map_reuse *reuse, int reuse_count)
+{
     struct bpf_program *prog = NULL;
+    int cpumap_progs = 0;
     /* set the prog_type to XDP for each program */
     bpf_object__for_each_program(prog, obj) {
         if (IS_ERR_OR_NULL(prog)) {
             return PTR_ERR(prog);
         }
         bpf_program__set_type(prog, BPF_PROG_TYPE_XDP);
+        const char *title = bpf_program__title(prog, false);
+        if (ebpd_has_prefix(title, EBPD_SEC_XDP_DEVMAP)) {
+            bpf_program__set_expected_attach_type(
+                prog, (enum bpf_attach_type) EBPD_XDP_DEVMAP);
+        } else if (ebpd_has_prefix(title, EBPD_SEC_XDP_CPUMAP)) {
+            bpf_program__set_expected_attach_type(
+                prog, (enum bpf_attach_type) EBPD_XDP_CPUMAP);
+            cpumap_progs = 1;
+        }
         /*
          * Do not set ifindex as part of this, which again
          * results in syscall failure. That should probably
          * be done as part of set link api (To be explored)
          */
     }
-    int ret = bpf_object__load(obj);
+    /* The kernel would only reject the programs with EINVAL */
+    if (cpumap_progs && !ebpd_has_cpumap_progs()) {
+        printf("Error: programs in %s sections need linux 5.9\n",
+               EBPD_SEC_XDP_CPUMAP);
+        return -ENOTSUP;
+    }
+    if (pin_dir) {
+        int ret = ebpd_reuse_pinned_maps(obj, pin_dir);
+        if (ret) {
+            return ret;
+        }
+    }
+    int ret = ebpd_reuse_maps(obj, reuse, reuse_count);
+    if (ret) {
+        return ret;
+    }
+    ret = bpf_object__load(obj);
+    if (ret || !pin_dir) {
+        return ret;
+    }
+    return ebpd_pin_maps(obj, pin_dir);
+}
+
+static int
+ebpd_open_and_load (void *buf, int buf_size, const char *name, const char *pin_dir,
+                    const struct ebpd_map_reuse *reuse, int reuse_count, void **handle)
+{
+    if (pin_dir) {
+        int ret = ebpd_mkdir(EBPD_PIN_ROOT);
+        if (!ret) {
+            ret = ebpd_mkdir(pin_dir);
+        }
+        if (ret) {
+            printf("Error creating pin directory %s (%d)\n", pin_dir, ret);
+            return ret;
+        }
+    }
+    struct bpf_object *obj = ebpd_open_buffer(buf, buf_size, name);
+    if (IS_ERR_OR_NULL(obj)) {
+        return PTR_ERR(obj);
+    }
+    printf("BPF buffer opened, obj: %p\n", obj);
+    int ret = ebpd_load_object(obj, pin_dir, reuse, reuse_count);
     switch (ret) {
     case 0:
         *handle = obj;
         break;
     default:
-        bpf_object__close(obj);
+        ebpd_close(obj);
         break;
     }
     return ret;
 }
 
+int
+ebpd_load_xdp_buffer (void *buf, int buf_size, const char *name, void **handle)
+{
+    return ebpd_open_and_load(buf, buf_size, name, NULL, NULL, 0, handle);
+}
+
+int
+ebpd_load_xdp_buffer_pinned (void *buf, int buf_size, const char *name,
+                             const char *pin_dir, void **handle)
+{
+    return ebpd_open_and_load(buf, buf_size, name, pin_dir, NULL, 0, handle);
+}
+
+int
+ebpd_load_xdp_buffer_reuse (void *buf, int buf_size, const char *name,
+                            const struct ebpd_map_reuse *reuse, int reuse_count,
+                            void **handle)
+{
+    return ebpd_open_and_load(buf, buf_size, name, NULL, reuse, reuse_count, handle);
+}
+
+int
+ebpd_unpin_maps (const char *pin_dir)
+{
+    char path[PATH_MAX];
+    DIR *dir = opendir(pin_dir);
+
+    if (!dir) {
+        return errno == ENOENT ? 0 : -errno;
+    }
+    int ret = 0;
+    struct dirent *entry = NULL;
+    while (!ret && (entry = readdir(dir))) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+            continue;
+        }
+        ret = ebpd_pin_path(path, pin_dir, entry->d_name);
+        if (!ret && unlink(path)) {
+            ret = -errno;
+        }
+    }
+    closedir(dir);
+    if (!ret && rmdir(pin_dir)) {
+        ret = -errno;
+    }
+    return ret;
+}
+
+int
+ebpd_get_prog_fd (void *handle, const char *section)
+{
+    struct bpf_object *obj = (struct bpf_object *) handle;
+    struct bpf_program *prog = NULL;
+
+    if (!obj) {
+        return -EINVAL;
+    }
+    bpf_object__for_each_program(prog, obj) {
+        if (!section || !strcmp(bpf_program__title(prog, false), section)) {
+            return bpf_program__fd(prog);
+        }
+    }
+    return -ENOENT;
+}
+
+int
+ebpd_get_map_fd (void *handle, const char *name)
+{
+    struct bpf_object *obj = (struct bpf_object *) handle;
+    struct bpf_map *map = NULL;
+
+    if (!obj) {
+        return -EINVAL;
+    }
+    bpf_object__for_each_map(map, obj) {
+        if (!strcmp(bpf_map__name(map), name)) {
+            return bpf_map__fd(map);
+        }
+    }
+    return -ENOENT;
+}
+
 void
 ebpd_unload (void *handle)
 {
     if (handle) {
         struct bpf_object *obj = (struct bpf_object *) handle;
-        bpf_object__close(obj);
+        ebpd_close(obj);
     }
 }
 
@@ -18,6 +18,67 @@ extern int ebpd_load_xdp_prog (const char *filepath, int ifindex, void **handle)
  */
 extern int ebpd_load_xdp_buffer (void *buf, int buf_size, const char *name, void **handle);
 
+/*
+ * Programs in sections starting with these names are loaded to run on
+ * packets redirected through a DEVMAP entry (linux 5.8) or CPUMAP entry
+ * (linux 5.9) rather than attached to a link, see lib/bpf/redirect_map.h.
+ * Names follow libbpf's, e.g. "xdp_devmap/rewrite". Objects with CPUMAP
+ * programs fail to load with -ENOTSUP on older kernels.
+ */
+#define EBPD_SEC_XDP_DEVMAP "xdp_devmap"
+#define EBPD_SEC_XDP_CPUMAP "xdp_cpumap"
+
+/*
+ * Directory of per-object directories pinning their maps, in bpffs
+ */
+#define EBPD_PIN_ROOT "/sys/fs/bpf/ebplane"
+
+/*
+ * API to load ebpf object code from a buffer into kernel, keeping its maps
+ * pinned in pin_dir (created if needed, along with EBPD_PIN_ROOT) so they
+ * outlive the process. Maps already pinned there with the same definition
+ * are reused with their contents instead of created; pins of maps whose
+ * definition changed are replaced.
+ */
+extern int ebpd_load_xdp_buffer_pinned (void *buf, int buf_size, const char *name,
+                                        const char *pin_dir, void **handle);
+
+/*
+ * A map of an object to be loaded that should use an existing map instead
+ * of creating its own, e.g. to share it with other objects
+ */
+struct ebpd_map_reuse {
+    const char *name;   /* name of the map variable in the elf */
+    int fd;             /* map to use, stays owned by the caller */
+};
+
+/*
+ * API to load ebpf object code from a buffer into kernel, its maps named in
+ * reuse using the given maps. Maps of the object not named are created as
+ * usual; names the object does not have are ignored.
+ */
+extern int ebpd_load_xdp_buffer_reuse (void *buf, int buf_size, const char *name,
+                                       const struct ebpd_map_reuse *reuse,
+                                       int reuse_count, void **handle);
+
+/*
+ * API to remove the maps pinned in pin_dir, and pin_dir itself. Maps go
+ * away once no loaded program uses them anymore.
+ */
+extern int ebpd_unpin_maps (const char *pin_dir);
+
+/*
+ * API to get the fd of a program in a loaded bpf object
+ * section - elf section (title) of the program, or NULL for the first one
+ */
+extern int ebpd_get_prog_fd (void *handle, const char *section);
+
+/*
+ * API to get the fd of a map in a loaded bpf object, owned by the object
+ * name - name of the map variable in the elf
+ */
+extern int ebpd_get_map_fd (void *handle, const char *name);
+
 /*
  * API to unload a previously loaded bpf object
  */
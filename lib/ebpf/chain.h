@@ -0,0 +1,58 @@
+#ifndef LIB_EBPF_CHAIN_H_
+#define LIB_EBPF_CHAIN_H_
+
+#include "lib/ebpf/helpers.h"
+#include "lib/ebpf/utils.h"
+
+// Pipeline of xdp programs calling each other through tail calls, managed by
+// XdpChain (lib/xdp_chain.h). Each stage is a separate program, verified on
+// its own, in a slot of the "chain" BPF_MAP_TYPE_PROG_ARRAY; userspace fills,
+// swaps and clears slots at runtime.
+//
+// Programs hand the packet to the next stage with
+//
+//   return ebpd_chain_next(ctx, EBPD_STAGE_ACL + 1);
+//
+// which jumps to the first filled slot from there on, skipping empty ones,
+// and passes the packet to the stack past the last one. The entry program
+// attached to the link starts the pipeline with ebpd_chain_next(ctx, 0).
+//
+// Include this header once per program: it defines the map, which XdpChain
+// shares between all the objects it loads.
+
+// Keep in sync with kXdpChainMaxStages.
+#define EBPD_CHAIN_MAX_STAGES 8
+
+// Slots of the stages of our pipeline, in order.
+enum ebpd_stage {
+    EBPD_STAGE_PARSE = 0,
+    EBPD_STAGE_CLASSIFY = 1,
+    EBPD_STAGE_ACL = 2,
+    EBPD_STAGE_NAT = 3,
+    EBPD_STAGE_FORWARD = 4,
+};
+
+__section("maps")
+struct bpf_map_def chain = {
+    .type = BPF_MAP_TYPE_PROG_ARRAY,
+    .key_size = sizeof(__u32),
+    .value_size = sizeof(__u32),
+    .max_entries = EBPD_CHAIN_MAX_STAGES,
+};
+
+// Jump to the first stage from 'stage' on. Only returns, with XDP_PASS, if
+// all of them are empty; a successful tail call never returns. The kernel
+// caps chains at 33 tail calls per packet.
+static __attribute__((always_inline)) inline int
+ebpd_chain_next(struct xdp_md *ctx, __u32 stage)
+{
+#pragma clang loop unroll(full)
+    for (__u32 i = 0; i < EBPD_CHAIN_MAX_STAGES; i++) {
+        if (i >= stage) {
+            bpf_tail_call(ctx, &chain, i);
+        }
+    }
+    return XDP_PASS;
+}
+
+#endif
@@ -0,0 +1,181 @@
+#include "lib/ebpf/conntrack_maps.h"
+#include "lib/ebpf/helpers.h"
+#include "lib/ebpf/parse.h"
+#include "lib/ebpf/utils.h"
+
+/*
+ * Connection tracking: every IPv4 and IPv6 packet updates the state of its
+ * connection in "connections", created on its first packet. Packets all pass;
+ * later stages (e.g. an ACL in an XdpChain) read the state to decide.
+ *
+ * Connections go away when idle: the LRU map evicts the least recently used
+ * ones when full, and ConntrackSweeper (lib/conntrack.h) expires them by
+ * state specific timeouts before that.
+ *
+ * TCP connections picked up mid-stream, e.g. after their entry expired or
+ * across a restart, start ESTABLISHED rather than being refused. Fragments
+ * other than the first are not tracked.
+ *
+ * Built with -DEBPD_CONNTRACK_PERCPU_LRU the map keeps one LRU list per CPU
+ * instead of a shared one: no lock shared by all CPUs on inserts, but each
+ * CPU only evicts from its own share of the entries.
+ */
+
+#ifdef EBPD_CONNTRACK_PERCPU_LRU
+#define CONNTRACK_MAP_FLAGS BPF_F_NO_COMMON_LRU
+#else
+#define CONNTRACK_MAP_FLAGS 0
+#endif
+
+__section("maps")
+struct bpf_map_def connections = {
+    .type = BPF_MAP_TYPE_LRU_HASH,
+    .key_size = sizeof(struct ebpd_ct_key),
+    .value_size = sizeof(struct ebpd_ct_entry),
+    .max_entries = EBPD_CONNTRACK_MAX_ENTRIES,
+    .map_flags = CONNTRACK_MAP_FLAGS,
+};
+
+/*
+ * Fill 'key' with the connection of 'pkt', swapping source and destination
+ * if 'reply'.
+ */
+__ebpd_inline void
+fill_key(struct ebpd_packet *pkt, struct ebpd_ct_key *key, int reply)
+{
+    __u8 *src = reply ? key->daddr : key->saddr;
+    __u8 *dst = reply ? key->saddr : key->daddr;
+    if (pkt->l3_proto == ebpd_htons(EBPD_ETH_P_IP)) {
+        key->family = EBPD_CT_IPV4;
+        __builtin_memcpy(src, &pkt->ip->saddr, 4);
+        __builtin_memcpy(dst, &pkt->ip->daddr, 4);
+    } else {
+        key->family = EBPD_CT_IPV6;
+        __builtin_memcpy(src, pkt->ip6->saddr, 16);
+        __builtin_memcpy(dst, pkt->ip6->daddr, 16);
+    }
+    key->proto = pkt->l4_proto;
+    if (pkt->l4) {
+        /* TCP and UDP both start with the ports. */
+        key->sport = reply ? pkt->udp->dest : pkt->udp->source;
+        key->dport = reply ? pkt->udp->source : pkt->udp->dest;
+    }
+}
+
+/*
+ * State of a new connection starting with 'pkt', whose TCP flags are
+ * 'flags'. Returns -1 for packets that cannot start one.
+ */
+__ebpd_inline int
+first_state(struct ebpd_packet *pkt, __u8 flags)
+{
+    if (pkt->l4_proto != EBPD_IPPROTO_TCP) {
+        return EBPD_CT_NEW;
+    }
+    if (flags & EBPD_TCP_RST) {
+        return -1;
+    }
+    if ((flags & (EBPD_TCP_SYN | EBPD_TCP_ACK)) == EBPD_TCP_SYN) {
+        return EBPD_CT_SYN_SENT;
+    }
+    return EBPD_CT_ESTABLISHED;
+}
+
+/*
+ * Move 'entry' to its next state for a packet with TCP flags 'flags', sent
+ * by the responder if 'reply'.
+ */
+__ebpd_inline void
+next_state(struct ebpd_packet *pkt, struct ebpd_ct_entry *entry, __u8 flags,
+           int reply)
+{
+    if (pkt->l4_proto != EBPD_IPPROTO_TCP) {
+        if (reply) {
+            entry->state = EBPD_CT_REPLIED;
+        }
+        return;
+    }
+    if (flags & EBPD_TCP_RST) {
+        entry->state = EBPD_CT_CLOSING;
+        return;
+    }
+    switch (entry->state) {
+    case EBPD_CT_SYN_SENT:
+        if (reply && (flags & EBPD_TCP_SYN) && (flags & EBPD_TCP_ACK)) {
+            entry->state = EBPD_CT_SYN_RECV;
+        }
+        break;
+    case EBPD_CT_SYN_RECV:
+        if (!reply && (flags & EBPD_TCP_ACK) && !(flags & EBPD_TCP_SYN)) {
+            entry->state = EBPD_CT_ESTABLISHED;
+        }
+        break;
+    case EBPD_CT_ESTABLISHED:
+    case EBPD_CT_FIN_WAIT:
+        if (flags & EBPD_TCP_FIN) {
+            entry->flags |= reply ? EBPD_CT_F_FIN_REPLY : EBPD_CT_F_FIN_ORIG;
+            entry->state = entry->flags == (EBPD_CT_F_FIN_ORIG |
+                                            EBPD_CT_F_FIN_REPLY) ?
+                           EBPD_CT_CLOSING : EBPD_CT_FIN_WAIT;
+        }
+        break;
+    case EBPD_CT_CLOSING:
+        /* A new SYN reuses the tuple of a closed connection. */
+        if (!reply && (flags & (EBPD_TCP_SYN | EBPD_TCP_ACK)) ==
+                      EBPD_TCP_SYN) {
+            entry->state = EBPD_CT_SYN_SENT;
+            entry->flags = 0;
+        }
+        break;
+    }
+}
+
+__section("xdp")
+int conntrack(struct xdp_md *ctx)
+{
+    struct ebpd_cursor cursor;
+    struct ebpd_packet pkt;
+    ebpd_cursor_init(&cursor, ctx);
+    if (ebpd_parse_packet(&cursor, &pkt) || !pkt.l3 ||
+        pkt.l4_proto == EBPD_IPPROTO_NONE) {
+        return XDP_PASS;
+    }
+    const __u8 flags = pkt.l4_proto == EBPD_IPPROTO_TCP && pkt.tcp ?
+                       pkt.tcp->flags : 0;
+    const __u64 now = bpf_ktime_get_ns();
+    const __u64 len = ctx->data_end - ctx->data;
+
+    struct ebpd_ct_key key = {};
+    fill_key(&pkt, &key, 0);
+    int reply = 0;
+    struct ebpd_ct_entry *entry = bpf_map_lookup_elem(&connections, &key);
+    if (!entry) {
+        fill_key(&pkt, &key, 1);
+        reply = 1;
+        entry = bpf_map_lookup_elem(&connections, &key);
+    }
+    if (!entry) {
+        const int state = first_state(&pkt, flags);
+        if (state < 0) {
+            return XDP_PASS;
+        }
+        fill_key(&pkt, &key, 0);
+        struct ebpd_ct_entry new_entry = {
+            .last_seen = now,
+            .packets = 1,
+            .bytes = len,
+            .state = state,
+        };
+        /* Losing a race with another CPU creating it is fine too. */
+        bpf_map_update_elem(&connections, &key, &new_entry, BPF_NOEXIST);
+        return XDP_PASS;
+    }
+    entry->last_seen = now;
+    __sync_fetch_and_add(&entry->packets, 1);
+    __sync_fetch_and_add(&entry->bytes, len);
+    next_state(&pkt, entry, flags, reply);
+    return XDP_PASS;
+}
+
+__section("license")
+char _license[] = "GPL";
@@ -0,0 +1,52 @@
+#ifndef LIB_EBPF_CONNTRACK_MAPS_H_
+#define LIB_EBPF_CONNTRACK_MAPS_H_
+
+#include <linux/types.h>
+
+// Map of lib/ebpf/conntrack.c, shared with the userspace code sweeping it
+// (lib/conntrack.h).
+
+// A connection, as its originator sent its first packet seen. IPv4
+// addresses fill the first 4 bytes of the address fields, the rest is zero.
+// Ports are zero for protocols other than TCP and UDP.
+struct ebpd_ct_key {
+    __u8 saddr[16];
+    __u8 daddr[16];
+    __be16 sport;
+    __be16 dport;
+    __u8 proto;
+    __u8 family;  // EBPD_CT_IPV4 or EBPD_CT_IPV6
+    __u8 pad[2];
+};
+
+#define EBPD_CT_IPV4 4
+#define EBPD_CT_IPV6 6
+
+// States of connections. TCP follows the handshake and teardown, as seen
+// from both directions; other protocols only track whether the responder
+// replied.
+enum ebpd_ct_state {
+    EBPD_CT_NEW = 0,          // seen from the originator only
+    EBPD_CT_REPLIED = 1,      // seen both ways
+    EBPD_CT_SYN_SENT = 2,
+    EBPD_CT_SYN_RECV = 3,
+    EBPD_CT_ESTABLISHED = 4,
+    EBPD_CT_FIN_WAIT = 5,     // FIN seen one way
+    EBPD_CT_CLOSING = 6,      // FIN seen both ways, or RST
+};
+
+// Directions a FIN was seen in, in ebpd_ct_entry.flags.
+#define EBPD_CT_F_FIN_ORIG 0x1
+#define EBPD_CT_F_FIN_REPLY 0x2
+
+struct ebpd_ct_entry {
+    __u64 last_seen;  // bpf_ktime_get_ns(), i.e. CLOCK_MONOTONIC
+    __u64 packets;
+    __u64 bytes;
+    __u32 state;
+    __u32 flags;
+};
+
+#define EBPD_CONNTRACK_MAX_ENTRIES (1 << 20)
+
+#endif
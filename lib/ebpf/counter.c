@@ -0,0 +1,31 @@
+#include "lib/ebpf/helpers.h"
+#include "lib/ebpf/utils.h"
+
+/*
+ * Number of packets seen, in the single entry of an array: userspace reads
+ * and resets it by key 0.
+ */
+__section("maps")
+struct bpf_map_def packets = {
+    .type = BPF_MAP_TYPE_ARRAY,
+    .key_size = sizeof(__u32),
+    .value_size = sizeof(__u64),
+    .max_entries = 1,
+};
+
+/*
+ * Count every packet and pass it on.
+ */
+__section("xdp")
+int counter(struct xdp_md *ctx)
+{
+    const __u32 key = 0;
+    __u64 *count = bpf_map_lookup_elem(&packets, &key);
+    if (count) {
+        __sync_fetch_and_add(count, 1);
+    }
+    return XDP_PASS;
+}
+
+__section("license")
+char _license[] = "GPL";
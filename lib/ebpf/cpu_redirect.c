@@ -0,0 +1,106 @@
+#include "lib/ebpf/helpers.h"
+#include "lib/ebpf/parse.h"
+#include "lib/ebpf/utils.h"
+
+/*
+ * Spread packets across CPUs by flow, for links whose RSS spreads them
+ * poorly: each packet is queued on the CPU its addresses and ports hash to,
+ * where the kernel builds its skb and runs the stack, in bulk. Packets of a
+ * flow stay on one CPU, in order.
+ *
+ * Userspace picks the CPUs: it stores a queue under each of them in
+ * "cpu_map" (see bpf::CpuMap), lists them in "cpus" and their number in
+ * "cpu_count". With no CPUs listed packets stay on the CPU they came in on.
+ */
+
+#define CPU_REDIRECT_MAX_CPUS 128
+
+/*
+ * Values are a struct bpf_cpumap_val: a queue size and a program to run on
+ * the target CPU, e.g. process() below. Both need linux 5.9: older kernels
+ * take the queue size alone, and reject this map and process() with it.
+ */
+__section("maps")
+struct bpf_map_def cpu_map = {
+    .type = BPF_MAP_TYPE_CPUMAP,
+    .key_size = sizeof(__u32),
+    .value_size = 2 * sizeof(__u32),
+    .max_entries = CPU_REDIRECT_MAX_CPUS,
+};
+
+__section("maps")
+struct bpf_map_def cpus = {
+    .type = BPF_MAP_TYPE_ARRAY,
+    .key_size = sizeof(__u32),
+    .value_size = sizeof(__u32),
+    .max_entries = CPU_REDIRECT_MAX_CPUS,
+};
+
+__section("maps")
+struct bpf_map_def cpu_count = {
+    .type = BPF_MAP_TYPE_ARRAY,
+    .key_size = sizeof(__u32),
+    .value_size = sizeof(__u32),
+    .max_entries = 1,
+};
+
+/*
+ * Hash of the addresses and ports of 'pkt', 0 for what is not IP.
+ */
+__ebpd_inline __u32
+flow_hash(struct ebpd_packet *pkt)
+{
+    __u32 hash = 0;
+    if (pkt->l3_proto == ebpd_htons(EBPD_ETH_P_IP) && pkt->ip) {
+        hash = pkt->ip->saddr ^ pkt->ip->daddr;
+    } else if (pkt->l3_proto == ebpd_htons(EBPD_ETH_P_IPV6) && pkt->ip6) {
+        __u32 addrs[8];
+        __builtin_memcpy(addrs, pkt->ip6->saddr, sizeof(addrs));
+#pragma clang loop unroll(full)
+        for (int i = 0; i < 8; i++) {
+            hash ^= addrs[i];
+        }
+    }
+    if (pkt->l4_proto == EBPD_IPPROTO_TCP && pkt->tcp) {
+        hash ^= (__u32) pkt->tcp->source << 16 | pkt->tcp->dest;
+    } else if (pkt->l4_proto == EBPD_IPPROTO_UDP && pkt->udp) {
+        hash ^= (__u32) pkt->udp->source << 16 | pkt->udp->dest;
+    }
+    /* Fibonacci hashing: the multiply mixes all bits into the high ones. */
+    return (hash * 0x9e3779b1) >> 8;
+}
+
+__section("xdp")
+int cpu_redirect(struct xdp_md *ctx)
+{
+    const __u32 zero = 0;
+    __u32 *count = bpf_map_lookup_elem(&cpu_count, &zero);
+    if (!count || !*count) {
+        return XDP_PASS;
+    }
+    struct ebpd_cursor cursor;
+    struct ebpd_packet pkt = {};
+    ebpd_cursor_init(&cursor, ctx);
+    ebpd_parse_packet(&cursor, &pkt);  // Hashes what parsed, if not all.
+
+    const __u32 slot = flow_hash(&pkt) % *count;
+    __u32 *cpu = bpf_map_lookup_elem(&cpus, &slot);
+    if (!cpu) {
+        return XDP_PASS;
+    }
+    /* CPUs listed without a queue in "cpu_map" leave packets to the stack. */
+    return bpf_redirect_map(&cpu_map, *cpu, XDP_PASS);
+}
+
+/*
+ * Second stage, run on the target CPU before the stack: the place for
+ * processing too expensive for the CPU the packet came in on.
+ */
+__section("xdp_cpumap/process")
+int process(struct xdp_md *ctx)
+{
+    return XDP_PASS;
+}
+
+__section("license")
+char _license[] = "GPL";
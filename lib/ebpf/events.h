@@ -0,0 +1,73 @@
+#ifndef LIB_EBPF_EVENTS_H_
+#define LIB_EBPF_EVENTS_H_
+
+#include "lib/ebpf/helpers.h"
+
+// Sending events to userspace, consumed by events::EventConsumer.
+//
+// Events go through a BPF_MAP_TYPE_RINGBUF map, or a
+// BPF_MAP_TYPE_PERF_EVENT_ARRAY map on kernels before linux 5.8 when built
+// with -DEBPD_EVENTS_PERF_BUFFER. Build both variants and load the one
+// events::IsRingBufferSupported() calls for. Declare the map as:
+//
+//   __section("maps")
+//   struct bpf_map_def events = {
+//       .type = EBPD_EVENTS_MAP_TYPE,
+//       .key_size = EBPD_EVENTS_KEY_SIZE,
+//       .value_size = EBPD_EVENTS_VALUE_SIZE,
+//       .max_entries = EBPD_EVENTS_MAX_ENTRIES(1 << 20),
+//   };
+
+#define EBPD_MAP_TYPE_RINGBUF 27
+
+// Flags of bpf_ringbuf_output() and bpf_ringbuf_query() (linux 5.8).
+#define EBPD_RB_NO_WAKEUP 1
+#define EBPD_RB_FORCE_WAKEUP 2
+#define EBPD_RB_AVAIL_DATA 0
+
+#ifdef EBPD_EVENTS_PERF_BUFFER
+
+// One entry per CPU (up to 1024), filled with perf events by the consumer.
+// The size of the per-cpu rings is set by the consumer too.
+#define EBPD_EVENTS_MAP_TYPE BPF_MAP_TYPE_PERF_EVENT_ARRAY
+#define EBPD_EVENTS_KEY_SIZE sizeof(__u32)
+#define EBPD_EVENTS_VALUE_SIZE sizeof(__u32)
+#define EBPD_EVENTS_MAX_ENTRIES(bytes) 1024
+
+// Send 'size' bytes at 'data' to 'events', through the perf ring of the
+// current CPU. The consumer decides how many events a wakeup takes, so
+// 'wakeup_bytes' is unused. Returns 0 or a negative errno; when the ring is
+// full the event is dropped and the consumer told how many were.
+static __attribute__((always_inline)) inline long
+ebpd_event_output(void *ctx, void *events, void *data, __u64 size,
+                  __u64 wakeup_bytes)
+{
+    return bpf_perf_event_output(ctx, events, BPF_F_CURRENT_CPU, data, size);
+}
+
+#else
+
+// Size in bytes, a power of two multiple of pages.
+#define EBPD_EVENTS_MAP_TYPE EBPD_MAP_TYPE_RINGBUF
+#define EBPD_EVENTS_KEY_SIZE 0
+#define EBPD_EVENTS_VALUE_SIZE 0
+#define EBPD_EVENTS_MAX_ENTRIES(bytes) (bytes)
+
+// Send 'size' bytes at 'data' to 'events', only waking the consumer once at
+// least 'wakeup_bytes' are queued. Saves a wakeup (and a consumer context
+// switch) per event at high rates; the consumer's poll timeout bounds the
+// latency of the events left queued. Returns 0 or a negative errno, e.g. when
+// the ring buffer is full and the event is dropped.
+static __attribute__((always_inline)) inline long
+ebpd_event_output(void *ctx, void *events, void *data, __u64 size,
+                  __u64 wakeup_bytes)
+{
+    const __u64 queued = bpf_ringbuf_query(events, EBPD_RB_AVAIL_DATA);
+    const __u64 flags = queued + size >= wakeup_bytes ?
+                        EBPD_RB_FORCE_WAKEUP : EBPD_RB_NO_WAKEUP;
+    return bpf_ringbuf_output(events, data, size, flags);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef LIB_EBPF_HELPERS_H_
+#define LIB_EBPF_HELPERS_H_
+
+#include "uapi/linux/bpf.h"
+
+// Map definitions placed in the "maps" section, in the layout the libbpf
+// loader parses.
+struct bpf_map_def {
+    unsigned int type;
+    unsigned int key_size;
+    unsigned int value_size;
+    unsigned int max_entries;
+    unsigned int map_flags;
+};
+
+// Kernel helpers callable from eBPF code, see 'man 7 bpf-helpers'.
+// Calls are resolved by helper id, the pointer is never dereferenced.
+static void *(*bpf_map_lookup_elem)(void *map, const void *key) =
+    (void *) BPF_FUNC_map_lookup_elem;
+static int (*bpf_map_update_elem)(void *map, const void *key,
+                                  const void *value, __u64 flags) =
+    (void *) BPF_FUNC_map_update_elem;
+static int (*bpf_redirect_map)(void *map, __u32 key, __u64 flags) =
+    (void *) BPF_FUNC_redirect_map;
+static __u64 (*bpf_ktime_get_ns)(void) = (void *) BPF_FUNC_ktime_get_ns;
+static int (*bpf_tail_call)(void *ctx, void *prog_array, __u32 index) =
+    (void *) BPF_FUNC_tail_call;
+static int (*bpf_perf_event_output)(void *ctx, void *map, __u64 flags,
+                                    void *data, __u64 size) =
+    (void *) BPF_FUNC_perf_event_output;
+
+// Ring buffer helpers (linux 5.8), by id: newer than the uapi headers we
+// build against.
+static long (*bpf_ringbuf_output)(void *ringbuf, void *data, __u64 size,
+                                  __u64 flags) = (void *) 130;
+static void *(*bpf_ringbuf_reserve)(void *ringbuf, __u64 size,
+                                    __u64 flags) = (void *) 131;
+static void (*bpf_ringbuf_submit)(void *data, __u64 flags) = (void *) 132;
+static void (*bpf_ringbuf_discard)(void *data, __u64 flags) = (void *) 133;
+static __u64 (*bpf_ringbuf_query)(void *ringbuf, __u64 flags) = (void *) 134;
+
+// FIB lookup helper (linux 4.18, return codes 4.19), by id too: struct
+// bpf_fib_lookup, with the fields our programs use.
+struct ebpd_fib_lookup {
+    __u8 family;
+    __u8 l4_protocol;
+    __be16 sport;
+    __be16 dport;
+    __u16 tot_len;
+    __u32 ifindex;
+    union {
+        __u8 tos;
+        __be32 flowinfo;
+    };
+    union {
+        __be32 ipv4_src;
+        __u32 ipv6_src[4];
+    };
+    union {
+        __be32 ipv4_dst;
+        __u32 ipv6_dst[4];
+    };
+    __be16 h_vlan_proto;
+    __be16 h_vlan_tci;
+    __u8 smac[6];
+    __u8 dmac[6];
+};
+
+#define EBPD_FIB_LKUP_RET_SUCCESS 0
+
+static long (*bpf_fib_lookup)(void *ctx, struct ebpd_fib_lookup *params,
+                              int plen, __u32 flags) = (void *) 69;
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef LIB_EBPF_PARSE_H_
+#define LIB_EBPF_PARSE_H_
+
+#include "lib/ebpf/parse_cursor.h"
+#include "lib/ebpf/parse_l2.h"
+#include "lib/ebpf/parse_l3.h"
+#include "lib/ebpf/parse_l4.h"
+#include "lib/ebpf/parse_tunnel.h"
+
+// Bounds checked packet parsing for xdp programs.
+//
+// The parse_*.h headers parse one layer each at a cursor, returning the
+// protocol of the next layer or -1 for malformed packets; this one chains
+// them, for programs wanting the usual layers at once:
+//
+//   struct ebpd_cursor cursor;
+//   struct ebpd_packet pkt;
+//   ebpd_cursor_init(&cursor, ctx);
+//   if (ebpd_parse_packet(&cursor, &pkt)) {
+//       return XDP_DROP;
+//   }
+//   if (pkt.l4_proto == EBPD_IPPROTO_UDP && ...)
+//
+// Protocols the parsers do not know are not errors: parsing stops there,
+// with the later layers left NULL. Headers stay in the packet and in network
+// byte order; only their position is recorded.
+
+struct ebpd_packet {
+    struct ebpd_ethhdr *eth;     // NULL for bare IP packets (tunnels)
+    struct ebpd_vlans vlans;
+    __be16 l3_proto;             // ethertype of 'l3'
+    __u8 l4_proto;               // protocol of 'l4'
+    union {
+        void *l3;                // NULL if neither IPv4 nor IPv6
+        struct ebpd_iphdr *ip;
+        struct ebpd_ipv6hdr *ip6;
+    };
+    union {
+        void *l4;                // NULL if neither TCP nor UDP
+        struct ebpd_tcphdr *tcp;
+        struct ebpd_udphdr *udp;
+    };
+};
+
+// Parse the network and transport layers at 'cursor' into 'pkt', 'proto'
+// being the ethertype of the network layer in network byte order. Returns
+// 0, or -1 if malformed. The cursor ends after the last header parsed.
+__ebpd_inline int
+ebpd_parse_l3(struct ebpd_cursor *cursor, int proto, struct ebpd_packet *pkt)
+{
+    int l4_proto;
+
+    pkt->l3_proto = proto;
+    pkt->l4_proto = EBPD_IPPROTO_NONE;
+    pkt->l3 = NULL;
+    pkt->l4 = NULL;
+    if (proto == ebpd_htons(EBPD_ETH_P_IP)) {
+        l4_proto = ebpd_parse_ipv4(cursor, &pkt->ip);
+    } else if (proto == ebpd_htons(EBPD_ETH_P_IPV6)) {
+        l4_proto = ebpd_parse_ipv6(cursor, &pkt->ip6);
+    } else {
+        return 0;
+    }
+    if (l4_proto < 0) {
+        return -1;
+    }
+    pkt->l4_proto = l4_proto;
+    if (l4_proto == EBPD_IPPROTO_TCP) {
+        return ebpd_parse_tcp(cursor, &pkt->tcp);
+    }
+    if (l4_proto == EBPD_IPPROTO_UDP) {
+        return ebpd_parse_udp(cursor, &pkt->udp);
+    }
+    return 0;
+}
+
+// Parse the ethernet frame at 'cursor' into 'pkt', up to the transport
+// layer. Returns 0, or -1 if malformed.
+__ebpd_inline int
+ebpd_parse_packet(struct ebpd_cursor *cursor, struct ebpd_packet *pkt)
+{
+    int proto = ebpd_parse_eth(cursor, &pkt->eth);
+    if (proto < 0) {
+        return -1;
+    }
+    proto = ebpd_parse_vlans(cursor, proto, &pkt->vlans);
+    if (proto < 0) {
+        return -1;
+    }
+    return ebpd_parse_l3(cursor, proto, pkt);
+}
+
+// Parse the tunnel header at 'cursor' if 'outer' is a VXLAN or Geneve
+// packet, by UDP destination port, and the packet it carries into 'inner'.
+// Stores the tunnel's network identifier in 'vni'. Returns 1 if it was a
+// tunnel, 0 if not, or -1 if malformed.
+__ebpd_inline int
+ebpd_parse_udp_tunnel(struct ebpd_cursor *cursor,
+                      const struct ebpd_packet *outer,
+                      struct ebpd_packet *inner, __u32 *vni)
+{
+    int proto;
+
+    if (outer->l4_proto != EBPD_IPPROTO_UDP || !outer->udp) {
+        return 0;
+    }
+    if (outer->udp->dest == ebpd_htons(EBPD_VXLAN_PORT)) {
+        struct ebpd_vxlanhdr *vxlan;
+        proto = ebpd_parse_vxlan(cursor, &vxlan);
+        if (proto >= 0) {
+            *vni = ebpd_vni(vxlan->vni);
+        }
+    } else if (outer->udp->dest == ebpd_htons(EBPD_GENEVE_PORT)) {
+        struct ebpd_genevehdr *geneve;
+        proto = ebpd_parse_geneve(cursor, &geneve);
+        if (proto >= 0) {
+            *vni = ebpd_vni(geneve->vni);
+        }
+    } else {
+        return 0;
+    }
+    if (proto < 0) {
+        return -1;
+    }
+    if (proto == ebpd_htons(EBPD_ETH_P_TEB)) {
+        return ebpd_parse_packet(cursor, inner) ? -1 : 1;
+    }
+    inner->eth = NULL;
+    inner->vlans.count = 0;
+    return ebpd_parse_l3(cursor, proto, inner) ? -1 : 1;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef LIB_EBPF_PARSE_CURSOR_H_
+#define LIB_EBPF_PARSE_CURSOR_H_
+
+#include <stddef.h>
+
+#include "lib/ebpf/helpers.h"
+#include "lib/ebpf/utils.h"
+
+// Position of a parser in the packet. Every parse function checks its
+// header against 'end' once, with its size known at compile time or bounded,
+// the pattern the verifier proves cheapest, and only advances 'pos' past
+// headers that fit.
+struct ebpd_cursor {
+    void *pos;
+    void *end;
+};
+
+__ebpd_inline void
+ebpd_cursor_init(struct ebpd_cursor *cursor, struct xdp_md *ctx)
+{
+    cursor->pos = (void *)(long) ctx->data;
+    cursor->end = (void *)(long) ctx->data_end;
+}
+
+// Return the next 'len' bytes and skip them, or NULL if the packet is too
+// short; 'len' must be a constant.
+__ebpd_inline void *
+ebpd_cursor_pull(struct ebpd_cursor *cursor, __u32 len)
+{
+    void *start = cursor->pos;
+    if (start + len > cursor->end) {
+        return NULL;
+    }
+    cursor->pos = start + len;
+    return start;
+}
+
+// Skip 'len' bytes, bounded by the caller (e.g. a masked header length
+// field), after a header whose fixed part was already pulled. Returns 0, or
+// -1 if the packet is too short.
+__ebpd_inline int
+ebpd_cursor_skip(struct ebpd_cursor *cursor, __u32 len)
+{
+    if (cursor->pos + len > cursor->end) {
+        return -1;
+    }
+    cursor->pos += len;
+    return 0;
+}
+
+#endif
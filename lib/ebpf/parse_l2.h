@@ -0,0 +1,78 @@
+#ifndef LIB_EBPF_PARSE_L2_H_
+#define LIB_EBPF_PARSE_L2_H_
+
+#include "lib/ebpf/parse_cursor.h"
+
+// Ethertypes, in host byte order: compare with ebpd_htons(), which folds.
+#define EBPD_ETH_P_IP 0x0800
+#define EBPD_ETH_P_IPV6 0x86dd
+#define EBPD_ETH_P_8021Q 0x8100
+#define EBPD_ETH_P_8021AD 0x88a8
+#define EBPD_ETH_P_TEB 0x6558  // Transparent ethernet bridging.
+
+// Tags parsed in front of the payload ethertype: 802.1Q, or 802.1ad QinQ.
+#define EBPD_MAX_VLANS 2
+
+struct ebpd_ethhdr {
+    __u8 dst[6];
+    __u8 src[6];
+    __be16 proto;
+};
+
+struct ebpd_vlanhdr {
+    __be16 tci;
+    __be16 proto;
+};
+
+struct ebpd_vlans {
+    __u32 count;
+    __be16 tci[EBPD_MAX_VLANS];  // Outermost first.
+};
+
+// VLAN id of a tag control information field.
+__ebpd_inline __u16
+ebpd_vlan_id(__be16 tci)
+{
+    return ebpd_ntohs(tci) & 0x0fff;
+}
+
+// Parse the ethernet header at 'cursor'. Returns its ethertype, in network
+// byte order, or -1 if truncated.
+__ebpd_inline int
+ebpd_parse_eth(struct ebpd_cursor *cursor, struct ebpd_ethhdr **ethhdr)
+{
+    struct ebpd_ethhdr *eth = ebpd_cursor_pull(cursor, sizeof(*eth));
+    if (!eth) {
+        return -1;
+    }
+    *ethhdr = eth;
+    return eth->proto;
+}
+
+// Parse up to EBPD_MAX_VLANS VLAN tags at 'cursor', 'proto' being the
+// ethertype in front of them, into 'vlans'. Returns the ethertype after
+// them, in network byte order, or -1 if truncated. More tags than
+// EBPD_MAX_VLANS are left to the caller, as an unknown ethertype.
+__ebpd_inline int
+ebpd_parse_vlans(struct ebpd_cursor *cursor, int proto,
+                 struct ebpd_vlans *vlans)
+{
+    vlans->count = 0;
+#pragma clang loop unroll(full)
+    for (int i = 0; i < EBPD_MAX_VLANS; i++) {
+        if (proto != ebpd_htons(EBPD_ETH_P_8021Q) &&
+            proto != ebpd_htons(EBPD_ETH_P_8021AD)) {
+            break;
+        }
+        struct ebpd_vlanhdr *vlan = ebpd_cursor_pull(cursor, sizeof(*vlan));
+        if (!vlan) {
+            return -1;
+        }
+        vlans->tci[i] = vlan->tci;
+        vlans->count = i + 1;
+        proto = vlan->proto;
+    }
+    return proto;
+}
+
+#endif
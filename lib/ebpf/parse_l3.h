@@ -0,0 +1,139 @@
+#ifndef LIB_EBPF_PARSE_L3_H_
+#define LIB_EBPF_PARSE_L3_H_
+
+#include "lib/ebpf/parse_cursor.h"
+
+// IP protocol numbers, also IPv6 next headers.
+#define EBPD_IPPROTO_HOPOPTS 0
+#define EBPD_IPPROTO_TCP 6
+#define EBPD_IPPROTO_UDP 17
+#define EBPD_IPPROTO_ROUTING 43
+#define EBPD_IPPROTO_FRAGMENT 44
+#define EBPD_IPPROTO_AH 51
+#define EBPD_IPPROTO_NONE 59
+#define EBPD_IPPROTO_DSTOPTS 60
+
+// IPv6 extension headers skipped before giving up on finding the upper layer.
+#define EBPD_IPV6_MAX_EXT_HEADERS 6
+
+struct ebpd_iphdr {
+    __u8 version_ihl;
+    __u8 tos;
+    __be16 tot_len;
+    __be16 id;
+    __be16 frag_off;
+    __u8 ttl;
+    __u8 protocol;
+    __sum16 check;
+    __be32 saddr;
+    __be32 daddr;
+};
+
+// Fragment offset bits of ebpd_iphdr.frag_off, in host byte order.
+#define EBPD_IP_OFFSET 0x1fff
+
+struct ebpd_ipv6hdr {
+    __be32 vtc_flow;
+    __be16 payload_len;
+    __u8 nexthdr;
+    __u8 hop_limit;
+    __u8 saddr[16];
+    __u8 daddr[16];
+};
+
+// Common part of hop-by-hop, routing, destination options and
+// authentication headers.
+struct ebpd_ipv6_opthdr {
+    __u8 nexthdr;
+    __u8 hdrlen;
+};
+
+struct ebpd_ipv6_fraghdr {
+    __u8 nexthdr;
+    __u8 reserved;
+    __be16 frag_off;
+    __be32 id;
+};
+
+// Fragment offset bits of ebpd_ipv6_fraghdr.frag_off, in host byte order.
+#define EBPD_IPV6_OFFSET 0xfff8
+
+// Parse the IPv4 header at 'cursor', options included. Returns the protocol
+// of the payload, EBPD_IPPROTO_NONE for fragments other than the first
+// (their payload has no upper layer header), or -1 if malformed or truncated.
+__ebpd_inline int
+ebpd_parse_ipv4(struct ebpd_cursor *cursor, struct ebpd_iphdr **iphdr)
+{
+    struct ebpd_iphdr *ip = ebpd_cursor_pull(cursor, sizeof(*ip));
+    if (!ip) {
+        return -1;
+    }
+    // Masked to 4 bits, the verifier knows the options fit in 40 bytes.
+    const __u32 len = (ip->version_ihl & 0x0f) * 4;
+    if ((ip->version_ihl >> 4) != 4 || len < sizeof(*ip)) {
+        return -1;
+    }
+    if (ebpd_cursor_skip(cursor, len - sizeof(*ip))) {
+        return -1;
+    }
+    *iphdr = ip;
+    if (ip->frag_off & ebpd_htons(EBPD_IP_OFFSET)) {
+        return EBPD_IPPROTO_NONE;
+    }
+    return ip->protocol;
+}
+
+// Parse the IPv6 header at 'cursor' and the extension headers following it.
+// Returns the protocol of the payload, EBPD_IPPROTO_NONE for fragments other
+// than the first, or -1 if malformed, truncated or with more than
+// EBPD_IPV6_MAX_EXT_HEADERS extension headers.
+__ebpd_inline int
+ebpd_parse_ipv6(struct ebpd_cursor *cursor, struct ebpd_ipv6hdr **ipv6hdr)
+{
+    struct ebpd_ipv6hdr *ip6 = ebpd_cursor_pull(cursor, sizeof(*ip6));
+    if (!ip6) {
+        return -1;
+    }
+    *ipv6hdr = ip6;
+    int nexthdr = ip6->nexthdr;
+#pragma clang loop unroll(full)
+    for (int i = 0; i < EBPD_IPV6_MAX_EXT_HEADERS; i++) {
+        switch (nexthdr) {
+        case EBPD_IPPROTO_HOPOPTS:
+        case EBPD_IPPROTO_ROUTING:
+        case EBPD_IPPROTO_DSTOPTS:
+        case EBPD_IPPROTO_AH: {
+            struct ebpd_ipv6_opthdr *opt =
+                ebpd_cursor_pull(cursor, sizeof(*opt));
+            if (!opt) {
+                return -1;
+            }
+            // Lengths exclude the first 8 bytes, in 4 byte words for AH.
+            const __u32 len = nexthdr == EBPD_IPPROTO_AH ?
+                              (opt->hdrlen + 2) * 4 : (opt->hdrlen + 1) * 8;
+            nexthdr = opt->nexthdr;
+            if (ebpd_cursor_skip(cursor, len - sizeof(*opt))) {
+                return -1;
+            }
+            break;
+        }
+        case EBPD_IPPROTO_FRAGMENT: {
+            struct ebpd_ipv6_fraghdr *frag =
+                ebpd_cursor_pull(cursor, sizeof(*frag));
+            if (!frag) {
+                return -1;
+            }
+            if (frag->frag_off & ebpd_htons(EBPD_IPV6_OFFSET)) {
+                return EBPD_IPPROTO_NONE;
+            }
+            nexthdr = frag->nexthdr;
+            break;
+        }
+        default:
+            return nexthdr;
+        }
+    }
+    return -1;
+}
+
+#endif
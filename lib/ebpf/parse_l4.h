@@ -0,0 +1,61 @@
+#ifndef LIB_EBPF_PARSE_L4_H_
+#define LIB_EBPF_PARSE_L4_H_
+
+#include "lib/ebpf/parse_cursor.h"
+
+struct ebpd_tcphdr {
+    __be16 source;
+    __be16 dest;
+    __be32 seq;
+    __be32 ack_seq;
+    __u8 doff_res;
+    __u8 flags;
+    __be16 window;
+    __sum16 check;
+    __be16 urg_ptr;
+};
+
+// Flags of ebpd_tcphdr.flags.
+#define EBPD_TCP_FIN 0x01
+#define EBPD_TCP_SYN 0x02
+#define EBPD_TCP_RST 0x04
+#define EBPD_TCP_PSH 0x08
+#define EBPD_TCP_ACK 0x10
+
+struct ebpd_udphdr {
+    __be16 source;
+    __be16 dest;
+    __be16 len;
+    __sum16 check;
+};
+
+// Parse the TCP header at 'cursor', options included. Returns 0, or -1 if
+// malformed or truncated.
+__ebpd_inline int
+ebpd_parse_tcp(struct ebpd_cursor *cursor, struct ebpd_tcphdr **tcphdr)
+{
+    struct ebpd_tcphdr *tcp = ebpd_cursor_pull(cursor, sizeof(*tcp));
+    if (!tcp) {
+        return -1;
+    }
+    const __u32 len = (tcp->doff_res >> 4) * 4;
+    if (len < sizeof(*tcp) || ebpd_cursor_skip(cursor, len - sizeof(*tcp))) {
+        return -1;
+    }
+    *tcphdr = tcp;
+    return 0;
+}
+
+// Parse the UDP header at 'cursor'. Returns 0, or -1 if truncated.
+__ebpd_inline int
+ebpd_parse_udp(struct ebpd_cursor *cursor, struct ebpd_udphdr **udphdr)
+{
+    struct ebpd_udphdr *udp = ebpd_cursor_pull(cursor, sizeof(*udp));
+    if (!udp) {
+        return -1;
+    }
+    *udphdr = udp;
+    return 0;
+}
+
+#endif
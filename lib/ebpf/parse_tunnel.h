@@ -0,0 +1,70 @@
+#ifndef LIB_EBPF_PARSE_TUNNEL_H_
+#define LIB_EBPF_PARSE_TUNNEL_H_
+
+#include "lib/ebpf/parse_cursor.h"
+#include "lib/ebpf/parse_l2.h"
+
+// IANA UDP ports, in host byte order.
+#define EBPD_VXLAN_PORT 4789
+#define EBPD_GENEVE_PORT 6081
+
+struct ebpd_vxlanhdr {
+    __u8 flags;
+    __u8 reserved1[3];
+    __u8 vni[3];
+    __u8 reserved2;
+};
+
+// ebpd_vxlanhdr.flags bit telling the VNI is valid, required by RFC 7348.
+#define EBPD_VXLAN_I 0x08
+
+struct ebpd_genevehdr {
+    __u8 ver_optlen;  // Version in the top 2 bits, options length in words.
+    __u8 flags;
+    __be16 proto;
+    __u8 vni[3];
+    __u8 reserved;
+};
+
+// VXLAN or Geneve network identifier.
+__ebpd_inline __u32
+ebpd_vni(const __u8 vni[3])
+{
+    return (vni[0] << 16) | (vni[1] << 8) | vni[2];
+}
+
+// Parse the VXLAN header at 'cursor', after the outer UDP header. Returns
+// the ethertype of the payload (EBPD_ETH_P_TEB, an ethernet frame) in
+// network byte order, or -1 if malformed or truncated.
+__ebpd_inline int
+ebpd_parse_vxlan(struct ebpd_cursor *cursor, struct ebpd_vxlanhdr **vxlanhdr)
+{
+    struct ebpd_vxlanhdr *vxlan = ebpd_cursor_pull(cursor, sizeof(*vxlan));
+    if (!vxlan || !(vxlan->flags & EBPD_VXLAN_I)) {
+        return -1;
+    }
+    *vxlanhdr = vxlan;
+    return ebpd_htons(EBPD_ETH_P_TEB);
+}
+
+// Parse the Geneve header at 'cursor', after the outer UDP header, skipping
+// its options. Returns the ethertype of the payload in network byte order:
+// EBPD_ETH_P_TEB for an ethernet frame, or e.g. EBPD_ETH_P_IP for a bare IP
+// packet. Returns -1 if malformed, truncated or of an unknown version.
+__ebpd_inline int
+ebpd_parse_geneve(struct ebpd_cursor *cursor,
+                  struct ebpd_genevehdr **genevehdr)
+{
+    struct ebpd_genevehdr *geneve = ebpd_cursor_pull(cursor, sizeof(*geneve));
+    if (!geneve || (geneve->ver_optlen >> 6) != 0) {
+        return -1;
+    }
+    // Masked to 6 bits, the verifier knows the options fit in 252 bytes.
+    if (ebpd_cursor_skip(cursor, (geneve->ver_optlen & 0x3f) * 4)) {
+        return -1;
+    }
+    *genevehdr = geneve;
+    return geneve->proto;
+}
+
+#endif
@@ -0,0 +1,200 @@
+#include "lib/ebpf/helpers.h"
+#include "lib/ebpf/parse.h"
+#include "lib/ebpf/router_maps.h"
+#include "lib/ebpf/utils.h"
+
+/*
+ * IPv4 and IPv6 forwarding: look the destination up, rewrite the ethernet
+ * addresses, decrement the TTL and redirect the packet to its output port.
+ *
+ * Routes come from the "routes_v4" and "routes_v6" longest prefix match
+ * tries, kept in sync by RouteSync (lib/route_sync.h), or from the kernel
+ * FIB with bpf_fib_lookup() when built with -DEBPD_ROUTER_FIB_LOOKUP. Either
+ * way output ports must be in "ports", under their own ifindex; RouteSync
+ * fills it for its routes.
+ *
+ * Anything not forwarded goes to the stack, which knows better: packets
+ * without a route or to a local address, expiring packets it answers with
+ * ICMP time exceeded, VLAN tagged, malformed or non IP packets.
+ */
+
+#define EBPD_AF_INET 2
+#define EBPD_AF_INET6 10
+
+__section("maps")
+struct bpf_map_def ports = {
+    .type = EBPD_MAP_TYPE_DEVMAP_HASH,
+    .key_size = sizeof(__u32),
+    .value_size = sizeof(__u32),
+    .max_entries = EBPD_ROUTER_MAX_PORTS,
+};
+
+#ifdef EBPD_ROUTER_FIB_LOOKUP
+
+/*
+ * Look 'fib', filled in with the packet's addresses, up in the kernel FIB
+ * into 'nh'. Returns 0, or -1 if the stack must handle the packet: no route,
+ * a local destination, or a neighbour not resolved yet.
+ */
+__ebpd_inline int
+fib_lookup(struct xdp_md *ctx, struct ebpd_fib_lookup *fib,
+           struct ebpd_nexthop *nh)
+{
+    fib->ifindex = ctx->ingress_ifindex;
+    if (bpf_fib_lookup(ctx, fib, sizeof(*fib), 0) !=
+        EBPD_FIB_LKUP_RET_SUCCESS) {
+        return -1;
+    }
+    nh->ifindex = fib->ifindex;
+    __builtin_memcpy(nh->dst_mac, fib->dmac, sizeof(nh->dst_mac));
+    __builtin_memcpy(nh->src_mac, fib->smac, sizeof(nh->src_mac));
+    return 0;
+}
+
+__ebpd_inline int
+lookup_ipv4(struct xdp_md *ctx, struct ebpd_iphdr *ip,
+            struct ebpd_nexthop *nh)
+{
+    struct ebpd_fib_lookup fib = {};
+    fib.family = EBPD_AF_INET;
+    fib.tos = ip->tos;
+    fib.l4_protocol = ip->protocol;
+    fib.tot_len = ebpd_ntohs(ip->tot_len);
+    fib.ipv4_src = ip->saddr;
+    fib.ipv4_dst = ip->daddr;
+    return fib_lookup(ctx, &fib, nh);
+}
+
+__ebpd_inline int
+lookup_ipv6(struct xdp_md *ctx, struct ebpd_ipv6hdr *ip6,
+            struct ebpd_nexthop *nh)
+{
+    struct ebpd_fib_lookup fib = {};
+    fib.family = EBPD_AF_INET6;
+    fib.flowinfo = ip6->vtc_flow & ebpd_htonl(0x0fffffff);
+    fib.l4_protocol = ip6->nexthdr;
+    fib.tot_len = ebpd_ntohs(ip6->payload_len);
+    __builtin_memcpy(fib.ipv6_src, ip6->saddr, sizeof(fib.ipv6_src));
+    __builtin_memcpy(fib.ipv6_dst, ip6->daddr, sizeof(fib.ipv6_dst));
+    return fib_lookup(ctx, &fib, nh);
+}
+
+#else
+
+/*
+ * Tries are not preallocated, as the kernel requires: memory grows with the
+ * routes actually installed.
+ */
+__section("maps")
+struct bpf_map_def routes_v4 = {
+    .type = BPF_MAP_TYPE_LPM_TRIE,
+    .key_size = sizeof(struct ebpd_route_v4),
+    .value_size = sizeof(struct ebpd_nexthop),
+    .max_entries = EBPD_ROUTER_MAX_ROUTES,
+    .map_flags = BPF_F_NO_PREALLOC,
+};
+
+__section("maps")
+struct bpf_map_def routes_v6 = {
+    .type = BPF_MAP_TYPE_LPM_TRIE,
+    .key_size = sizeof(struct ebpd_route_v6),
+    .value_size = sizeof(struct ebpd_nexthop),
+    .max_entries = EBPD_ROUTER_MAX_ROUTES,
+    .map_flags = BPF_F_NO_PREALLOC,
+};
+
+__ebpd_inline int
+lookup_ipv4(struct xdp_md *ctx, struct ebpd_iphdr *ip,
+            struct ebpd_nexthop *nh)
+{
+    struct ebpd_route_v4 key = {.prefixlen = 32};
+    __builtin_memcpy(key.addr, &ip->daddr, sizeof(key.addr));
+    struct ebpd_nexthop *route = bpf_map_lookup_elem(&routes_v4, &key);
+    if (!route) {
+        return -1;
+    }
+    *nh = *route;
+    return 0;
+}
+
+__ebpd_inline int
+lookup_ipv6(struct xdp_md *ctx, struct ebpd_ipv6hdr *ip6,
+            struct ebpd_nexthop *nh)
+{
+    struct ebpd_route_v6 key = {.prefixlen = 128};
+    __builtin_memcpy(key.addr, ip6->daddr, sizeof(key.addr));
+    struct ebpd_nexthop *route = bpf_map_lookup_elem(&routes_v6, &key);
+    if (!route) {
+        return -1;
+    }
+    *nh = *route;
+    return 0;
+}
+
+#endif
+
+/*
+ * Rewrite the ethernet addresses of the packet for 'nh' and send it there.
+ * A port missing from "ports" aborts the packet, which shows up in the
+ * xdp:xdp_exception tracepoint.
+ */
+__ebpd_inline int
+forward(struct ebpd_ethhdr *eth, const struct ebpd_nexthop *nh)
+{
+    __builtin_memcpy(eth->dst, nh->dst_mac, sizeof(eth->dst));
+    __builtin_memcpy(eth->src, nh->src_mac, sizeof(eth->src));
+    return bpf_redirect_map(&ports, nh->ifindex, 0);
+}
+
+__ebpd_inline int
+route_ipv4(struct xdp_md *ctx, struct ebpd_cursor *cursor,
+           struct ebpd_ethhdr *eth)
+{
+    struct ebpd_iphdr *ip;
+    struct ebpd_nexthop nh;
+    if (ebpd_parse_ipv4(cursor, &ip) < 0 || ip->ttl <= 1 ||
+        lookup_ipv4(ctx, ip, &nh)) {
+        return XDP_PASS;
+    }
+    /*
+     * Incremental checksum update (RFC 1624) for the TTL, the high byte of
+     * its 16 bit word, going down by one.
+     */
+    __u32 check = ip->check;
+    check += ebpd_htons(0x0100);
+    ip->check = (__sum16)(check + (check >= 0xffff));
+    ip->ttl--;
+    return forward(eth, &nh);
+}
+
+__ebpd_inline int
+route_ipv6(struct xdp_md *ctx, struct ebpd_cursor *cursor,
+           struct ebpd_ethhdr *eth)
+{
+    struct ebpd_ipv6hdr *ip6 = ebpd_cursor_pull(cursor, sizeof(*ip6));
+    struct ebpd_nexthop nh;
+    if (!ip6 || ip6->hop_limit <= 1 || lookup_ipv6(ctx, ip6, &nh)) {
+        return XDP_PASS;
+    }
+    ip6->hop_limit--;
+    return forward(eth, &nh);
+}
+
+__section("xdp")
+int router(struct xdp_md *ctx)
+{
+    struct ebpd_cursor cursor;
+    struct ebpd_ethhdr *eth;
+    ebpd_cursor_init(&cursor, ctx);
+    const int proto = ebpd_parse_eth(&cursor, &eth);
+    if (proto == ebpd_htons(EBPD_ETH_P_IP)) {
+        return route_ipv4(ctx, &cursor, eth);
+    }
+    if (proto == ebpd_htons(EBPD_ETH_P_IPV6)) {
+        return route_ipv6(ctx, &cursor, eth);
+    }
+    return XDP_PASS;
+}
+
+__section("license")
+char _license[] = "GPL";
@@ -0,0 +1,37 @@
+#ifndef LIB_EBPF_ROUTER_MAPS_H_
+#define LIB_EBPF_ROUTER_MAPS_H_
+
+#include <linux/types.h>
+
+// Maps of lib/ebpf/router.c, shared with the userspace code filling them
+// (lib/route_sync.h).
+
+// Keys of the "routes_v4" and "routes_v6" BPF_MAP_TYPE_LPM_TRIE maps: a
+// prefix length in bits, then the address in network byte order.
+struct ebpd_route_v4 {
+    __u32 prefixlen;
+    __u8 addr[4];
+};
+
+struct ebpd_route_v6 {
+    __u32 prefixlen;
+    __u8 addr[16];
+};
+
+// Value of the route maps: the port to forward through, a key of the
+// "ports" BPF_MAP_TYPE_DEVMAP_HASH, and the ethernet addresses to rewrite.
+struct ebpd_nexthop {
+    __u32 ifindex;
+    __u8 dst_mac[6];
+    __u8 src_mac[6];
+};
+
+#define EBPD_ROUTER_MAX_ROUTES (1 << 20)
+
+// Ports are keyed by ifindex, however large, in a BPF_MAP_TYPE_DEVMAP_HASH
+// (linux 5.4) holding this many. The map type is newer than the oldest uapi
+// headers we build against; its value is ABI.
+#define EBPD_MAP_TYPE_DEVMAP_HASH 25
+#define EBPD_ROUTER_MAX_PORTS 1024
+
+#endif
@@ -8,4 +8,21 @@
 // - marks the symbol as being used, so it is not optimized out.
 #define __section(NAME) __attribute__((section(NAME), used))
 
+// eBPF has no calls between functions of a program before linux 4.16, and
+// they cost registers spills after: helpers in headers are always inlined.
+#define __ebpd_inline static __attribute__((always_inline)) inline
+
+// Byte order conversion of constants and packet fields. eBPF runs in the
+// host byte order; constants fold at compile time, fields take one
+// instruction.
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define ebpd_htons(x) ((__u16) __builtin_bswap16(x))
+#define ebpd_htonl(x) ((__u32) __builtin_bswap32(x))
+#else
+#define ebpd_htons(x) ((__u16) (x))
+#define ebpd_htonl(x) ((__u32) (x))
+#endif
+#define ebpd_ntohs(x) ebpd_htons(x)
+#define ebpd_ntohl(x) ebpd_htonl(x)
+
 #endif
@@ -0,0 +1,29 @@
+#include "lib/ebpf/helpers.h"
+#include "lib/ebpf/utils.h"
+
+/*
+ * AF_XDP sockets by rx queue index, registered by userspace with
+ * xsk::RegisterSocket(). Sized for the largest number of queues we expect
+ * on a NIC.
+ */
+__section("maps")
+struct bpf_map_def xsks = {
+    .type = BPF_MAP_TYPE_XSKMAP,
+    .key_size = sizeof(__u32),
+    .value_size = sizeof(__u32),
+    .max_entries = 64,
+};
+
+/*
+ * Hand every packet to the AF_XDP socket of its rx queue. Queues without a
+ * socket fall back to the normal stack: the low bits of the flags are the
+ * action to take when the lookup fails (linux 5.3+).
+ */
+__section("xdp")
+int xsk_redirect(struct xdp_md *ctx)
+{
+    return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+}
+
+__section("license")
+char _license[] = "GPL";
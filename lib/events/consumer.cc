@@ -0,0 +1,99 @@
+#include "lib/events/consumer.h"
+
+#include <sys/epoll.h>
+
+#include <cerrno>
+
+#include "lib/bpf/map.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+
+namespace events {
+namespace {
+
+// epoll data of the nested consumers.
+enum : uint32_t {
+  kRingBuffer,
+  kPerfBuffer,
+};
+
+error::Status AddNested(const posix::FileDescriptor epoll,
+                        const posix::FileDescriptor nested,
+                        const uint32_t id) {
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u32 = id;
+  const int rv =
+      ::epoll_ctl(GetValue(epoll), EPOLL_CTL_ADD, GetValue(nested), &event);
+  return posix::OkStatusOrCaptureErrnoIf(-1 == rv, "epoll_ctl() failed");
+}
+
+}  // namespace
+
+error::Status EventConsumer::Add(const posix::FileDescriptor map_fd,
+                                 Callback callback) {
+  ASSIGN_OR_RETURN(const auto info, bpf::impl::GetMapInfo(map_fd));
+  if (info.type == kMapTypeRingBuf) {
+    return ring_buffer_.Add(map_fd, std::move(callback));
+  }
+  if (info.type == BPF_MAP_TYPE_PERF_EVENT_ARRAY) {
+    return perf_buffer_.Add(map_fd, std::move(callback));
+  }
+  return error::Status(posix::MakeCodeFromErrno(EINVAL),
+                       "not a ring buffer or perf event array map");
+}
+
+error::StatusOr<size_t> EventConsumer::Poll(const int timeout_ms) {
+  epoll_event events[2];
+  const int ready =
+      ::epoll_wait(GetValue(GetValue(epoll_)), events, 2, timeout_ms);
+  if (-1 == ready && errno == EINTR) {
+    return size_t{0};
+  }
+  RETURN_IF_ERROR(
+      posix::OkStatusOrCaptureErrnoIf(-1 == ready, "epoll_wait() failed"));
+  if (ready == 0) {
+    return Consume();
+  }
+  size_t count = 0;
+  for (int i = 0; i < ready; ++i) {
+    if (events[i].data.u32 == kRingBuffer) {
+      ASSIGN_OR_RETURN(const size_t consumed, ring_buffer_.Poll(0));
+      count += consumed;
+    } else {
+      ASSIGN_OR_RETURN(const size_t consumed, perf_buffer_.Poll(0));
+      count += consumed;
+    }
+  }
+  return count;
+}
+
+size_t EventConsumer::Consume() {
+  return ring_buffer_.Consume() + perf_buffer_.Consume();
+}
+
+error::StatusOr<EventConsumer> CreateEventConsumer(
+    const EventConsumerOptions& options) {
+  const int fd = ::epoll_create1(EPOLL_CLOEXEC);
+  RETURN_IF_ERROR(
+      posix::OkStatusOrCaptureErrnoIf(-1 == fd, "epoll_create1() failed"));
+  posix::UniqueFileDescriptor epoll{posix::FileDescriptor(fd)};
+  ASSIGN_OR_RETURN(auto ring_buffer,
+                   CreateRingBufferConsumer(options.ring_buffer));
+  ASSIGN_OR_RETURN(auto perf_buffer,
+                   CreatePerfBufferConsumer(options.perf_buffer));
+  RETURN_IF_ERROR(AddNested(GetValue(epoll), GetFileDescriptor(ring_buffer),
+                            kRingBuffer));
+  RETURN_IF_ERROR(AddNested(GetValue(epoll), GetFileDescriptor(perf_buffer),
+                            kPerfBuffer));
+  return EventConsumer(std::move(epoll), std::move(ring_buffer),
+                       std::move(perf_buffer));
+}
+
+bool IsRingBufferSupported() {
+  return IsOk(bpf::impl::CreateMap(static_cast<bpf_map_type>(kMapTypeRingBuf),
+                                   0, 0, posix::GetPageSize(), 0));
+}
+
+}  // namespace events
@@ -0,0 +1,95 @@
+#ifndef LIB_EVENTS_CONSUMER_H_
+#define LIB_EVENTS_CONSUMER_H_
+
+#include <cstdint>
+
+#include "lib/error/status.h"
+#include "lib/error/status_or.h"
+#include "lib/events/perf_buffer.h"
+#include "lib/events/ring_buffer.h"
+#include "lib/posix/file_descriptor.h"
+#include "lib/posix/unique_file_descriptor.h"
+
+namespace events {
+
+struct EventConsumerOptions {
+  RingBufferOptions ring_buffer;
+  PerfBufferOptions perf_buffer;
+};
+
+// Consumer of bpf program events through either BPF_MAP_TYPE_RINGBUF or
+// BPF_MAP_TYPE_PERF_EVENT_ARRAY maps, picked per map by its type, so callers
+// have a single code path whichever the kernel supports. Programs built with
+// lib/ebpf/events.h send events through the right map type at compile time;
+// load the variant IsRingBufferSupported() calls for.
+//
+// Example usage:
+//
+// ASSIGN_OR_RETURN(auto consumer, CreateEventConsumer());
+// RETURN_IF_ERROR(consumer.Add(loader->GetMapFd("events"), [](auto record) {
+//   HandleEvent(record);
+// }));
+// while (running) RETURN_IF_ERROR(GetStatus(consumer.Poll(100)));
+//
+class EventConsumer {
+ public:
+  EventConsumer() = default;
+
+  // Take ownership of 'epoll', 'ring_buffer' and 'perf_buffer', which must be
+  // registered in 'epoll'. Prefer CreateEventConsumer().
+  EventConsumer(posix::UniqueFileDescriptor epoll,
+                RingBufferConsumer ring_buffer, PerfBufferConsumer perf_buffer)
+      : epoll_(std::move(epoll)),
+        ring_buffer_(std::move(ring_buffer)),
+        perf_buffer_(std::move(perf_buffer)) {}
+
+  // Default move constructor.
+  EventConsumer(EventConsumer&&) = default;
+
+  // Default move assignment operator.
+  EventConsumer& operator=(EventConsumer&&) = default;
+
+  // Consume the ring buffer or perf event array map 'map_fd', which stays
+  // owned by the caller, calling 'callback' for each of its records. Fails
+  // with EINVAL for other map types.
+  error::Status Add(posix::FileDescriptor map_fd, Callback callback);
+
+  // Wait up to 'timeout_ms' (-1 forever) for records, then consume all
+  // available. Returns the number of records consumed.
+  error::StatusOr<size_t> Poll(int timeout_ms);
+
+  // Consume all available records without waiting. Returns the number of
+  // records consumed.
+  size_t Consume();
+
+ private:
+  // Return the epoll file descriptor of 'consumer', readable when records are
+  // available, to wait on it from another event loop.
+  friend posix::FileDescriptor GetFileDescriptor(
+      const EventConsumer& consumer) {
+    return GetValue(consumer.epoll_);
+  }
+
+  // Return the number of events the kernel reported dropped. Only perf event
+  // arrays report drops: bpf_ringbuf_output() fails instead, for the program
+  // to count.
+  friend uint64_t GetLostCount(const EventConsumer& consumer) {
+    return GetLostCount(consumer.perf_buffer_);
+  }
+
+  posix::UniqueFileDescriptor epoll_;
+  RingBufferConsumer ring_buffer_;
+  PerfBufferConsumer perf_buffer_;
+};
+
+// Create a consumer with no maps yet.
+error::StatusOr<EventConsumer> CreateEventConsumer(
+    const EventConsumerOptions& options = EventConsumerOptions());
+
+// Return whether the kernel supports BPF_MAP_TYPE_RINGBUF (linux 5.8), by
+// creating one. Perf event arrays are the fallback.
+bool IsRingBufferSupported();
+
+}  // namespace events
+
+#endif  // LIB_EVENTS_CONSUMER_H_
@@ -0,0 +1,47 @@
+#include "lib/events/consumer.h"
+
+#include <linux/bpf.h>
+#include <sys/epoll.h>
+
+#include "gtest/gtest.h"
+#include "lib/bpf/map.h"
+
+namespace events {
+namespace {
+
+void Ignore(base::Span<const uint8_t>) {}
+
+TEST(EventConsumerTest, AddsRingBuffersAndPerfEventArrays) {
+  auto consumer_or = CreateEventConsumer();
+  ASSERT_TRUE(IsOk(consumer_or));
+  auto& consumer = GetValue(consumer_or);
+
+  auto perf_or =
+      bpf::impl::CreateMap(BPF_MAP_TYPE_PERF_EVENT_ARRAY, 4, 4, 1024, 0);
+  ASSERT_TRUE(IsOk(perf_or));
+  EXPECT_TRUE(IsOk(consumer.Add(GetValue(GetValue(perf_or)), Ignore)));
+
+  if (IsRingBufferSupported()) {
+    auto ring_or = bpf::impl::CreateMap(
+        static_cast<bpf_map_type>(kMapTypeRingBuf), 0, 0, 4096, 0);
+    ASSERT_TRUE(IsOk(ring_or));
+    EXPECT_TRUE(IsOk(consumer.Add(GetValue(GetValue(ring_or)), Ignore)));
+  }
+
+  auto count_or = consumer.Poll(0);
+  ASSERT_TRUE(IsOk(count_or));
+  EXPECT_EQ(0, GetValue(count_or));
+  EXPECT_EQ(0, GetLostCount(consumer));
+}
+
+TEST(EventConsumerTest, RejectsOtherMaps) {
+  auto consumer_or = CreateEventConsumer();
+  ASSERT_TRUE(IsOk(consumer_or));
+  auto array_or = bpf::impl::CreateMap(BPF_MAP_TYPE_ARRAY, 4, 8, 1, 0);
+  ASSERT_TRUE(IsOk(array_or));
+  EXPECT_TRUE(IsError(
+      GetValue(consumer_or).Add(GetValue(GetValue(array_or)), Ignore)));
+}
+
+}  // namespace
+}  // namespace events
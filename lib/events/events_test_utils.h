@@ -0,0 +1,61 @@
+#ifndef LIB_EVENTS_EVENTS_TEST_UTILS_H_
+#define LIB_EVENTS_EVENTS_TEST_UTILS_H_
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/events/consumer.h"
+#include "lib/posix/unique_file_descriptor.h"
+#include "lib/tests/xdp_test_utils.h"
+
+// Helpers for tests of consumers, sending them records from real programs.
+
+namespace events {
+
+// Fixture of consumer tests: SetUp() of each test creates 'map_', programs
+// made by LoadProg() write records to it with helper 'helper', see
+// LoadOutputProg().
+class OutputTest : public testing::Test {
+ protected:
+  explicit OutputTest(const int helper) : helper_(helper) {}
+
+  // Callback collecting the value and size of each record into 'values_'
+  // and 'sizes_'.
+  Callback Collect() {
+    return [this](const base::Span<const uint8_t> record) {
+      ASSERT_LE(sizeof(int64_t), GetSize(record));
+      int64_t value;
+      std::memcpy(&value, GetBase(record), sizeof(value));
+      values_.push_back(value);
+      sizes_.push_back(GetSize(record));
+    };
+  }
+
+  // Load a program writing 'value' to 'map_', kept until the test ends.
+  int LoadProg(const int32_t value, const int flags = 0) {
+    const int fd =
+        LoadOutputProg(helper_, GetValue(GetValue(map_)), value, flags);
+    EXPECT_LE(0, fd);
+    progs_.emplace_back(posix::FileDescriptor(fd));
+    return fd;
+  }
+
+  // Run 'prog' 'count' times, writing as many records.
+  static bool RunProg(const int prog, const uint32_t count) {
+    return RunXdpProg(prog, count) == XDP_PASS;
+  }
+
+  posix::UniqueFileDescriptor map_;
+  std::vector<posix::UniqueFileDescriptor> progs_;
+  std::vector<int64_t> values_;
+  std::vector<size_t> sizes_;
+
+ private:
+  const int helper_;
+};
+
+}  // namespace events
+
+#endif  // LIB_EVENTS_EVENTS_TEST_UTILS_H_
@@ -0,0 +1,184 @@
+#include "lib/events/perf_buffer.h"
+
+#include <linux/perf_event.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "lib/bpf/cpus.h"
+#include "lib/bpf/map.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+
+namespace events {
+namespace {
+
+// PERF_COUNT_SW_BPF_OUTPUT (linux 4.4): the event bpf_perf_event_output()
+// writes to.
+constexpr uint64_t kCountSoftwareBpfOutput = 10;
+
+// Layout of a PERF_RECORD_SAMPLE with only PERF_SAMPLE_RAW: the header, the
+// raw size, then the raw data.
+constexpr size_t kRawSizeOffset = sizeof(perf_event_header);
+constexpr size_t kRawDataOffset = kRawSizeOffset + sizeof(uint32_t);
+
+// Layout of a PERF_RECORD_LOST: the header, an id, then the lost count.
+constexpr size_t kLostCountOffset = sizeof(perf_event_header) + 8;
+
+error::StatusOr<posix::UniqueFileDescriptor> OpenBpfOutputEvent(
+    const int cpu, const uint32_t wakeup_events) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_SOFTWARE;
+  attr.size = sizeof(attr);
+  attr.config = kCountSoftwareBpfOutput;
+  attr.sample_type = PERF_SAMPLE_RAW;
+  attr.sample_period = 1;
+  attr.wakeup_events = wakeup_events;
+  const long fd = ::syscall(__NR_perf_event_open, &attr, -1, cpu, -1,
+                            PERF_FLAG_FD_CLOEXEC);
+  RETURN_IF_ERROR(posix::OkStatusOrCaptureErrnoIf(
+      -1 == fd, "perf_event_open() failed"));
+  return posix::UniqueFileDescriptor(posix::FileDescriptor(fd));
+}
+
+}  // namespace
+
+error::Status PerfBufferConsumer::Add(const posix::FileDescriptor map_fd,
+                                      Callback callback) {
+  ASSIGN_OR_RETURN(const auto info, bpf::impl::GetMapInfo(map_fd));
+  if (info.type != BPF_MAP_TYPE_PERF_EVENT_ARRAY) {
+    return error::Status(posix::MakeCodeFromErrno(EINVAL),
+                         "not a perf event array map");
+  }
+  ASSIGN_OR_RETURN(const int num_cpus, bpf::GetPossibleCpuCount());
+  const size_t page_size = posix::GetPageSize();
+  const size_t callback_index = callbacks_.size();
+  callbacks_.push_back(std::move(callback));
+
+  const int max_cpu = std::min<int>(num_cpus, info.max_entries);
+  for (int cpu = 0; cpu < max_cpu; ++cpu) {
+    auto event_or = OpenBpfOutputEvent(cpu, options_.wakeup_events);
+    if (posix::IsErrno(GetStatus(event_or), ENODEV)) {
+      continue;  // Possible but offline CPU, nothing runs there.
+    }
+    impl::PerfRing ring;
+    ASSIGN_OR_RETURN(ring.event, std::move(event_or));
+    ring.callback = callback_index;
+    const int event = GetValue(GetValue(ring.event));
+    ASSIGN_OR_RETURN(
+        ring.mapping,
+        posix::Mmap((options_.page_count + 1) * page_size,
+                    PROT_READ | PROT_WRITE, MAP_SHARED, GetValue(ring.event),
+                    0));
+    RETURN_IF_ERROR(posix::OkStatusOrCaptureErrnoIf(
+        -1 == ::ioctl(event, PERF_EVENT_IOC_ENABLE, 0), "ioctl() failed"));
+    const uint32_t key = cpu;
+    RETURN_IF_ERROR(bpf::impl::UpdateElement(map_fd, &key, &event, BPF_ANY));
+
+    epoll_event ready = {};
+    ready.events = EPOLLIN;
+    ready.data.u32 = rings_.size();
+    const int rv = ::epoll_ctl(GetValue(GetValue(epoll_)), EPOLL_CTL_ADD,
+                               event, &ready);
+    RETURN_IF_ERROR(
+        posix::OkStatusOrCaptureErrnoIf(-1 == rv, "epoll_ctl() failed"));
+    rings_.push_back(std::move(ring));
+  }
+  return error::kOkStatus;
+}
+
+error::StatusOr<size_t> PerfBufferConsumer::Poll(const int timeout_ms) {
+  std::vector<epoll_event> events(rings_.empty() ? 1 : rings_.size());
+  const int ready = ::epoll_wait(GetValue(GetValue(epoll_)), events.data(),
+                                 events.size(), timeout_ms);
+  if (-1 == ready && errno == EINTR) {
+    return size_t{0};
+  }
+  RETURN_IF_ERROR(
+      posix::OkStatusOrCaptureErrnoIf(-1 == ready, "epoll_wait() failed"));
+  if (ready == 0) {
+    // Timed out: pick up samples below the wakeup threshold.
+    return Consume();
+  }
+  size_t count = 0;
+  for (int i = 0; i < ready; ++i) {
+    count += ConsumeRing(&rings_[events[i].data.u32]);
+  }
+  return count;
+}
+
+size_t PerfBufferConsumer::Consume() {
+  size_t count = 0;
+  for (auto& ring : rings_) {
+    count += ConsumeRing(&ring);
+  }
+  return count;
+}
+
+size_t PerfBufferConsumer::ConsumeRing(impl::PerfRing* const ring) {
+  uint8_t* const base = GetBase(GetValue(ring->mapping));
+  auto* const control = reinterpret_cast<perf_event_mmap_page*>(base);
+  const size_t page_size = posix::GetPageSize();
+  uint8_t* const data = base + page_size;
+  const uint64_t size = options_.page_count * page_size;
+  const auto& callback = callbacks_[ring->callback];
+
+  const uint64_t head = __atomic_load_n(&control->data_head, __ATOMIC_ACQUIRE);
+  uint64_t tail = control->data_tail;  // Only we write it.
+  size_t count = 0;
+  size_t batch = 0;
+  while (tail < head) {
+    const uint64_t offset = tail % size;
+    // Records are 8 byte aligned, so headers never wrap; the rest may.
+    perf_event_header header;
+    std::memcpy(&header, data + offset, sizeof(header));
+    const uint8_t* record = data + offset;
+    if (offset + header.size > size) {
+      scratch_.resize(header.size);
+      const size_t first = size - offset;
+      std::memcpy(scratch_.data(), data + offset, first);
+      std::memcpy(scratch_.data() + first, data, header.size - first);
+      record = scratch_.data();
+    }
+
+    if (header.type == PERF_RECORD_SAMPLE) {
+      uint32_t raw_size;
+      std::memcpy(&raw_size, record + kRawSizeOffset, sizeof(raw_size));
+      callback(base::MakeSpan(record + kRawDataOffset, raw_size));
+      ++count;
+    } else if (header.type == PERF_RECORD_LOST) {
+      uint64_t lost;
+      std::memcpy(&lost, record + kLostCountOffset, sizeof(lost));
+      lost_ += lost;
+    }
+
+    tail += header.size;
+    if (++batch == options_.max_batch) {
+      __atomic_store_n(&control->data_tail, tail, __ATOMIC_RELEASE);
+      batch = 0;
+    }
+  }
+  if (batch) {
+    __atomic_store_n(&control->data_tail, tail, __ATOMIC_RELEASE);
+  }
+  return count;
+}
+
+error::StatusOr<PerfBufferConsumer> CreatePerfBufferConsumer(
+    const PerfBufferOptions& options) {
+  const int epoll = ::epoll_create1(EPOLL_CLOEXEC);
+  RETURN_IF_ERROR(
+      posix::OkStatusOrCaptureErrnoIf(-1 == epoll, "epoll_create1() failed"));
+  return PerfBufferConsumer(
+      posix::UniqueFileDescriptor(posix::FileDescriptor(epoll)), options);
+}
+
+}  // namespace events
@@ -0,0 +1,111 @@
+#ifndef LIB_EVENTS_PERF_BUFFER_H_
+#define LIB_EVENTS_PERF_BUFFER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "lib/error/status.h"
+#include "lib/error/status_or.h"
+#include "lib/events/ring_buffer.h"
+#include "lib/posix/file_descriptor.h"
+#include "lib/posix/mmap.h"
+#include "lib/posix/unique_file_descriptor.h"
+
+namespace events {
+
+struct PerfBufferOptions {
+  // Size of each per-cpu ring, in pages. Must be a power of two.
+  size_t page_count = 64;
+
+  // Samples a CPU queues before waking the consumer up. Higher values trade
+  // latency (bounded by Poll()'s timeout) for fewer wakeups.
+  uint32_t wakeup_events = 1;
+
+  // Records consumed before handing their space back to the kernel.
+  size_t max_batch = 256;
+};
+
+namespace impl {
+
+// The perf ring of one CPU, mapped into our address space: a control page
+// followed by the data area.
+struct PerfRing {
+  posix::UniqueFileDescriptor event;
+  posix::UniqueMapping mapping;
+  size_t callback = 0;  // Index in PerfBufferConsumer::callbacks_.
+};
+
+}  // namespace impl
+
+// Consumer of events sent by bpf programs through BPF_MAP_TYPE_PERF_EVENT_ARRAY
+// maps with bpf_perf_event_output(), for kernels without BPF ring buffers
+// (before linux 5.8). Same interface and semantics as RingBufferConsumer,
+// with two differences:
+//
+// - Each CPU has its own ring, so records from different CPUs arrive out of
+//   order.
+// - Records carry up to 7 bytes of padding after the data the program sent.
+//
+// Records are passed without copying, except those wrapping around the end
+// of their ring, which go through a scratch buffer.
+//
+// When a ring is full the kernel drops samples and later reports how many;
+// GetLostCount() sums them.
+class PerfBufferConsumer {
+ public:
+  PerfBufferConsumer() = default;
+
+  // Take ownership of 'epoll'. Prefer CreatePerfBufferConsumer().
+  PerfBufferConsumer(posix::UniqueFileDescriptor epoll,
+                     const PerfBufferOptions& options)
+      : epoll_(std::move(epoll)), options_(options) {}
+
+  // Default move constructor.
+  PerfBufferConsumer(PerfBufferConsumer&&) = default;
+
+  // Default move assignment operator.
+  PerfBufferConsumer& operator=(PerfBufferConsumer&&) = default;
+
+  // Open a perf ring on every CPU, store them in the perf event array map
+  // 'map_fd' (which stays owned by the caller) and call 'callback' for each
+  // of their records. Fails with EINVAL if the map is not a perf event array.
+  error::Status Add(posix::FileDescriptor map_fd, Callback callback);
+
+  // Wait up to 'timeout_ms' (-1 forever) for records, then consume all
+  // available in every ring. Returns the number of records consumed.
+  error::StatusOr<size_t> Poll(int timeout_ms);
+
+  // Consume all available records without waiting. Returns the number of
+  // records consumed.
+  size_t Consume();
+
+ private:
+  // Return the epoll file descriptor of 'consumer', readable when records are
+  // available, to wait on it from another event loop.
+  friend posix::FileDescriptor GetFileDescriptor(
+      const PerfBufferConsumer& consumer) {
+    return GetValue(consumer.epoll_);
+  }
+
+  // Return the number of samples the kernel dropped because a ring was full.
+  friend uint64_t GetLostCount(const PerfBufferConsumer& consumer) {
+    return consumer.lost_;
+  }
+
+  size_t ConsumeRing(impl::PerfRing* ring);
+
+  posix::UniqueFileDescriptor epoll_;
+  PerfBufferOptions options_;
+  std::vector<Callback> callbacks_;
+  std::vector<impl::PerfRing> rings_;
+  std::vector<uint8_t> scratch_;
+  uint64_t lost_ = 0;
+};
+
+// Create a consumer with no perf event arrays yet.
+error::StatusOr<PerfBufferConsumer> CreatePerfBufferConsumer(
+    const PerfBufferOptions& options = PerfBufferOptions());
+
+}  // namespace events
+
+#endif  // LIB_EVENTS_PERF_BUFFER_H_
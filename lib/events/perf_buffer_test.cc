@@ -0,0 +1,99 @@
+#include "lib/events/perf_buffer.h"
+
+#include <linux/bpf.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/bpf/map.h"
+#include "lib/events/events_test_utils.h"
+
+namespace events {
+namespace {
+
+constexpr uint32_t kMaxCpus = 1024;
+
+// Samples are padded so the raw size field and data end 8 byte aligned:
+// records are longer than the values written.
+class PerfBufferTest : public OutputTest {
+ protected:
+  PerfBufferTest() : OutputTest(BPF_FUNC_perf_event_output) {}
+
+  void SetUp() override {
+    auto map_or = bpf::impl::CreateMap(BPF_MAP_TYPE_PERF_EVENT_ARRAY, 4, 4,
+                                       kMaxCpus, 0);
+    ASSERT_TRUE(IsOk(map_or));
+    map_ = std::move(GetValue(map_or));
+  }
+};
+
+TEST_F(PerfBufferTest, PollConsumesRecords) {
+  auto consumer_or = CreatePerfBufferConsumer();
+  ASSERT_TRUE(IsOk(consumer_or));
+  auto& consumer = GetValue(consumer_or);
+  ASSERT_TRUE(IsOk(consumer.Add(GetValue(map_), Collect())));
+
+  auto count_or = consumer.Poll(0);
+  ASSERT_TRUE(IsOk(count_or));
+  EXPECT_EQ(0, GetValue(count_or));
+
+  // The test runs on a single CPU, so records stay in order.
+  ASSERT_TRUE(RunProg(LoadProg(7), 3));
+  ASSERT_TRUE(RunProg(LoadProg(9), 2));
+  count_or = consumer.Poll(1000);
+  ASSERT_TRUE(IsOk(count_or));
+  EXPECT_EQ(5, GetValue(count_or));
+  EXPECT_EQ(std::vector<int64_t>({7, 7, 7, 9, 9}), values_);
+  EXPECT_EQ(0, GetLostCount(consumer));
+}
+
+TEST_F(PerfBufferTest, WrapsAroundInBatches) {
+  PerfBufferOptions options;
+  options.page_count = 1;
+  options.max_batch = 7;
+  auto consumer_or = CreatePerfBufferConsumer(options);
+  ASSERT_TRUE(IsOk(consumer_or));
+  auto& consumer = GetValue(consumer_or);
+  ASSERT_TRUE(IsOk(consumer.Add(GetValue(map_), Collect())));
+
+  // Samples take 24 bytes, which does not divide the ring size: some wrap
+  // around and go through the scratch buffer.
+  const int prog = LoadProg(42);
+  for (int round = 0; round < 5; ++round) {
+    ASSERT_TRUE(RunProg(prog, 100));
+    EXPECT_EQ(100, consumer.Consume());
+  }
+  EXPECT_EQ(std::vector<int64_t>(500, 42), values_);
+  EXPECT_EQ(0, GetLostCount(consumer));
+}
+
+TEST_F(PerfBufferTest, CountsLostSamples) {
+  PerfBufferOptions options;
+  options.page_count = 1;
+  auto consumer_or = CreatePerfBufferConsumer(options);
+  ASSERT_TRUE(IsOk(consumer_or));
+  auto& consumer = GetValue(consumer_or);
+  ASSERT_TRUE(IsOk(consumer.Add(GetValue(map_), Collect())));
+
+  // Overflow the ring, then make room: the kernel reports the drops with the
+  // next sample.
+  const int prog = LoadProg(1);
+  ASSERT_TRUE(RunProg(prog, 1000));
+  const size_t kept = consumer.Consume();
+  EXPECT_GT(1000, kept);
+  ASSERT_TRUE(RunProg(prog, 1));
+  EXPECT_EQ(1, consumer.Consume());
+  EXPECT_EQ(1000 - kept, GetLostCount(consumer));
+}
+
+TEST_F(PerfBufferTest, RejectsOtherMaps) {
+  auto consumer_or = CreatePerfBufferConsumer();
+  ASSERT_TRUE(IsOk(consumer_or));
+  auto array_or = bpf::impl::CreateMap(BPF_MAP_TYPE_ARRAY, 4, 8, 1, 0);
+  ASSERT_TRUE(IsOk(array_or));
+  EXPECT_TRUE(IsError(GetValue(consumer_or).Add(GetValue(GetValue(array_or)),
+                                                Collect())));
+}
+
+}  // namespace
+}  // namespace events
@@ -0,0 +1,146 @@
+#include "lib/events/ring_buffer.h"
+
+#include <sys/epoll.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+
+#include "lib/bpf/map.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+
+namespace events {
+namespace {
+
+// Record header written by the kernel in front of each record: the length,
+// with the flags below in its top bits, and a page offset we do not need.
+constexpr size_t kHeaderSize = 8;
+constexpr uint32_t kBusyBit = 1U << 31;     // Reserved, not committed yet.
+constexpr uint32_t kDiscardBit = 1U << 30;  // Committed as discarded.
+
+// Records start 8 byte aligned.
+constexpr uint64_t RoundUpRecordSize(const uint32_t size) {
+  return (uint64_t{size} + kHeaderSize + 7) & ~uint64_t{7};
+}
+
+}  // namespace
+
+error::Status RingBufferConsumer::Add(const posix::FileDescriptor map_fd,
+                                      Callback callback) {
+  ASSIGN_OR_RETURN(const auto info, bpf::impl::GetMapInfo(map_fd));
+  if (info.type != kMapTypeRingBuf) {
+    return error::Status(posix::MakeCodeFromErrno(EINVAL),
+                         "not a ring buffer map");
+  }
+  impl::RingBuffer ring;
+  ASSIGN_OR_RETURN(ring.map, bpf::impl::DuplicateMap(map_fd));
+  const size_t page_size = posix::GetPageSize();
+  ASSIGN_OR_RETURN(ring.consumer,
+                   posix::Mmap(page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                               GetValue(ring.map), 0));
+  ASSIGN_OR_RETURN(ring.producer,
+                   posix::Mmap(page_size + 2 * size_t{info.max_entries},
+                               PROT_READ, MAP_SHARED, GetValue(ring.map),
+                               page_size));
+  ring.mask = info.max_entries - 1;
+  ring.callback = std::move(callback);
+
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u32 = rings_.size();
+  const int rv = ::epoll_ctl(GetValue(GetValue(epoll_)), EPOLL_CTL_ADD,
+                             GetValue(GetValue(ring.map)), &event);
+  RETURN_IF_ERROR(
+      posix::OkStatusOrCaptureErrnoIf(-1 == rv, "epoll_ctl() failed"));
+  rings_.push_back(std::move(ring));
+  return error::kOkStatus;
+}
+
+error::StatusOr<size_t> RingBufferConsumer::Poll(const int timeout_ms) {
+  std::vector<epoll_event> events(rings_.empty() ? 1 : rings_.size());
+  const int ready = ::epoll_wait(GetValue(GetValue(epoll_)), events.data(),
+                                 events.size(), timeout_ms);
+  if (-1 == ready && errno == EINTR) {
+    return size_t{0};
+  }
+  RETURN_IF_ERROR(
+      posix::OkStatusOrCaptureErrnoIf(-1 == ready, "epoll_wait() failed"));
+  if (ready == 0) {
+    // Timed out: pick up records whose producers did not ask for a wakeup.
+    return Consume();
+  }
+  size_t count = 0;
+  for (int i = 0; i < ready; ++i) {
+    count += ConsumeRing(&rings_[events[i].data.u32]);
+  }
+  return count;
+}
+
+size_t RingBufferConsumer::Consume() {
+  size_t count = 0;
+  for (auto& ring : rings_) {
+    count += ConsumeRing(&ring);
+  }
+  return count;
+}
+
+size_t RingBufferConsumer::ConsumeRing(impl::RingBuffer* const ring) {
+  auto* const consumer_position =
+      reinterpret_cast<uint64_t*>(GetBase(GetValue(ring->consumer)));
+  const uint8_t* const producer = GetBase(GetValue(ring->producer));
+  const auto* const producer_position =
+      reinterpret_cast<const uint64_t*>(producer);
+  const uint8_t* const data = producer + posix::GetPageSize();
+
+  // Only we write the consumer position.
+  uint64_t position = *consumer_position;
+  size_t count = 0;
+  size_t batch = 0;
+  for (;;) {
+    const uint64_t end = __atomic_load_n(producer_position, __ATOMIC_ACQUIRE);
+    if (position == end) {
+      break;
+    }
+    bool busy = false;
+    while (position < end) {
+      const uint8_t* const header = data + (position & ring->mask);
+      const uint32_t length = __atomic_load_n(
+          reinterpret_cast<const uint32_t*>(header), __ATOMIC_ACQUIRE);
+      if (length & kBusyBit) {
+        // Records are committed in order: wait for this one.
+        busy = true;
+        break;
+      }
+      const uint32_t size = length & ~(kBusyBit | kDiscardBit);
+      if (!(length & kDiscardBit)) {
+        ring->callback(base::MakeSpan(header + kHeaderSize, size));
+        ++count;
+      }
+      position += RoundUpRecordSize(size);
+      if (++batch == options_.max_batch) {
+        __atomic_store_n(consumer_position, position, __ATOMIC_RELEASE);
+        batch = 0;
+      }
+    }
+    if (batch) {
+      __atomic_store_n(consumer_position, position, __ATOMIC_RELEASE);
+      batch = 0;
+    }
+    if (busy) {
+      break;
+    }
+  }
+  return count;
+}
+
+error::StatusOr<RingBufferConsumer> CreateRingBufferConsumer(
+    const RingBufferOptions& options) {
+  const int epoll = ::epoll_create1(EPOLL_CLOEXEC);
+  RETURN_IF_ERROR(
+      posix::OkStatusOrCaptureErrnoIf(-1 == epoll, "epoll_create1() failed"));
+  return RingBufferConsumer(
+      posix::UniqueFileDescriptor(posix::FileDescriptor(epoll)), options);
+}
+
+}  // namespace events
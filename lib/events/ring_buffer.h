@@ -0,0 +1,119 @@
+#ifndef LIB_EVENTS_RING_BUFFER_H_
+#define LIB_EVENTS_RING_BUFFER_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "lib/base/span.h"
+#include "lib/error/status.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/file_descriptor.h"
+#include "lib/posix/mmap.h"
+#include "lib/posix/unique_file_descriptor.h"
+
+namespace events {
+
+// BPF_MAP_TYPE_RINGBUF (linux 5.8), newer than the oldest uapi headers we
+// build against.
+constexpr uint32_t kMapTypeRingBuf = 27;
+
+// Called with each event record. The record points straight into the ring
+// buffer and is only valid until the callback returns: copy out what needs
+// to outlive it.
+using Callback = std::function<void(base::Span<const uint8_t> record)>;
+
+struct RingBufferOptions {
+  // Records consumed before handing their space back to the producers.
+  // Larger batches mean fewer writes to the shared consumer position, but
+  // producers see the space freed later.
+  size_t max_batch = 256;
+};
+
+namespace impl {
+
+// One BPF_MAP_TYPE_RINGBUF, mapped into our address space.
+struct RingBuffer {
+  posix::UniqueFileDescriptor map;
+
+  // Consumer position page, the only part userspace writes.
+  posix::UniqueMapping consumer;
+
+  // Producer position page followed by the data area, mapped twice in a row
+  // so records wrapping around the end are contiguous.
+  posix::UniqueMapping producer;
+
+  uint64_t mask = 0;
+  Callback callback;
+};
+
+}  // namespace impl
+
+// Consumer of events sent by bpf programs through BPF_MAP_TYPE_RINGBUF maps,
+// shared by all CPUs and read without copying.
+//
+// Any number of ring buffers can be added; Poll() waits for any of them to
+// have records with a single epoll_wait() and drains them in batches. The
+// kernel only wakes the consumer up when it caught up with the producers, or
+// as the program asks with BPF_RB_{NO,FORCE}_WAKEUP (see lib/ebpf/events.h to
+// only wake once enough data is queued). Poll()'s timeout bounds the latency
+// of records submitted without a wakeup.
+//
+// Example usage:
+//
+// ASSIGN_OR_RETURN(auto consumer, CreateRingBufferConsumer());
+// RETURN_IF_ERROR(consumer.Add(loader->GetMapFd("events"), [](auto record) {
+//   HandleEvent(record);
+// }));
+// while (running) RETURN_IF_ERROR(GetStatus(consumer.Poll(100)));
+//
+class RingBufferConsumer {
+ public:
+  RingBufferConsumer() = default;
+
+  // Take ownership of 'epoll'. Prefer CreateRingBufferConsumer().
+  RingBufferConsumer(posix::UniqueFileDescriptor epoll,
+                     const RingBufferOptions& options)
+      : epoll_(std::move(epoll)), options_(options) {}
+
+  // Default move constructor.
+  RingBufferConsumer(RingBufferConsumer&&) = default;
+
+  // Default move assignment operator.
+  RingBufferConsumer& operator=(RingBufferConsumer&&) = default;
+
+  // Consume the ring buffer map 'map_fd', which stays owned by the caller,
+  // calling 'callback' for each of its records. Fails with EINVAL if the map
+  // is not a ring buffer.
+  error::Status Add(posix::FileDescriptor map_fd, Callback callback);
+
+  // Wait up to 'timeout_ms' (-1 forever) for records, then consume all
+  // available in every ring buffer. Returns the number of records consumed.
+  error::StatusOr<size_t> Poll(int timeout_ms);
+
+  // Consume all available records without waiting. Returns the number of
+  // records consumed.
+  size_t Consume();
+
+ private:
+  // Return the epoll file descriptor of 'consumer', readable when records are
+  // available, to wait on it from another event loop.
+  friend posix::FileDescriptor GetFileDescriptor(
+      const RingBufferConsumer& consumer) {
+    return GetValue(consumer.epoll_);
+  }
+
+  size_t ConsumeRing(impl::RingBuffer* ring);
+
+  posix::UniqueFileDescriptor epoll_;
+  RingBufferOptions options_;
+  std::vector<impl::RingBuffer> rings_;
+};
+
+// Create a consumer with no ring buffers yet.
+error::StatusOr<RingBufferConsumer> CreateRingBufferConsumer(
+    const RingBufferOptions& options = RingBufferOptions());
+
+}  // namespace events
+
+#endif  // LIB_EVENTS_RING_BUFFER_H_
@@ -0,0 +1,88 @@
+#include "lib/events/ring_buffer.h"
+
+#include <linux/bpf.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/bpf/map.h"
+#include "lib/events/events_test_utils.h"
+
+namespace events {
+namespace {
+
+constexpr uint32_t kRingSize = 4096;
+
+class RingBufferTest : public OutputTest {
+ protected:
+  RingBufferTest() : OutputTest(kHelperRingbufOutput) {}
+
+  void SetUp() override {
+    auto map_or = bpf::impl::CreateMap(
+        static_cast<bpf_map_type>(kMapTypeRingBuf), 0, 0, kRingSize, 0);
+    ASSERT_TRUE(IsOk(map_or));
+    map_ = std::move(GetValue(map_or));
+  }
+};
+
+TEST_F(RingBufferTest, PollConsumesRecords) {
+  auto consumer_or = CreateRingBufferConsumer();
+  ASSERT_TRUE(IsOk(consumer_or));
+  auto& consumer = GetValue(consumer_or);
+  ASSERT_TRUE(IsOk(consumer.Add(GetValue(map_), Collect())));
+
+  auto count_or = consumer.Poll(0);
+  ASSERT_TRUE(IsOk(count_or));
+  EXPECT_EQ(0, GetValue(count_or));
+
+  ASSERT_TRUE(RunProg(LoadProg(7), 3));
+  ASSERT_TRUE(RunProg(LoadProg(9), 2));
+  count_or = consumer.Poll(1000);
+  ASSERT_TRUE(IsOk(count_or));
+  EXPECT_EQ(5, GetValue(count_or));
+  EXPECT_EQ(std::vector<int64_t>({7, 7, 7, 9, 9}), values_);
+  EXPECT_EQ(std::vector<size_t>(5, sizeof(int64_t)), sizes_);
+}
+
+TEST_F(RingBufferTest, WrapsAroundInBatches) {
+  RingBufferOptions options;
+  options.max_batch = 7;
+  auto consumer_or = CreateRingBufferConsumer(options);
+  ASSERT_TRUE(IsOk(consumer_or));
+  auto& consumer = GetValue(consumer_or);
+  ASSERT_TRUE(IsOk(consumer.Add(GetValue(map_), Collect())));
+
+  // Records take 16 bytes: several rounds wrap around the 4096 byte ring,
+  // which only works if consumed space gets handed back.
+  const int prog = LoadProg(42);
+  for (int round = 0; round < 5; ++round) {
+    ASSERT_TRUE(RunProg(prog, 200));
+    EXPECT_EQ(200, consumer.Consume());
+  }
+  EXPECT_EQ(1000, values_.size());
+}
+
+TEST_F(RingBufferTest, TimeoutPicksUpRecordsWithoutWakeup) {
+  auto consumer_or = CreateRingBufferConsumer();
+  ASSERT_TRUE(IsOk(consumer_or));
+  auto& consumer = GetValue(consumer_or);
+  ASSERT_TRUE(IsOk(consumer.Add(GetValue(map_), Collect())));
+
+  constexpr int kNoWakeup = 1;
+  ASSERT_TRUE(RunProg(LoadProg(5, kNoWakeup), 4));
+  auto count_or = consumer.Poll(10);
+  ASSERT_TRUE(IsOk(count_or));
+  EXPECT_EQ(4, GetValue(count_or));
+}
+
+TEST_F(RingBufferTest, RejectsOtherMaps) {
+  auto consumer_or = CreateRingBufferConsumer();
+  ASSERT_TRUE(IsOk(consumer_or));
+  auto array_or = bpf::impl::CreateMap(BPF_MAP_TYPE_ARRAY, 4, 8, 1, 0);
+  ASSERT_TRUE(IsOk(array_or));
+  EXPECT_TRUE(IsError(GetValue(consumer_or).Add(GetValue(GetValue(array_or)),
+                                                Collect())));
+}
+
+}  // namespace
+}  // namespace events
@@ -0,0 +1,91 @@
+#include "lib/pcap/reader.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "lib/posix/errno.h"
+
+namespace pcap {
+namespace {
+
+constexpr uint32_t kMagicMicros = 0xa1b2c3d4;
+constexpr uint32_t kMagicNanos = 0xa1b23c4d;
+constexpr size_t kFileHeaderSize = 24;
+constexpr size_t kRecordHeaderSize = 16;
+
+error::Status MakeStatus(const int e, const std::string_view text) {
+  return error::Status(posix::MakeCodeFromErrno(e), text);
+}
+
+// Reads the fields of a capture, in its byte order.
+class FieldReader {
+ public:
+  explicit FieldReader(const bool swapped) : swapped_(swapped) {}
+
+  uint32_t Read32(const char* const field) const {
+    uint32_t value;
+    std::memcpy(&value, field, sizeof(value));
+    return swapped_ ? __builtin_bswap32(value) : value;
+  }
+
+ private:
+  const bool swapped_;
+};
+
+}  // namespace
+
+error::StatusOr<std::vector<Packet>> ParsePcap(std::string_view contents) {
+  if (contents.size() < kFileHeaderSize) {
+    return MakeStatus(EINVAL, "truncated pcap header");
+  }
+  uint32_t magic;
+  std::memcpy(&magic, contents.data(), sizeof(magic));
+  const bool swapped = magic == __builtin_bswap32(kMagicMicros) ||
+                       magic == __builtin_bswap32(kMagicNanos);
+  const FieldReader reader(swapped);
+  magic = reader.Read32(contents.data());
+  if (magic != kMagicMicros && magic != kMagicNanos) {
+    return MakeStatus(EINVAL, "not a pcap file");
+  }
+  const uint64_t fraction_ns = magic == kMagicNanos ? 1 : 1000;
+  if (reader.Read32(contents.data() + 20) != kLinkTypeEthernet) {
+    return MakeStatus(ENOTSUP, "not an ethernet capture");
+  }
+  contents.remove_prefix(kFileHeaderSize);
+
+  std::vector<Packet> packets;
+  while (!contents.empty()) {
+    if (contents.size() < kRecordHeaderSize) {
+      return MakeStatus(EINVAL, "truncated pcap record header");
+    }
+    const uint32_t seconds = reader.Read32(contents.data());
+    const uint32_t fraction = reader.Read32(contents.data() + 4);
+    const uint32_t captured = reader.Read32(contents.data() + 8);
+    const uint32_t length = reader.Read32(contents.data() + 12);
+    contents.remove_prefix(kRecordHeaderSize);
+    if (captured > contents.size() || captured > length) {
+      return MakeStatus(EINVAL, "truncated pcap record");
+    }
+    Packet packet;
+    packet.timestamp = std::chrono::seconds(seconds) +
+                       std::chrono::nanoseconds(fraction * fraction_ns);
+    packet.length = length;
+    packet.data.assign(contents.begin(), contents.begin() + captured);
+    packets.push_back(std::move(packet));
+    contents.remove_prefix(captured);
+  }
+  return packets;
+}
+
+error::StatusOr<std::vector<Packet>> ReadPcapFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::ostringstream contents;
+  if (!(contents << file.rdbuf())) {
+    return MakeStatus(EIO, "cannot read pcap file");
+  }
+  return ParsePcap(contents.str());
+}
+
+}  // namespace pcap
@@ -0,0 +1,39 @@
+#ifndef LIB_PCAP_READER_H_
+#define LIB_PCAP_READER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lib/error/status_or.h"
+
+namespace pcap {
+
+// Link type of ethernet captures, the only ones xdp programs take.
+constexpr uint32_t kLinkTypeEthernet = 1;
+
+// A captured packet.
+struct Packet {
+  // Capture time, since the epoch.
+  std::chrono::nanoseconds timestamp{0};
+  // Length of the packet on the wire, at least that of 'data': captures may
+  // truncate packets to their snapshot length.
+  uint32_t length = 0;
+  std::vector<uint8_t> data;
+};
+
+// Parse 'contents', a capture in the classic pcap format (not pcapng) with
+// microsecond or nanosecond timestamps, in either byte order. Fails with
+// EINVAL if malformed, and with ENOTSUP on captures of links other than
+// ethernet.
+error::StatusOr<std::vector<Packet>> ParsePcap(std::string_view contents);
+
+// Read the pcap file at 'path', see ParsePcap(). Fails with EIO if it cannot
+// be read.
+error::StatusOr<std::vector<Packet>> ReadPcapFile(const std::string& path);
+
+}  // namespace pcap
+
+#endif  // LIB_PCAP_READER_H_
@@ -0,0 +1,123 @@
+#include "lib/pcap/reader.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "lib/posix/errno.h"
+
+using namespace pcap;
+
+namespace {
+
+// Capture built field by field, in host byte order unless 'swapped'.
+class Capture {
+ public:
+  explicit Capture(const uint32_t magic = 0xa1b2c3d4,
+                   const uint32_t link_type = kLinkTypeEthernet,
+                   const bool swapped = false)
+      : swapped_(swapped) {
+    U32(magic);
+    U32(2 | 4 << 16);  // Version 2.4, both 16 bit fields.
+    U32(0);
+    U32(0);
+    U32(65535);
+    U32(link_type);
+  }
+
+  Capture& Add(const uint32_t seconds, const uint32_t fraction,
+               const std::string& data, const uint32_t length = 0) {
+    U32(seconds);
+    U32(fraction);
+    U32(data.size());
+    U32(length ? length : data.size());
+    bytes_ += data;
+    return *this;
+  }
+
+  const std::string& GetBytes() const { return bytes_; }
+
+ private:
+  void U32(uint32_t value) {
+    if (swapped_) {
+      value = __builtin_bswap32(value);
+    }
+    bytes_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  const bool swapped_;
+  std::string bytes_;
+};
+
+}  // namespace
+
+TEST(PcapReaderTest, ParsesPackets) {
+  Capture capture;
+  capture.Add(10, 500, "abc").Add(11, 0, "defg", 1500);
+  const auto packets_or = ParsePcap(capture.GetBytes());
+  ASSERT_TRUE(IsOk(packets_or)) << GetText(GetStatus(packets_or));
+  const auto& packets = GetValue(packets_or);
+  ASSERT_EQ(2, packets.size());
+  EXPECT_EQ(std::chrono::nanoseconds(10000500000), packets[0].timestamp);
+  EXPECT_EQ(3, packets[0].length);
+  EXPECT_EQ("abc", std::string(packets[0].data.begin(), packets[0].data.end()));
+  EXPECT_EQ(1500, packets[1].length);
+  EXPECT_EQ(4, packets[1].data.size());
+}
+
+TEST(PcapReaderTest, ParsesNanosecondsAndSwappedCaptures) {
+  Capture nanos(0xa1b23c4d);
+  nanos.Add(1, 5, "x");
+  auto packets_or = ParsePcap(nanos.GetBytes());
+  ASSERT_TRUE(IsOk(packets_or));
+  EXPECT_EQ(std::chrono::nanoseconds(1000000005),
+            GetValue(packets_or)[0].timestamp);
+
+  Capture swapped(0xa1b2c3d4, kLinkTypeEthernet, true);
+  swapped.Add(1, 5, "xy");
+  packets_or = ParsePcap(swapped.GetBytes());
+  ASSERT_TRUE(IsOk(packets_or));
+  EXPECT_EQ(std::chrono::nanoseconds(1000005000),
+            GetValue(packets_or)[0].timestamp);
+  EXPECT_EQ(2, GetValue(packets_or)[0].data.size());
+}
+
+TEST(PcapReaderTest, RejectsMalformedCaptures) {
+  EXPECT_TRUE(posix::IsErrno(GetStatus(ParsePcap("")), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(ParsePcap(Capture(0x12345678).GetBytes())), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(ParsePcap(Capture(0xa1b2c3d4, 101).GetBytes())), ENOTSUP));
+
+  Capture capture;
+  capture.Add(1, 0, "abcd");
+  const std::string& bytes = capture.GetBytes();
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(ParsePcap(bytes.substr(0, bytes.size() - 1))), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(ParsePcap(bytes.substr(0, 30))),
+                             EINVAL));
+  // More captured than sent.
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(ParsePcap(Capture().Add(1, 0, "abcd", 2).GetBytes())),
+      EINVAL));
+}
+
+TEST(PcapReaderTest, ReadsFiles) {
+  char path[] = "/tmp/pcap_reader_test_XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_LE(0, fd);
+  Capture capture;
+  capture.Add(1, 0, "abcd");
+  ASSERT_EQ(capture.GetBytes().size(),
+            write(fd, capture.GetBytes().data(), capture.GetBytes().size()));
+  close(fd);
+  const auto packets_or = ReadPcapFile(path);
+  unlink(path);
+  ASSERT_TRUE(IsOk(packets_or));
+  EXPECT_EQ(1, GetValue(packets_or).size());
+
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(ReadPcapFile("/nonexistent/capture.pcap")), EIO));
+}
@@ -0,0 +1,182 @@
+#include "lib/pcap/replay.h"
+
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cerrno>
+
+#include "lib/base/span.h"
+#include "lib/bpf/test_run.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+#include "lib/posix/mmap.h"
+#include "lib/posix/unique_file_descriptor.h"
+
+namespace pcap {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Largest packet captured off a link.
+constexpr size_t kMaxPacketSize = 65536;
+
+// Receive buffer of capture sockets, for replays outpacing the captures.
+constexpr int kReceiveBufferSize = 64 << 20;
+
+// Room BPF_PROG_TEST_RUN keeps around xdp test packets in their page, before
+// linux 5.18: XDP_PACKET_HEADROOM, and the skb_shared_info of 64 bit hosts.
+constexpr size_t kTestRunHeadroom = 256;
+constexpr size_t kTestRunSharedInfoSize = 320;
+
+// Whether BPF_PROG_TEST_RUN may refuse to run an xdp program on a packet of
+// 'size' bytes on some kernel: packets must hold an ethernet header and, but
+// for newer kernels, fit in a page.
+bool MayRejectSize(const size_t size) {
+  return size < ETH_HLEN || size > posix::GetPageSize() - kTestRunHeadroom -
+                                       kTestRunSharedInfoSize;
+}
+
+// Open a non-blocking raw packet socket on link 'ifindex', seeing all the
+// packets it sends and receives.
+error::StatusOr<posix::UniqueFileDescriptor> OpenPacketSocket(
+    const int ifindex) {
+  const int rv = ::socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                          htons(ETH_P_ALL));
+  RETURN_IF_ERROR(posix::OkStatusOrCaptureErrnoIf(-1 == rv, "socket() failed"));
+  posix::UniqueFileDescriptor fd((posix::FileDescriptor(rv)));
+
+  // Beyond the rmem_max limit with CAP_NET_ADMIN, up to it otherwise.
+  if (-1 == ::setsockopt(rv, SOL_SOCKET, SO_RCVBUFFORCE, &kReceiveBufferSize,
+                         sizeof(kReceiveBufferSize))) {
+    (void)::setsockopt(rv, SOL_SOCKET, SO_RCVBUF, &kReceiveBufferSize,
+                       sizeof(kReceiveBufferSize));
+  }
+  sockaddr_ll address = {};
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = htons(ETH_P_ALL);
+  address.sll_ifindex = ifindex;
+  RETURN_IF_ERROR(posix::OkStatusOrCaptureErrnoIf(
+      -1 == ::bind(rv, reinterpret_cast<sockaddr*>(&address), sizeof(address)),
+      "bind() failed"));
+  return fd;
+}
+
+// Read the packets waiting on 'fd' into 'packets', skipping those the link
+// sent. Returns how many were read.
+error::StatusOr<size_t> Drain(const posix::FileDescriptor fd,
+                              std::vector<Packet>* const packets) {
+  size_t count = 0;
+  std::vector<uint8_t> buffer(kMaxPacketSize);
+  for (;;) {
+    sockaddr_ll address = {};
+    socklen_t address_size = sizeof(address);
+    const ssize_t rv = ::recvfrom(
+        GetValue(fd), buffer.data(), buffer.size(), MSG_TRUNC,
+        reinterpret_cast<sockaddr*>(&address), &address_size);
+    if (-1 == rv) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return count;
+      }
+      return posix::CaptureErrnoAsStatus("recvfrom() failed");
+    }
+    if (address.sll_pkttype == PACKET_OUTGOING) {
+      continue;
+    }
+    Packet packet;
+    packet.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    packet.length = rv;
+    packet.data.assign(buffer.begin(),
+                       buffer.begin() + std::min<size_t>(rv, buffer.size()));
+    packets->push_back(std::move(packet));
+    ++count;
+  }
+}
+
+}  // namespace
+
+error::StatusOr<ReplayResult> ReplayTestRun(
+    const posix::FileDescriptor prog, const std::vector<Packet>& packets) {
+  ReplayResult result;
+  const auto start = Clock::now();
+  for (const auto& packet : packets) {
+    if (packet.data.size() < ETH_HLEN) {
+      ++result.rejected;
+      continue;
+    }
+    auto run_or = bpf::TestRun(
+        prog, base::MakeSpan(packet.data.data(), packet.data.size()));
+    if (posix::IsErrno(GetStatus(run_or), EINVAL) &&
+        MayRejectSize(packet.data.size())) {
+      ++result.rejected;
+      continue;
+    }
+    ASSIGN_OR_RETURN(auto run, std::move(run_or));
+    Packet out;
+    out.timestamp = packet.timestamp;
+    // Keep what the capture truncated off, as the program never saw it.
+    out.length = packet.length - packet.data.size() + run.packet.size();
+    out.data = std::move(run.packet);
+    result.packets[run.retval].push_back(std::move(out));
+  }
+  result.elapsed = Clock::now() - start;
+  if (!packets.empty() && result.rejected == packets.size()) {
+    return error::Status(posix::MakeCodeFromErrno(EINVAL),
+                         "no packet could be run");
+  }
+  return result;
+}
+
+error::StatusOr<ReplayResult> ReplayThroughLink(
+    const int ifindex, const int peer_ifindex,
+    const std::vector<Packet>& packets, const LinkReplayOptions& options) {
+  ASSIGN_OR_RETURN(const auto rx, OpenPacketSocket(ifindex));
+  ASSIGN_OR_RETURN(const auto tx, OpenPacketSocket(peer_ifindex));
+  ReplayResult result;
+  auto& passed = result.packets[XDP_PASS];
+  auto& bounced = result.packets[XDP_TX];
+
+  const auto start = Clock::now();
+  for (const auto& packet : packets) {
+    for (;;) {
+      const ssize_t rv = ::send(GetValue(GetValue(tx)), packet.data.data(),
+                                packet.data.size(), 0);
+      if (-1 != rv) {
+        break;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+        return posix::CaptureErrnoAsStatus("send() failed");
+      }
+      // The link is backed up: make room by reading what came through.
+      RETURN_IF_ERROR(GetStatus(Drain(GetValue(rx), &passed)));
+      RETURN_IF_ERROR(GetStatus(Drain(GetValue(tx), &bounced)));
+    }
+  }
+  for (;;) {
+    ASSIGN_OR_RETURN(const size_t rx_count, Drain(GetValue(rx), &passed));
+    ASSIGN_OR_RETURN(const size_t tx_count, Drain(GetValue(tx), &bounced));
+    if (rx_count + tx_count == 0) {
+      pollfd fds[2] = {{GetValue(GetValue(rx)), POLLIN, 0},
+                       {GetValue(GetValue(tx)), POLLIN, 0}};
+      const int rv = ::poll(fds, 2, options.idle_timeout.count());
+      RETURN_IF_ERROR(
+          posix::OkStatusOrCaptureErrnoIf(-1 == rv, "poll() failed"));
+      if (0 == rv) {
+        break;
+      }
+    }
+  }
+  result.elapsed = Clock::now() - start - options.idle_timeout;
+
+  const size_t seen = passed.size() + bounced.size();
+  result.lost = seen < packets.size() ? packets.size() - seen : 0;
+  return result;
+}
+
+}  // namespace pcap
@@ -0,0 +1,64 @@
+#ifndef LIB_PCAP_REPLAY_H_
+#define LIB_PCAP_REPLAY_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "lib/error/status_or.h"
+#include "lib/pcap/reader.h"
+#include "lib/posix/file_descriptor.h"
+
+namespace pcap {
+
+struct ReplayResult {
+  // Packets as the program left them, by xdp verdict, in replay order.
+  std::map<uint32_t, std::vector<Packet>> packets;
+  // Packets sent over a link and never seen again, see ReplayThroughLink().
+  size_t lost = 0;
+  // Packets the program could not be run on, see ReplayTestRun().
+  size_t rejected = 0;
+  // Wall time of the replay.
+  std::chrono::nanoseconds elapsed{0};
+};
+
+// Run xdp program 'prog' once on each of 'packets' with BPF_PROG_TEST_RUN
+// and sort the packets it returns by verdict. Packets keep their capture
+// time; those the program grows or shrinks their new size on the wire.
+//
+// Runs happen on the calling CPU, against the program's maps as they are,
+// in capture order: stateful programs see the traffic as recorded.
+//
+// Packets BPF_PROG_TEST_RUN cannot run programs on are skipped and counted
+// as rejected: runts shorter than an ethernet header, and frames larger than
+// a page the kernel refuses with EINVAL, before linux 5.18. Other failures
+// end the replay, e.g. EBADF for 'prog' or EINVAL for programs it cannot
+// run at all, as does every packet being rejected.
+error::StatusOr<ReplayResult> ReplayTestRun(posix::FileDescriptor prog,
+                                            const std::vector<Packet>& packets);
+
+struct LinkReplayOptions {
+  // How long to wait for packets after the last one seen, once all are sent.
+  std::chrono::milliseconds idle_timeout{200};
+};
+
+// Send 'packets' out of link 'peer_ifindex' and capture what comes back
+// through the xdp program attached to its peer link 'ifindex', e.g. the two
+// ends of a veth pair:
+//  - XDP_PASS: packets received on 'ifindex'.
+//  - XDP_TX: packets bounced back, received on 'peer_ifindex'.
+// Packets get the time they were captured at. Packets that never come back
+// are only counted: a link cannot tell XDP_DROP, XDP_ABORTED and
+// XDP_REDIRECT elsewhere apart.
+//
+// Captures everything the links receive: keep other traffic off them, e.g.
+// IPv6 neighbor discovery, or it ends up among the packets passed. Needs
+// CAP_NET_RAW.
+error::StatusOr<ReplayResult> ReplayThroughLink(
+    int ifindex, int peer_ifindex, const std::vector<Packet>& packets,
+    const LinkReplayOptions& options = LinkReplayOptions());
+
+}  // namespace pcap
+
+#endif  // LIB_PCAP_REPLAY_H_
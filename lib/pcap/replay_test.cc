@@ -0,0 +1,176 @@
+#include "lib/pcap/replay.h"
+
+#include <linux/if_link.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+
+#include "gtest/gtest.h"
+#include "lib/bpf/redirect_map.h"
+#include "lib/bpf/syscall.h"
+#include "lib/ebpd_link.h"
+#include "lib/posix/errno.h"
+#include "lib/posix/unique_file_descriptor.h"
+#include "lib/tests/xdp_test_utils.h"
+
+using namespace pcap;
+
+// These tests load real programs and need root.
+
+namespace {
+
+constexpr int kPackets = 10;
+
+std::vector<Packet> MakePackets() {
+  std::vector<Packet> packets(kPackets);
+  for (int i = 0; i < kPackets; ++i) {
+    packets[i].timestamp = std::chrono::seconds(i);
+    packets[i].length = 1500;
+    // Broadcast frames of a local experimental ethertype.
+    packets[i].data.assign(60, i);
+    std::fill(packets[i].data.begin(), packets[i].data.begin() + 6, 0xff);
+    packets[i].data[12] = 0x88;
+    packets[i].data[13] = 0xb5;
+  }
+  return packets;
+}
+
+}  // namespace
+
+TEST(ReplayTest, SortsTestRunsByVerdict) {
+  const int prog_fd = LoadTrivialXdpProg(XDP_TX);
+  ASSERT_LE(0, prog_fd);
+  const auto packets = MakePackets();
+  const auto result_or = ReplayTestRun(posix::FileDescriptor(prog_fd), packets);
+  close(prog_fd);
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  const auto& result = GetValue(result_or);
+  ASSERT_EQ(1, result.packets.size());
+  const auto& sent = result.packets.at(XDP_TX);
+  ASSERT_EQ(kPackets, sent.size());
+  for (int i = 0; i < kPackets; ++i) {
+    EXPECT_EQ(packets[i].timestamp, sent[i].timestamp);
+    EXPECT_EQ(packets[i].length, sent[i].length);
+    EXPECT_EQ(packets[i].data, sent[i].data);
+  }
+  EXPECT_EQ(0, result.lost);
+  EXPECT_EQ(0, result.rejected);
+}
+
+TEST(ReplayTest, SkipsRejectedPackets) {
+  const int prog_fd = LoadTrivialXdpProg(XDP_TX);
+  ASSERT_LE(0, prog_fd);
+  auto packets = MakePackets();
+  // A runt, shorter than an ethernet header.
+  packets[3].data.resize(10);
+  packets[3].length = 10;
+  const auto result_or = ReplayTestRun(posix::FileDescriptor(prog_fd), packets);
+  close(prog_fd);
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  const auto& result = GetValue(result_or);
+  EXPECT_EQ(1, result.rejected);
+  const auto& sent = result.packets.at(XDP_TX);
+  ASSERT_EQ(kPackets - 1, sent.size());
+  EXPECT_EQ(packets[2].timestamp, sent[2].timestamp);
+  EXPECT_EQ(packets[4].timestamp, sent[3].timestamp);
+}
+
+TEST(ReplayTest, FailsWithoutPacketsRun) {
+  const int prog_fd = LoadTrivialXdpProg(XDP_TX);
+  ASSERT_LE(0, prog_fd);
+  auto packets = MakePackets();
+  for (auto& packet : packets) {
+    packet.data.resize(10);
+  }
+  const auto result_or = ReplayTestRun(posix::FileDescriptor(prog_fd), packets);
+  close(prog_fd);
+  EXPECT_TRUE(posix::IsErrno(GetStatus(result_or), EINVAL));
+}
+
+TEST(ReplayTest, FailsOnBadPrograms) {
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(ReplayTestRun(posix::FileDescriptor(-1), MakePackets())),
+      EBADF));
+
+  // Programs for devmap entries only run there, never in test runs.
+  bpf_insn insns[2] = {};
+  insns[0].code = BPF_ALU64 | BPF_MOV | BPF_K;
+  insns[0].imm = XDP_PASS;
+  insns[1].code = BPF_JMP | BPF_EXIT;
+  static const char license[] = "GPL";
+  auto attr = bpf::MakeAttr<bpf::ProgLoadAttr>();
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insn_cnt = 2;
+  attr.insns = bpf::ToAttrPointer(insns);
+  attr.license = bpf::ToAttrPointer(license);
+  attr.expected_attach_type = bpf::kAttachXdpDevMap;
+  const auto fd_or = bpf::Bpf(BPF_PROG_LOAD, &attr);
+  ASSERT_TRUE(IsOk(fd_or)) << GetText(GetStatus(fd_or));
+  const posix::UniqueFileDescriptor prog(
+      (posix::FileDescriptor(GetValue(fd_or))));
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(ReplayTestRun(GetValue(prog), MakePackets())), EINVAL));
+}
+
+// Replays through a program attached to veth1, sending from veth0.
+class LinkReplayTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(EnterNewNetns());
+    // No router solicitations or neighbor discovery among the packets.
+    std::ofstream("/proc/sys/net/ipv6/conf/default/disable_ipv6") << "1";
+    peer_ifindex_ = CreateVethPair("veth0", "veth1");
+    ASSERT_NE(0, peer_ifindex_);
+    ifindex_ = if_nametoindex("veth1");
+  }
+
+  void TearDown() override {
+    if (prog_fd_ >= 0) {
+      close(prog_fd_);
+    }
+  }
+
+  ReplayResult Replay(const int verdict) {
+    prog_fd_ = LoadTrivialXdpProg(verdict);
+    EXPECT_LE(0, prog_fd_);
+    EXPECT_EQ(0, ebpd_link_set_xdp(ifindex_, prog_fd_, XDP_FLAGS_SKB_MODE));
+    LinkReplayOptions options;
+    options.idle_timeout = std::chrono::milliseconds(100);
+    auto result_or =
+        ReplayThroughLink(ifindex_, peer_ifindex_, MakePackets(), options);
+    EXPECT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+    return IsOk(result_or) ? std::move(GetValue(result_or)) : ReplayResult();
+  }
+
+  int ifindex_ = 0;
+  int peer_ifindex_ = 0;
+  int prog_fd_ = -1;
+};
+
+TEST_F(LinkReplayTest, CapturesPassedPackets) {
+  const auto result = Replay(XDP_PASS);
+  const auto& passed = result.packets.at(XDP_PASS);
+  ASSERT_EQ(kPackets, passed.size());
+  const auto packets = MakePackets();
+  for (int i = 0; i < kPackets; ++i) {
+    EXPECT_EQ(packets[i].data, passed[i].data);
+  }
+  EXPECT_TRUE(result.packets.at(XDP_TX).empty());
+  EXPECT_EQ(0, result.lost);
+}
+
+TEST_F(LinkReplayTest, CapturesBouncedPackets) {
+  const auto result = Replay(XDP_TX);
+  EXPECT_TRUE(result.packets.at(XDP_PASS).empty());
+  EXPECT_EQ(kPackets, result.packets.at(XDP_TX).size());
+  EXPECT_EQ(0, result.lost);
+}
+
+TEST_F(LinkReplayTest, CountsDroppedPackets) {
+  const auto result = Replay(XDP_DROP);
+  EXPECT_TRUE(result.packets.at(XDP_PASS).empty());
+  EXPECT_TRUE(result.packets.at(XDP_TX).empty());
+  EXPECT_EQ(kPackets, result.lost);
+}
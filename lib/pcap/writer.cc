@@ -0,0 +1,60 @@
+#include "lib/pcap/writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <fstream>
+
+#include "lib/posix/errno.h"
+
+namespace pcap {
+namespace {
+
+constexpr uint32_t kMagicNanos = 0xa1b23c4d;
+
+void Append32(const uint32_t value, std::string* const out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void Append16(const uint16_t value, std::string* const out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}  // namespace
+
+std::string FormatPcap(const std::vector<Packet>& packets) {
+  uint32_t snaplen = 65535;
+  for (const auto& packet : packets) {
+    snaplen = std::max<uint32_t>(snaplen, packet.data.size());
+  }
+  std::string out;
+  Append32(kMagicNanos, &out);
+  Append16(2, &out);  // Version 2.4.
+  Append16(4, &out);
+  Append32(0, &out);  // Timestamps in UTC.
+  Append32(0, &out);
+  Append32(snaplen, &out);
+  Append32(kLinkTypeEthernet, &out);
+  for (const auto& packet : packets) {
+    const uint64_t ns = packet.timestamp.count();
+    Append32(ns / 1000000000, &out);
+    Append32(ns % 1000000000, &out);
+    Append32(packet.data.size(), &out);
+    Append32(std::max<uint32_t>(packet.length, packet.data.size()), &out);
+    out.append(packet.data.begin(), packet.data.end());
+  }
+  return out;
+}
+
+error::Status WritePcapFile(const std::string& path,
+                            const std::vector<Packet>& packets) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  const std::string contents = FormatPcap(packets);
+  if (!file.write(contents.data(), contents.size()) || !file.flush()) {
+    return error::Status(posix::MakeCodeFromErrno(EIO),
+                         "cannot write pcap file");
+  }
+  return error::kOkStatus;
+}
+
+}  // namespace pcap
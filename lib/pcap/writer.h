@@ -0,0 +1,23 @@
+#ifndef LIB_PCAP_WRITER_H_
+#define LIB_PCAP_WRITER_H_
+
+#include <string>
+#include <vector>
+
+#include "lib/error/status.h"
+#include "lib/pcap/reader.h"
+
+namespace pcap {
+
+// Return 'packets' as an ethernet capture in the classic pcap format, with
+// nanosecond timestamps. ParsePcap() reads it back as it was.
+std::string FormatPcap(const std::vector<Packet>& packets);
+
+// Write 'packets' to a pcap file at 'path', see FormatPcap(), replacing it
+// if it exists. Fails with EIO if it cannot be written.
+error::Status WritePcapFile(const std::string& path,
+                            const std::vector<Packet>& packets);
+
+}  // namespace pcap
+
+#endif  // LIB_PCAP_WRITER_H_
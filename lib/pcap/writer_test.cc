@@ -0,0 +1,54 @@
+#include "lib/pcap/writer.h"
+
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "lib/posix/errno.h"
+
+using namespace pcap;
+
+namespace {
+
+Packet MakePacket(const int64_t ns, const std::string& data,
+                  const uint32_t length = 0) {
+  Packet packet;
+  packet.timestamp = std::chrono::nanoseconds(ns);
+  packet.length = length;
+  packet.data.assign(data.begin(), data.end());
+  return packet;
+}
+
+}  // namespace
+
+TEST(PcapWriterTest, RoundTrips) {
+  const std::vector<Packet> packets = {
+      MakePacket(1000000001, "abc", 3),
+      MakePacket(2999999999, "defg", 1500),
+      // Rewritten by a program past its original length.
+      MakePacket(3, "hijkl", 2),
+  };
+  const auto parsed_or = ParsePcap(FormatPcap(packets));
+  ASSERT_TRUE(IsOk(parsed_or)) << GetText(GetStatus(parsed_or));
+  const auto& parsed = GetValue(parsed_or);
+  ASSERT_EQ(3, parsed.size());
+  for (size_t i = 0; i < parsed.size(); ++i) {
+    EXPECT_EQ(packets[i].timestamp, parsed[i].timestamp);
+    EXPECT_EQ(packets[i].data, parsed[i].data);
+  }
+  EXPECT_EQ(1500, parsed[1].length);
+  EXPECT_EQ(5, parsed[2].length);
+}
+
+TEST(PcapWriterTest, WritesFiles) {
+  char path[] = "/tmp/pcap_writer_test_XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_LE(0, fd);
+  close(fd);
+  ASSERT_TRUE(IsOk(WritePcapFile(path, {MakePacket(1, "abcd")})));
+  const auto packets_or = ReadPcapFile(path);
+  unlink(path);
+  ASSERT_TRUE(IsOk(packets_or));
+  EXPECT_EQ(1, GetValue(packets_or).size());
+
+  EXPECT_TRUE(posix::IsErrno(WritePcapFile("/nonexistent/out.pcap", {}), EIO));
+}
@@ -37,6 +37,13 @@ inline error::Status OkStatusOrCaptureErrnoIf(const bool predicate,
   return predicate ? CaptureErrnoAsStatus(text) : error::kOkStatus;
 }
 
+// Idiom to check whether 'status' carries the errno value 'e'. Useful when
+// specific errno values are part of a call's contract (e.g. ENOENT from a
+// lookup) rather than a failure.
+inline bool IsErrno(const error::Status& status, const int e) {
+  return GetCode(status) == MakeCodeFromErrno(e);
+}
+
 }  // namespace posix
 
 #endif  // LIB_POSIX_ERRNO_H_
\ No newline at end of file
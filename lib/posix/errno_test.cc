@@ -18,4 +18,12 @@ TEST(ErrnoTest, OkStatusOrCaptureErrnoIfError) {
   const auto status = OkStatusOrCaptureErrnoIf(true, "some error");
   EXPECT_TRUE(IsError(status));
   EXPECT_EQ("some error", GetText(status));
-}
\ No newline at end of file
+}
+
+TEST(ErrnoTest, IsErrno) {
+  errno = ENOENT;
+  const auto status = CaptureErrnoAsStatus("not found");
+  EXPECT_TRUE(IsErrno(status, ENOENT));
+  EXPECT_FALSE(IsErrno(status, EINVAL));
+  EXPECT_FALSE(IsErrno(kOkStatus, ENOENT));
+}
@@ -0,0 +1,70 @@
+#ifndef LIB_POSIX_MMAP_H_
+#define LIB_POSIX_MMAP_H_
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdint>
+
+#include "lib/base/ignore.h"
+#include "lib/base/span.h"
+#include "lib/base/unique_value.h"
+#include "lib/error/return_if_error.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/errno.h"
+#include "lib/posix/file_descriptor.h"
+
+namespace posix {
+
+// Remove the memory mapping described by 'mapping'.
+inline error::Status Munmap(const base::Span<uint8_t> mapping) {
+  const auto rv = ::munmap(GetBase(mapping), GetSize(mapping));
+  return OkStatusOrCaptureErrnoIf(-1 == rv, "munmap() failed");
+}
+
+namespace impl {
+
+struct UniqueMappingDtor {
+  void operator()(const base::Span<uint8_t> mapping) {
+    base::Ignore(Munmap(mapping));  // Nothing we can do about an error here.
+  }
+};
+
+}  // namespace impl
+
+// Type implementing a movable, automatically unmapped memory mapping. The
+// wrapped span describes the whole mapping.
+//
+// Example usage:
+// {
+//   ASSIGN_OR_RETURN(auto mapping, Mmap(size, PROT_READ, MAP_SHARED, fd, 0));
+//   DoSomethingWithBytes(GetValue(mapping));
+// }  // 'mapping' leaves scope and is automatically unmapped!
+//
+using UniqueMapping =
+    base::UniqueValue<base::Span<uint8_t>, impl::UniqueMappingDtor>;
+
+// Return the size of a page, the granularity of mappings.
+inline size_t GetPageSize() { return ::sysconf(_SC_PAGESIZE); }
+
+// Round 'size' up to a whole number of pages.
+inline size_t RoundUpToPageSize(const size_t size) {
+  const size_t page_size = GetPageSize();
+  return (size + page_size - 1) / page_size * page_size;
+}
+
+// Map 'size' bytes of 'fd' at 'offset' (or anonymous memory if 'fd' is
+// kInvalidFileDescriptor and 'flags' has MAP_ANONYMOUS). See 'man 2 mmap'.
+inline error::StatusOr<UniqueMapping> Mmap(const size_t size, const int prot,
+                                           const int flags,
+                                           const FileDescriptor fd,
+                                           const off_t offset) {
+  void* const base = ::mmap(nullptr, size, prot, flags, GetValue(fd), offset);
+  RETURN_IF_ERROR(
+      OkStatusOrCaptureErrnoIf(MAP_FAILED == base, "mmap() failed"));
+  return UniqueMapping(base::MakeSpan(static_cast<uint8_t*>(base), size));
+}
+
+}  // namespace posix
+
+#endif  // LIB_POSIX_MMAP_H_
@@ -0,0 +1,27 @@
+#include "lib/posix/mmap.h"
+#include "gtest/gtest.h"
+
+using namespace posix;
+
+TEST(MmapTest, Anonymous) {
+  auto mapping = Mmap(GetPageSize(), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, kInvalidFileDescriptor, 0);
+  ASSERT_TRUE(IsOk(mapping));
+  const auto bytes = GetValue(GetValue(mapping));
+  EXPECT_EQ(GetPageSize(), GetSize(bytes));
+  GetBase(bytes)[0] = 42;
+  EXPECT_EQ(42, GetBase(bytes)[0]);
+}
+
+TEST(MmapTest, Failure) {
+  auto mapping = Mmap(GetPageSize(), PROT_READ, MAP_SHARED,
+                      kInvalidFileDescriptor, 0);
+  EXPECT_TRUE(IsErrno(GetStatus(mapping), EBADF));
+}
+
+TEST(MmapTest, RoundUpToPageSize) {
+  EXPECT_EQ(0, RoundUpToPageSize(0));
+  EXPECT_EQ(GetPageSize(), RoundUpToPageSize(1));
+  EXPECT_EQ(GetPageSize(), RoundUpToPageSize(GetPageSize()));
+  EXPECT_EQ(2 * GetPageSize(), RoundUpToPageSize(GetPageSize() + 1));
+}
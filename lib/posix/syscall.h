@@ -23,7 +23,7 @@ template <typename... ArgsT>
 inline error::StatusOr<int> Syscall(const int number, ArgsT&&... args) {
   const auto rv = ::syscall(number, std::forward<ArgsT>(args)...);
   RETURN_IF_ERROR(OkStatusOrCaptureErrnoIf(-1 == rv, "syscall() failed"));
-  return rv;
+  return static_cast<int>(rv);
 }
 
 }  // namespace posix
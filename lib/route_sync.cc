@@ -0,0 +1,250 @@
+#include "lib/route_sync.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <string>
+#include <vector>
+
+#include "lib/base/span.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+
+namespace {
+
+error::Status MakeStatus(const int e, const std::string_view text) {
+  return error::Status(posix::MakeCodeFromErrno(e), text);
+}
+
+// Parse the address and length of 'prefix' into 'key', a route map key,
+// clearing the address bits past the length.
+template <typename K>
+error::Status ParsePrefix(const std::string_view prefix, const int family,
+                          K* const key) {
+  const size_t slash = prefix.find('/');
+  if (slash == std::string_view::npos) {
+    return MakeStatus(EINVAL, "prefix without length");
+  }
+  const std::string addr(prefix.substr(0, slash));
+  const std::string_view length = prefix.substr(slash + 1);
+  uint32_t prefixlen = 0;
+  const auto result =
+      std::from_chars(length.data(), length.data() + length.size(), prefixlen);
+  if (result.ec != std::errc() ||
+      result.ptr != length.data() + length.size() ||
+      prefixlen > sizeof(key->addr) * 8 ||
+      inet_pton(family, addr.c_str(), key->addr) != 1) {
+    return MakeStatus(EINVAL, "malformed prefix");
+  }
+  key->prefixlen = prefixlen;
+  for (size_t i = 0; i < sizeof(key->addr); ++i) {
+    const uint32_t bits = std::min<uint32_t>(prefixlen, 8);
+    key->addr[i] &= static_cast<uint8_t>(0xff00 >> bits);
+    prefixlen -= bits;
+  }
+  return error::kOkStatus;
+}
+
+bool IsIpv6(const std::string_view prefix) {
+  return prefix.find(':') != std::string_view::npos;
+}
+
+bool operator==(const ebpd_nexthop& a, const ebpd_nexthop& b) {
+  return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// Changes turning the routes 'from' into the routes 'to'.
+template <typename K>
+struct RouteDiff {
+  std::vector<K> update_keys;
+  std::vector<ebpd_nexthop> update_values;
+  std::vector<K> remove_keys;
+  size_t added = 0;
+  size_t changed = 0;
+};
+
+// Walk both sorted maps at once, linear in their sizes.
+template <typename K>
+RouteDiff<K> Diff(const impl::RouteMap<K>& from, const impl::RouteMap<K>& to) {
+  const impl::BytesLess less;
+  RouteDiff<K> diff;
+  auto it = from.begin();
+  for (const auto& [key, nexthop] : to) {
+    for (; it != from.end() && less(it->first, key); ++it) {
+      diff.remove_keys.push_back(it->first);
+    }
+    if (it != from.end() && !less(key, it->first)) {
+      if (!(it->second == nexthop)) {
+        diff.update_keys.push_back(key);
+        diff.update_values.push_back(nexthop);
+        ++diff.changed;
+      }
+      ++it;
+      continue;
+    }
+    diff.update_keys.push_back(key);
+    diff.update_values.push_back(nexthop);
+    ++diff.added;
+  }
+  for (; it != from.end(); ++it) {
+    diff.remove_keys.push_back(it->first);
+  }
+  return diff;
+}
+
+template <typename K>
+error::Status WriteRoutes(bpf::BpfMap<K, ebpd_nexthop>* const map,
+                          const RouteDiff<K>& diff, const size_t batch_size) {
+  for (size_t i = 0; i < diff.update_keys.size(); i += batch_size) {
+    const size_t count = std::min(batch_size, diff.update_keys.size() - i);
+    RETURN_IF_ERROR(GetStatus(
+        map->UpdateBatch(base::MakeSpan(diff.update_keys.data() + i, count),
+                         base::MakeSpan(diff.update_values.data() + i, count))));
+  }
+  return error::kOkStatus;
+}
+
+template <typename K>
+error::Status RemoveRoutes(bpf::BpfMap<K, ebpd_nexthop>* const map,
+                           const RouteDiff<K>& diff, const size_t batch_size) {
+  for (size_t i = 0; i < diff.remove_keys.size(); i += batch_size) {
+    const size_t count = std::min(batch_size, diff.remove_keys.size() - i);
+    RETURN_IF_ERROR(GetStatus(map->DeleteBatch(
+        base::MakeSpan(diff.remove_keys.data() + i, count))));
+  }
+  return error::kOkStatus;
+}
+
+template <typename K>
+error::Status ReadRoutes(const bpf::BpfMap<K, ebpd_nexthop>& map,
+                         impl::RouteMap<K>* const routes) {
+  std::vector<K> keys;
+  std::vector<ebpd_nexthop> values;
+  RETURN_IF_ERROR(map.LookupAll(&keys, &values));
+  routes->clear();
+  for (size_t i = 0; i < keys.size(); ++i) {
+    routes->emplace(keys[i], values[i]);
+  }
+  return error::kOkStatus;
+}
+
+template <typename K>
+void AddPorts(const impl::RouteMap<K>& routes, std::set<uint32_t>* const ports) {
+  for (const auto& route : routes) {
+    ports->insert(route.second.ifindex);
+  }
+}
+
+}  // namespace
+
+error::Status RouteTable::Add(const std::string_view prefix,
+                              const ebpd_nexthop& nexthop) {
+  if (IsIpv6(prefix)) {
+    ebpd_route_v6 key = {};
+    RETURN_IF_ERROR(ParsePrefix(prefix, AF_INET6, &key));
+    v6_[key] = nexthop;
+  } else {
+    ebpd_route_v4 key = {};
+    RETURN_IF_ERROR(ParsePrefix(prefix, AF_INET, &key));
+    v4_[key] = nexthop;
+  }
+  return error::kOkStatus;
+}
+
+error::Status RouteTable::Remove(const std::string_view prefix) {
+  size_t erased = 0;
+  if (IsIpv6(prefix)) {
+    ebpd_route_v6 key = {};
+    RETURN_IF_ERROR(ParsePrefix(prefix, AF_INET6, &key));
+    erased = v6_.erase(key);
+  } else {
+    ebpd_route_v4 key = {};
+    RETURN_IF_ERROR(ParsePrefix(prefix, AF_INET, &key));
+    erased = v4_.erase(key);
+  }
+  if (!erased) {
+    return MakeStatus(ENOENT, "no route to prefix");
+  }
+  return error::kOkStatus;
+}
+
+error::Status RouteSync::Load() {
+  RETURN_IF_ERROR(ReadRoutes(v4_map_, &synced_.v4_));
+  RETURN_IF_ERROR(ReadRoutes(v6_map_, &synced_.v6_));
+  std::vector<uint32_t> keys;
+  std::vector<uint32_t> ifindexes;
+  RETURN_IF_ERROR(ports_map_.LookupAll(&keys, &ifindexes));
+  synced_ports_.clear();
+  synced_ports_.insert(keys.begin(), keys.end());
+  loaded_ = true;
+  return error::kOkStatus;
+}
+
+error::StatusOr<RouteSyncStats> RouteSync::Sync(const RouteTable& table) {
+  if (!loaded_) {
+    RETURN_IF_ERROR(Load());
+  }
+  // Anything failing from here leaves the maps somewhere between the synced
+  // routes and 'table'.
+  loaded_ = false;
+
+  std::set<uint32_t> ports;
+  AddPorts(table.v4_, &ports);
+  AddPorts(table.v6_, &ports);
+  for (const uint32_t ifindex : ports) {
+    if (!synced_ports_.count(ifindex)) {
+      RETURN_IF_ERROR(ports_map_.Update(ifindex, ifindex));
+    }
+  }
+
+  const auto v4_diff = Diff(synced_.v4_, table.v4_);
+  const auto v6_diff = Diff(synced_.v6_, table.v6_);
+  RETURN_IF_ERROR(WriteRoutes(&v4_map_, v4_diff, options_.batch_size));
+  RETURN_IF_ERROR(WriteRoutes(&v6_map_, v6_diff, options_.batch_size));
+  RETURN_IF_ERROR(RemoveRoutes(&v4_map_, v4_diff, options_.batch_size));
+  RETURN_IF_ERROR(RemoveRoutes(&v6_map_, v6_diff, options_.batch_size));
+
+  for (const uint32_t ifindex : synced_ports_) {
+    if (!ports.count(ifindex)) {
+      const auto status = ports_map_.Delete(ifindex);
+      if (IsError(status) && !posix::IsErrno(status, ENOENT)) {
+        return status;
+      }
+    }
+  }
+
+  synced_ = table;
+  synced_ports_ = std::move(ports);
+  loaded_ = true;
+  RouteSyncStats stats;
+  stats.added = v4_diff.added + v6_diff.added;
+  stats.changed = v4_diff.changed + v6_diff.changed;
+  stats.removed = v4_diff.remove_keys.size() + v6_diff.remove_keys.size();
+  return stats;
+}
+
+error::StatusOr<RouteSync> CreateRouteSync(const posix::FileDescriptor v4_map,
+                                           const posix::FileDescriptor v6_map,
+                                           const posix::FileDescriptor ports_map,
+                                           const RouteSyncOptions& options) {
+  ASSIGN_OR_RETURN(auto v4, (bpf::OpenMap<ebpd_route_v4, ebpd_nexthop>(v4_map)));
+  ASSIGN_OR_RETURN(auto v6, (bpf::OpenMap<ebpd_route_v6, ebpd_nexthop>(v6_map)));
+  ASSIGN_OR_RETURN(auto ports, (bpf::OpenMap<uint32_t, uint32_t>(ports_map)));
+  return RouteSync(std::move(v4), std::move(v6), std::move(ports), options);
+}
+
+error::StatusOr<RouteSync> CreateRouteSync(const XdpLoader& router,
+                                           const RouteSyncOptions& options) {
+  const int v4_map = router.GetMapFd(kRouterIpv4MapName);
+  const int v6_map = router.GetMapFd(kRouterIpv6MapName);
+  const int ports_map = router.GetMapFd(kRouterPortsMapName);
+  if (v4_map < 0 || v6_map < 0 || ports_map < 0) {
+    return MakeStatus(ENOENT, "router maps not found");
+  }
+  return CreateRouteSync(posix::FileDescriptor(v4_map),
+                         posix::FileDescriptor(v6_map),
+                         posix::FileDescriptor(ports_map), options);
+}
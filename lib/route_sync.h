@@ -0,0 +1,169 @@
+#ifndef LIB_ROUTE_SYNC_H_
+#define LIB_ROUTE_SYNC_H_
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string_view>
+
+#include "lib/bpf/map.h"
+#include "lib/ebpf/router_maps.h"
+#include "lib/error/status.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/file_descriptor.h"
+#include "lib/xdp_loader.h"
+
+// Names of the maps of lib/ebpf/router.c.
+constexpr char kRouterIpv4MapName[] = "routes_v4";
+constexpr char kRouterIpv6MapName[] = "routes_v6";
+constexpr char kRouterPortsMapName[] = "ports";
+
+namespace impl {
+
+// Orders map keys and values byte by byte, the way the kernel compares them.
+struct BytesLess {
+  template <typename T>
+  bool operator()(const T& a, const T& b) const {
+    return std::memcmp(&a, &b, sizeof(T)) < 0;
+  }
+};
+
+template <typename K>
+using RouteMap = std::map<K, ebpd_nexthop, BytesLess>;
+
+}  // namespace impl
+
+// Routes for lib/ebpf/router.c, as userspace wants them, e.g. mirrored from
+// the kernel or a routing daemon.
+//
+// Example usage:
+//
+// RouteTable table;
+// RETURN_IF_ERROR(table.Add("10.0.0.0/8", nexthop));
+// RETURN_IF_ERROR(table.Add("2001:db8::/32", nexthop));
+//
+class RouteTable {
+ public:
+  // Route 'prefix', e.g. "10.0.0.0/8" or "2001:db8::/32", through 'nexthop',
+  // in place of the route to 'prefix' if any. Address bits past the prefix
+  // length are ignored. Fails with EINVAL on malformed prefixes.
+  error::Status Add(std::string_view prefix, const ebpd_nexthop& nexthop);
+
+  // Remove the route to 'prefix'. Fails with ENOENT if there is none.
+  error::Status Remove(std::string_view prefix);
+
+ private:
+  // Reads the routes back from the maps.
+  friend class RouteSync;
+
+  // Return the IPv4 routes of 'table'.
+  friend const impl::RouteMap<ebpd_route_v4>& GetIpv4Routes(
+      const RouteTable& table) {
+    return table.v4_;
+  }
+
+  // Return the IPv6 routes of 'table'.
+  friend const impl::RouteMap<ebpd_route_v6>& GetIpv6Routes(
+      const RouteTable& table) {
+    return table.v6_;
+  }
+
+  // Return the number of routes in 'table'.
+  friend size_t GetSize(const RouteTable& table) {
+    return table.v4_.size() + table.v6_.size();
+  }
+
+  impl::RouteMap<ebpd_route_v4> v4_;
+  impl::RouteMap<ebpd_route_v6> v6_;
+};
+
+struct RouteSyncOptions {
+  // Routes written or removed per bpf() call, on kernels and map types with
+  // batch operations.
+  size_t batch_size = 1024;
+};
+
+// What a RouteSync::Sync() call changed.
+struct RouteSyncStats {
+  size_t added = 0;
+  size_t changed = 0;
+  size_t removed = 0;
+};
+
+// Keeps the maps of lib/ebpf/router.c in sync with a RouteTable.
+//
+// Each Sync() diffs the table against the routes synced last and only writes
+// the difference, so syncing a full table of a million routes after one
+// route changed costs one map update. New and changed routes are written
+// before removed ones go: packets matching a removed prefix fall back to a
+// shorter one already in place, never to no route at all.
+//
+// Output ports are added to the router's DEVMAP_HASH before the first route
+// using them, and removed after the last one. Syncs fail once routes go
+// through more than EBPD_ROUTER_MAX_PORTS ports.
+//
+// Example usage:
+//
+// ASSIGN_OR_RETURN(auto sync, CreateRouteSync(*router));
+// for (;;) {
+//   RouteTable table = ReadRoutes();
+//   ASSIGN_OR_RETURN(const auto stats, sync.Sync(table));
+//   ...
+// }
+//
+class RouteSync {
+ public:
+  RouteSync() = default;
+
+  // Take ownership of the maps of a router. Prefer CreateRouteSync().
+  RouteSync(bpf::BpfMap<ebpd_route_v4, ebpd_nexthop> v4_map,
+            bpf::BpfMap<ebpd_route_v6, ebpd_nexthop> v6_map,
+            bpf::BpfMap<uint32_t, uint32_t> ports_map,
+            const RouteSyncOptions& options)
+      : v4_map_(std::move(v4_map)),
+        v6_map_(std::move(v6_map)),
+        ports_map_(std::move(ports_map)),
+        options_(options) {}
+
+  // Default move constructor.
+  RouteSync(RouteSync&&) = default;
+
+  // Default move assignment operator.
+  RouteSync& operator=(RouteSync&&) = default;
+
+  // Make the router's maps hold exactly the routes of 'table'. On error the
+  // maps may hold part of the changes; the next Sync() reads them back and
+  // completes them.
+  error::StatusOr<RouteSyncStats> Sync(const RouteTable& table);
+
+ private:
+  // Read the routes and ports in the maps as the last synced state.
+  error::Status Load();
+
+  bpf::BpfMap<ebpd_route_v4, ebpd_nexthop> v4_map_;
+  bpf::BpfMap<ebpd_route_v6, ebpd_nexthop> v6_map_;
+  bpf::BpfMap<uint32_t, uint32_t> ports_map_;
+  RouteSyncOptions options_;
+
+  // What the maps hold, valid once loaded.
+  bool loaded_ = false;
+  RouteTable synced_;
+  std::set<uint32_t> synced_ports_;
+};
+
+// Sync routes into the maps behind 'v4_map', 'v6_map' and 'ports_map', which
+// stay owned by the caller. Routes and ports already in the maps, e.g. pinned
+// maps reused across restarts, are the starting point of the first diff.
+// Fails with EINVAL if the maps are not those of lib/ebpf/router.c.
+error::StatusOr<RouteSync> CreateRouteSync(
+    posix::FileDescriptor v4_map, posix::FileDescriptor v6_map,
+    posix::FileDescriptor ports_map,
+    const RouteSyncOptions& options = RouteSyncOptions());
+
+// Sync routes into the maps of 'router', a loaded lib/ebpf/router.c.
+error::StatusOr<RouteSync> CreateRouteSync(
+    const XdpLoader& router,
+    const RouteSyncOptions& options = RouteSyncOptions());
+
+#endif  // LIB_ROUTE_SYNC_H_
@@ -0,0 +1,27 @@
+#include "lib/ebpf/chain.h"
+
+/*
+ * Stages for XdpChain tests: an entry program starting the pipeline, and
+ * stages returning distinct verdicts to tell which one ran.
+ */
+
+__section("xdp/entry")
+int entry(struct xdp_md *ctx)
+{
+    return ebpd_chain_next(ctx, 0);
+}
+
+__section("xdp/drop")
+int drop(struct xdp_md *ctx)
+{
+    return XDP_DROP;
+}
+
+__section("xdp/tx")
+int tx(struct xdp_md *ctx)
+{
+    return XDP_TX;
+}
+
+__section("license")
+char _license[] = "GPL";
@@ -0,0 +1,275 @@
+#include "lib/conntrack.h"
+
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <time.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/ebpd.h"
+#include "lib/ebpf/conntrack.h"
+#include "lib/posix/errno.h"
+#include "lib/tests/xdp_test_utils.h"
+
+namespace {
+
+using std::chrono::minutes;
+using std::chrono::seconds;
+
+uint64_t GetMonotonicTime() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * uint64_t{1000000000} + now.tv_nsec;
+}
+
+// An IPv4 connection from 10.0.0.1:'port' to 10.0.0.2:80.
+ebpd_ct_key MakeKey(const uint16_t port, const uint8_t proto = 6) {
+  ebpd_ct_key key = {};
+  key.saddr[0] = 10;
+  key.saddr[3] = 1;
+  key.daddr[0] = 10;
+  key.daddr[3] = 2;
+  key.sport = htons(port);
+  key.dport = htons(80);
+  key.proto = proto;
+  key.family = EBPD_CT_IPV4;
+  return key;
+}
+
+// A connection in 'state' idle for 'idle'.
+ebpd_ct_entry MakeEntry(const uint32_t state,
+                        const std::chrono::nanoseconds idle) {
+  ebpd_ct_entry entry = {};
+  entry.last_seen = GetMonotonicTime() - idle.count();
+  entry.packets = 1;
+  entry.state = state;
+  return entry;
+}
+
+// A map laid out as that of lib/ebpf/conntrack.c.
+class ConntrackSweeperTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    auto map_or = bpf::CreateMap<ebpd_ct_key, ebpd_ct_entry>(
+        BPF_MAP_TYPE_LRU_HASH, 4096);
+    ASSERT_TRUE(IsOk(map_or));
+    map_ = std::move(GetValue(map_or));
+  }
+
+  ConntrackSweeper CreateSweeper(const ConntrackSweeperOptions& options =
+                                     ConntrackSweeperOptions()) {
+    auto sweeper_or =
+        CreateConntrackSweeper(GetFileDescriptor(map_), options);
+    EXPECT_TRUE(IsOk(sweeper_or));
+    return std::move(GetValue(sweeper_or));
+  }
+
+  bool Has(const ebpd_ct_key& key) { return IsOk(map_.Lookup(key)); }
+
+  bpf::BpfMap<ebpd_ct_key, ebpd_ct_entry> map_;
+};
+
+TEST(ConntrackTimeoutsTest, DependOnState) {
+  ConntrackTimeouts timeouts;
+  EXPECT_EQ(timeouts.tcp_handshake, GetTimeout(timeouts, EBPD_CT_SYN_SENT));
+  EXPECT_EQ(timeouts.tcp_handshake, GetTimeout(timeouts, EBPD_CT_SYN_RECV));
+  EXPECT_EQ(timeouts.tcp_established,
+            GetTimeout(timeouts, EBPD_CT_ESTABLISHED));
+  EXPECT_EQ(timeouts.unreplied, GetTimeout(timeouts, 1000));
+}
+
+TEST_F(ConntrackSweeperTest, ExpiresIdleConnections) {
+  ASSERT_TRUE(
+      IsOk(map_.Update(MakeKey(1), MakeEntry(EBPD_CT_NEW, minutes(1)))));
+  ASSERT_TRUE(
+      IsOk(map_.Update(MakeKey(2), MakeEntry(EBPD_CT_REPLIED, minutes(1)))));
+  ASSERT_TRUE(
+      IsOk(map_.Update(MakeKey(3), MakeEntry(EBPD_CT_CLOSING, seconds(11)))));
+  ASSERT_TRUE(IsOk(
+      map_.Update(MakeKey(4), MakeEntry(EBPD_CT_ESTABLISHED, minutes(10)))));
+
+  auto sweeper = CreateSweeper();
+  auto stats_or = sweeper.SweepAll();
+  ASSERT_TRUE(IsOk(stats_or)) << GetText(GetStatus(stats_or));
+  EXPECT_EQ(4, GetValue(stats_or).scanned);
+  EXPECT_EQ(2, GetValue(stats_or).expired);
+  EXPECT_TRUE(GetValue(stats_or).done);
+  EXPECT_FALSE(Has(MakeKey(1)));
+  EXPECT_TRUE(Has(MakeKey(2)));
+  EXPECT_FALSE(Has(MakeKey(3)));
+  EXPECT_TRUE(Has(MakeKey(4)));
+
+  // Passes start over.
+  stats_or = sweeper.SweepAll();
+  ASSERT_TRUE(IsOk(stats_or));
+  EXPECT_EQ(2, GetValue(stats_or).scanned);
+  EXPECT_EQ(0, GetValue(stats_or).expired);
+}
+
+TEST_F(ConntrackSweeperTest, SweepsInSteps) {
+  for (uint16_t port = 0; port < 1000; ++port) {
+    ASSERT_TRUE(IsOk(map_.Update(
+        MakeKey(port), MakeEntry(EBPD_CT_NEW, port % 2 ? minutes(1)
+                                                       : seconds(1)))));
+  }
+  ConntrackSweeperOptions options;
+  options.batch_size = 16;
+  auto sweeper = CreateSweeper(options);
+
+  ConntrackSweepStats total;
+  int steps = 0;
+  while (!total.done) {
+    auto stats_or = sweeper.Sweep(100);
+    ASSERT_TRUE(IsOk(stats_or)) << GetText(GetStatus(stats_or));
+    total.scanned += GetValue(stats_or).scanned;
+    total.expired += GetValue(stats_or).expired;
+    total.done = GetValue(stats_or).done;
+    ++steps;
+  }
+  EXPECT_LT(1, steps);
+  EXPECT_EQ(1000, total.scanned);
+  EXPECT_EQ(500, total.expired);
+  for (uint16_t port = 0; port < 1000; ++port) {
+    EXPECT_EQ(port % 2 == 0, Has(MakeKey(port))) << port;
+  }
+}
+
+TEST_F(ConntrackSweeperTest, ToleratesEvictedConnections) {
+  // Expired connections removed behind the sweeper's back.
+  for (uint16_t port = 0; port < 10; ++port) {
+    ASSERT_TRUE(
+        IsOk(map_.Update(MakeKey(port), MakeEntry(EBPD_CT_NEW, minutes(1)))));
+  }
+  ConntrackSweeperOptions options;
+  options.batch_size = 4;
+  auto sweeper = CreateSweeper(options);
+  ASSERT_TRUE(IsOk(sweeper.Sweep(1)));
+  for (uint16_t port = 0; port < 10; ++port) {
+    if (Has(MakeKey(port))) {
+      ASSERT_TRUE(IsOk(map_.Delete(MakeKey(port))));
+    }
+  }
+  auto stats_or = sweeper.SweepAll();
+  ASSERT_TRUE(IsOk(stats_or)) << GetText(GetStatus(stats_or));
+  EXPECT_TRUE(GetValue(stats_or).done);
+}
+
+TEST_F(ConntrackSweeperTest, RejectsOtherMaps) {
+  auto other_or = bpf::CreateMap<uint32_t, uint32_t>(BPF_MAP_TYPE_HASH, 16);
+  ASSERT_TRUE(IsOk(other_or));
+  auto sweeper_or =
+      CreateConntrackSweeper(GetFileDescriptor(GetValue(other_or)));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(sweeper_or), EINVAL));
+}
+
+// Ethernet, IPv4 and TCP or UDP headers of a packet between 10.0.0.1:1000
+// and 10.0.0.2:80, from the former unless 'reply'.
+std::vector<uint8_t> MakePacket(const bool reply, const uint8_t proto,
+                                const uint8_t tcp_flags = 0) {
+  std::vector<uint8_t> packet(14 + 20 + 20);
+  packet[12] = 0x08;
+  uint8_t* const ip = packet.data() + 14;
+  ip[0] = 0x45;
+  ip[8] = 64;
+  ip[9] = proto;
+  const uint8_t client[] = {10, 0, 0, 1};
+  const uint8_t server[] = {10, 0, 0, 2};
+  memcpy(ip + 12, reply ? server : client, 4);
+  memcpy(ip + 16, reply ? client : server, 4);
+  uint8_t* const l4 = ip + 20;
+  const uint16_t sport = htons(reply ? 80 : 1000);
+  const uint16_t dport = htons(reply ? 1000 : 80);
+  memcpy(l4, &sport, 2);
+  memcpy(l4 + 2, &dport, 2);
+  l4[12] = 0x50;  // Data offset, 5 words.
+  l4[13] = tcp_flags;
+  return packet;
+}
+
+constexpr uint8_t kFin = 0x01;
+constexpr uint8_t kSyn = 0x02;
+constexpr uint8_t kRst = 0x04;
+constexpr uint8_t kAck = 0x10;
+
+class ConntrackTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    InitEbpdLib();
+    xdph_ = LoadXdpBuffer(ebpf::conntrack, "conntrack");
+    ASSERT_NE(nullptr, xdph_);
+    auto map_or = bpf::OpenMap<ebpd_ct_key, ebpd_ct_entry>(
+        posix::FileDescriptor(xdph_->GetMapFd(kConntrackMapName)));
+    ASSERT_TRUE(IsOk(map_or));
+    map_ = std::move(GetValue(map_or));
+  }
+
+  // Run the program on a packet of the connection, see MakePacket().
+  void Send(const bool reply, const uint8_t proto,
+            const uint8_t tcp_flags = 0) {
+    const auto packet = MakePacket(reply, proto, tcp_flags);
+    EXPECT_EQ(XDP_PASS,
+              RunXdpProgOn(xdph_->GetProgFd(), packet.data(), packet.size()));
+  }
+
+  // Return the state of the connection, -1 if not tracked.
+  int GetState(const uint8_t proto) {
+    const auto entry_or = map_.Lookup(MakeKey(1000, proto));
+    return IsOk(entry_or) ? GetValue(entry_or).state : -1;
+  }
+
+  XdpHandle xdph_;
+  bpf::BpfMap<ebpd_ct_key, ebpd_ct_entry> map_;
+};
+
+TEST_F(ConntrackTest, FollowsTcpConnections) {
+  Send(false, IPPROTO_TCP, kSyn);
+  EXPECT_EQ(EBPD_CT_SYN_SENT, GetState(IPPROTO_TCP));
+  Send(true, IPPROTO_TCP, kSyn | kAck);
+  EXPECT_EQ(EBPD_CT_SYN_RECV, GetState(IPPROTO_TCP));
+  Send(false, IPPROTO_TCP, kAck);
+  EXPECT_EQ(EBPD_CT_ESTABLISHED, GetState(IPPROTO_TCP));
+  Send(true, IPPROTO_TCP, kFin | kAck);
+  EXPECT_EQ(EBPD_CT_FIN_WAIT, GetState(IPPROTO_TCP));
+  Send(false, IPPROTO_TCP, kFin | kAck);
+  EXPECT_EQ(EBPD_CT_CLOSING, GetState(IPPROTO_TCP));
+
+  const auto entry_or = map_.Lookup(MakeKey(1000));
+  ASSERT_TRUE(IsOk(entry_or));
+  EXPECT_EQ(5, GetValue(entry_or).packets);
+  EXPECT_EQ(5 * 54, GetValue(entry_or).bytes);
+}
+
+TEST_F(ConntrackTest, PicksUpTcpConnectionsMidStream) {
+  Send(false, IPPROTO_TCP, kRst);
+  EXPECT_EQ(-1, GetState(IPPROTO_TCP));
+  Send(false, IPPROTO_TCP, kAck);
+  EXPECT_EQ(EBPD_CT_ESTABLISHED, GetState(IPPROTO_TCP));
+  Send(true, IPPROTO_TCP, kRst);
+  EXPECT_EQ(EBPD_CT_CLOSING, GetState(IPPROTO_TCP));
+}
+
+TEST_F(ConntrackTest, TracksRepliesOfOtherProtocols) {
+  Send(false, IPPROTO_UDP);
+  EXPECT_EQ(EBPD_CT_NEW, GetState(IPPROTO_UDP));
+  Send(false, IPPROTO_UDP);
+  EXPECT_EQ(EBPD_CT_NEW, GetState(IPPROTO_UDP));
+  Send(true, IPPROTO_UDP);
+  EXPECT_EQ(EBPD_CT_REPLIED, GetState(IPPROTO_UDP));
+}
+
+TEST_F(ConntrackTest, SweepsProgramMap) {
+  Send(false, IPPROTO_UDP);
+  ConntrackSweeperOptions options;
+  options.timeouts.unreplied = std::chrono::nanoseconds(0);
+  auto sweeper_or = CreateConntrackSweeper(*xdph_, options);
+  ASSERT_TRUE(IsOk(sweeper_or));
+  const auto stats_or = GetValue(sweeper_or).SweepAll();
+  ASSERT_TRUE(IsOk(stats_or));
+  EXPECT_EQ(1, GetValue(stats_or).expired);
+  EXPECT_EQ(-1, GetState(IPPROTO_UDP));
+}
+
+}  // namespace
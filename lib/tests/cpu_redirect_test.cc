@@ -0,0 +1,81 @@
+#include <linux/bpf.h>
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+#include "lib/bpf/map.h"
+#include "lib/bpf/redirect_map.h"
+#include "lib/ebpd.h"
+#include "lib/ebpf/cpu_redirect.h"
+#include "lib/tests/xdp_test_utils.h"
+#include "lib/xdp_loader.h"
+
+namespace {
+
+class CpuRedirectTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    InitEbpdLib();
+    xdph_ = LoadXdpBuffer(ebpf::cpu_redirect, "cpu_redirect");
+    ASSERT_NE(nullptr, xdph_);
+    prog_fd_ = xdph_->GetProgFd("xdp");
+    ASSERT_LE(0, prog_fd_);
+  }
+
+  // Spread packets over CPU 0 alone, running program 'prog' there.
+  void UseCpu0(const int32_t prog) {
+    auto cpu_map_or = bpf::OpenMap<uint32_t, bpf::CpuMapEntry>(
+        posix::FileDescriptor(xdph_->GetMapFd("cpu_map")));
+    auto cpus_or = bpf::OpenMap<uint32_t, uint32_t>(
+        posix::FileDescriptor(xdph_->GetMapFd("cpus")));
+    auto count_or = bpf::OpenMap<uint32_t, uint32_t>(
+        posix::FileDescriptor(xdph_->GetMapFd("cpu_count")));
+    ASSERT_TRUE(IsOk(cpu_map_or));
+    ASSERT_TRUE(IsOk(cpus_or));
+    ASSERT_TRUE(IsOk(count_or));
+    ASSERT_TRUE(IsOk(GetValue(cpu_map_or).Update(0, {64, prog})));
+    ASSERT_TRUE(IsOk(GetValue(cpus_or).Update(0, 0)));
+    ASSERT_TRUE(IsOk(GetValue(count_or).Update(0, 1)));
+  }
+
+  XdpHandle xdph_;
+  int prog_fd_ = -1;
+};
+
+TEST_F(CpuRedirectTest, PassesWithoutCpus) {
+  EXPECT_EQ(XDP_PASS, RunXdpProg(prog_fd_));
+}
+
+TEST_F(CpuRedirectTest, RedirectsToCpus) {
+  UseCpu0(bpf::kNoProgram);
+  EXPECT_EQ(XDP_REDIRECT, RunXdpProg(prog_fd_));
+}
+
+TEST_F(CpuRedirectTest, PassesToCpusWithoutQueue) {
+  // CPU 1 listed, but no queue stored under it in "cpu_map".
+  auto cpus_or = bpf::OpenMap<uint32_t, uint32_t>(
+      posix::FileDescriptor(xdph_->GetMapFd("cpus")));
+  auto count_or = bpf::OpenMap<uint32_t, uint32_t>(
+      posix::FileDescriptor(xdph_->GetMapFd("cpu_count")));
+  ASSERT_TRUE(IsOk(cpus_or));
+  ASSERT_TRUE(IsOk(count_or));
+  ASSERT_TRUE(IsOk(GetValue(cpus_or).Update(0, 1)));
+  ASSERT_TRUE(IsOk(GetValue(count_or).Update(0, 1)));
+  EXPECT_EQ(XDP_PASS, RunXdpProg(prog_fd_));
+}
+
+TEST_F(CpuRedirectTest, RunsSecondStageOnCpus) {
+  // Loaded as a cpumap program from its section name.
+  const int process_fd = xdph_->GetProgFd("xdp_cpumap/process");
+  ASSERT_LE(0, process_fd);
+  UseCpu0(process_fd);
+  auto cpu_map_or = bpf::OpenMap<uint32_t, bpf::CpuMapEntry>(
+      posix::FileDescriptor(xdph_->GetMapFd("cpu_map")));
+  ASSERT_TRUE(IsOk(cpu_map_or));
+  const auto entry_or = GetValue(cpu_map_or).Lookup(0);
+  ASSERT_TRUE(IsOk(entry_or));
+  EXPECT_NE(0, GetValue(entry_or).prog);
+  EXPECT_EQ(XDP_REDIRECT, RunXdpProg(prog_fd_));
+}
+
+}  // namespace
@@ -0,0 +1,101 @@
+#include "gtest/gtest.h"
+#include "lib/ebpd_link.h"
+#include "lib/tests/xdp_test_utils.h"
+#include <errno.h>
+#include <linux/if_link.h>
+#include <unistd.h>
+
+class EbpdLinkTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(EnterNewNetns());
+    ifindex_ = CreateVethPair("veth0", "veth1");
+    ASSERT_NE(0, ifindex_);
+    prog_fd_ = LoadTrivialXdpProg(XDP_PASS);
+    ASSERT_LE(0, prog_fd_);
+  }
+  void TearDown() override {
+    if (prog_fd_ >= 0) {
+      close(prog_fd_);
+    }
+  }
+  int ifindex_ = 0;
+  int prog_fd_ = -1;
+};
+
+TEST_F(EbpdLinkTest, NothingAttached) {
+  struct ebpd_xdp_link_info info;
+  EXPECT_EQ(0, ebpd_link_get_xdp(ifindex_, &info));
+  EXPECT_EQ(XDP_ATTACHED_NONE, info.attach_mode);
+  __u8 mode = XDP_ATTACHED_SKB;
+  EXPECT_EQ(0, ebpd_link_xdp_mode(ifindex_, prog_fd_, &mode));
+  EXPECT_EQ(XDP_ATTACHED_NONE, mode);
+}
+
+TEST_F(EbpdLinkTest, AttachGeneric) {
+  ASSERT_EQ(0, ebpd_link_set_xdp(ifindex_, prog_fd_, XDP_FLAGS_SKB_MODE));
+  __u8 mode = XDP_ATTACHED_NONE;
+  EXPECT_EQ(0, ebpd_link_xdp_mode(ifindex_, prog_fd_, &mode));
+  EXPECT_EQ(XDP_ATTACHED_SKB, mode);
+  EXPECT_EQ(0, ebpd_link_detach_xdp(ifindex_, prog_fd_));
+  EXPECT_EQ(0, ebpd_link_xdp_mode(ifindex_, prog_fd_, &mode));
+  EXPECT_EQ(XDP_ATTACHED_NONE, mode);
+}
+
+TEST_F(EbpdLinkTest, AttachNative) {
+  // veth has native xdp support since 4.19.
+  ASSERT_EQ(0, ebpd_link_set_xdp(ifindex_, prog_fd_, XDP_FLAGS_DRV_MODE));
+  __u8 mode = XDP_ATTACHED_NONE;
+  EXPECT_EQ(0, ebpd_link_xdp_mode(ifindex_, prog_fd_, &mode));
+  EXPECT_EQ(XDP_ATTACHED_DRV, mode);
+  EXPECT_EQ(0, ebpd_link_detach_xdp(ifindex_, prog_fd_));
+}
+
+TEST_F(EbpdLinkTest, OffloadUnsupportedOnVeth) {
+  EXPECT_NE(0, ebpd_link_set_xdp(ifindex_, prog_fd_, XDP_FLAGS_HW_MODE));
+}
+
+TEST_F(EbpdLinkTest, UpdateIfNoExist) {
+  ASSERT_EQ(0, ebpd_link_set_xdp(ifindex_, prog_fd_, XDP_FLAGS_SKB_MODE));
+  const int other_fd = LoadTrivialXdpProg(XDP_DROP);
+  ASSERT_LE(0, other_fd);
+  EXPECT_EQ(-EBUSY, ebpd_link_set_xdp(ifindex_, other_fd,
+                                      XDP_FLAGS_SKB_MODE |
+                                          XDP_FLAGS_UPDATE_IF_NOEXIST));
+  // Someone else's program is never detached.
+  EXPECT_EQ(0, ebpd_link_detach_xdp(ifindex_, other_fd));
+  __u8 mode = XDP_ATTACHED_NONE;
+  EXPECT_EQ(0, ebpd_link_xdp_mode(ifindex_, prog_fd_, &mode));
+  EXPECT_EQ(XDP_ATTACHED_SKB, mode);
+  close(other_fd);
+}
+
+TEST_F(EbpdLinkTest, Replace) {
+  ASSERT_EQ(0, ebpd_link_set_xdp(ifindex_, prog_fd_, XDP_FLAGS_DRV_MODE));
+  const int next_fd = LoadTrivialXdpProg(XDP_DROP);
+  ASSERT_LE(0, next_fd);
+  EXPECT_EQ(0, ebpd_link_replace_xdp(ifindex_, next_fd, prog_fd_,
+                                     XDP_FLAGS_DRV_MODE));
+  __u8 mode = XDP_ATTACHED_NONE;
+  EXPECT_EQ(0, ebpd_link_xdp_mode(ifindex_, next_fd, &mode));
+  EXPECT_EQ(XDP_ATTACHED_DRV, mode);
+  EXPECT_EQ(0, ebpd_link_xdp_mode(ifindex_, prog_fd_, &mode));
+  EXPECT_EQ(XDP_ATTACHED_NONE, mode);
+  close(next_fd);
+}
+
+TEST_F(EbpdLinkTest, ReplaceUnexpected) {
+  ASSERT_EQ(0, ebpd_link_set_xdp(ifindex_, prog_fd_, XDP_FLAGS_SKB_MODE));
+  const int next_fd = LoadTrivialXdpProg(XDP_DROP);
+  const int stale_fd = LoadTrivialXdpProg(XDP_DROP);
+  ASSERT_LE(0, next_fd);
+  ASSERT_LE(0, stale_fd);
+  // Someone else's program is attached: nothing must change.
+  EXPECT_EQ(-EEXIST, ebpd_link_replace_xdp(ifindex_, next_fd, stale_fd,
+                                           XDP_FLAGS_SKB_MODE));
+  __u8 mode = XDP_ATTACHED_NONE;
+  EXPECT_EQ(0, ebpd_link_xdp_mode(ifindex_, prog_fd_, &mode));
+  EXPECT_EQ(XDP_ATTACHED_SKB, mode);
+  close(stale_fd);
+  close(next_fd);
+}
@@ -0,0 +1,93 @@
+#include "lib/ebpf/parse.h"
+#include "lib/tests/parse_result.h"
+
+/*
+ * Parses packets run through it with BPF_PROG_TEST_RUN and stores what it
+ * found in "result", for lib/tests/parse_test.cc. Malformed packets are
+ * dropped.
+ */
+
+__section("maps")
+struct bpf_map_def result = {
+    .type = BPF_MAP_TYPE_ARRAY,
+    .key_size = sizeof(__u32),
+    .value_size = sizeof(struct parse_result),
+    .max_entries = 1,
+};
+
+__ebpd_inline __u16
+dport(const struct ebpd_packet *pkt)
+{
+    if (pkt->l4_proto == EBPD_IPPROTO_TCP && pkt->tcp) {
+        return ebpd_ntohs(pkt->tcp->dest);
+    }
+    if (pkt->l4_proto == EBPD_IPPROTO_UDP && pkt->udp) {
+        return ebpd_ntohs(pkt->udp->dest);
+    }
+    return 0;
+}
+
+/*
+ * Parse the packet starting at 'data' into 'res'. Returns 0, or -1 if
+ * malformed.
+ */
+__ebpd_inline int
+parse(struct ebpd_cursor *cursor, void *data, struct parse_result *res)
+{
+    struct ebpd_packet pkt;
+    if (ebpd_parse_packet(cursor, &pkt)) {
+        return -1;
+    }
+    res->vlan_count = pkt.vlans.count;
+#pragma clang loop unroll(full)
+    for (int i = 0; i < EBPD_MAX_VLANS; i++) {
+        if (i < pkt.vlans.count) {
+            res->vlan_ids[i] = ebpd_vlan_id(pkt.vlans.tci[i]);
+        }
+    }
+    res->l3_proto = ebpd_ntohs(pkt.l3_proto);
+    res->l4_proto = pkt.l4_proto;
+    if (pkt.l3) {
+        res->l3_offset = pkt.l3 - data;
+    }
+    if (pkt.l4) {
+        res->l4_offset = pkt.l4 - data;
+    }
+    res->dport = dport(&pkt);
+
+    struct ebpd_packet inner;
+    __u32 vni = 0;
+    const int tunnel = ebpd_parse_udp_tunnel(cursor, &pkt, &inner, &vni);
+    if (tunnel < 0) {
+        return -1;
+    }
+    if (tunnel) {
+        res->tunnel = 1;
+        res->vni = vni;
+        res->inner_l3_proto = ebpd_ntohs(inner.l3_proto);
+        res->inner_l4_proto = inner.l4_proto;
+        res->inner_dport = dport(&inner);
+    }
+    res->payload_offset = cursor->pos - data;
+    return 0;
+}
+
+__section("xdp")
+int parse_prog(struct xdp_md *ctx)
+{
+    struct ebpd_cursor cursor;
+    struct parse_result res = {};
+    ebpd_cursor_init(&cursor, ctx);
+    if (parse(&cursor, cursor.pos, &res)) {
+        return XDP_DROP;
+    }
+    const __u32 key = 0;
+    struct parse_result *out = bpf_map_lookup_elem(&result, &key);
+    if (out) {
+        *out = res;
+    }
+    return XDP_PASS;
+}
+
+__section("license")
+char _license[] = "GPL";
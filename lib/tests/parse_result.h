@@ -0,0 +1,26 @@
+#ifndef LIB_TESTS_PARSE_RESULT_H_
+#define LIB_TESTS_PARSE_RESULT_H_
+
+#include <linux/types.h>
+
+// What lib/tests/parse_prog.c found in the last packet it parsed, read back
+// by lib/tests/parse_test.cc. Protocols and ports are in host byte order,
+// offsets from the start of the packet.
+struct parse_result {
+    __u32 vlan_count;
+    __u16 vlan_ids[2];
+    __u16 l3_proto;
+    __u16 l3_offset;
+    __u16 l4_offset;
+    __u16 payload_offset;
+    __u16 dport;
+    __u8 l4_proto;
+    __u8 tunnel;
+    __u32 vni;
+    __u16 inner_l3_proto;
+    __u16 inner_dport;
+    __u8 inner_l4_proto;
+    __u8 pad[3];
+};
+
+#endif
@@ -0,0 +1,338 @@
+#include <linux/bpf.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/bpf/map.h"
+#include "lib/ebpd.h"
+#include "lib/tests/parse_prog.h"
+#include "lib/tests/parse_result.h"
+#include "lib/tests/xdp_test_utils.h"
+#include "lib/xdp_loader.h"
+
+namespace {
+
+// Packet built header by header, fields in network byte order.
+class Packet {
+ public:
+  Packet& Eth(const uint16_t proto) {
+    Bytes(12, 0x02);
+    return U16(proto);
+  }
+
+  Packet& Vlan(const uint16_t tpid, const uint16_t id, const uint16_t proto) {
+    // Rewrite the ethertype in front of the tag.
+    bytes_.resize(bytes_.size() - 2);
+    U16(tpid);
+    U16(id);
+    return U16(proto);
+  }
+
+  Packet& Ipv4(const uint8_t protocol, const uint8_t ihl = 5,
+               const uint16_t frag_off = 0) {
+    U8(0x40 | ihl);
+    U8(0);
+    U16(0);  // Total length, not checked.
+    U16(0);
+    U16(frag_off);
+    U8(64);
+    U8(protocol);
+    U16(0);
+    Bytes(8, 10);
+    return Bytes((ihl > 5 ? ihl - 5 : 0) * 4, 1);  // NOP options.
+  }
+
+  Packet& Ipv6(const uint8_t nexthdr) {
+    U8(0x60);
+    Bytes(3, 0);
+    U16(0);
+    U8(nexthdr);
+    U8(64);
+    return Bytes(32, 0xfd);
+  }
+
+  // Hop-by-hop, routing or destination options header of 'size' bytes.
+  Packet& Ipv6Options(const uint8_t nexthdr, const size_t size) {
+    U8(nexthdr);
+    U8(size / 8 - 1);
+    return Bytes(size - 2, 0);
+  }
+
+  Packet& Ipv6Fragment(const uint8_t nexthdr, const uint16_t offset) {
+    U8(nexthdr);
+    U8(0);
+    U16(offset << 3);
+    return U32(1234);
+  }
+
+  Packet& Tcp(const uint16_t dport, const uint8_t doff = 5) {
+    U16(12345);
+    U16(dport);
+    U32(0);
+    U32(0);
+    U8(doff << 4);
+    U8(0x02);
+    U16(0xffff);
+    U16(0);
+    U16(0);
+    return Bytes((doff > 5 ? doff - 5 : 0) * 4, 1);
+  }
+
+  Packet& Udp(const uint16_t dport) {
+    U16(12345);
+    U16(dport);
+    U16(0);
+    return U16(0);
+  }
+
+  Packet& Vxlan(const uint32_t vni) {
+    U8(0x08);
+    Bytes(3, 0);
+    return U32(vni << 8);
+  }
+
+  Packet& Geneve(const uint32_t vni, const uint16_t proto,
+                 const uint8_t optlen = 0) {
+    U8(optlen);
+    U8(0);
+    U16(proto);
+    U32(vni << 8);
+    return Bytes(optlen * 4, 0);
+  }
+
+  Packet& Bytes(const size_t count, const uint8_t value) {
+    bytes_.insert(bytes_.end(), count, value);
+    return *this;
+  }
+
+  Packet& Truncate(const size_t count) {
+    bytes_.resize(bytes_.size() - count);
+    return *this;
+  }
+
+  std::vector<uint8_t>& Get() { return bytes_; }
+
+ private:
+  Packet& U8(const uint8_t value) { return Bytes(1, value); }
+
+  Packet& U16(const uint16_t value) {
+    U8(value >> 8);
+    return U8(value);
+  }
+
+  Packet& U32(const uint32_t value) {
+    U16(value >> 16);
+    return U16(value);
+  }
+
+  std::vector<uint8_t> bytes_;
+};
+
+constexpr uint16_t kIpv4 = 0x0800;
+constexpr uint16_t kIpv6 = 0x86dd;
+constexpr uint8_t kTcp = 6;
+constexpr uint8_t kUdp = 17;
+constexpr uint8_t kNone = 59;
+
+class ParseTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    InitEbpdLib();
+    xdph_ = LoadXdpBuffer(ebpf::parse_prog, "parse_prog");
+    ASSERT_NE(nullptr, xdph_);
+    prog_fd_ = xdph_->GetProgFd();
+    map_fd_ = xdph_->GetMapFd("result");
+    ASSERT_LE(0, prog_fd_);
+    ASSERT_LE(0, map_fd_);
+  }
+
+  // Run the parser on 'packet'. Returns its verdict, with what it found in
+  // 'result_' if it passed the packet.
+  int Parse(Packet& packet) {
+    const auto& bytes = packet.Get();
+    const int verdict = RunXdpProgOn(prog_fd_, bytes.data(), bytes.size());
+    if (verdict == XDP_PASS) {
+      auto map_or = bpf::OpenMap<uint32_t, parse_result>(
+          posix::FileDescriptor(map_fd_));
+      EXPECT_TRUE(IsOk(map_or));
+      auto result_or = GetValue(map_or).Lookup(0);
+      EXPECT_TRUE(IsOk(result_or));
+      result_ = GetValue(result_or);
+    }
+    return verdict;
+  }
+
+  XdpHandle xdph_;
+  int prog_fd_ = -1;
+  int map_fd_ = -1;
+  parse_result result_ = {};
+};
+
+TEST_F(ParseTest, TcpOverIpv4) {
+  Packet packet;
+  packet.Eth(kIpv4).Ipv4(kTcp).Tcp(80).Bytes(4, 0);
+  ASSERT_EQ(XDP_PASS, Parse(packet));
+  EXPECT_EQ(0, result_.vlan_count);
+  EXPECT_EQ(kIpv4, result_.l3_proto);
+  EXPECT_EQ(14, result_.l3_offset);
+  EXPECT_EQ(kTcp, result_.l4_proto);
+  EXPECT_EQ(34, result_.l4_offset);
+  EXPECT_EQ(54, result_.payload_offset);
+  EXPECT_EQ(80, result_.dport);
+  EXPECT_EQ(0, result_.tunnel);
+}
+
+TEST_F(ParseTest, SkipsIpv4AndTcpOptions) {
+  Packet packet;
+  packet.Eth(kIpv4).Ipv4(kTcp, 7).Tcp(443, 8);
+  ASSERT_EQ(XDP_PASS, Parse(packet));
+  EXPECT_EQ(42, result_.l4_offset);
+  EXPECT_EQ(42 + 32, result_.payload_offset);
+  EXPECT_EQ(443, result_.dport);
+}
+
+TEST_F(ParseTest, QinQ) {
+  Packet packet;
+  packet.Eth(kIpv4)
+      .Vlan(0x88a8, 100, 0x8100)
+      .Vlan(0x8100, 200, kIpv4)
+      .Ipv4(kUdp)
+      .Udp(53);
+  ASSERT_EQ(XDP_PASS, Parse(packet));
+  EXPECT_EQ(2, result_.vlan_count);
+  EXPECT_EQ(100, result_.vlan_ids[0]);
+  EXPECT_EQ(200, result_.vlan_ids[1]);
+  EXPECT_EQ(kIpv4, result_.l3_proto);
+  EXPECT_EQ(22, result_.l3_offset);
+  EXPECT_EQ(53, result_.dport);
+}
+
+TEST_F(ParseTest, Ipv6ExtensionHeaders) {
+  Packet packet;
+  packet.Eth(kIpv6)
+      .Ipv6(0)                  // Hop-by-hop options follow.
+      .Ipv6Options(43, 8)       // Routing header follows.
+      .Ipv6Options(44, 16)      // Fragment header follows.
+      .Ipv6Fragment(kUdp, 0)
+      .Udp(53);
+  ASSERT_EQ(XDP_PASS, Parse(packet));
+  EXPECT_EQ(kIpv6, result_.l3_proto);
+  EXPECT_EQ(kUdp, result_.l4_proto);
+  EXPECT_EQ(14 + 40 + 8 + 16 + 8, result_.l4_offset);
+  EXPECT_EQ(53, result_.dport);
+}
+
+TEST_F(ParseTest, LaterFragmentsHaveNoTransportHeader) {
+  Packet ipv4;
+  ipv4.Eth(kIpv4).Ipv4(kTcp, 5, 100).Bytes(20, 0);
+  ASSERT_EQ(XDP_PASS, Parse(ipv4));
+  EXPECT_EQ(kNone, result_.l4_proto);
+  EXPECT_EQ(0, result_.l4_offset);
+
+  Packet ipv6;
+  ipv6.Eth(kIpv6).Ipv6(44).Ipv6Fragment(kTcp, 100).Bytes(20, 0);
+  ASSERT_EQ(XDP_PASS, Parse(ipv6));
+  EXPECT_EQ(kNone, result_.l4_proto);
+  EXPECT_EQ(0, result_.l4_offset);
+}
+
+TEST_F(ParseTest, UnknownProtocolsStopParsing) {
+  Packet arp;
+  arp.Eth(0x0806).Bytes(28, 0);
+  ASSERT_EQ(XDP_PASS, Parse(arp));
+  EXPECT_EQ(0x0806, result_.l3_proto);
+  EXPECT_EQ(0, result_.l3_offset);
+  EXPECT_EQ(14, result_.payload_offset);
+
+  Packet icmp;
+  icmp.Eth(kIpv4).Ipv4(1).Bytes(8, 0);
+  ASSERT_EQ(XDP_PASS, Parse(icmp));
+  EXPECT_EQ(1, result_.l4_proto);
+  EXPECT_EQ(0, result_.l4_offset);
+  EXPECT_EQ(34, result_.payload_offset);
+}
+
+TEST_F(ParseTest, DropsMalformedPackets) {
+  Packet short_ipv4;
+  short_ipv4.Eth(kIpv4).Ipv4(kTcp).Truncate(1);
+  EXPECT_EQ(XDP_DROP, Parse(short_ipv4));
+
+  Packet short_options;
+  short_options.Eth(kIpv4).Ipv4(kTcp, 15).Truncate(4);
+  EXPECT_EQ(XDP_DROP, Parse(short_options));
+
+  Packet bad_ihl;
+  bad_ihl.Eth(kIpv4).Ipv4(kTcp, 4).Bytes(40, 0);
+  EXPECT_EQ(XDP_DROP, Parse(bad_ihl));
+
+  Packet bad_doff;
+  bad_doff.Eth(kIpv4).Ipv4(kTcp).Tcp(80, 4).Bytes(20, 0);
+  EXPECT_EQ(XDP_DROP, Parse(bad_doff));
+
+  Packet short_vlan;
+  short_vlan.Eth(0x8100).Bytes(2, 0);
+  EXPECT_EQ(XDP_DROP, Parse(short_vlan));
+
+  Packet short_extension;
+  short_extension.Eth(kIpv6).Ipv6(60).Ipv6Options(kUdp, 16).Truncate(1);
+  EXPECT_EQ(XDP_DROP, Parse(short_extension));
+}
+
+TEST_F(ParseTest, BoundsIpv6ExtensionHeaders) {
+  Packet packet;
+  packet.Eth(kIpv6).Ipv6(60);
+  for (int i = 0; i < 7; ++i) {
+    packet.Ipv6Options(i < 6 ? 60 : kUdp, 8);
+  }
+  packet.Udp(53);
+  EXPECT_EQ(XDP_DROP, Parse(packet));
+}
+
+TEST_F(ParseTest, Vxlan) {
+  Packet packet;
+  packet.Eth(kIpv4)
+      .Ipv4(kUdp)
+      .Udp(4789)
+      .Vxlan(42)
+      .Eth(kIpv4)
+      .Ipv4(kTcp)
+      .Tcp(443);
+  ASSERT_EQ(XDP_PASS, Parse(packet));
+  EXPECT_EQ(4789, result_.dport);
+  EXPECT_EQ(1, result_.tunnel);
+  EXPECT_EQ(42, result_.vni);
+  EXPECT_EQ(kIpv4, result_.inner_l3_proto);
+  EXPECT_EQ(kTcp, result_.inner_l4_proto);
+  EXPECT_EQ(443, result_.inner_dport);
+  EXPECT_EQ(14 + 20 + 8 + 8 + 14 + 20 + 20, result_.payload_offset);
+}
+
+TEST_F(ParseTest, GeneveWithOptionsAndBareIp) {
+  Packet packet;
+  packet.Eth(kIpv6)
+      .Ipv6(kUdp)
+      .Udp(6081)
+      .Geneve(0xabcdef, kIpv6, 2)
+      .Ipv6(kUdp)
+      .Udp(53);
+  ASSERT_EQ(XDP_PASS, Parse(packet));
+  EXPECT_EQ(1, result_.tunnel);
+  EXPECT_EQ(0xabcdef, result_.vni);
+  EXPECT_EQ(kIpv6, result_.inner_l3_proto);
+  EXPECT_EQ(kUdp, result_.inner_l4_proto);
+  EXPECT_EQ(53, result_.inner_dport);
+}
+
+TEST_F(ParseTest, DropsMalformedTunnels) {
+  Packet no_vni;
+  no_vni.Eth(kIpv4).Ipv4(kUdp).Udp(4789).Vxlan(42).Eth(kIpv4);
+  no_vni.Get()[14 + 20 + 8] = 0;  // Clear the I flag.
+  EXPECT_EQ(XDP_DROP, Parse(no_vni));
+
+  Packet short_inner;
+  short_inner.Eth(kIpv4).Ipv4(kUdp).Udp(6081).Geneve(1, 0x6558).Bytes(10, 0);
+  EXPECT_EQ(XDP_DROP, Parse(short_inner));
+}
+
+}  // namespace
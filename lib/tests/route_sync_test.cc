@@ -0,0 +1,201 @@
+#include "lib/route_sync.h"
+
+#include <arpa/inet.h>
+
+#include <cstdlib>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "lib/posix/errno.h"
+#include "lib/tests/xdp_test_utils.h"
+
+namespace {
+
+ebpd_nexthop MakeNexthop(const uint32_t ifindex, const uint8_t mac) {
+  return {ifindex, {2, 0, 0, 0, 0, mac}, {2, 0, 0, 0, 1, mac}};
+}
+
+ebpd_route_v4 MakeHostRoute(const std::string& addr) {
+  ebpd_route_v4 key = {32, {}};
+  EXPECT_EQ(1, inet_pton(AF_INET, addr.c_str(), key.addr));
+  return key;
+}
+
+ebpd_route_v6 MakeHostRoute6(const std::string& addr) {
+  ebpd_route_v6 key = {128, {}};
+  EXPECT_EQ(1, inet_pton(AF_INET6, addr.c_str(), key.addr));
+  return key;
+}
+
+// Maps laid out as those of lib/ebpf/router.c.
+class RouteSyncTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    auto v4_or = bpf::CreateMap<ebpd_route_v4, ebpd_nexthop>(
+        BPF_MAP_TYPE_LPM_TRIE, 1024, BPF_F_NO_PREALLOC);
+    auto v6_or = bpf::CreateMap<ebpd_route_v6, ebpd_nexthop>(
+        BPF_MAP_TYPE_LPM_TRIE, 1024, BPF_F_NO_PREALLOC);
+    auto ports_or = bpf::CreateMap<uint32_t, uint32_t>(
+        static_cast<bpf_map_type>(EBPD_MAP_TYPE_DEVMAP_HASH),
+        EBPD_ROUTER_MAX_PORTS);
+    ASSERT_TRUE(IsOk(v4_or));
+    ASSERT_TRUE(IsOk(v6_or));
+    ASSERT_TRUE(IsOk(ports_or));
+    v4_ = std::move(GetValue(v4_or));
+    v6_ = std::move(GetValue(v6_or));
+    ports_ = std::move(GetValue(ports_or));
+  }
+
+  RouteSync CreateSync(const RouteSyncOptions& options = RouteSyncOptions()) {
+    auto sync_or =
+        CreateRouteSync(GetFileDescriptor(v4_), GetFileDescriptor(v6_),
+                        GetFileDescriptor(ports_), options);
+    EXPECT_TRUE(IsOk(sync_or));
+    return std::move(GetValue(sync_or));
+  }
+
+  // Return the ifindex of the route matching 'addr', longest prefix first,
+  // 0 if none.
+  uint32_t Lookup(const std::string& addr) {
+    auto nexthop_or = addr.find(':') == std::string::npos
+                          ? v4_.Lookup(MakeHostRoute(addr))
+                          : v6_.Lookup(MakeHostRoute6(addr));
+    return IsOk(nexthop_or) ? GetValue(nexthop_or).ifindex : 0;
+  }
+
+  bool HasPort(const uint32_t ifindex) {
+    return IsOk(ports_.Lookup(ifindex));
+  }
+
+  // The loopback device, always there to redirect to.
+  const uint32_t lo_ = 1;
+
+  bpf::BpfMap<ebpd_route_v4, ebpd_nexthop> v4_;
+  bpf::BpfMap<ebpd_route_v6, ebpd_nexthop> v6_;
+  bpf::BpfMap<uint32_t, uint32_t> ports_;
+};
+
+TEST(RouteTableTest, RejectsMalformedPrefixes) {
+  RouteTable table;
+  const auto nexthop = MakeNexthop(1, 1);
+  for (const char* prefix :
+       {"10.0.0.0", "10.0.0.0/33", "10.0.0.0/", "10.0.0/8", "10.0.0.0/8x",
+        "2001:db8::/129", "2001:db8::1::/64", "host/8"}) {
+    EXPECT_TRUE(posix::IsErrno(table.Add(prefix, nexthop), EINVAL)) << prefix;
+  }
+  EXPECT_EQ(0, GetSize(table));
+}
+
+TEST(RouteTableTest, TakesAnyIfindex) {
+  RouteTable table;
+  EXPECT_TRUE(IsOk(table.Add("10.0.0.0/8", MakeNexthop(1 << 20, 1))));
+  EXPECT_EQ(1, GetSize(table));
+}
+
+TEST(RouteTableTest, IgnoresHostBits) {
+  RouteTable table;
+  ASSERT_TRUE(IsOk(table.Add("10.1.2.3/8", MakeNexthop(1, 1))));
+  ASSERT_TRUE(IsOk(table.Add("10.0.0.0/8", MakeNexthop(1, 2))));
+  ASSERT_TRUE(IsOk(table.Add("2001:db8:ffff::/31", MakeNexthop(1, 3))));
+  ASSERT_TRUE(IsOk(table.Add("2001:db8::/31", MakeNexthop(1, 4))));
+  EXPECT_EQ(2, GetSize(table));
+  EXPECT_TRUE(IsOk(table.Remove("10.255.0.0/8")));
+  EXPECT_TRUE(posix::IsErrno(table.Remove("10.0.0.0/8"), ENOENT));
+  EXPECT_EQ(1, GetSize(table));
+}
+
+TEST_F(RouteSyncTest, SyncsPortsOfAnyIfindex) {
+  ASSERT_TRUE(EnterNewNetns());
+  ASSERT_EQ(0, system("ip link add big index 5000 type veth peer name peer"));
+  auto sync = CreateSync();
+  RouteTable table;
+  ASSERT_TRUE(IsOk(table.Add("10.0.0.0/8", MakeNexthop(5000, 1))));
+  auto stats_or = sync.Sync(table);
+  ASSERT_TRUE(IsOk(stats_or)) << GetText(GetStatus(stats_or));
+  EXPECT_EQ(5000, Lookup("10.1.2.3"));
+  EXPECT_TRUE(HasPort(5000));
+}
+
+TEST_F(RouteSyncTest, WritesOnlyDifferences) {
+  auto sync = CreateSync(RouteSyncOptions{2});
+  RouteTable table;
+  ASSERT_TRUE(IsOk(table.Add("0.0.0.0/0", MakeNexthop(lo_, 1))));
+  ASSERT_TRUE(IsOk(table.Add("10.0.0.0/8", MakeNexthop(lo_, 2))));
+  ASSERT_TRUE(IsOk(table.Add("10.1.0.0/16", MakeNexthop(lo_, 3))));
+  ASSERT_TRUE(IsOk(table.Add("2001:db8::/32", MakeNexthop(lo_, 4))));
+  ASSERT_TRUE(IsOk(table.Add("::/0", MakeNexthop(lo_, 5))));
+
+  auto stats_or = sync.Sync(table);
+  ASSERT_TRUE(IsOk(stats_or)) << GetText(GetStatus(stats_or));
+  EXPECT_EQ(5, GetValue(stats_or).added);
+  EXPECT_EQ(0, GetValue(stats_or).changed);
+  EXPECT_EQ(0, GetValue(stats_or).removed);
+  EXPECT_EQ(lo_, Lookup("10.1.2.3"));
+  EXPECT_EQ(lo_, Lookup("2001:db8::1"));
+  EXPECT_TRUE(HasPort(lo_));
+
+  stats_or = sync.Sync(table);
+  ASSERT_TRUE(IsOk(stats_or));
+  EXPECT_EQ(0, GetValue(stats_or).added);
+  EXPECT_EQ(0, GetValue(stats_or).changed);
+  EXPECT_EQ(0, GetValue(stats_or).removed);
+
+  ASSERT_TRUE(IsOk(table.Remove("10.1.0.0/16")));
+  ASSERT_TRUE(IsOk(table.Add("10.0.0.0/8", MakeNexthop(lo_, 6))));
+  ASSERT_TRUE(IsOk(table.Add("192.168.0.0/16", MakeNexthop(lo_, 7))));
+  stats_or = sync.Sync(table);
+  ASSERT_TRUE(IsOk(stats_or));
+  EXPECT_EQ(1, GetValue(stats_or).added);
+  EXPECT_EQ(1, GetValue(stats_or).changed);
+  EXPECT_EQ(1, GetValue(stats_or).removed);
+  auto nexthop_or = v4_.Lookup(MakeHostRoute("10.1.2.3"));
+  ASSERT_TRUE(IsOk(nexthop_or));
+  EXPECT_EQ(6, GetValue(nexthop_or).dst_mac[5]);
+}
+
+TEST_F(RouteSyncTest, RemovesUnusedPorts) {
+  auto sync = CreateSync();
+  RouteTable table;
+  ASSERT_TRUE(IsOk(table.Add("10.0.0.0/8", MakeNexthop(lo_, 1))));
+  ASSERT_TRUE(IsOk(sync.Sync(table)));
+  EXPECT_TRUE(HasPort(lo_));
+
+  ASSERT_TRUE(IsOk(table.Remove("10.0.0.0/8")));
+  auto stats_or = sync.Sync(table);
+  ASSERT_TRUE(IsOk(stats_or));
+  EXPECT_EQ(1, GetValue(stats_or).removed);
+  EXPECT_FALSE(HasPort(lo_));
+  EXPECT_EQ(0, Lookup("10.1.2.3"));
+}
+
+TEST_F(RouteSyncTest, StartsFromRoutesInMaps) {
+  RouteTable table;
+  ASSERT_TRUE(IsOk(table.Add("10.0.0.0/8", MakeNexthop(lo_, 1))));
+  ASSERT_TRUE(IsOk(table.Add("2001:db8::/32", MakeNexthop(lo_, 2))));
+  ASSERT_TRUE(IsOk(CreateSync().Sync(table)));
+
+  // A new sync, e.g. after a restart, finds the routes already there.
+  auto sync = CreateSync();
+  ASSERT_TRUE(IsOk(table.Add("172.16.0.0/12", MakeNexthop(lo_, 3))));
+  auto stats_or = sync.Sync(table);
+  ASSERT_TRUE(IsOk(stats_or));
+  EXPECT_EQ(1, GetValue(stats_or).added);
+  EXPECT_EQ(0, GetValue(stats_or).changed);
+  EXPECT_EQ(0, GetValue(stats_or).removed);
+
+  // Including routes it no longer wants.
+  auto other = CreateSync();
+  stats_or = other.Sync(RouteTable());
+  ASSERT_TRUE(IsOk(stats_or));
+  EXPECT_EQ(3, GetValue(stats_or).removed);
+  EXPECT_FALSE(HasPort(lo_));
+}
+
+TEST_F(RouteSyncTest, RejectsOtherMaps) {
+  auto sync_or =
+      CreateRouteSync(GetFileDescriptor(ports_), GetFileDescriptor(v6_),
+                      GetFileDescriptor(ports_));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(sync_or), EINVAL));
+}
+
+}  // namespace
@@ -0,0 +1,136 @@
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/base/span.h"
+#include "lib/bpf/test_run.h"
+#include "lib/ebpd.h"
+#include "lib/ebpf/router.h"
+#include "lib/ebpf/router_maps.h"
+#include "lib/posix/file_descriptor.h"
+#include "lib/route_sync.h"
+#include "lib/xdp_loader.h"
+
+namespace {
+
+constexpr uint32_t kLoopback = 1;
+const ebpd_nexthop kNexthop = {kLoopback,
+                               {0x02, 0, 0, 0, 0, 0x0d},
+                               {0x02, 0, 0, 0, 0, 0x05}};
+
+// Ethernet and IPv4 or IPv6 headers, with a few bytes of payload.
+std::vector<uint8_t> MakePacket(const char* const dst, const uint8_t ttl) {
+  const bool ipv6 = strchr(dst, ':');
+  std::vector<uint8_t> packet(14 + (ipv6 ? 40 : 20) + 8);
+  packet[12] = ipv6 ? 0x86 : 0x08;
+  packet[13] = ipv6 ? 0xdd : 0x00;
+  uint8_t* const ip = packet.data() + 14;
+  if (ipv6) {
+    ip[0] = 0x60;
+    ip[6] = 17;
+    ip[7] = ttl;
+    inet_pton(AF_INET6, "2001:db8::1", ip + 8);
+    inet_pton(AF_INET6, dst, ip + 24);
+    return packet;
+  }
+  ip[0] = 0x45;
+  ip[3] = 28;
+  ip[8] = ttl;
+  ip[9] = 17;
+  inet_pton(AF_INET, "192.0.2.1", ip + 12);
+  inet_pton(AF_INET, dst, ip + 16);
+  uint32_t sum = 0;
+  for (int i = 0; i < 20; i += 2) {
+    sum += ip[i] << 8 | ip[i + 1];
+  }
+  sum = (sum & 0xffff) + (sum >> 16);
+  const uint16_t check = ~sum;
+  ip[10] = check >> 8;
+  ip[11] = check;
+  return packet;
+}
+
+// Return true iff the checksum of the IPv4 header of 'packet' is valid.
+bool IsIpv4ChecksumValid(const std::vector<uint8_t>& packet) {
+  uint32_t sum = 0;
+  for (int i = 14; i < 34; i += 2) {
+    sum += packet[i] << 8 | packet[i + 1];
+  }
+  sum = (sum & 0xffff) + (sum >> 16);
+  return sum == 0xffff;
+}
+
+class RouterTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    InitEbpdLib();
+    router_ = LoadXdpBuffer(ebpf::router, "router");
+    ASSERT_NE(nullptr, router_);
+    auto sync_or = CreateRouteSync(*router_);
+    ASSERT_TRUE(IsOk(sync_or));
+    sync_ = std::move(GetValue(sync_or));
+  }
+
+  // Run the router on 'packet', rewritten in place. Returns its verdict.
+  int Route(std::vector<uint8_t>* const packet) {
+    auto result_or = bpf::TestRun(posix::FileDescriptor(router_->GetProgFd()),
+                                  base::MakeSpan(*packet));
+    EXPECT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+    if (IsError(result_or)) {
+      return -1;
+    }
+    *packet = std::move(GetValue(result_or).packet);
+    return GetValue(result_or).retval;
+  }
+
+  XdpHandle router_;
+  RouteSync sync_;
+};
+
+TEST_F(RouterTest, ForwardsIpv4) {
+  RouteTable table;
+  ASSERT_TRUE(IsOk(table.Add("198.51.100.0/24", kNexthop)));
+  ASSERT_TRUE(IsOk(sync_.Sync(table)));
+
+  auto packet = MakePacket("198.51.100.7", 64);
+  ASSERT_EQ(XDP_REDIRECT, Route(&packet));
+  EXPECT_EQ(0, memcmp(kNexthop.dst_mac, packet.data(), 6));
+  EXPECT_EQ(0, memcmp(kNexthop.src_mac, packet.data() + 6, 6));
+  EXPECT_EQ(63, packet[14 + 8]);
+  EXPECT_TRUE(IsIpv4ChecksumValid(packet));
+}
+
+TEST_F(RouterTest, ForwardsIpv6) {
+  RouteTable table;
+  ASSERT_TRUE(IsOk(table.Add("2001:db8:1::/48", kNexthop)));
+  ASSERT_TRUE(IsOk(sync_.Sync(table)));
+
+  auto packet = MakePacket("2001:db8:1::7", 64);
+  ASSERT_EQ(XDP_REDIRECT, Route(&packet));
+  EXPECT_EQ(0, memcmp(kNexthop.dst_mac, packet.data(), 6));
+  EXPECT_EQ(63, packet[14 + 7]);
+}
+
+TEST_F(RouterTest, PassesWhatItCannotForward) {
+  RouteTable table;
+  ASSERT_TRUE(IsOk(table.Add("198.51.100.0/24", kNexthop)));
+  ASSERT_TRUE(IsOk(sync_.Sync(table)));
+
+  auto no_route = MakePacket("203.0.113.7", 64);
+  EXPECT_EQ(XDP_PASS, Route(&no_route));
+  auto expiring = MakePacket("198.51.100.7", 1);
+  EXPECT_EQ(XDP_PASS, Route(&expiring));
+  auto no_route6 = MakePacket("2001:db8:2::7", 64);
+  EXPECT_EQ(XDP_PASS, Route(&no_route6));
+  std::vector<uint8_t> arp(42);
+  arp[12] = 0x08;
+  arp[13] = 0x06;
+  EXPECT_EQ(XDP_PASS, Route(&arp));
+}
+
+}  // namespace
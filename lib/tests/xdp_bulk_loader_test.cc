@@ -0,0 +1,123 @@
+#include "lib/xdp_bulk_loader.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/ebpd.h"
+#include "lib/ebpf/sample.h"
+#include "lib/tests/xdp_test_utils.h"
+
+namespace {
+
+constexpr int kLinks = 4;
+
+class XdpBulkLoaderTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    InitEbpdLib();
+    ASSERT_TRUE(EnterNewNetns());
+    for (int i = 0; i < kLinks; ++i) {
+      const int ifindex = CreateVethPair("veth" + std::to_string(2 * i),
+                                         "veth" + std::to_string(2 * i + 1));
+      ASSERT_NE(0, ifindex);
+      ifindexes_.push_back(ifindex);
+    }
+  }
+
+  std::vector<int> ifindexes_;
+};
+
+TEST_F(XdpBulkLoaderTest, AttachesEverySpec) {
+  std::vector<XdpLoadSpec> specs;
+  for (const int ifindex : ifindexes_) {
+    specs.push_back({ebpf::sample, "ebpf_sample", ifindex, XdpMode::kGeneric});
+  }
+  auto result = LoadAndAttachXdpBulk(specs);
+  ASSERT_EQ(specs.size(), result.handles.size());
+  for (size_t i = 0; i < specs.size(); ++i) {
+    ASSERT_TRUE(IsOk(result.handles[i]));
+    const auto& xdph = GetValue(result.handles[i]);
+    EXPECT_EQ(ifindexes_[i], xdph->AttachedIfindex());
+    EXPECT_EQ(XdpMode::kGeneric, xdph->AttachedMode());
+  }
+  EXPECT_LT(0, result.wall_time.count());
+}
+
+TEST_F(XdpBulkLoaderTest, SharedSpecsLoadOnce) {
+  std::vector<XdpLoadSpec> specs;
+  for (const int ifindex : ifindexes_) {
+    specs.push_back(
+        {ebpf::sample, "ebpf_sample", ifindex, XdpMode::kGeneric, true});
+  }
+  XdpBulkLoadOptions options;
+  options.threads = 2;
+  auto result = LoadAndAttachXdpBulk(specs, options);
+  const size_t count = SharedXdpObjectCount();
+  ASSERT_LE(1, count);
+  int prog_fd = -1;
+  for (auto& handle_or : result.handles) {
+    ASSERT_TRUE(IsOk(handle_or));
+    const auto& xdph = GetValue(handle_or);
+    if (prog_fd < 0) {
+      prog_fd = xdph->GetProgFd();
+    }
+    EXPECT_EQ(prog_fd, xdph->GetProgFd());
+  }
+  result.handles.clear();
+  EXPECT_EQ(count - 1, SharedXdpObjectCount());
+}
+
+TEST_F(XdpBulkLoaderTest, FailuresStayPerSpec) {
+  const std::string_view garbage = "not an elf";
+  std::vector<XdpLoadSpec> specs = {
+      {ebpf::sample, "ebpf_sample", ifindexes_[0], XdpMode::kGeneric},
+      {garbage, "garbage", ifindexes_[1], XdpMode::kGeneric},
+      {garbage, "garbage", ifindexes_[2], XdpMode::kGeneric, true},
+      {ebpf::sample, "ebpf_sample", 0, XdpMode::kGeneric},
+  };
+  auto result = LoadAndAttachXdpBulk(specs);
+  ASSERT_EQ(specs.size(), result.handles.size());
+  EXPECT_TRUE(IsOk(result.handles[0]));
+  EXPECT_TRUE(IsError(result.handles[1]));
+  EXPECT_TRUE(IsError(result.handles[2]));
+  EXPECT_TRUE(IsError(result.handles[3]));
+}
+
+TEST_F(XdpBulkLoaderTest, LoadsManyObjectsAtOnce) {
+  // libbpf lists open objects globally: opening and closing them from many
+  // threads at once must leave the list intact.
+  constexpr int kObjects = 32;
+  std::vector<XdpLoadSpec> specs;
+  for (int i = 0; i < kObjects; ++i) {
+    const int ifindex = CreateVethPair("many" + std::to_string(2 * i),
+                                       "many" + std::to_string(2 * i + 1));
+    ASSERT_NE(0, ifindex);
+    specs.push_back({ebpf::sample, "ebpf_sample_" + std::to_string(i),
+                     ifindex, XdpMode::kGeneric});
+  }
+  XdpBulkLoadOptions options;
+  options.threads = 8;
+  auto result = LoadAndAttachXdpBulk(specs, options);
+  ASSERT_EQ(specs.size(), result.handles.size());
+  for (size_t i = 0; i < specs.size(); ++i) {
+    ASSERT_TRUE(IsOk(result.handles[i])) << i;
+    EXPECT_EQ(specs[i].ifindex, GetValue(result.handles[i])->AttachedIfindex());
+  }
+
+  std::vector<std::thread> unloaders;
+  for (auto& handle_or : result.handles) {
+    unloaders.emplace_back([&handle_or] { GetValue(handle_or).reset(); });
+  }
+  for (auto& unloader : unloaders) {
+    unloader.join();
+  }
+}
+
+TEST_F(XdpBulkLoaderTest, EmptySpecs) {
+  auto result = LoadAndAttachXdpBulk({});
+  EXPECT_TRUE(result.handles.empty());
+}
+
+}  // namespace
@@ -0,0 +1,90 @@
+#include "lib/xdp_chain.h"
+
+#include "gtest/gtest.h"
+#include "lib/ebpd.h"
+#include "lib/posix/errno.h"
+#include "lib/tests/chain_stages.h"
+#include "lib/tests/xdp_test_utils.h"
+
+namespace {
+
+class XdpChainTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    InitEbpdLib();
+    auto chain_or = CreateXdpChain();
+    ASSERT_TRUE(IsOk(chain_or));
+    chain_ = std::move(GetValue(chain_or));
+    ASSERT_TRUE(IsOk(chain_.AddObject(ebpf::chain_stages, "stages")));
+  }
+
+  // Verdict of the pipeline, started by the entry program of 'object', for
+  // a dummy packet.
+  int Run(const std::string& object = "stages") {
+    auto prog_fd_or = chain_.GetProgFd(object, "xdp/entry");
+    EXPECT_TRUE(IsOk(prog_fd_or));
+    return IsOk(prog_fd_or) ? RunXdpProg(GetValue(prog_fd_or)) : -1;
+  }
+
+  XdpChain chain_;
+};
+
+TEST_F(XdpChainTest, EmptyChainPasses) {
+  EXPECT_EQ(XDP_PASS, Run());
+}
+
+TEST_F(XdpChainTest, RunsFirstStageAndSkipsEmptySlots) {
+  ASSERT_TRUE(IsOk(chain_.SetStage(3, "stages", "xdp/drop")));
+  EXPECT_EQ(XDP_DROP, Run());
+  ASSERT_TRUE(IsOk(chain_.SetStage(1, "stages", "xdp/tx")));
+  EXPECT_EQ(XDP_TX, Run());
+  ASSERT_TRUE(IsOk(chain_.ClearStage(1)));
+  EXPECT_EQ(XDP_DROP, Run());
+  ASSERT_TRUE(IsOk(chain_.ClearStage(3)));
+  EXPECT_EQ(XDP_PASS, Run());
+  EXPECT_TRUE(IsOk(chain_.ClearStage(3)));
+}
+
+TEST_F(XdpChainTest, SwapsStagesAcrossObjects) {
+  ASSERT_TRUE(IsOk(chain_.SetStage(0, "stages", "xdp/drop")));
+  EXPECT_EQ(XDP_DROP, Run());
+
+  // A second object shares the prog array: its entry runs the same chain,
+  // and its programs can replace stages of the first.
+  ASSERT_TRUE(IsOk(chain_.AddObject(ebpf::chain_stages, "stages_v2")));
+  EXPECT_EQ(XDP_DROP, Run("stages_v2"));
+  ASSERT_TRUE(IsOk(chain_.SetStage(0, "stages_v2", "xdp/tx")));
+  EXPECT_EQ(XDP_TX, Run());
+  EXPECT_EQ("stages_v2", GetStageObject(chain_, 0));
+}
+
+TEST_F(XdpChainTest, KeepsObjectsInUse) {
+  ASSERT_TRUE(IsOk(chain_.AddObject(ebpf::chain_stages, "other")));
+  ASSERT_TRUE(IsOk(chain_.SetStage(2, "other", "xdp/drop")));
+  EXPECT_TRUE(posix::IsErrno(chain_.RemoveObject("other"), EBUSY));
+  ASSERT_TRUE(IsOk(chain_.ClearStage(2)));
+  EXPECT_TRUE(IsOk(chain_.RemoveObject("other")));
+  EXPECT_TRUE(posix::IsErrno(chain_.RemoveObject("other"), ENOENT));
+}
+
+TEST_F(XdpChainTest, RejectsBadStages) {
+  EXPECT_TRUE(posix::IsErrno(
+      chain_.AddObject(ebpf::chain_stages, "stages"), EEXIST));
+  EXPECT_TRUE(IsError(chain_.SetStage(kXdpChainMaxStages, "stages",
+                                      "xdp/drop")));
+  EXPECT_TRUE(IsError(chain_.SetStage(0, "stages", "xdp/no_such_section")));
+  EXPECT_TRUE(IsError(chain_.SetStage(0, "no_such_object", "xdp/drop")));
+}
+
+TEST_F(XdpChainTest, AttachesEntry) {
+  ASSERT_TRUE(EnterNewNetns());
+  const int ifindex = CreateVethPair("veth0", "veth1");
+  ASSERT_NE(0, ifindex);
+  ASSERT_TRUE(IsOk(
+      chain_.Attach(ifindex, XdpMode::kGeneric, "stages", "xdp/entry")));
+  EXPECT_TRUE(posix::IsErrno(chain_.RemoveObject("stages"), EBUSY));
+  ASSERT_TRUE(IsOk(chain_.Detach("stages")));
+  EXPECT_TRUE(IsOk(chain_.RemoveObject("stages")));
+}
+
+}  // namespace
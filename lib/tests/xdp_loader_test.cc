@@ -1,9 +1,18 @@
 #include "gtest/gtest.h"
+#include "lib/bpf/map.h"
+#include "lib/btf/btf_test_utils.h"
+#include "lib/btf/core.h"
+#include "lib/ebpf/counter.h"
 #include "lib/ebpf/sample.h"
 #include "lib/ebpd.h"
+#include "lib/ebpd_link.h"
+#include "lib/verifier/verifier.h"
 #include "lib/xdp_loader.h"
+#include "lib/tests/xdp_test_utils.h"
+#include <cerrno>
 #include <iostream>
 #include <string_view>
+#include <unistd.h>
 
 using namespace std;
 
@@ -18,3 +27,226 @@ TEST(XdpLoader, Test1) {
   EXPECT_EQ(1, (xdph != nullptr));
 }
 
+
+TEST(XdpLoader, AttachGeneric) {
+  InitEbpdLib();
+  ASSERT_TRUE(EnterNewNetns());
+  const int ifindex = CreateVethPair("veth0", "veth1");
+  ASSERT_NE(0, ifindex);
+  XdpHandle xdph = LoadXdpBuffer(ebpf::sample, "ebpf_sample");
+  ASSERT_NE(nullptr, xdph);
+  EXPECT_EQ(XdpMode::kNone, xdph->AttachedMode());
+  EXPECT_EQ(0, xdph->Attach(ifindex, XdpMode::kGeneric));
+  EXPECT_EQ(XdpMode::kGeneric, xdph->AttachedMode());
+  EXPECT_EQ(ifindex, xdph->AttachedIfindex());
+  EXPECT_EQ(0, xdph->Detach());
+  EXPECT_EQ(XdpMode::kNone, xdph->AttachedMode());
+}
+
+TEST(XdpLoader, AttachNative) {
+  InitEbpdLib();
+  ASSERT_TRUE(EnterNewNetns());
+  const int ifindex = CreateVethPair("veth0", "veth1");
+  ASSERT_NE(0, ifindex);
+  XdpHandle xdph = LoadAndAttachXdpBuffer(ebpf::sample, "ebpf_sample",
+                                          ifindex, XdpMode::kNative);
+  ASSERT_NE(nullptr, xdph);
+  EXPECT_EQ(XdpMode::kNative, xdph->AttachedMode());
+}
+
+TEST(XdpLoader, AttachUnknownSection) {
+  InitEbpdLib();
+  ASSERT_TRUE(EnterNewNetns());
+  const int ifindex = CreateVethPair("veth0", "veth1");
+  ASSERT_NE(0, ifindex);
+  XdpHandle xdph = LoadXdpBuffer(ebpf::sample, "ebpf_sample");
+  ASSERT_NE(nullptr, xdph);
+  EXPECT_NE(0, xdph->Attach(ifindex, XdpMode::kAuto, "no_such_section"));
+  EXPECT_EQ(XdpMode::kNone, xdph->AttachedMode());
+}
+
+TEST(XdpLoader, Replace) {
+  InitEbpdLib();
+  ASSERT_TRUE(EnterNewNetns());
+  const int ifindex = CreateVethPair("veth0", "veth1");
+  ASSERT_NE(0, ifindex);
+  XdpHandle xdph = LoadAndAttachXdpBuffer(ebpf::sample, "ebpf_sample",
+                                          ifindex, XdpMode::kGeneric);
+  ASSERT_NE(nullptr, xdph);
+  ebpd_xdp_link_info before;
+  ASSERT_EQ(0, ebpd_link_get_xdp(ifindex, &before));
+  ASSERT_NE(0u, before.skb_prog_id);
+  EXPECT_EQ(0, ReplaceXdpBuffer(xdph, ebpf::counter, "counter"));
+  EXPECT_EQ(XdpMode::kGeneric, xdph->AttachedMode());
+  EXPECT_EQ(ifindex, xdph->AttachedIfindex());
+  ebpd_xdp_link_info after;
+  ASSERT_EQ(0, ebpd_link_get_xdp(ifindex, &after));
+  EXPECT_NE(0u, after.skb_prog_id);
+  EXPECT_NE(before.skb_prog_id, after.skb_prog_id);
+}
+
+TEST(XdpLoader, ReplaceNullHandle) {
+  InitEbpdLib();
+  EXPECT_EQ(-EINVAL, ReplaceXdpBuffer(nullptr, ebpf::sample, "ebpf_sample"));
+}
+
+TEST(XdpLoader, ReplaceNotAttached) {
+  InitEbpdLib();
+  XdpHandle xdph = LoadXdpBuffer(ebpf::sample, "ebpf_sample");
+  ASSERT_NE(nullptr, xdph);
+  EXPECT_NE(0, ReplaceXdpBuffer(xdph, ebpf::sample, "ebpf_sample_v2"));
+}
+
+TEST(XdpLoader, GetMapFdUnknown) {
+  InitEbpdLib();
+  XdpHandle xdph = LoadXdpBuffer(ebpf::sample, "ebpf_sample");
+  ASSERT_NE(nullptr, xdph);
+  EXPECT_GT(0, xdph->GetMapFd("no_such_map"));
+}
+
+TEST(XdpLoader, SharedBufferLoadsOnce) {
+  InitEbpdLib();
+  ASSERT_TRUE(EnterNewNetns());
+  const int ifindex0 = CreateVethPair("veth0", "veth1");
+  ASSERT_NE(0, ifindex0);
+  const int ifindex1 = CreateVethPair("veth2", "veth3");
+  ASSERT_NE(0, ifindex1);
+  const size_t count = SharedXdpObjectCount();
+
+  XdpHandle first = LoadSharedXdpBuffer(ebpf::sample, "ebpf_sample");
+  ASSERT_NE(nullptr, first);
+  XdpHandle second = LoadSharedXdpBuffer(ebpf::sample, "ebpf_sample");
+  ASSERT_NE(nullptr, second);
+  EXPECT_EQ(count + 1, SharedXdpObjectCount());
+  EXPECT_LE(0, first->GetProgFd());
+  EXPECT_EQ(first->GetProgFd(), second->GetProgFd());
+
+  // Each handle attaches the same program to its own link.
+  EXPECT_EQ(0, first->Attach(ifindex0, XdpMode::kGeneric));
+  EXPECT_EQ(0, second->Attach(ifindex1, XdpMode::kGeneric));
+
+  // The program outlives the first handle, as long as another shares it.
+  first.reset();
+  EXPECT_EQ(count + 1, SharedXdpObjectCount());
+  EXPECT_EQ(XdpMode::kGeneric, second->AttachedMode());
+  EXPECT_EQ(0, second->Detach());
+  second.reset();
+  EXPECT_EQ(count, SharedXdpObjectCount());
+}
+
+TEST(XdpLoader, UnsharedBufferLoadsAgain) {
+  InitEbpdLib();
+  XdpHandle shared = LoadSharedXdpBuffer(ebpf::sample, "ebpf_sample");
+  ASSERT_NE(nullptr, shared);
+  XdpHandle other_name = LoadSharedXdpBuffer(ebpf::sample, "ebpf_sample_v2");
+  ASSERT_NE(nullptr, other_name);
+  XdpHandle unshared = LoadXdpBuffer(ebpf::sample, "ebpf_sample");
+  ASSERT_NE(nullptr, unshared);
+  EXPECT_NE(shared->GetProgFd(), other_name->GetProgFd());
+  EXPECT_NE(shared->GetProgFd(), unshared->GetProgFd());
+}
+
+TEST(XdpLoader, SharedBufferPerBtf) {
+  InitEbpdLib();
+  XdpLoader running;
+  ASSERT_EQ(0, running.LoadFrmSharedBuffer(ebpf::sample, "ebpf_sample"));
+  XdpLoader kernel;
+  kernel.SetBtfPath(btf::kKernelBtfPath);
+  ASSERT_EQ(0, kernel.LoadFrmSharedBuffer(ebpf::sample, "ebpf_sample"));
+  EXPECT_EQ(running.GetProgFd(), kernel.GetProgFd());
+
+  // Relocated for another kernel, the object would differ: not shared.
+  XdpLoader other;
+  other.SetBtfPath("/nonexistent/vmlinux");
+  ASSERT_EQ(0, other.LoadFrmSharedBuffer(ebpf::sample, "ebpf_sample"));
+  EXPECT_NE(running.GetProgFd(), other.GetProgFd());
+}
+
+// Store 'value' in the packet counter of 'xdph', a loaded lib/ebpf/counter.c.
+bool SetPacketCount(const XdpHandle& xdph, const uint64_t value) {
+  auto map_or = bpf::OpenMap<uint32_t, uint64_t>(
+      posix::FileDescriptor(xdph->GetMapFd("packets")));
+  return IsOk(map_or) && IsOk(GetValue(map_or).Update(0, value));
+}
+
+// Return the packet counter of 'xdph', a loaded lib/ebpf/counter.c.
+uint64_t GetPacketCount(const XdpHandle& xdph) {
+  auto map_or = bpf::OpenMap<uint32_t, uint64_t>(
+      posix::FileDescriptor(xdph->GetMapFd("packets")));
+  EXPECT_TRUE(IsOk(map_or));
+  auto value_or = GetValue(map_or).Lookup(0);
+  EXPECT_TRUE(IsOk(value_or));
+  return IsOk(value_or) ? GetValue(value_or) : 0;
+}
+
+TEST(XdpLoader, PinnedMapsSurviveReload) {
+  InitEbpdLib();
+  ASSERT_TRUE(EnterNewBpffs());
+  const std::string pin = PinnedMapsDir("counter") + "/packets";
+  {
+    XdpHandle xdph = LoadPinnedXdpBuffer(ebpf::counter, "counter");
+    ASSERT_NE(nullptr, xdph);
+    ASSERT_TRUE(SetPacketCount(xdph, 42));
+  }
+  EXPECT_EQ(0, access(pin.c_str(), F_OK));
+
+  // A warm restart finds the counter as it was left.
+  XdpHandle xdph = LoadPinnedXdpBuffer(ebpf::counter, "counter");
+  ASSERT_NE(nullptr, xdph);
+  EXPECT_EQ(42, GetPacketCount(xdph));
+
+  // Unpinned, the next load starts over.
+  EXPECT_EQ(0, UnpinXdpMaps("counter"));
+  EXPECT_NE(0, access(pin.c_str(), F_OK));
+  xdph = LoadPinnedXdpBuffer(ebpf::counter, "counter");
+  ASSERT_NE(nullptr, xdph);
+  EXPECT_EQ(0, GetPacketCount(xdph));
+  EXPECT_EQ(0, UnpinXdpMaps("counter"));
+}
+
+TEST(XdpLoader, PinnedMapsRejectBadNames) {
+  InitEbpdLib();
+  EXPECT_EQ(nullptr, LoadPinnedXdpBuffer(ebpf::counter, "../counter"));
+  EXPECT_EQ(nullptr, LoadPinnedXdpBuffer(ebpf::counter, ""));
+  EXPECT_NE(0, UnpinXdpMaps("../counter"));
+}
+
+TEST(XdpLoader, RelocatesOnlyCoreBuffers) {
+  InitEbpdLib();
+  // Without CO-RE relocations, the BTF is not even read.
+  XdpLoader loader;
+  loader.SetBtfPath("/nonexistent/vmlinux");
+  EXPECT_EQ(0, loader.LoadFrmBuffer(ebpf::sample, "ebpf_sample"));
+
+  btf::BtfBuilder local;
+  const uint32_t xdp_md =
+      local.AddStruct("xdp_md", 4, {{"data", local.AddInt("u32", 4), 0}});
+  const uint32_t data = local.AddString("0:0");
+  const uint32_t section = local.AddString("xdp");
+  bpf_insn load = {};
+  load.code = BPF_LDX | BPF_MEM | BPF_W;
+  load.src_reg = BPF_REG_1;
+  const std::string core = btf::MakeObject(
+      {{"xdp", btf::MakeCode({load})},
+       {".BTF", local.Build()},
+       {".BTF.ext", btf::MakeBtfExt(section, {{0, xdp_md, data, 0}})}});
+  XdpLoader core_loader;
+  core_loader.SetBtfPath("/nonexistent/vmlinux");
+  EXPECT_EQ(-EIO, core_loader.LoadFrmBuffer(core, "core"));
+}
+
+TEST(XdpLoader, ReportsVerifierStats) {
+  InitEbpdLib();
+  XdpLoader loader;
+  EXPECT_EQ(0, loader.LoadFrmBuffer(ebpf::counter, "counter"));
+  EXPECT_TRUE(loader.VerifierStats().empty());
+
+  XdpLoader verified;
+  verified.SetVerifierLogLevel(verifier::kLogLevelStats);
+  EXPECT_EQ(0, verified.LoadFrmBuffer(ebpf::counter, "counter"));
+  ASSERT_EQ(1, verified.VerifierStats().size());
+  const verifier::Stats& stats = verified.VerifierStats().at("xdp");
+  EXPECT_LT(0, stats.processed_insns);
+  EXPECT_GE(verifier::kMaxProcessedInsns, stats.processed_insns);
+  EXPECT_LT(0, stats.load_time.count());
+}
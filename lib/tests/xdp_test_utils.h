@@ -0,0 +1,160 @@
+#ifndef LIB_TESTS_XDP_TEST_UTILS_H_
+#define LIB_TESTS_XDP_TEST_UTILS_H_
+
+#include <linux/bpf.h>
+#include <net/if.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+
+#include "lib/base/span.h"
+#include "lib/bpf/test_run.h"
+#include "lib/posix/file_descriptor.h"
+
+// Helpers for tests that need real links to attach programs to.
+// All of them require root (CAP_SYS_ADMIN + CAP_NET_ADMIN + CAP_BPF).
+
+// Move the calling process into a fresh network namespace, so links
+// created by the test vanish with it and never touch the host.
+inline bool EnterNewNetns() { return unshare(CLONE_NEWNET) == 0; }
+
+// Move the calling process into a fresh mount namespace with its own, empty
+// bpffs at /sys/fs/bpf, so pins made by the test vanish with it.
+inline bool EnterNewBpffs() {
+  return unshare(CLONE_NEWNS) == 0 &&
+         mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) == 0 &&
+         mount("bpf", "/sys/fs/bpf", "bpf", 0, nullptr) == 0;
+}
+
+// Create a veth pair with both ends up. Returns the ifindex of 'name',
+// 0 on failure.
+inline int CreateVethPair(const std::string& name, const std::string& peer) {
+  const std::string cmd = "ip link add " + name + " type veth peer name " +
+                          peer + " && ip link set " + name + " up" +
+                          " && ip link set " + peer + " up";
+  if (system(cmd.c_str()) != 0) {
+    return 0;
+  }
+  return if_nametoindex(name.c_str());
+}
+
+// Load the 'count' instructions 'insns' as an xdp program straight through
+// the bpf syscall, without libbpf. Returns the program fd, -1 on failure.
+inline int LoadXdpInsns(const struct bpf_insn* const insns,
+                        const size_t count) {
+  static const char license[] = "GPL";
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = reinterpret_cast<__u64>(insns);
+  attr.insn_cnt = count;
+  attr.license = reinterpret_cast<__u64>(license);
+  return syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof(attr));
+}
+
+// Load a minimal xdp program returning 'verdict'. Returns the program fd, -1
+// on failure.
+inline int LoadTrivialXdpProg(const int verdict) {
+  struct bpf_insn insns[2] = {};
+  insns[0].code = BPF_ALU64 | BPF_MOV | BPF_K;  // r0 = verdict
+  insns[0].dst_reg = BPF_REG_0;
+  insns[0].imm = verdict;
+  insns[1].code = BPF_JMP | BPF_EXIT;
+  return LoadXdpInsns(insns, 2);
+}
+
+// Load an xdp program redirecting every packet to the AF_XDP socket of its rx
+// queue in XSKMAP 'map_fd', passing it on if there is none; the bytecode of
+// lib/ebpf/xsk_redirect.c. Returns the program fd, -1 on failure.
+inline int LoadXskRedirectProg(const int map_fd) {
+  struct bpf_insn insns[6] = {};
+  insns[0].code = BPF_LDX | BPF_MEM | BPF_W;  // r2 = ctx->rx_queue_index
+  insns[0].dst_reg = BPF_REG_2;
+  insns[0].src_reg = BPF_REG_1;
+  insns[0].off = 16;  // offsetof(struct xdp_md, rx_queue_index), linux 4.16
+  insns[1].code = BPF_LD | BPF_DW | BPF_IMM;  // r1 = map_fd (2 insns)
+  insns[1].dst_reg = BPF_REG_1;
+  insns[1].src_reg = BPF_PSEUDO_MAP_FD;
+  insns[1].imm = map_fd;
+  insns[3].code = BPF_ALU64 | BPF_MOV | BPF_K;  // r3 = XDP_PASS
+  insns[3].dst_reg = BPF_REG_3;
+  insns[3].imm = XDP_PASS;
+  insns[4].code = BPF_JMP | BPF_CALL;  // r0 = bpf_redirect_map(r1, r2, r3)
+  insns[4].imm = BPF_FUNC_redirect_map;
+  insns[5].code = BPF_JMP | BPF_EXIT;
+  return LoadXdpInsns(insns, 6);
+}
+
+// Id of helper bpf_ringbuf_output(), linux 5.8, newer than our headers.
+constexpr int kHelperRingbufOutput = 130;
+
+// Load an xdp program writing 'value' as an 8 byte record to map 'map_fd'
+// every time it runs, passing the packet on. 'helper' is the helper writing
+// it: BPF_FUNC_perf_event_output, to a perf event array, on the current CPU,
+// or kHelperRingbufOutput, to a ring buffer, with 'flags'. Returns the
+// program fd, -1 on failure.
+inline int LoadOutputProg(const int helper, const int map_fd,
+                          const int32_t value, const int flags = 0) {
+  const bool ringbuf = helper == kHelperRingbufOutput;
+  // The map, the record and its size, and the flags go in these registers.
+  const uint8_t map = ringbuf ? BPF_REG_1 : BPF_REG_2;
+  const uint8_t data = ringbuf ? BPF_REG_2 : BPF_REG_4;
+  const uint8_t size = ringbuf ? BPF_REG_3 : BPF_REG_5;
+  const uint8_t flags_reg = ringbuf ? BPF_REG_4 : BPF_REG_3;
+  struct bpf_insn insns[10] = {};
+  insns[0].code = BPF_ST | BPF_MEM | BPF_DW;  // *(u64 *)(r10 - 8) = value
+  insns[0].dst_reg = BPF_REG_10;
+  insns[0].off = -8;
+  insns[0].imm = value;
+  insns[1].code = BPF_LD | BPF_DW | BPF_IMM;  // map = map_fd (2 insns)
+  insns[1].dst_reg = map;
+  insns[1].src_reg = BPF_PSEUDO_MAP_FD;
+  insns[1].imm = map_fd;
+  insns[3].code = BPF_ALU64 | BPF_MOV | BPF_X;  // data = r10 - 8
+  insns[3].dst_reg = data;
+  insns[3].src_reg = BPF_REG_10;
+  insns[4].code = BPF_ALU64 | BPF_ADD | BPF_K;
+  insns[4].dst_reg = data;
+  insns[4].imm = -8;
+  insns[5].code = BPF_ALU64 | BPF_MOV | BPF_K;  // size = 8
+  insns[5].dst_reg = size;
+  insns[5].imm = 8;
+  // flags = BPF_F_CURRENT_CPU, a 32 bit -1, for perf event arrays.
+  insns[6].code = ringbuf ? BPF_ALU64 | BPF_MOV | BPF_K
+                          : BPF_ALU | BPF_MOV | BPF_K;
+  insns[6].dst_reg = flags_reg;
+  insns[6].imm = ringbuf ? flags : -1;
+  insns[7].code = BPF_JMP | BPF_CALL;  // helper(r1 = ctx for perf, ...)
+  insns[7].imm = helper;
+  insns[8].code = BPF_ALU64 | BPF_MOV | BPF_K;  // r0 = XDP_PASS
+  insns[8].dst_reg = BPF_REG_0;
+  insns[8].imm = XDP_PASS;
+  insns[9].code = BPF_JMP | BPF_EXIT;
+  return LoadXdpInsns(insns, 10);
+}
+
+// Run xdp program 'prog_fd' 'repeat' times on the 'size' bytes of packet
+// 'data' with BPF_PROG_TEST_RUN, see bpf::TestRun(). Returns its last
+// verdict, -1 on failure.
+inline int RunXdpProgOn(const int prog_fd, const void* const data,
+                        const size_t size, const uint32_t repeat = 1) {
+  const auto result_or = bpf::TestRun(
+      posix::FileDescriptor(prog_fd),
+      base::MakeSpan(static_cast<const uint8_t*>(data), size), repeat);
+  return IsOk(result_or) ? static_cast<int>(GetValue(result_or).retval) : -1;
+}
+
+// Run xdp program 'prog_fd' 'repeat' times on a dummy packet with
+// BPF_PROG_TEST_RUN. Returns its last verdict, -1 on failure.
+inline int RunXdpProg(const int prog_fd, const uint32_t repeat = 1) {
+  const unsigned char packet[64] = {};
+  return RunXdpProgOn(prog_fd, packet, sizeof(packet), repeat);
+}
+
+#endif  // LIB_TESTS_XDP_TEST_UTILS_H_
@@ -0,0 +1,148 @@
+// Loads eBPF objects and fails if a program of theirs is harder to verify,
+// or slower to load, than allowed: the test cc_ebpf_budget_test() makes,
+// to notice programs growing towards the limits of the verifier before a
+// kernel rejects them.
+//
+// usage: budget_test [--max-insns=N] [--max-states=N] [--max-load-ms=MS]
+//            [--log-level=N] FILE.o...
+//
+// --max-insns bounds the instructions the verifier processes per program,
+// --max-states the states it keeps (linux 5.2 and later, 0 before), and
+// --max-load-ms the time BPF_PROG_LOAD takes; 0 for no bound. Prints what
+// the verifier reported for each program, and with --log-level its log.
+//
+// Objects with CO-RE relocations are relocated for the running kernel
+// first, as XdpLoader does. Needs CAP_SYS_ADMIN.
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lib/btf/btf.h"
+#include "lib/btf/core.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/posix/errno.h"
+#include "lib/verifier/verifier.h"
+
+namespace {
+
+struct Flags {
+  uint64_t max_insns = verifier::kMaxProcessedInsns;
+  uint64_t max_states = 0;
+  double max_load_ms = 0;
+  uint32_t log_level = 0;
+  std::vector<std::string> objects;
+};
+
+void PrintUsage(const char* name) {
+  std::cerr << "usage: " << name << " [--max-insns=N] [--max-states=N]"
+            << " [--max-load-ms=MS] [--log-level=N] FILE.o..." << std::endl;
+}
+
+bool ParseFlags(const int argc, char** const argv, Flags* const flags) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.rfind("--max-insns=", 0) == 0) {
+      flags->max_insns = std::strtoull(arg.c_str() + 12, nullptr, 10);
+    } else if (arg.rfind("--max-states=", 0) == 0) {
+      flags->max_states = std::strtoull(arg.c_str() + 13, nullptr, 10);
+    } else if (arg.rfind("--max-load-ms=", 0) == 0) {
+      flags->max_load_ms = std::atof(arg.c_str() + 14);
+    } else if (arg.rfind("--log-level=", 0) == 0) {
+      flags->log_level = std::atoi(arg.c_str() + 12);
+    } else if (arg.rfind("--", 0) == 0) {
+      return false;
+    } else {
+      flags->objects.push_back(arg);
+    }
+  }
+  return !flags->objects.empty();
+}
+
+// Read the object at 'path', relocated for the running kernel if needed.
+error::StatusOr<std::string> ReadObject(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::ostringstream contents;
+  if (!(contents << file.rdbuf())) {
+    return error::Status(posix::MakeCodeFromErrno(ENOENT),
+                         "cannot read " + path);
+  }
+  ASSIGN_OR_RETURN(const bool relocate,
+                   btf::HasCoreRelocations(contents.str()));
+  if (!relocate) {
+    return contents.str();
+  }
+  ASSIGN_OR_RETURN(const auto target, btf::ReadBtfFile(btf::kKernelBtfPath));
+  return btf::RelocateObject(contents.str(), target);
+}
+
+// Print what the verifier reported for program 'section' of 'path'.
+// Returns false if over budget.
+bool Report(const std::string& path, const std::string& section,
+            const verifier::Stats& stats, const Flags& flags) {
+  const double load_ms =
+      std::chrono::duration<double, std::milli>(stats.load_time).count();
+  std::cout << path << " " << section << ": " << stats.insns << " insns, "
+            << stats.processed_insns << " processed, " << stats.total_states
+            << " states (peak " << stats.peak_states << ", at most "
+            << stats.max_states_per_insn << " per insn), " << std::fixed
+            << std::setprecision(3) << load_ms << " ms" << std::endl;
+  if (flags.log_level) {
+    std::cout << stats.log;
+  }
+  bool ok = true;
+  if (flags.max_insns && stats.processed_insns > flags.max_insns) {
+    std::cout << "  over budget: " << stats.processed_insns
+              << " insns processed, at most " << flags.max_insns
+              << " allowed" << std::endl;
+    ok = false;
+  }
+  if (flags.max_states && stats.total_states > flags.max_states) {
+    std::cout << "  over budget: " << stats.total_states
+              << " states, at most " << flags.max_states << " allowed"
+              << std::endl;
+    ok = false;
+  }
+  if (flags.max_load_ms > 0 && load_ms > flags.max_load_ms) {
+    std::cout << "  over budget: loaded in " << load_ms << " ms, at most "
+              << flags.max_load_ms << " allowed" << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Flags flags;
+  if (!ParseFlags(argc, argv, &flags)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  bool ok = true;
+  for (const auto& path : flags.objects) {
+    const auto elf_or = ReadObject(path);
+    if (IsError(elf_or)) {
+      std::cerr << path << ": " << GetText(GetStatus(elf_or)) << std::endl;
+      ok = false;
+      continue;
+    }
+    const auto stats_or =
+        verifier::VerifyObject(GetValue(elf_or), flags.log_level);
+    if (IsError(stats_or)) {
+      std::cerr << path << ": " << GetText(GetStatus(stats_or)) << std::endl;
+      ok = false;
+      continue;
+    }
+    for (const auto& [section, stats] : GetValue(stats_or)) {
+      ok = Report(path, section, stats, flags) && ok;
+    }
+  }
+  return ok ? 0 : 1;
+}
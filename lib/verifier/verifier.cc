@@ -0,0 +1,201 @@
+#include "lib/verifier/verifier.h"
+
+#include <linux/bpf.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <utility>
+#include <vector>
+
+#include "lib/bpf/cpus.h"
+#include "lib/bpf/map.h"
+#include "lib/bpf/redirect_map.h"
+#include "lib/bpf/syscall.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+#include "lib/posix/unique_file_descriptor.h"
+#include "lib/vm/elf.h"
+
+namespace verifier {
+namespace {
+
+// Size of the log buffer of the first attempt at loading a program, and the
+// most the kernel accepts: it fails with ENOSPC when the log does not fit.
+constexpr uint32_t kMinLogSize = 64 * 1024;
+constexpr uint32_t kMaxLogSize = UINT_MAX >> 8;
+// Lines at the end of the log of a rejected program quoted in the status.
+constexpr size_t kRejectedLogLines = 16;
+
+// Sections of programs loaded with an expected attach type, as by
+// ebpd_load_object().
+constexpr std::string_view kDevMapSection = "xdp_devmap";
+constexpr std::string_view kCpuMapSection = "xdp_cpumap";
+
+error::Status MakeStatus(const int e, const std::string_view text) {
+  return error::Status(posix::MakeCodeFromErrno(e), text);
+}
+
+// Read the decimal number following the first 'key' of 'line' into
+// 'value'. Returns false if there is none.
+bool ReadCounter(std::string_view line, const std::string_view key,
+                 uint64_t* const value) {
+  const size_t start = line.find(key);
+  if (start == std::string_view::npos) {
+    return false;
+  }
+  line.remove_prefix(start + key.size());
+  uint64_t number = 0;
+  size_t digits = 0;
+  for (; digits < line.size() && line[digits] >= '0' && line[digits] <= '9';
+       ++digits) {
+    number = number * 10 + (line[digits] - '0');
+  }
+  if (digits == 0) {
+    return false;
+  }
+  *value = number;
+  return true;
+}
+
+// The last 'lines' lines of 'log'.
+std::string_view GetTail(std::string_view log, const size_t lines) {
+  while (!log.empty() && log.back() == '\n') {
+    log.remove_suffix(1);
+  }
+  size_t start = log.size();
+  for (size_t i = 0; i < lines && start != 0; ++i) {
+    const size_t newline = log.rfind('\n', start - 1);
+    start = newline == std::string_view::npos ? 0 : newline;
+  }
+  return log.substr(start == 0 ? 0 : start + 1);
+}
+
+error::StatusOr<posix::UniqueFileDescriptor> CreateMap(
+    const vm::MapSpec& spec) {
+  uint32_t max_entries = spec.max_entries;
+  if (spec.type == BPF_MAP_TYPE_ARRAY_OF_MAPS ||
+      spec.type == BPF_MAP_TYPE_HASH_OF_MAPS) {
+    return MakeStatus(ENOTSUP, "map '" + spec.name + "': maps of maps are "
+                                   "not supported");
+  }
+  // Sized by the loader, as libbpf does: a slot per CPU.
+  if (spec.type == BPF_MAP_TYPE_PERF_EVENT_ARRAY && max_entries == 0) {
+    ASSIGN_OR_RETURN(max_entries, bpf::GetPossibleCpuCount());
+  }
+  auto map_or = bpf::impl::CreateMap(static_cast<bpf_map_type>(spec.type),
+                                     spec.key_size, spec.value_size,
+                                     max_entries, spec.flags);
+  if (IsError(map_or)) {
+    return error::Status(GetCode(GetStatus(map_or)),
+                         "map '" + spec.name + "': " +
+                             std::string(GetText(GetStatus(map_or))));
+  }
+  return std::move(GetValue(map_or));
+}
+
+uint32_t GetExpectedAttachType(const std::string_view section) {
+  if (section.substr(0, kDevMapSection.size()) == kDevMapSection) {
+    return bpf::kAttachXdpDevMap;
+  }
+  if (section.substr(0, kCpuMapSection.size()) == kCpuMapSection) {
+    return bpf::kAttachXdpCpuMap;
+  }
+  return 0;
+}
+
+// Load 'program', its map references resolved, and unload it again.
+error::StatusOr<Stats> LoadProgram(const vm::ProgramSpec& program,
+                                   const std::string& license,
+                                   uint32_t log_level) {
+  Stats stats;
+  stats.insns = program.insns.size();
+  std::vector<char> log(kMinLogSize);
+  while (true) {
+    auto attr = bpf::MakeAttr<bpf::ProgLoadAttr>();
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insn_cnt = program.insns.size();
+    attr.insns = bpf::ToAttrPointer(program.insns.data());
+    attr.license = bpf::ToAttrPointer(license.c_str());
+    attr.log_level = log_level;
+    attr.log_size = log.size();
+    attr.log_buf = bpf::ToAttrPointer(log.data());
+    attr.expected_attach_type = GetExpectedAttachType(program.section);
+    log[0] = '\0';
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto fd_or = bpf::Bpf(BPF_PROG_LOAD, &attr);
+    stats.load_time = std::chrono::steady_clock::now() - start;
+    if (IsOk(fd_or)) {
+      posix::UniqueFileDescriptor fd(posix::FileDescriptor(GetValue(fd_or)));
+      break;
+    }
+    const error::Status& status = GetStatus(fd_or);
+    if (posix::IsErrno(status, ENOSPC) && log.size() < kMaxLogSize) {
+      log.resize(std::min<size_t>(log.size() * 2, kMaxLogSize));
+    } else if (posix::IsErrno(status, EINVAL) &&
+               (log_level & kLogLevelStats) && log[0] == '\0') {
+      // Before linux 5.2: the level is rejected before verifying anything.
+      log_level &= ~kLogLevelStats;
+      log_level = log_level ? log_level : kLogLevelInsns;
+    } else {
+      const std::string_view text(log.data());
+      return error::Status(
+          GetCode(status), "section '" + program.section + "' rejected: " +
+                               std::string(GetTail(text, kRejectedLogLines)));
+    }
+  }
+  stats.log = log.data();
+  const error::Status status = ParseLog(stats.log, &stats);
+  if (IsError(status)) {
+    return error::Status(GetCode(status), "section '" + program.section +
+                                              "': " +
+                                              std::string(GetText(status)));
+  }
+  return stats;
+}
+
+}  // namespace
+
+error::Status ParseLog(const std::string_view log, Stats* const stats) {
+  const size_t start = log.rfind("processed ");
+  if (start == std::string_view::npos) {
+    return MakeStatus(EBADMSG, "no processed instructions in verifier log");
+  }
+  std::string_view line = log.substr(start);
+  line = line.substr(0, line.find('\n'));
+  uint64_t processed_insns = 0;
+  if (!ReadCounter(line, "processed ", &processed_insns) ||
+      line.find(" insns") == std::string_view::npos) {
+    return MakeStatus(EBADMSG, "no processed instructions in verifier log");
+  }
+  stats->processed_insns = processed_insns;
+  // Since linux 5.2.
+  ReadCounter(line, "max_states_per_insn ", &stats->max_states_per_insn);
+  ReadCounter(line, "total_states ", &stats->total_states);
+  ReadCounter(line, "peak_states ", &stats->peak_states);
+  return error::Status();
+}
+
+error::StatusOr<std::map<std::string, Stats>> VerifyObject(
+    const std::string_view elf, const uint32_t log_level) {
+  ASSIGN_OR_RETURN(vm::Object object, vm::ParseObject(elf));
+  std::vector<posix::UniqueFileDescriptor> maps;
+  for (const auto& spec : object.maps) {
+    ASSIGN_OR_RETURN(auto map, CreateMap(spec));
+    maps.push_back(std::move(map));
+  }
+  std::map<std::string, Stats> stats;
+  for (auto& program : object.programs) {
+    for (const auto& [index, map] : program.map_references) {
+      program.insns[index].imm = GetValue(*maps[map]);
+    }
+    ASSIGN_OR_RETURN(
+        stats[program.section],
+        LoadProgram(program, object.license, log_level | kLogLevelStats));
+  }
+  return stats;
+}
+
+}  // namespace verifier
@@ -0,0 +1,68 @@
+#ifndef LIB_VERIFIER_VERIFIER_H_
+#define LIB_VERIFIER_VERIFIER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "lib/error/status_or.h"
+
+// What the kernel verifier reports about eBPF programs: how hard they were
+// to verify and how long it took, to keep an eye on programs growing
+// towards the limits of the verifier, or failing to load on older kernels.
+
+namespace verifier {
+
+// Log levels of BPF_PROG_LOAD, ORed together. Values are ABI. Since linux
+// 5.2 kLogLevelInsns alone logs little but why programs are rejected.
+constexpr uint32_t kLogLevelInsns = 1;   // the instructions verified
+constexpr uint32_t kLogLevelStates = 2;  // and the register states, huge
+constexpr uint32_t kLogLevelStats = 4;   // the statistics only, linux 5.2
+
+// Instructions the verifier processes at most, per program: before linux
+// 5.2, and for unprivileged loads since. Privileged loads get 1000000.
+constexpr uint64_t kMaxProcessedInsns = 131072;
+
+struct Stats {
+  // Instructions of the program, with the functions it calls.
+  uint64_t insns = 0;
+  // Instructions the verifier walked through, over all paths: what the
+  // kernel limits, see kMaxProcessedInsns.
+  uint64_t processed_insns = 0;
+  // States the verifier kept to prune paths with, in total, at most at
+  // once, and at most for one instruction. 0 before linux 5.2.
+  uint64_t total_states = 0;
+  uint64_t peak_states = 0;
+  uint64_t max_states_per_insn = 0;
+  // Time BPF_PROG_LOAD took, mostly verification.
+  std::chrono::nanoseconds load_time{0};
+  // The log of the verifier.
+  std::string log;
+};
+
+// Fill the counters of 'stats' from 'log', a verifier log of any level.
+// Counters the log has not are left alone. Fails with EBADMSG if the log
+// has not even the number of processed instructions, e.g. it was
+// truncated: no budget can be checked then.
+error::Status ParseLog(std::string_view log, Stats* stats);
+
+// Load each program of 'elf', an eBPF ELF object as built by cc_ebpf(), as
+// an xdp program on its own, with maps of its own, and return what the
+// verifier reported, by section. Programs and maps are gone on return.
+//
+// 'log_level' is of kLogLevel*: kLogLevelStats is always added, and left
+// out again on kernels not knowing it. The object must be relocated for
+// the running kernel, see btf::RelocateObject().
+//
+// Fails with the errno of the first program the kernel rejects, the end
+// of its log in the text, as ParseLog() on logs without statistics, and
+// as lib/vm/elf.h on objects it cannot parse.
+// Needs CAP_SYS_ADMIN.
+error::StatusOr<std::map<std::string, Stats>> VerifyObject(
+    std::string_view elf, uint32_t log_level = kLogLevelStats);
+
+}  // namespace verifier
+
+#endif  // LIB_VERIFIER_VERIFIER_H_
@@ -0,0 +1,79 @@
+#include "lib/verifier/verifier.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "lib/ebpf/counter.h"
+#include "lib/posix/errno.h"
+
+namespace verifier {
+namespace {
+
+TEST(ParseLogTest, ParsesStats) {
+  Stats stats;
+  EXPECT_TRUE(IsOk(ParseLog(
+      "verification time 31 usec\n"
+      "stack depth 8\n"
+      "processed 12 insns (limit 1000000) max_states_per_insn 1 "
+      "total_states 3 peak_states 2 mark_read 1\n",
+      &stats)));
+  EXPECT_EQ(12, stats.processed_insns);
+  EXPECT_EQ(1, stats.max_states_per_insn);
+  EXPECT_EQ(3, stats.total_states);
+  EXPECT_EQ(2, stats.peak_states);
+}
+
+TEST(ParseLogTest, ParsesOlderLogs) {
+  Stats stats;
+  // Of log level 1 before linux 5.2: the instructions, then the count.
+  EXPECT_TRUE(IsOk(ParseLog(
+      "0: (b7) r0 = 2\n"
+      "1: (95) exit\n"
+      "processed 2 insns (limit 131072), stack depth 0\n",
+      &stats)));
+  EXPECT_EQ(2, stats.processed_insns);
+  EXPECT_EQ(0, stats.total_states);
+  EXPECT_TRUE(IsOk(ParseLog("processed 7 insns, stack depth 0", &stats)));
+  EXPECT_EQ(7, stats.processed_insns);
+}
+
+TEST(ParseLogTest, FailsWithoutCount) {
+  Stats stats;
+  stats.processed_insns = 5;
+  EXPECT_TRUE(posix::IsErrno(ParseLog("", &stats), EBADMSG));
+  EXPECT_TRUE(posix::IsErrno(
+      ParseLog("0: (b7) r0 = 2\n1: (95) exit\n", &stats), EBADMSG));
+  EXPECT_TRUE(posix::IsErrno(ParseLog("processed insns", &stats), EBADMSG));
+  // Truncated before the end of the line.
+  EXPECT_TRUE(posix::IsErrno(ParseLog("processed 12", &stats), EBADMSG));
+  EXPECT_EQ(5, stats.processed_insns);
+}
+
+TEST(VerifyObjectTest, ReportsEachProgram) {
+  const auto stats_or = VerifyObject(ebpf::counter);
+  ASSERT_TRUE(IsOk(stats_or)) << GetText(GetStatus(stats_or));
+  const auto& stats = GetValue(stats_or);
+  ASSERT_EQ(1, stats.size());
+  const Stats& xdp = stats.at("xdp");
+  EXPECT_LT(0, xdp.insns);
+  EXPECT_LT(0, xdp.processed_insns);
+  EXPECT_GE(kMaxProcessedInsns, xdp.processed_insns);
+  EXPECT_LT(0, xdp.load_time.count());
+  EXPECT_NE(std::string::npos, xdp.log.find("processed"));
+}
+
+TEST(VerifyObjectTest, LogsInstructions) {
+  const auto stats_or =
+      VerifyObject(ebpf::counter, kLogLevelInsns | kLogLevelStates);
+  ASSERT_TRUE(IsOk(stats_or)) << GetText(GetStatus(stats_or));
+  const Stats& xdp = GetValue(stats_or).at("xdp");
+  EXPECT_NE(std::string::npos, xdp.log.find("(95) exit"));
+  EXPECT_LT(0, xdp.processed_insns);
+}
+
+TEST(VerifyObjectTest, FailsOnOtherFiles) {
+  EXPECT_TRUE(posix::IsErrno(GetStatus(VerifyObject("")), EINVAL));
+}
+
+}  // namespace
+}  // namespace verifier
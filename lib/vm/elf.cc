@@ -0,0 +1,322 @@
+#include "lib/vm/elf.h"
+
+#include <elf.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+
+namespace vm {
+namespace {
+
+// EM_BPF, missing from older <elf.h>.
+constexpr uint16_t kMachineBpf = 247;
+
+// Fields of struct bpf_map_def read, in order; older objects may have fewer.
+constexpr size_t kMapDefFields = 5;
+constexpr size_t kMinMapDefSize = 4 * sizeof(uint32_t);
+
+error::Status MakeStatus(const int e, const std::string_view text) {
+  return error::Status(posix::MakeCodeFromErrno(e), text);
+}
+
+// Copy 'T' at 'offset' of 'data' to 'value'. Returns false if out of bounds.
+template <typename T>
+bool Read(const std::string_view data, const uint64_t offset, T* const value) {
+  if (offset > data.size() || data.size() - offset < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(value, data.data() + offset, sizeof(T));
+  return true;
+}
+
+bool IsGlobalData(const std::string_view name) {
+  return name == ".data" || name == ".bss" || name.rfind(".rodata", 0) == 0;
+}
+
+bool IsMapLoad(const bpf_insn& insn) {
+  return insn.code == (BPF_LD | BPF_IMM | BPF_DW);
+}
+
+bool IsPseudoCall(const bpf_insn& insn) {
+  return insn.code == (BPF_JMP | BPF_CALL) && insn.src_reg == BPF_PSEUDO_CALL;
+}
+
+// The code of an executable section, with its relocations resolved but for
+// calls into ".text".
+struct Code {
+  std::vector<bpf_insn> insns;
+  std::map<size_t, size_t> map_references;
+  // Calls to functions of ".text": instruction index, and index in ".text"
+  // of the function called.
+  std::vector<std::pair<size_t, size_t>> text_calls;
+};
+
+class Parser {
+ public:
+  explicit Parser(const std::string_view elf) : elf_(elf) {}
+
+  error::StatusOr<Object> Parse() {
+    RETURN_IF_ERROR(ParseSections());
+    RETURN_IF_ERROR(ParseMaps());
+
+    std::map<size_t, Code> code;
+    for (size_t i = 0; i < sections_.size(); ++i) {
+      const Elf64_Shdr& section = sections_[i];
+      if (section.sh_type != SHT_PROGBITS ||
+          !(section.sh_flags & SHF_EXECINSTR) || section.sh_size == 0) {
+        continue;
+      }
+      const std::string_view data = GetData(section);
+      if (data.size() != section.sh_size || data.size() % sizeof(bpf_insn)) {
+        return MakeStatus(EINVAL, "truncated program section");
+      }
+      auto& insns = code[i].insns;
+      insns.resize(data.size() / sizeof(bpf_insn));
+      std::memcpy(insns.data(), data.data(), data.size());
+    }
+    for (const auto& section : sections_) {
+      if (section.sh_type != SHT_REL) {
+        continue;
+      }
+      const auto target = code.find(section.sh_info);
+      if (target != code.end()) {
+        RETURN_IF_ERROR(Relocate(section, &target->second));
+      }
+    }
+
+    const Code* text = nullptr;
+    for (const auto& [index, section_code] : code) {
+      if (GetName(sections_[index]) == ".text") {
+        text = &section_code;
+      }
+    }
+    for (auto& [index, section_code] : code) {
+      if (&section_code == text) {
+        continue;
+      }
+      ProgramSpec program;
+      program.section = std::string(GetName(sections_[index]));
+      RETURN_IF_ERROR(Link(text, &section_code, &program));
+      object_.programs.push_back(std::move(program));
+    }
+    return std::move(object_);
+  }
+
+ private:
+  std::string_view GetData(const Elf64_Shdr& section) const {
+    if (section.sh_type == SHT_NOBITS || section.sh_offset > elf_.size()) {
+      return {};
+    }
+    return elf_.substr(section.sh_offset, section.sh_size);
+  }
+
+  // Return the string at 'offset' of string table 'table', empty if invalid.
+  std::string_view GetString(const Elf64_Shdr& table,
+                             const uint64_t offset) const {
+    const std::string_view strings = GetData(table);
+    if (offset >= strings.size()) {
+      return {};
+    }
+    const std::string_view string = strings.substr(offset);
+    return string.substr(0, string.find('\0'));
+  }
+
+  std::string_view GetName(const Elf64_Shdr& section) const {
+    return GetString(sections_[header_.e_shstrndx], section.sh_name);
+  }
+
+  error::Status ParseSections() {
+    if (!Read(elf_, 0, &header_) ||
+        std::memcmp(header_.e_ident, ELFMAG, SELFMAG) != 0) {
+      return MakeStatus(EINVAL, "not an ELF object");
+    }
+    if (header_.e_ident[EI_CLASS] != ELFCLASS64 ||
+        header_.e_ident[EI_DATA] != ELFDATA2LSB) {
+      return MakeStatus(ENOTSUP, "not a 64 bit little endian ELF object");
+    }
+    if (header_.e_type != ET_REL || header_.e_machine != kMachineBpf) {
+      return MakeStatus(EINVAL, "not a relocatable eBPF object");
+    }
+    if (header_.e_shentsize != sizeof(Elf64_Shdr) ||
+        header_.e_shstrndx >= header_.e_shnum) {
+      return MakeStatus(EINVAL, "bad ELF section headers");
+    }
+    sections_.resize(header_.e_shnum);
+    for (size_t i = 0; i < sections_.size(); ++i) {
+      if (!Read(elf_, header_.e_shoff + i * sizeof(Elf64_Shdr),
+                &sections_[i])) {
+        return MakeStatus(EINVAL, "truncated ELF section headers");
+      }
+    }
+    for (size_t i = 0; i < sections_.size(); ++i) {
+      const std::string_view name = GetName(sections_[i]);
+      if (sections_[i].sh_type == SHT_SYMTAB) {
+        if (sections_[i].sh_link >= sections_.size()) {
+          return MakeStatus(EINVAL, "bad ELF symbol table");
+        }
+        symtab_ = &sections_[i];
+      } else if (name == "maps") {
+        maps_index_ = i;
+      } else if (name == "license") {
+        const std::string_view license = GetData(sections_[i]);
+        object_.license = std::string(license.substr(0, license.find('\0')));
+      } else if (name == ".maps") {
+        return MakeStatus(ENOTSUP, "BTF defined maps are not supported");
+      }
+    }
+    if (!symtab_) {
+      return MakeStatus(EINVAL, "no ELF symbol table");
+    }
+    return error::kOkStatus;
+  }
+
+  error::Status GetSymbol(const size_t index, Elf64_Sym* const symbol) const {
+    if (!Read(GetData(*symtab_), index * sizeof(Elf64_Sym), symbol)) {
+      return MakeStatus(EINVAL, "bad ELF symbol index");
+    }
+    return error::kOkStatus;
+  }
+
+  error::Status ParseMaps() {
+    if (!maps_index_) {
+      return error::kOkStatus;
+    }
+    // Map definitions are all the same size, whatever the struct bpf_map_def
+    // of the object.
+    std::vector<Elf64_Sym> symbols;
+    for (size_t i = 0; i < symtab_->sh_size / sizeof(Elf64_Sym); ++i) {
+      Elf64_Sym symbol;
+      RETURN_IF_ERROR(GetSymbol(i, &symbol));
+      if (symbol.st_shndx == maps_index_ &&
+          ELF64_ST_TYPE(symbol.st_info) != STT_SECTION) {
+        symbols.push_back(symbol);
+      }
+    }
+    if (symbols.empty()) {
+      return error::kOkStatus;
+    }
+    std::sort(symbols.begin(), symbols.end(),
+              [](const Elf64_Sym& a, const Elf64_Sym& b) {
+                return a.st_value < b.st_value;
+              });
+    const std::string_view data = GetData(sections_[maps_index_]);
+    const size_t def_size = data.size() / symbols.size();
+    if (def_size < kMinMapDefSize || def_size * symbols.size() != data.size()) {
+      return MakeStatus(EINVAL, "bad maps section");
+    }
+    for (const auto& symbol : symbols) {
+      uint32_t fields[kMapDefFields] = {};
+      if (symbol.st_value % def_size ||
+          symbol.st_value + def_size > data.size()) {
+        return MakeStatus(EINVAL, "bad map definition");
+      }
+      std::memcpy(fields, data.data() + symbol.st_value,
+                  std::min(def_size, sizeof(fields)));
+      MapSpec map;
+      map.name = std::string(
+          GetString(sections_[symtab_->sh_link], symbol.st_name));
+      map.type = fields[0];
+      map.key_size = fields[1];
+      map.value_size = fields[2];
+      map.max_entries = fields[3];
+      map.flags = fields[4];
+      map_offsets_[symbol.st_value] = object_.maps.size();
+      object_.maps.push_back(std::move(map));
+    }
+    return error::kOkStatus;
+  }
+
+  error::Status Relocate(const Elf64_Shdr& section, Code* const code) {
+    const std::string_view data = GetData(section);
+    for (size_t offset = 0; offset + sizeof(Elf64_Rel) <= data.size();
+         offset += sizeof(Elf64_Rel)) {
+      Elf64_Rel rel;
+      Read(data, offset, &rel);
+      const size_t index = rel.r_offset / sizeof(bpf_insn);
+      if (rel.r_offset % sizeof(bpf_insn) || index >= code->insns.size()) {
+        return MakeStatus(EINVAL, "bad relocation offset");
+      }
+      Elf64_Sym symbol;
+      RETURN_IF_ERROR(GetSymbol(ELF64_R_SYM(rel.r_info), &symbol));
+      if (symbol.st_shndx >= sections_.size()) {
+        return MakeStatus(EINVAL, "relocation against an undefined symbol");
+      }
+      const std::string_view target = GetName(sections_[symbol.st_shndx]);
+      bpf_insn& insn = code->insns[index];
+      if (IsMapLoad(insn) && maps_index_ &&
+          symbol.st_shndx == maps_index_) {
+        const auto map = map_offsets_.find(symbol.st_value + insn.imm);
+        if (map == map_offsets_.end() || index + 1 >= code->insns.size()) {
+          return MakeStatus(EINVAL, "relocation against no map");
+        }
+        insn.src_reg = BPF_PSEUDO_MAP_FD;
+        insn.imm = 0;
+        code->map_references[index] = map->second;
+      } else if (IsMapLoad(insn) && IsGlobalData(target)) {
+        return MakeStatus(ENOTSUP, "global data is not supported");
+      } else if (IsPseudoCall(insn) && target == ".text") {
+        // The immediate is relative to the symbol, a function or the
+        // section itself.
+        const int64_t callee =
+            static_cast<int64_t>(symbol.st_value / sizeof(bpf_insn)) +
+            insn.imm + 1;
+        if (callee < 0) {
+          return MakeStatus(EINVAL, "bad call relocation");
+        }
+        code->text_calls.emplace_back(index, callee);
+      } else {
+        return MakeStatus(EINVAL, "unsupported relocation");
+      }
+    }
+    return error::kOkStatus;
+  }
+
+  // Make 'program' out of 'code', appending 'text' if it calls functions
+  // there.
+  error::Status Link(const Code* const text, const Code* const code,
+                     ProgramSpec* const program) const {
+    program->insns = code->insns;
+    program->map_references = code->map_references;
+    if (code->text_calls.empty()) {
+      return error::kOkStatus;
+    }
+    if (!text) {
+      return MakeStatus(EINVAL, "call into a missing .text section");
+    }
+    const size_t base = program->insns.size();
+    program->insns.insert(program->insns.end(), text->insns.begin(),
+                          text->insns.end());
+    for (const auto& [index, map] : text->map_references) {
+      program->map_references[base + index] = map;
+    }
+    for (const auto& [index, callee] : code->text_calls) {
+      program->insns[index].imm = base + callee - index - 1;
+    }
+    for (const auto& [index, callee] : text->text_calls) {
+      program->insns[base + index].imm = callee - index - 1;
+    }
+    return error::kOkStatus;
+  }
+
+  const std::string_view elf_;
+  Elf64_Ehdr header_;
+  std::vector<Elf64_Shdr> sections_;
+  const Elf64_Shdr* symtab_ = nullptr;
+  size_t maps_index_ = 0;
+  // Index in object_.maps of the map defined at each offset of "maps".
+  std::map<uint64_t, size_t> map_offsets_;
+  Object object_;
+};
+
+}  // namespace
+
+error::StatusOr<Object> ParseObject(const std::string_view elf) {
+  return Parser(elf).Parse();
+}
+
+}  // namespace vm
@@ -0,0 +1,60 @@
+#ifndef LIB_VM_ELF_H_
+#define LIB_VM_ELF_H_
+
+#include <linux/bpf.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lib/error/status_or.h"
+
+namespace vm {
+
+// A map definition, a struct bpf_map_def of the "maps" section.
+struct MapSpec {
+  std::string name;
+  uint32_t type = 0;
+  uint32_t key_size = 0;
+  uint32_t value_size = 0;
+  uint32_t max_entries = 0;
+  uint32_t flags = 0;
+};
+
+// A program, the code of an executable section.
+struct ProgramSpec {
+  // Section of the program, e.g. "xdp", which programs are looked up by.
+  std::string section;
+  // The instructions of the program, followed by those of the ".text"
+  // section if it calls functions there.
+  std::vector<bpf_insn> insns;
+  // The map each BPF_LD | BPF_IMM | BPF_DW instruction referring to one
+  // loads, by instruction index: an index in Object::maps.
+  std::map<size_t, size_t> map_references;
+};
+
+// The contents of an eBPF ELF object, as built by cc_ebpf().
+struct Object {
+  std::vector<MapSpec> maps;
+  // Programs in section order, without the ".text" section: it holds the
+  // functions programs call, if any.
+  std::vector<ProgramSpec> programs;
+  // Of the "license" section, e.g. "GPL": the kernel only lets GPL
+  // compatible programs call some helpers.
+  std::string license;
+};
+
+// Parse 'elf', a relocatable eBPF ELF object, the way the libbpf loader
+// does: maps come from the "maps" section, programs from executable
+// sections, and relocations of programs are resolved against both.
+//
+// Fails with EINVAL if malformed, and with ENOTSUP on objects using what
+// the libbpf we build against does not support either: BTF defined maps
+// (".maps") and global data (".data", ".bss", ".rodata").
+error::StatusOr<Object> ParseObject(std::string_view elf);
+
+}  // namespace vm
+
+#endif  // LIB_VM_ELF_H_
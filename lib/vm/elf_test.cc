@@ -0,0 +1,51 @@
+#include "lib/vm/elf.h"
+
+#include <linux/bpf.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "lib/ebpf/counter.h"
+#include "lib/posix/errno.h"
+
+namespace vm {
+namespace {
+
+TEST(ParseObjectTest, ParsesMapsAndPrograms) {
+  const auto object_or = ParseObject(ebpf::counter);
+  ASSERT_TRUE(IsOk(object_or)) << GetText(GetStatus(object_or));
+  const Object& object = GetValue(object_or);
+
+  ASSERT_EQ(1, object.maps.size());
+  EXPECT_EQ("packets", object.maps[0].name);
+  EXPECT_EQ(BPF_MAP_TYPE_ARRAY, object.maps[0].type);
+  EXPECT_EQ(sizeof(uint32_t), object.maps[0].key_size);
+  EXPECT_EQ(sizeof(uint64_t), object.maps[0].value_size);
+  EXPECT_EQ(1, object.maps[0].max_entries);
+
+  ASSERT_EQ(1, object.programs.size());
+  const ProgramSpec& program = object.programs[0];
+  EXPECT_EQ("xdp", program.section);
+  ASSERT_EQ(1, program.map_references.size());
+  const auto [index, map] = *program.map_references.begin();
+  EXPECT_EQ(0, map);
+  ASSERT_LT(index + 1, program.insns.size());
+  EXPECT_EQ(BPF_LD | BPF_IMM | BPF_DW, program.insns[index].code);
+  EXPECT_EQ(BPF_PSEUDO_MAP_FD, program.insns[index].src_reg);
+  EXPECT_EQ(BPF_JMP | BPF_EXIT, program.insns.back().code);
+  EXPECT_EQ("GPL", object.license);
+}
+
+TEST(ParseObjectTest, FailsOnOtherFiles) {
+  EXPECT_TRUE(posix::IsErrno(GetStatus(ParseObject("")), EINVAL));
+  EXPECT_TRUE(
+      posix::IsErrno(GetStatus(ParseObject("not an ELF object")), EINVAL));
+}
+
+TEST(ParseObjectTest, FailsOnTruncatedObjects) {
+  const std::string truncated(ebpf::counter.substr(0, 128));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(ParseObject(truncated)), EINVAL));
+}
+
+}  // namespace
+}  // namespace vm
@@ -0,0 +1,433 @@
+#include "lib/vm/helpers.h"
+
+#include <linux/bpf.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "lib/posix/errno.h"
+#include "lib/vm/map.h"
+#include "lib/vm/run.h"
+
+namespace vm {
+namespace {
+
+using impl::Run;
+using impl::XdpContext;
+
+// Flags of bpf_perf_event_output().
+constexpr uint64_t kIndexMask = 0xffffffffULL;
+constexpr uint64_t kCurrentCpu = kIndexMask;
+constexpr uint64_t kContextLengthMask = 0xfffffULL << 32;
+
+// Flags of bpf_ringbuf_query().
+constexpr uint64_t kRingbufAvailData = 0;
+constexpr uint64_t kRingbufRingSize = 1;
+constexpr uint64_t kRingbufProdPos = 3;
+
+// Smallest packet bpf_xdp_adjust_head() and bpf_xdp_adjust_tail() leave.
+constexpr uintptr_t kEthernetHeaderSize = 14;
+// Largest metadata bpf_xdp_adjust_meta() makes room for.
+constexpr uintptr_t kMaxMetadataSize = 32;
+// Largest buffers bpf_csum_diff() takes.
+constexpr uint64_t kMaxChecksumSize = 512;
+
+Map* ToMap(const uint64_t map) { return reinterpret_cast<Map*>(map); }
+
+void* ToPointer(const uint64_t pointer) {
+  return reinterpret_cast<void*>(pointer);
+}
+
+uint64_t FromPointer(const void* const pointer) {
+  return reinterpret_cast<uint64_t>(pointer);
+}
+
+// Return whether the program may pass helpers the 'size' bytes at 'address',
+// recording a fault if not.
+bool CheckAccess(Run* const run, const uint64_t address, const uint64_t size,
+                 const bool write = false) {
+  if (!run->check_memory || size == 0 ||
+      impl::IsAccessible(*run, address, size, write)) {
+    return true;
+  }
+  impl::SetAccessFault(run, address, size);
+  return false;
+}
+
+// Let the program access the 'size' bytes at 'pointer', returned by a
+// helper.
+void AddRegion(Run* const run, const void* const pointer,
+               const uint64_t size) {
+  if (run->check_memory && pointer) {
+    const auto begin = FromPointer(pointer);
+    run->regions.push_back({begin, begin + size});
+  }
+}
+
+void RemoveRegion(Run* const run, const void* const pointer) {
+  const auto begin = FromPointer(pointer);
+  const auto region =
+      std::find_if(run->regions.begin(), run->regions.end(),
+                   [begin](const impl::Region& r) { return r.begin == begin; });
+  if (region != run->regions.end()) {
+    run->regions.erase(region);
+  }
+}
+
+uint8_t* GetData(const XdpContext& ctx) {
+  return reinterpret_cast<uint8_t*>(uintptr_t{ctx.data});
+}
+
+uint64_t MapLookupElem(const uint64_t map, const uint64_t key, uint64_t,
+                       uint64_t, uint64_t) {
+  Run* const run = impl::current_run;
+  if (!CheckAccess(run, key, ToMap(map)->GetSpec().key_size)) {
+    return 0;
+  }
+  void* const value = ToMap(map)->LookupElement(ToPointer(key));
+  AddRegion(run, value, ToMap(map)->GetSpec().value_size);
+  return FromPointer(value);
+}
+
+uint64_t MapUpdateElem(const uint64_t map, const uint64_t key,
+                       const uint64_t value, const uint64_t flags, uint64_t) {
+  Run* const run = impl::current_run;
+  if (!CheckAccess(run, key, ToMap(map)->GetSpec().key_size) ||
+      !CheckAccess(run, value, ToMap(map)->GetSpec().value_size)) {
+    return -EFAULT;
+  }
+  return ToMap(map)->UpdateElement(ToPointer(key), ToPointer(value), flags);
+}
+
+uint64_t MapDeleteElem(const uint64_t map, const uint64_t key, uint64_t,
+                       uint64_t, uint64_t) {
+  if (!CheckAccess(impl::current_run, key, ToMap(map)->GetSpec().key_size)) {
+    return -EFAULT;
+  }
+  return ToMap(map)->DeleteElement(ToPointer(key));
+}
+
+uint64_t KtimeGetNs(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * uint64_t{1000000000} + now.tv_nsec;
+}
+
+// Print 'fmt' with up to 3 integer arguments to stderr. Supports the
+// conversions the kernel does but for %s and %p: %d, %i, %u and %x with the
+// l and ll modifiers, and %%.
+uint64_t TracePrintk(const uint64_t fmt, const uint64_t fmt_size,
+                     const uint64_t arg1, const uint64_t arg2,
+                     const uint64_t arg3) {
+  if (!CheckAccess(impl::current_run, fmt, fmt_size)) {
+    return -EFAULT;
+  }
+  const char* const format = static_cast<const char*>(ToPointer(fmt));
+  const std::string_view text(format, strnlen(format, fmt_size));
+  const uint64_t args[] = {arg1, arg2, arg3};
+  size_t used = 0;
+  std::string out;
+  for (size_t i = 0; i < text.size(); ++i) {
+    if (text[i] != '%' || i + 1 == text.size()) {
+      out += text[i];
+      continue;
+    }
+    size_t longs = 0;
+    while (i + 1 < text.size() && text[i + 1] == 'l') {
+      ++longs;
+      ++i;
+    }
+    const char conversion = i + 1 < text.size() ? text[++i] : '\0';
+    if (conversion == '%') {
+      out += '%';
+      continue;
+    }
+    if (used == 3 || !std::strchr("diux", conversion)) {
+      return -EINVAL;
+    }
+    uint64_t arg = args[used++];
+    if (longs == 0) {
+      arg = conversion == 'd' || conversion == 'i'
+                ? static_cast<uint64_t>(static_cast<int32_t>(arg))
+                : static_cast<uint32_t>(arg);
+    }
+    char number[32];
+    if (conversion == 'x') {
+      snprintf(number, sizeof(number), "%llx",
+               static_cast<unsigned long long>(arg));
+    } else if (conversion == 'u') {
+      snprintf(number, sizeof(number), "%llu",
+               static_cast<unsigned long long>(arg));
+    } else {
+      snprintf(number, sizeof(number), "%lld", static_cast<long long>(arg));
+    }
+    out += number;
+  }
+  std::cerr << out << std::flush;
+  return out.size();
+}
+
+uint64_t GetPrandomU32(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t) {
+  thread_local std::mt19937 random(std::random_device{}());
+  return static_cast<uint32_t>(random());
+}
+
+uint64_t GetSmpProcessorId(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t) {
+  return 0;
+}
+
+uint64_t Redirect(const uint64_t ifindex, const uint64_t flags, uint64_t,
+                  uint64_t, uint64_t) {
+  if (flags) {
+    return XDP_ABORTED;
+  }
+  Run* const run = impl::current_run;
+  run->redirect_map = nullptr;
+  run->redirect_key = ifindex;
+  return XDP_REDIRECT;
+}
+
+// Since linux 5.3: without an element for 'key', return the lower bits of
+// 'flags' as verdict.
+uint64_t RedirectMap(const uint64_t map, const uint64_t key,
+                     const uint64_t flags, uint64_t, uint64_t) {
+  if (flags > XDP_TX) {
+    return XDP_ABORTED;
+  }
+  const uint32_t index = key;
+  if (!ToMap(map)->LookupElement(&index)) {
+    return flags;
+  }
+  Run* const run = impl::current_run;
+  run->redirect_map = ToMap(map);
+  run->redirect_key = index;
+  return XDP_REDIRECT;
+}
+
+// Only the current CPU, 0, has a perf event.
+uint64_t PerfEventOutput(uint64_t, const uint64_t map, const uint64_t flags,
+                         const uint64_t data, const uint64_t size) {
+  Run* const run = impl::current_run;
+  const uint64_t index = flags & kIndexMask;
+  const uint64_t ctx_size = (flags & kContextLengthMask) >> 32;
+  if (flags & ~(kIndexMask | kContextLengthMask)) {
+    return -EINVAL;
+  }
+  if (index != kCurrentCpu && index != 0) {
+    return -ENOENT;
+  }
+  if (!CheckAccess(run, data, size)) {
+    return -EFAULT;
+  }
+  const XdpContext& ctx = *run->ctx;
+  if (ctx_size > ctx.data_end - ctx.data) {
+    return -EFAULT;
+  }
+  std::vector<uint8_t> record(size + ctx_size);
+  std::memcpy(record.data(), ToPointer(data), size);
+  std::memcpy(record.data() + size, GetData(ctx), ctx_size);
+  return ToMap(map)->OutputRecord(record.data(), record.size());
+}
+
+// Fold the 64 bit sum of 32 bit words 'sum' into 32 bits, as the kernel's
+// csum_partial().
+uint32_t Fold(uint64_t sum) {
+  while (sum >> 32) {
+    sum = (sum & 0xffffffff) + (sum >> 32);
+  }
+  return sum;
+}
+
+uint64_t CsumDiff(const uint64_t from, const uint64_t from_size,
+                  const uint64_t to, const uint64_t to_size,
+                  const uint64_t seed) {
+  if (from_size % 4 || to_size % 4 || from_size > kMaxChecksumSize ||
+      to_size > kMaxChecksumSize) {
+    return -EINVAL;
+  }
+  Run* const run = impl::current_run;
+  if (!CheckAccess(run, from, from_size) || !CheckAccess(run, to, to_size)) {
+    return -EFAULT;
+  }
+  uint64_t sum = static_cast<uint32_t>(seed);
+  for (uint64_t i = 0; i < from_size; i += 4) {
+    uint32_t word;
+    std::memcpy(&word, static_cast<const uint8_t*>(ToPointer(from)) + i, 4);
+    sum += static_cast<uint32_t>(~word);
+  }
+  for (uint64_t i = 0; i < to_size; i += 4) {
+    uint32_t word;
+    std::memcpy(&word, static_cast<const uint8_t*>(ToPointer(to)) + i, 4);
+    sum += word;
+  }
+  return Fold(sum);
+}
+
+uint64_t XdpAdjustHead(uint64_t, const uint64_t delta, uint64_t, uint64_t,
+                       uint64_t) {
+  Run* const run = impl::current_run;
+  XdpContext& ctx = *run->ctx;
+  const uintptr_t frame_end =
+      reinterpret_cast<uintptr_t>(run->buffer_begin) + impl::kXdpFrameSize;
+  const uintptr_t metadata_size = ctx.data - ctx.data_meta;
+  const uintptr_t data = ctx.data + static_cast<int32_t>(delta);
+  if (data < frame_end + metadata_size ||
+      data + kEthernetHeaderSize > ctx.data_end) {
+    return -EINVAL;
+  }
+  if (metadata_size) {
+    std::memmove(reinterpret_cast<uint8_t*>(data - metadata_size),
+                 reinterpret_cast<uint8_t*>(uintptr_t{ctx.data_meta}),
+                 metadata_size);
+  }
+  ctx.data_meta += static_cast<int32_t>(delta);
+  ctx.data = data;
+  return 0;
+}
+
+uint64_t XdpAdjustMeta(uint64_t, const uint64_t delta, uint64_t, uint64_t,
+                       uint64_t) {
+  Run* const run = impl::current_run;
+  XdpContext& ctx = *run->ctx;
+  const uintptr_t frame_end =
+      reinterpret_cast<uintptr_t>(run->buffer_begin) + impl::kXdpFrameSize;
+  const uintptr_t meta = ctx.data_meta + static_cast<int32_t>(delta);
+  if (meta < frame_end || meta > ctx.data) {
+    return -EINVAL;
+  }
+  const uintptr_t metadata_size = ctx.data - meta;
+  if (metadata_size > kMaxMetadataSize || metadata_size % 4) {
+    return -EACCES;
+  }
+  ctx.data_meta = meta;
+  return 0;
+}
+
+uint64_t XdpAdjustTail(uint64_t, const uint64_t delta, uint64_t, uint64_t,
+                       uint64_t) {
+  Run* const run = impl::current_run;
+  XdpContext& ctx = *run->ctx;
+  const uintptr_t data_end = ctx.data_end + static_cast<int32_t>(delta);
+  if (data_end > reinterpret_cast<uintptr_t>(run->buffer_end) ||
+      data_end < ctx.data + kEthernetHeaderSize) {
+    return -EINVAL;
+  }
+  if (data_end > ctx.data_end) {
+    std::memset(reinterpret_cast<uint8_t*>(uintptr_t{ctx.data_end}), 0,
+                data_end - ctx.data_end);
+  }
+  ctx.data_end = data_end;
+  return 0;
+}
+
+uint64_t FibLookup(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t) {
+  return kFibLookupNotForwarded;
+}
+
+uint64_t RingbufOutput(const uint64_t map, const uint64_t data,
+                       const uint64_t size, uint64_t, uint64_t) {
+  if (!CheckAccess(impl::current_run, data, size)) {
+    return -EFAULT;
+  }
+  return ToMap(map)->OutputRecord(ToPointer(data), size);
+}
+
+uint64_t RingbufReserve(const uint64_t map, const uint64_t size,
+                        const uint64_t flags, uint64_t, uint64_t) {
+  Run* const run = impl::current_run;
+  Map* const ringbuf = ToMap(map);
+  uint64_t reserved = ringbuf->GetRecordBytes();
+  for (const auto& reservation : run->reservations) {
+    if (reservation.map == ringbuf) {
+      reserved += (reservation.size + 15) / 8 * 8;
+    }
+  }
+  if (flags || ringbuf->GetSpec().type != kMapTypeRingbuf ||
+      reserved + (size + 15) / 8 * 8 > ringbuf->GetSpec().max_entries) {
+    return 0;
+  }
+  impl::Reservation reservation;
+  reservation.map = ringbuf;
+  reservation.data = std::make_unique<uint8_t[]>(size);
+  reservation.size = size;
+  void* const data = reservation.data.get();
+  run->reservations.push_back(std::move(reservation));
+  AddRegion(run, data, size);
+  return FromPointer(data);
+}
+
+// Submit or discard the record reserved at 'data'.
+uint64_t ReleaseRecord(const uint64_t data, const bool submit) {
+  Run* const run = impl::current_run;
+  const auto reservation = std::find_if(
+      run->reservations.begin(), run->reservations.end(),
+      [data](const impl::Reservation& r) {
+        return FromPointer(r.data.get()) == data;
+      });
+  if (reservation == run->reservations.end()) {
+    impl::SetAccessFault(run, data, 0);
+    return 0;
+  }
+  if (submit) {
+    reservation->map->OutputRecord(reservation->data.get(), reservation->size);
+  }
+  RemoveRegion(run, ToPointer(data));
+  run->reservations.erase(reservation);
+  return 0;
+}
+
+uint64_t RingbufSubmit(const uint64_t data, uint64_t, uint64_t, uint64_t,
+                       uint64_t) {
+  return ReleaseRecord(data, true);
+}
+
+uint64_t RingbufDiscard(const uint64_t data, uint64_t, uint64_t, uint64_t,
+                        uint64_t) {
+  return ReleaseRecord(data, false);
+}
+
+uint64_t RingbufQuery(const uint64_t map, const uint64_t flags, uint64_t,
+                      uint64_t, uint64_t) {
+  switch (flags) {
+    case kRingbufAvailData:
+    case kRingbufProdPos:
+      return ToMap(map)->GetRecordBytes();
+    case kRingbufRingSize:
+      return ToMap(map)->GetSpec().max_entries;
+  }
+  return 0;
+}
+
+}  // namespace
+
+HelperTable GetBuiltinHelpers() {
+  HelperTable helpers = {};
+  helpers[BPF_FUNC_map_lookup_elem] = MapLookupElem;
+  helpers[BPF_FUNC_map_update_elem] = MapUpdateElem;
+  helpers[BPF_FUNC_map_delete_elem] = MapDeleteElem;
+  helpers[BPF_FUNC_ktime_get_ns] = KtimeGetNs;
+  helpers[BPF_FUNC_trace_printk] = TracePrintk;
+  helpers[BPF_FUNC_get_prandom_u32] = GetPrandomU32;
+  helpers[BPF_FUNC_get_smp_processor_id] = GetSmpProcessorId;
+  helpers[BPF_FUNC_redirect] = Redirect;
+  helpers[BPF_FUNC_perf_event_output] = PerfEventOutput;
+  helpers[BPF_FUNC_csum_diff] = CsumDiff;
+  helpers[BPF_FUNC_xdp_adjust_head] = XdpAdjustHead;
+  helpers[BPF_FUNC_redirect_map] = RedirectMap;
+  helpers[BPF_FUNC_xdp_adjust_meta] = XdpAdjustMeta;
+  helpers[kHelperXdpAdjustTail] = XdpAdjustTail;
+  helpers[kHelperFibLookup] = FibLookup;
+  helpers[kHelperRingbufOutput] = RingbufOutput;
+  helpers[kHelperRingbufReserve] = RingbufReserve;
+  helpers[kHelperRingbufSubmit] = RingbufSubmit;
+  helpers[kHelperRingbufDiscard] = RingbufDiscard;
+  helpers[kHelperRingbufQuery] = RingbufQuery;
+  return helpers;
+}
+
+}  // namespace vm
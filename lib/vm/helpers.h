@@ -0,0 +1,46 @@
+#ifndef LIB_VM_HELPERS_H_
+#define LIB_VM_HELPERS_H_
+
+#include <array>
+#include <cstdint>
+
+namespace vm {
+
+// A helper programs call, with its arguments in r1 to r5 and its result in
+// r0; pointers are passed as they are. See 'man 7 bpf-helpers'.
+using Helper = uint64_t (*)(uint64_t, uint64_t, uint64_t, uint64_t,
+                            uint64_t);
+
+// Helper ids are below this.
+constexpr uint32_t kMaxHelpers = 256;
+
+// Helpers by id, nullptr for those missing.
+using HelperTable = std::array<Helper, kMaxHelpers>;
+
+// Helper ids of linux 4.18+ missing from the uapi headers we build against.
+constexpr uint32_t kHelperXdpAdjustTail = 65;
+constexpr uint32_t kHelperFibLookup = 69;
+constexpr uint32_t kHelperRingbufOutput = 130;
+constexpr uint32_t kHelperRingbufReserve = 131;
+constexpr uint32_t kHelperRingbufSubmit = 132;
+constexpr uint32_t kHelperRingbufDiscard = 133;
+constexpr uint32_t kHelperRingbufQuery = 134;
+
+// Return code of bpf_fib_lookup() for packets the stack must handle.
+constexpr uint64_t kFibLookupNotForwarded = 4;
+
+// Return the helpers built in, those xdp programs use most:
+//  - maps: map_lookup_elem, map_update_elem, map_delete_elem.
+//  - packets: xdp_adjust_head, xdp_adjust_meta, xdp_adjust_tail, csum_diff.
+//  - verdicts: redirect, redirect_map. tail_call is built into the engines.
+//  - events: perf_event_output, ringbuf_output, ringbuf_reserve,
+//    ringbuf_submit, ringbuf_discard, ringbuf_query.
+//  - misc: ktime_get_ns, get_prandom_u32, get_smp_processor_id (always 0),
+//    trace_printk (to stderr).
+//  - fib_lookup, always returning kFibLookupNotForwarded: replace it to give
+//    programs routes.
+HelperTable GetBuiltinHelpers();
+
+}  // namespace vm
+
+#endif  // LIB_VM_HELPERS_H_
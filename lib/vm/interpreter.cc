@@ -0,0 +1,296 @@
+#include "lib/vm/interpreter.h"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#include "lib/posix/errno.h"
+
+namespace vm {
+namespace impl {
+namespace {
+
+// Registers a function saves on calls: r6 to r9 of its caller, and r10.
+struct Frame {
+  size_t return_pc;
+  std::array<uint64_t, 5> saved;
+};
+
+uint64_t GetSize(const uint8_t code) {
+  switch (BPF_SIZE(code)) {
+    case BPF_B:
+      return 1;
+    case BPF_H:
+      return 2;
+    case BPF_W:
+      return 4;
+  }
+  return 8;
+}
+
+uint64_t Load(const uint64_t address, const uint64_t size) {
+  switch (size) {
+    case 1: {
+      uint8_t value;
+      std::memcpy(&value, reinterpret_cast<const void*>(address), 1);
+      return value;
+    }
+    case 2: {
+      uint16_t value;
+      std::memcpy(&value, reinterpret_cast<const void*>(address), 2);
+      return value;
+    }
+    case 4: {
+      uint32_t value;
+      std::memcpy(&value, reinterpret_cast<const void*>(address), 4);
+      return value;
+    }
+  }
+  uint64_t value;
+  std::memcpy(&value, reinterpret_cast<const void*>(address), 8);
+  return value;
+}
+
+void Store(const uint64_t address, const uint64_t size, const uint64_t value) {
+  switch (size) {
+    case 1: {
+      const uint8_t narrow = value;
+      std::memcpy(reinterpret_cast<void*>(address), &narrow, 1);
+      return;
+    }
+    case 2: {
+      const uint16_t narrow = value;
+      std::memcpy(reinterpret_cast<void*>(address), &narrow, 2);
+      return;
+    }
+    case 4: {
+      const uint32_t narrow = value;
+      std::memcpy(reinterpret_cast<void*>(address), &narrow, 4);
+      return;
+    }
+  }
+  std::memcpy(reinterpret_cast<void*>(address), &value, 8);
+}
+
+uint64_t Alu64(const uint8_t op, const uint64_t dst, const uint64_t src) {
+  switch (op) {
+    case BPF_ADD:
+      return dst + src;
+    case BPF_SUB:
+      return dst - src;
+    case BPF_MUL:
+      return dst * src;
+    case BPF_DIV:
+      return src ? dst / src : 0;
+    case BPF_OR:
+      return dst | src;
+    case BPF_AND:
+      return dst & src;
+    case BPF_LSH:
+      return dst << (src & 63);
+    case BPF_RSH:
+      return dst >> (src & 63);
+    case BPF_NEG:
+      return -dst;
+    case BPF_MOD:
+      return src ? dst % src : dst;
+    case BPF_XOR:
+      return dst ^ src;
+    case BPF_MOV:
+      return src;
+    case BPF_ARSH:
+      return static_cast<int64_t>(dst) >> (src & 63);
+  }
+  return dst;
+}
+
+uint32_t Alu32(const uint8_t op, const uint32_t dst, const uint32_t src) {
+  switch (op) {
+    case BPF_LSH:
+      return dst << (src & 31);
+    case BPF_RSH:
+      return dst >> (src & 31);
+    case BPF_ARSH:
+      return static_cast<int32_t>(dst) >> (src & 31);
+  }
+  return Alu64(op, dst, src);
+}
+
+uint64_t Swap(const int32_t bits, const uint64_t value, const bool to_big) {
+  switch (bits) {
+    case 16:
+      return to_big ? __builtin_bswap16(value) : static_cast<uint16_t>(value);
+    case 32:
+      return to_big ? __builtin_bswap32(value) : static_cast<uint32_t>(value);
+  }
+  return to_big ? __builtin_bswap64(value) : value;
+}
+
+template <typename U, typename S>
+bool Compare(const uint8_t op, const U dst, const U src) {
+  switch (op) {
+    case BPF_JEQ:
+      return dst == src;
+    case BPF_JGT:
+      return dst > src;
+    case BPF_JGE:
+      return dst >= src;
+    case BPF_JSET:
+      return dst & src;
+    case BPF_JNE:
+      return dst != src;
+    case BPF_JSGT:
+      return static_cast<S>(dst) > static_cast<S>(src);
+    case BPF_JSGE:
+      return static_cast<S>(dst) >= static_cast<S>(src);
+    case BPF_JLT:
+      return dst < src;
+    case BPF_JLE:
+      return dst <= src;
+    case BPF_JSLT:
+      return static_cast<S>(dst) < static_cast<S>(src);
+    case BPF_JSLE:
+      return static_cast<S>(dst) <= static_cast<S>(src);
+  }
+  return true;  // BPF_JA.
+}
+
+}  // namespace
+
+uint64_t Interpret(const std::vector<bpf_insn>& insns,
+                   const HelperTable& helpers, void* const ctx,
+                   Run* const run) {
+  alignas(8) std::array<uint8_t, kStackSize * kMaxCallDepth> stack;
+  const auto stack_begin = reinterpret_cast<uintptr_t>(stack.data());
+  run->regions.push_back({stack_begin, stack_begin + stack.size()});
+  const size_t regions = run->regions.size() - 1;
+
+  std::array<uint64_t, MAX_BPF_REG> r = {};
+  r[BPF_REG_1] = reinterpret_cast<uint64_t>(ctx);
+  r[BPF_REG_10] = stack_begin + kStackSize;
+  std::vector<Frame> frames;
+
+  // Leave the run with 'rv', forgetting the stack.
+  const auto leave = [&](const uint64_t rv) {
+    run->regions.resize(regions);
+    return rv;
+  };
+  const auto fail = [&](const int e, const char* const text) {
+    if (!IsError(run->fault)) {
+      run->fault = error::Status(posix::MakeCodeFromErrno(e), text);
+    }
+    return leave(0);
+  };
+  const auto access = [&](const uint64_t address, const uint64_t size,
+                          const bool write) {
+    if (IsAccessible(*run, address, size, write)) {
+      return true;
+    }
+    SetAccessFault(run, address, size);
+    return false;
+  };
+
+  for (size_t pc = 0;; ++pc) {
+    if (run->insns_left == 0) {
+      return fail(ELOOP, "instruction limit exceeded");
+    }
+    --run->insns_left;
+
+    const bpf_insn& insn = insns[pc];
+    const uint8_t cls = BPF_CLASS(insn.code);
+    const uint8_t op = BPF_OP(insn.code);
+    uint64_t& dst = r[insn.dst_reg];
+    const bool use_src = BPF_SRC(insn.code) == BPF_X;
+
+    switch (cls) {
+      case BPF_ALU64:
+        dst = Alu64(op, dst,
+                    use_src ? r[insn.src_reg] : static_cast<int64_t>(insn.imm));
+        break;
+
+      case BPF_ALU:
+        if (op == BPF_END) {
+          dst = Swap(insn.imm, dst, use_src);
+        } else {
+          dst = Alu32(op, dst,
+                      use_src ? r[insn.src_reg]
+                              : static_cast<uint32_t>(insn.imm));
+        }
+        break;
+
+      case BPF_JMP:
+      case kClassJmp32:
+        if (op == BPF_CALL) {
+          if (insn.src_reg == BPF_PSEUDO_CALL) {
+            frames.push_back({pc, {r[6], r[7], r[8], r[9], r[10]}});
+            r[BPF_REG_10] += kStackSize;
+            pc += insn.imm;
+            break;
+          }
+          r[BPF_REG_0] = helpers[insn.imm](r[1], r[2], r[3], r[4], r[5]);
+          if (IsError(run->fault)) {
+            return leave(0);
+          }
+          if (insn.imm == BPF_FUNC_tail_call &&
+              static_cast<int64_t>(r[BPF_REG_0]) >= 0) {
+            return leave(r[BPF_REG_0]);
+          }
+        } else if (op == BPF_EXIT) {
+          if (frames.empty()) {
+            return leave(r[BPF_REG_0]);
+          }
+          const Frame& frame = frames.back();
+          std::memcpy(&r[BPF_REG_6], frame.saved.data(), sizeof(frame.saved));
+          pc = frame.return_pc;
+          frames.pop_back();
+        } else {
+          const uint64_t src =
+              use_src ? r[insn.src_reg] : static_cast<int64_t>(insn.imm);
+          const bool taken =
+              cls == BPF_JMP
+                  ? Compare<uint64_t, int64_t>(op, dst, src)
+                  : Compare<uint32_t, int32_t>(op, dst, src);
+          if (taken) {
+            pc += insn.off;
+          }
+        }
+        break;
+
+      case BPF_LD:  // BPF_LD | BPF_IMM | BPF_DW, the only one validated.
+        dst = static_cast<uint32_t>(insn.imm) |
+              static_cast<uint64_t>(insns[pc + 1].imm) << 32;
+        ++pc;
+        break;
+
+      case BPF_LDX: {
+        const uint64_t address = r[insn.src_reg] + insn.off;
+        const uint64_t size = GetSize(insn.code);
+        if (!access(address, size, false)) {
+          return leave(0);
+        }
+        dst = Load(address, size);
+        break;
+      }
+
+      case BPF_ST:
+      case BPF_STX: {
+        const uint64_t address = dst + insn.off;
+        const uint64_t size = GetSize(insn.code);
+        if (!access(address, size, true)) {
+          return leave(0);
+        }
+        const uint64_t value =
+            cls == BPF_ST ? static_cast<int64_t>(insn.imm) : r[insn.src_reg];
+        if (BPF_MODE(insn.code) == BPF_XADD) {
+          Store(address, size, Load(address, size) + value);
+        } else {
+          Store(address, size, value);
+        }
+        break;
+      }
+    }
+  }
+}
+
+}  // namespace impl
+}  // namespace vm
@@ -0,0 +1,24 @@
+#ifndef LIB_VM_INTERPRETER_H_
+#define LIB_VM_INTERPRETER_H_
+
+#include <linux/bpf.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "lib/vm/helpers.h"
+#include "lib/vm/run.h"
+
+namespace vm {
+namespace impl {
+
+// Run 'insns', a validated program, on 'ctx' and return its r0. Checks
+// every memory access and counts instructions against run->insns_left: on
+// a bad access or when out of instructions, sets run->fault and returns 0.
+uint64_t Interpret(const std::vector<bpf_insn>& insns,
+                   const HelperTable& helpers, void* ctx, Run* run);
+
+}  // namespace impl
+}  // namespace vm
+
+#endif  // LIB_VM_INTERPRETER_H_
@@ -0,0 +1,643 @@
+#include "lib/vm/jit.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+#include "lib/vm/run.h"
+
+namespace vm {
+namespace impl {
+
+#if defined(__x86_64__)
+
+namespace {
+
+// x86-64 registers, by encoding.
+enum Reg : uint8_t {
+  kRax = 0,
+  kRcx = 1,
+  kRdx = 2,
+  kRbx = 3,
+  kRsp = 4,
+  kRbp = 5,
+  kRsi = 6,
+  kRdi = 7,
+  kR8 = 8,
+  kR10 = 10,
+  kR11 = 11,
+  kR12 = 12,
+  kR13 = 13,
+  kR14 = 14,
+  kR15 = 15,
+};
+
+// The register of each eBPF register. r1 to r5 are those of arguments, and
+// r6 to r10 callee saved ones, as in the kernel JIT. r12 keeps the stack
+// pointer of the program, for tail calls to return from any function; r10
+// and r11 are scratch.
+constexpr Reg kRegs[MAX_BPF_REG] = {kRax, kRdi, kRsi, kRdx, kRcx, kR8,
+                                    kRbx, kR13, kR14, kR15, kRbp};
+constexpr Reg kBase = kR12;
+constexpr Reg kScratch = kR10;
+constexpr Reg kAux = kR11;
+
+// Bytes below the callee saved registers of the program: its stack, and
+// padding to keep calls 16-byte aligned.
+constexpr int32_t kFrameSize = kStackSize + 8;
+
+// Condition codes of Jcc.
+enum Condition : uint8_t {
+  kBelow = 0x2,
+  kAboveOrEqual = 0x3,
+  kEqual = 0x4,
+  kNotEqual = 0x5,
+  kBelowOrEqual = 0x6,
+  kAbove = 0x7,
+  kSign = 0x8,
+  kNotSign = 0x9,
+  kLess = 0xc,
+  kGreaterOrEqual = 0xd,
+  kLessOrEqual = 0xe,
+  kGreater = 0xf,
+};
+
+// Opcodes of the ALU instructions of the "op r/m, r" form, and extensions of
+// their "op r/m, imm32" form.
+struct AluOpcode {
+  uint8_t reg;
+  uint8_t imm;
+};
+constexpr AluOpcode kAdd = {0x01, 0};
+constexpr AluOpcode kOr = {0x09, 1};
+constexpr AluOpcode kAnd = {0x21, 4};
+constexpr AluOpcode kSub = {0x29, 5};
+constexpr AluOpcode kXor = {0x31, 6};
+constexpr AluOpcode kCmp = {0x39, 7};
+
+class Assembler {
+ public:
+  const std::vector<uint8_t>& GetCode() const { return code_; }
+  size_t GetSize() const { return code_.size(); }
+
+  void Byte(const uint8_t byte) { code_.push_back(byte); }
+
+  void Imm32(const uint32_t imm) {
+    for (int i = 0; i < 4; ++i) {
+      Byte(imm >> (8 * i));
+    }
+  }
+
+  // Emit a REX prefix if needed: for 64-bit operands, registers r8 to r15,
+  // or with 'byte_regs' the low bytes of rsp, rbp, rsi and rdi.
+  void Rex(const bool wide, const uint8_t reg, const uint8_t rm,
+           const bool byte_regs = false) {
+    const uint8_t rex =
+        0x40 | wide << 3 | (reg >> 3) << 2 | rm >> 3;
+    if (rex != 0x40 || (byte_regs && (reg >= 4 || rm >= 4))) {
+      Byte(rex);
+    }
+  }
+
+  void ModRm(const uint8_t mod, const uint8_t reg, const uint8_t rm) {
+    Byte(mod << 6 | (reg & 7) << 3 | (rm & 7));
+  }
+
+  // ModRM of [base + disp32].
+  void Memory(const uint8_t reg, const Reg base, const int32_t disp) {
+    ModRm(2, reg, base);
+    if ((base & 7) == kRsp) {
+      Byte(0x24);
+    }
+    Imm32(disp);
+  }
+
+  // 'opcode' with 'reg' and the register 'rm'.
+  void RegReg(const bool wide, const uint8_t opcode, const uint8_t reg,
+              const uint8_t rm) {
+    Rex(wide, reg, rm);
+    Byte(opcode);
+    ModRm(3, reg, rm);
+  }
+
+  void Alu(const bool wide, const AluOpcode op, const Reg dst, const Reg src) {
+    RegReg(wide, op.reg, src, dst);
+  }
+
+  void Alu(const bool wide, const AluOpcode op, const Reg dst,
+           const int32_t imm) {
+    RegReg(wide, 0x81, op.imm, dst);
+    Imm32(imm);
+  }
+
+  void Mov(const bool wide, const Reg dst, const Reg src) {
+    RegReg(wide, 0x89, src, dst);
+  }
+
+  // Set 'dst' to 'imm', sign extended if 'wide' and zero extended otherwise.
+  void Mov(const bool wide, const Reg dst, const int32_t imm) {
+    if (wide) {
+      RegReg(true, 0xc7, 0, dst);
+    } else {
+      Rex(false, 0, dst);
+      Byte(0xb8 + (dst & 7));
+    }
+    Imm32(imm);
+  }
+
+  void Mov64(const Reg dst, const uint64_t imm) {
+    Rex(true, 0, dst);
+    Byte(0xb8 + (dst & 7));
+    Imm32(imm);
+    Imm32(imm >> 32);
+  }
+
+  // "op r/m" instructions of opcode 0xf7: test with an immediate (0), neg (3)
+  // and div (6); or, for 'opcode' 0xd3, shifts by cl.
+  void Unary(const bool wide, const uint8_t opcode, const uint8_t ext,
+             const Reg dst) {
+    RegReg(wide, opcode, ext, dst);
+  }
+
+  void Shift(const bool wide, const uint8_t ext, const Reg dst,
+             const uint8_t count) {
+    RegReg(wide, 0xc1, ext, dst);
+    Byte(count);
+  }
+
+  void Imul(const bool wide, const Reg dst, const Reg src) {
+    Rex(wide, dst, src);
+    Byte(0x0f);
+    Byte(0xaf);
+    ModRm(3, dst, src);
+  }
+
+  void Test(const bool wide, const Reg dst, const Reg src) {
+    RegReg(wide, 0x85, src, dst);
+  }
+
+  void Push(const Reg reg) {
+    Rex(false, 0, reg);
+    Byte(0x50 + (reg & 7));
+  }
+
+  void Pop(const Reg reg) {
+    Rex(false, 0, reg);
+    Byte(0x58 + (reg & 7));
+  }
+
+  // Return the offset of the rel32 to patch.
+  size_t Jcc(const Condition condition) {
+    Byte(0x0f);
+    Byte(0x80 | condition);
+    Imm32(0);
+    return GetSize() - 4;
+  }
+
+  size_t Jmp() {
+    Byte(0xe9);
+    Imm32(0);
+    return GetSize() - 4;
+  }
+
+  size_t Call() {
+    Byte(0xe8);
+    Imm32(0);
+    return GetSize() - 4;
+  }
+
+  // Point the rel32 at 'offset' to 'target'.
+  void Patch(const size_t offset, const size_t target) {
+    const int32_t rel = target - (offset + 4);
+    std::memcpy(&code_[offset], &rel, sizeof(rel));
+  }
+
+  // Point the rel32 at 'offset' here.
+  void Bind(const size_t offset) { Patch(offset, GetSize()); }
+
+ private:
+  std::vector<uint8_t> code_;
+};
+
+class Compiler {
+ public:
+  Compiler(const std::vector<bpf_insn>& insns, const HelperTable& helpers)
+      : insns_(insns), helpers_(helpers), offsets_(insns.size()) {}
+
+  std::vector<uint8_t> Compile() {
+    const std::vector<size_t> functions = GetFunctionStarts(insns_);
+    Prologue();
+    size_t function = 0;
+    for (size_t pc = 0; pc < insns_.size(); ++pc) {
+      while (function + 1 < functions.size() &&
+             functions[function + 1] <= pc) {
+        ++function;
+      }
+      offsets_[pc] = a_.GetSize();
+      pc += Emit(pc, function != 0);
+    }
+    const size_t epilogue = a_.GetSize();
+    Epilogue();
+    for (const auto& [offset, target] : fixups_) {
+      a_.Patch(offset, target == kEpilogue ? epilogue : offsets_[target]);
+    }
+    return a_.GetCode();
+  }
+
+ private:
+  // Target of fixups jumping to the epilogue.
+  static constexpr size_t kEpilogue = -1;
+
+  void Prologue() {
+    a_.Push(kRbp);
+    a_.Push(kRbx);
+    a_.Push(kR12);
+    a_.Push(kR13);
+    a_.Push(kR14);
+    a_.Push(kR15);
+    a_.Alu(true, kSub, kRsp, kFrameSize);
+    a_.Mov(true, kBase, kRsp);
+    Lea(kRbp, kRsp, kStackSize);
+  }
+
+  void Epilogue() {
+    a_.Mov(true, kRsp, kBase);
+    a_.Alu(true, kAdd, kRsp, kFrameSize);
+    a_.Pop(kR15);
+    a_.Pop(kR14);
+    a_.Pop(kR13);
+    a_.Pop(kR12);
+    a_.Pop(kRbx);
+    a_.Pop(kRbp);
+    a_.Byte(0xc3);  // ret
+  }
+
+  void Lea(const Reg dst, const Reg base, const int32_t disp) {
+    a_.Rex(true, dst, base);
+    a_.Byte(0x8d);
+    a_.Memory(dst, base, disp);
+  }
+
+  void Jump(const size_t pc, const Condition condition) {
+    fixups_.emplace_back(a_.Jcc(condition), pc);
+  }
+
+  void Jump(const size_t pc) { fixups_.emplace_back(a_.Jmp(), pc); }
+
+  // Emit the instruction at 'pc' of a function, the program itself unless
+  // 'subprogram'. Returns the number of extra instructions it spans.
+  size_t Emit(const size_t pc, const bool subprogram) {
+    const bpf_insn& insn = insns_[pc];
+    const uint8_t cls = BPF_CLASS(insn.code);
+    switch (cls) {
+      case BPF_ALU:
+      case BPF_ALU64:
+        EmitAlu(insn, cls == BPF_ALU64);
+        return 0;
+      case BPF_JMP:
+      case kClassJmp32:
+        EmitJmp(pc, insn, cls == BPF_JMP, subprogram);
+        return 0;
+      case BPF_LD:
+        a_.Mov64(kRegs[insn.dst_reg],
+                 static_cast<uint32_t>(insn.imm) |
+                     static_cast<uint64_t>(insns_[pc + 1].imm) << 32);
+        return 1;
+      case BPF_LDX:
+        EmitLoad(insn);
+        return 0;
+      case BPF_ST:
+      case BPF_STX:
+        EmitStore(insn);
+        return 0;
+    }
+    return 0;
+  }
+
+  void EmitAlu(const bpf_insn& insn, const bool wide) {
+    const uint8_t op = BPF_OP(insn.code);
+    const Reg dst = kRegs[insn.dst_reg];
+    const bool use_src = BPF_SRC(insn.code) == BPF_X;
+    const Reg src = kRegs[insn.src_reg];
+
+    const auto alu = [&](const AluOpcode opcode) {
+      if (use_src) {
+        a_.Alu(wide, opcode, dst, src);
+      } else {
+        a_.Alu(wide, opcode, dst, insn.imm);
+      }
+    };
+
+    switch (op) {
+      case BPF_ADD:
+        return alu(kAdd);
+      case BPF_SUB:
+        return alu(kSub);
+      case BPF_OR:
+        return alu(kOr);
+      case BPF_AND:
+        return alu(kAnd);
+      case BPF_XOR:
+        return alu(kXor);
+      case BPF_MOV:
+        if (use_src) {
+          a_.Mov(wide, dst, src);
+        } else {
+          a_.Mov(wide, dst, insn.imm);
+        }
+        return;
+      case BPF_MUL:
+        if (use_src) {
+          a_.Imul(wide, dst, src);
+        } else {
+          a_.Mov(wide, kAux, insn.imm);
+          a_.Imul(wide, dst, kAux);
+        }
+        return;
+      case BPF_NEG:
+        return a_.Unary(wide, 0xf7, 3, dst);
+      case BPF_LSH:
+        return EmitShift(insn, wide, 4);
+      case BPF_RSH:
+        return EmitShift(insn, wide, 5);
+      case BPF_ARSH:
+        return EmitShift(insn, wide, 7);
+      case BPF_DIV:
+      case BPF_MOD:
+        return EmitDivide(insn, wide);
+      case BPF_END:
+        return EmitSwap(insn);
+    }
+  }
+
+  void EmitShift(const bpf_insn& insn, const bool wide, const uint8_t ext) {
+    const Reg dst = kRegs[insn.dst_reg];
+    if (BPF_SRC(insn.code) == BPF_K) {
+      a_.Shift(wide, ext, dst, insn.imm & (wide ? 63 : 31));
+      return;
+    }
+    // Shift by cl, saving rcx, r4, in the scratch register.
+    const Reg src = kRegs[insn.src_reg];
+    a_.Mov(true, kAux, kRcx);
+    if (src != kRcx) {
+      a_.Mov(true, kRcx, src);
+    }
+    if (dst == kRcx) {
+      a_.Unary(wide, 0xd3, ext, kAux);
+      a_.Mov(true, kRcx, kAux);
+    } else {
+      a_.Unary(wide, 0xd3, ext, dst);
+      a_.Mov(true, kRcx, kAux);
+    }
+  }
+
+  // Divide with rax and rdx, r0 and r3, saved on the stack. Division by zero
+  // sets 'dst' to zero, and modulo by zero leaves it as it is.
+  void EmitDivide(const bpf_insn& insn, const bool wide) {
+    const Reg dst = kRegs[insn.dst_reg];
+    if (BPF_SRC(insn.code) == BPF_X) {
+      a_.Mov(true, kAux, kRegs[insn.src_reg]);
+    } else {
+      a_.Mov(wide, kAux, insn.imm);
+    }
+    a_.Test(wide, kAux, kAux);
+    const size_t zero = a_.Jcc(kEqual);
+    a_.Push(kRax);
+    a_.Push(kRdx);
+    if (dst != kRax) {
+      a_.Mov(true, kRax, dst);
+    }
+    a_.Alu(false, kXor, kRdx, kRdx);
+    a_.Unary(wide, 0xf7, 6, kAux);
+    a_.Mov(true, kScratch, BPF_OP(insn.code) == BPF_DIV ? kRax : kRdx);
+    a_.Pop(kRdx);
+    a_.Pop(kRax);
+    a_.Mov(true, dst, kScratch);
+    const size_t done = a_.Jmp();
+    a_.Bind(zero);
+    if (BPF_OP(insn.code) == BPF_DIV) {
+      a_.Alu(false, kXor, dst, dst);
+    } else if (!wide) {
+      a_.Mov(false, dst, dst);
+    }
+    a_.Bind(done);
+  }
+
+  void EmitSwap(const bpf_insn& insn) {
+    const Reg dst = kRegs[insn.dst_reg];
+    const bool to_big = BPF_SRC(insn.code) == BPF_TO_BE;
+    switch (insn.imm) {
+      case 16:
+        if (to_big) {
+          a_.Byte(0x66);  // rol r16, 8
+          a_.Rex(false, 0, dst);
+          a_.Byte(0xc1);
+          a_.ModRm(3, 0, dst);
+          a_.Byte(8);
+        }
+        a_.Rex(false, dst, dst);  // movzx r32, r16
+        a_.Byte(0x0f);
+        a_.Byte(0xb7);
+        a_.ModRm(3, dst, dst);
+        return;
+      case 32:
+      case 64:
+        if (to_big) {
+          a_.Rex(insn.imm == 64, 0, dst);  // bswap
+          a_.Byte(0x0f);
+          a_.Byte(0xc8 + (dst & 7));
+        } else if (insn.imm == 32) {
+          a_.Mov(false, dst, dst);
+        }
+        return;
+    }
+  }
+
+  void EmitJmp(const size_t pc, const bpf_insn& insn, const bool wide,
+               const bool subprogram) {
+    const uint8_t op = BPF_OP(insn.code);
+    const Reg dst = kRegs[insn.dst_reg];
+    switch (op) {
+      case BPF_JA:
+        return Jump(pc + 1 + insn.off);
+      case BPF_EXIT:
+        if (subprogram) {
+          a_.Byte(0xc3);  // ret
+        } else {
+          Jump(kEpilogue);
+        }
+        return;
+      case BPF_CALL:
+        if (insn.src_reg == BPF_PSEUDO_CALL) {
+          return EmitPseudoCall(pc + 1 + insn.imm);
+        }
+        a_.Mov64(kRax, reinterpret_cast<uint64_t>(helpers_[insn.imm]));
+        a_.Byte(0xff);  // call rax
+        a_.Byte(0xd0);
+        if (insn.imm == BPF_FUNC_tail_call) {
+          a_.Test(true, kRax, kRax);
+          Jump(kEpilogue, kNotSign);
+        }
+        return;
+    }
+
+    if (BPF_SRC(insn.code) == BPF_X) {
+      const Reg src = kRegs[insn.src_reg];
+      if (op == BPF_JSET) {
+        a_.Test(wide, dst, src);
+      } else {
+        a_.Alu(wide, kCmp, dst, src);
+      }
+    } else if (op == BPF_JSET) {
+      a_.Unary(wide, 0xf7, 0, dst);
+      a_.Imm32(insn.imm);
+    } else {
+      a_.Alu(wide, kCmp, dst, insn.imm);
+    }
+    Jump(pc + 1 + insn.off, GetCondition(op));
+  }
+
+  static Condition GetCondition(const uint8_t op) {
+    switch (op) {
+      case BPF_JEQ:
+        return kEqual;
+      case BPF_JGT:
+        return kAbove;
+      case BPF_JGE:
+        return kAboveOrEqual;
+      case BPF_JLT:
+        return kBelow;
+      case BPF_JLE:
+        return kBelowOrEqual;
+      case BPF_JSGT:
+        return kGreater;
+      case BPF_JSGE:
+        return kGreaterOrEqual;
+      case BPF_JSLT:
+        return kLess;
+      case BPF_JSLE:
+        return kLessOrEqual;
+    }
+    return kNotEqual;  // BPF_JNE and BPF_JSET.
+  }
+
+  // Call the function at 'target' with a stack of its own, saving the
+  // callee saved registers of its caller.
+  void EmitPseudoCall(const size_t target) {
+    a_.Push(kRbx);
+    a_.Push(kR13);
+    a_.Push(kR14);
+    a_.Push(kR15);
+    a_.Push(kRbp);
+    a_.Alu(true, kSub, kRsp, kStackSize);
+    Lea(kRbp, kRsp, kStackSize);
+    fixups_.emplace_back(a_.Call(), target);
+    a_.Alu(true, kAdd, kRsp, kStackSize);
+    a_.Pop(kRbp);
+    a_.Pop(kR15);
+    a_.Pop(kR14);
+    a_.Pop(kR13);
+    a_.Pop(kRbx);
+  }
+
+  void EmitLoad(const bpf_insn& insn) {
+    const Reg dst = kRegs[insn.dst_reg];
+    const Reg src = kRegs[insn.src_reg];
+    switch (BPF_SIZE(insn.code)) {
+      case BPF_B:
+      case BPF_H:
+        a_.Rex(false, dst, src);  // movzx
+        a_.Byte(0x0f);
+        a_.Byte(BPF_SIZE(insn.code) == BPF_B ? 0xb6 : 0xb7);
+        break;
+      case BPF_W:
+      case BPF_DW:
+        a_.Rex(BPF_SIZE(insn.code) == BPF_DW, dst, src);
+        a_.Byte(0x8b);
+        break;
+    }
+    a_.Memory(dst, src, insn.off);
+  }
+
+  void EmitStore(const bpf_insn& insn) {
+    const Reg dst = kRegs[insn.dst_reg];
+    const uint8_t size = BPF_SIZE(insn.code);
+    const bool wide = size == BPF_DW;
+    if (size == BPF_H) {
+      a_.Byte(0x66);
+    }
+    if (BPF_CLASS(insn.code) == BPF_ST) {
+      a_.Rex(wide, 0, dst);
+      a_.Byte(size == BPF_B ? 0xc6 : 0xc7);
+      a_.Memory(0, dst, insn.off);
+      switch (size) {
+        case BPF_B:
+          a_.Byte(insn.imm);
+          return;
+        case BPF_H:
+          a_.Byte(insn.imm);
+          a_.Byte(insn.imm >> 8);
+          return;
+      }
+      a_.Imm32(insn.imm);
+      return;
+    }
+    const Reg src = kRegs[insn.src_reg];
+    if (BPF_MODE(insn.code) == BPF_XADD) {
+      a_.Byte(0xf0);  // lock add
+      a_.Rex(wide, src, dst);
+      a_.Byte(0x01);
+    } else {
+      a_.Rex(wide, src, dst, size == BPF_B);
+      a_.Byte(size == BPF_B ? 0x88 : 0x89);
+    }
+    a_.Memory(src, dst, insn.off);
+  }
+
+  const std::vector<bpf_insn>& insns_;
+  const HelperTable& helpers_;
+  Assembler a_;
+  // Offset of the code of each instruction.
+  std::vector<size_t> offsets_;
+  // Jumps and calls to patch: offset of their rel32, and target instruction.
+  std::vector<std::pair<size_t, size_t>> fixups_;
+};
+
+}  // namespace
+
+error::StatusOr<JitProgram> Compile(const std::vector<bpf_insn>& insns,
+                                    const HelperTable& helpers) {
+  const std::vector<uint8_t> code = Compiler(insns, helpers).Compile();
+  ASSIGN_OR_RETURN(auto mapping,
+                   posix::Mmap(posix::RoundUpToPageSize(code.size()),
+                               PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS,
+                               posix::kInvalidFileDescriptor, 0));
+  const auto base = GetBase(GetValue(mapping));
+  std::memcpy(base, code.data(), code.size());
+  RETURN_IF_ERROR(posix::OkStatusOrCaptureErrnoIf(
+      ::mprotect(base, GetSize(GetValue(mapping)), PROT_READ | PROT_EXEC) ==
+          -1,
+      "mprotect() failed"));
+  return JitProgram(std::move(mapping),
+                    reinterpret_cast<JitProgram::Function>(base));
+}
+
+#else
+
+error::StatusOr<JitProgram> Compile(const std::vector<bpf_insn>&,
+                                    const HelperTable&) {
+  return error::Status(posix::MakeCodeFromErrno(ENOTSUP),
+                       "the JIT supports x86-64 only");
+}
+
+#endif
+
+}  // namespace impl
+}  // namespace vm
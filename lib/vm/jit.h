@@ -0,0 +1,46 @@
+#ifndef LIB_VM_JIT_H_
+#define LIB_VM_JIT_H_
+
+#include <linux/bpf.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "lib/error/status_or.h"
+#include "lib/posix/mmap.h"
+#include "lib/vm/helpers.h"
+
+namespace vm {
+namespace impl {
+
+// A program compiled to native code. Unlike the interpreter, compiled
+// programs neither check memory accesses nor count instructions: run only
+// programs the interpreter or the kernel verifier accept.
+class JitProgram {
+ public:
+  // Run the program on 'ctx' and return its r0.
+  uint64_t Run(void* const ctx) const { return function_(ctx); }
+
+ private:
+  using Function = uint64_t (*)(void*);
+
+  JitProgram(posix::UniqueMapping code, const Function function)
+      : code_(std::move(code)), function_(function) {}
+
+  posix::UniqueMapping code_;
+  Function function_;
+
+  friend error::StatusOr<JitProgram> Compile(const std::vector<bpf_insn>&,
+                                             const HelperTable&);
+};
+
+// Compile 'insns', a validated program calling 'helpers'. Fails with
+// ENOTSUP on hosts other than x86-64.
+error::StatusOr<JitProgram> Compile(const std::vector<bpf_insn>& insns,
+                                    const HelperTable& helpers);
+
+}  // namespace impl
+}  // namespace vm
+
+#endif  // LIB_VM_JIT_H_
@@ -0,0 +1,453 @@
+#include "lib/vm/map.h"
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+namespace vm {
+namespace {
+
+error::Status MakeStatus(const int e, const std::string_view text) {
+  return error::Status(posix::MakeCodeFromErrno(e), text);
+}
+
+bool IsValidFlags(const uint64_t flags) { return flags <= BPF_EXIST; }
+
+// Arrays of values preallocated for every key below max_entries. Arrays of
+// objects (programs, links, CPUs and sockets) only have the keys set.
+class ArrayMap : public Map {
+ public:
+  ArrayMap(MapSpec spec, const bool sparse)
+      : Map(std::move(spec)),
+        sparse_(sparse),
+        stride_((GetSpec().value_size + 7) / 8 * 8),
+        values_(uint64_t{stride_} * GetSpec().max_entries),
+        present_(GetSpec().max_entries, !sparse) {}
+
+  void* LookupElement(const void* const key) override {
+    const uint32_t index = GetIndex(key);
+    if (index >= GetSpec().max_entries || !present_[index]) {
+      return nullptr;
+    }
+    return &values_[uint64_t{stride_} * index];
+  }
+
+  int UpdateElement(const void* const key, const void* const value,
+                    const uint64_t flags) override {
+    const uint32_t index = GetIndex(key);
+    if (!IsValidFlags(flags)) {
+      return -EINVAL;
+    }
+    if (index >= GetSpec().max_entries) {
+      return -E2BIG;
+    }
+    if (flags == BPF_NOEXIST && present_[index]) {
+      return -EEXIST;
+    }
+    if (flags == BPF_EXIST && !present_[index]) {
+      return -ENOENT;
+    }
+    std::memcpy(&values_[uint64_t{stride_} * index], value,
+                GetSpec().value_size);
+    present_[index] = true;
+    return 0;
+  }
+
+  int DeleteElement(const void* const key) override {
+    const uint32_t index = GetIndex(key);
+    if (!sparse_ || index >= GetSpec().max_entries) {
+      return -EINVAL;
+    }
+    if (!present_[index]) {
+      // Like the kernel: only program arrays tell.
+      return GetSpec().type == BPF_MAP_TYPE_PROG_ARRAY ? -ENOENT : 0;
+    }
+    present_[index] = false;
+    return 0;
+  }
+
+  int GetNextKey(const void* const key, void* const next_key) override {
+    const uint32_t index = key ? GetIndex(key) : GetSpec().max_entries;
+    uint32_t next = index >= GetSpec().max_entries ? 0 : index + 1;
+    if (next >= GetSpec().max_entries) {
+      return -ENOENT;
+    }
+    std::memcpy(next_key, &next, sizeof(next));
+    return 0;
+  }
+
+ private:
+  static uint32_t GetIndex(const void* const key) {
+    uint32_t index;
+    std::memcpy(&index, key, sizeof(index));
+    return index;
+  }
+
+  const bool sparse_;
+  // Values are 8 byte aligned, as in the kernel.
+  const uint32_t stride_;
+  std::vector<uint8_t> values_;
+  std::vector<bool> present_;
+};
+
+// Hash tables, optionally evicting the least recently used element when full
+// instead of failing.
+class HashMap : public Map {
+ public:
+  HashMap(MapSpec spec, const bool lru) : Map(std::move(spec)), lru_(lru) {}
+
+  void* LookupElement(const void* const key) override {
+    const auto element = elements_.find(MakeKey(key));
+    if (element == elements_.end()) {
+      return nullptr;
+    }
+    if (lru_) {
+      order_.splice(order_.begin(), order_, element->second.order);
+    }
+    return element->second.value.get();
+  }
+
+  int UpdateElement(const void* const key, const void* const value,
+                    const uint64_t flags) override {
+    if (!IsValidFlags(flags)) {
+      return -EINVAL;
+    }
+    std::string bytes = MakeKey(key);
+    auto element = elements_.find(bytes);
+    if (element != elements_.end()) {
+      if (flags == BPF_NOEXIST) {
+        return -EEXIST;
+      }
+      if (lru_) {
+        order_.splice(order_.begin(), order_, element->second.order);
+      }
+      std::memcpy(element->second.value.get(), value, GetSpec().value_size);
+      return 0;
+    }
+    if (flags == BPF_EXIST) {
+      return -ENOENT;
+    }
+    if (elements_.size() >= GetSpec().max_entries) {
+      if (!lru_) {
+        return -E2BIG;
+      }
+      Erase(elements_.find(order_.back()));
+    }
+    Element new_element;
+    new_element.value = std::make_unique<uint8_t[]>(GetSpec().value_size);
+    std::memcpy(new_element.value.get(), value, GetSpec().value_size);
+    if (lru_) {
+      order_.push_front(bytes);
+      new_element.order = order_.begin();
+    }
+    elements_.emplace(std::move(bytes), std::move(new_element));
+    return 0;
+  }
+
+  int DeleteElement(const void* const key) override {
+    const auto element = elements_.find(MakeKey(key));
+    if (element == elements_.end()) {
+      return -ENOENT;
+    }
+    Erase(element);
+    return 0;
+  }
+
+  int GetNextKey(const void* const key, void* const next_key) override {
+    auto element = key ? elements_.find(MakeKey(key)) : elements_.end();
+    if (element == elements_.end()) {
+      element = elements_.begin();
+    } else {
+      ++element;
+    }
+    if (element == elements_.end()) {
+      return -ENOENT;
+    }
+    std::memcpy(next_key, element->first.data(), element->first.size());
+    return 0;
+  }
+
+  void Reclaim() override { retired_.clear(); }
+
+ private:
+  struct Element {
+    std::unique_ptr<uint8_t[]> value;
+    // Position in order_, for LRU maps.
+    std::list<std::string>::iterator order;
+  };
+  using Elements = std::unordered_map<std::string, Element>;
+
+  std::string MakeKey(const void* const key) const {
+    return std::string(static_cast<const char*>(key), GetSpec().key_size);
+  }
+
+  void Erase(const Elements::iterator element) {
+    if (lru_) {
+      order_.erase(element->second.order);
+    }
+    retired_.push_back(std::move(element->second.value));
+    elements_.erase(element);
+  }
+
+  const bool lru_;
+  Elements elements_;
+  // Keys from the most to the least recently used, for LRU maps.
+  std::list<std::string> order_;
+  // Values of deleted elements, which programs may still use.
+  std::vector<std::unique_ptr<uint8_t[]>> retired_;
+};
+
+// Longest prefix match tries, keyed by a 32 bit prefix length and the data
+// it applies to. Lookups try each prefix length in use, longest first.
+class LpmTrieMap : public Map {
+ public:
+  explicit LpmTrieMap(MapSpec spec)
+      : Map(std::move(spec)),
+        data_bits_((GetSpec().key_size - sizeof(uint32_t)) * 8) {}
+
+  void* LookupElement(const void* const key) override {
+    const uint32_t max_length = std::min(GetPrefixLength(key), data_bits_);
+    for (auto length = lengths_.rbegin(); length != lengths_.rend();
+         ++length) {
+      if (length->first > max_length) {
+        continue;
+      }
+      const auto element = elements_.find(MakeKey(key, length->first));
+      if (element != elements_.end()) {
+        return element->second.get();
+      }
+    }
+    return nullptr;
+  }
+
+  int UpdateElement(const void* const key, const void* const value,
+                    const uint64_t flags) override {
+    const uint32_t length = GetPrefixLength(key);
+    if (!IsValidFlags(flags) || length > data_bits_) {
+      return -EINVAL;
+    }
+    std::string bytes = MakeKey(key, length);
+    auto element = elements_.find(bytes);
+    if (element != elements_.end()) {
+      if (flags == BPF_NOEXIST) {
+        return -EEXIST;
+      }
+      std::memcpy(element->second.get(), value, GetSpec().value_size);
+      return 0;
+    }
+    if (flags == BPF_EXIST) {
+      return -ENOENT;
+    }
+    if (elements_.size() >= GetSpec().max_entries) {
+      return -ENOSPC;
+    }
+    auto new_value = std::make_unique<uint8_t[]>(GetSpec().value_size);
+    std::memcpy(new_value.get(), value, GetSpec().value_size);
+    elements_.emplace(std::move(bytes), std::move(new_value));
+    ++lengths_[length];
+    return 0;
+  }
+
+  int DeleteElement(const void* const key) override {
+    const uint32_t length = GetPrefixLength(key);
+    if (length > data_bits_) {
+      return -EINVAL;
+    }
+    const auto element = elements_.find(MakeKey(key, length));
+    if (element == elements_.end()) {
+      return -ENOENT;
+    }
+    retired_.push_back(std::move(element->second));
+    elements_.erase(element);
+    if (--lengths_[length] == 0) {
+      lengths_.erase(length);
+    }
+    return 0;
+  }
+
+  int GetNextKey(const void* const key, void* const next_key) override {
+    auto element = elements_.end();
+    if (key && GetPrefixLength(key) <= data_bits_) {
+      element = elements_.find(MakeKey(key, GetPrefixLength(key)));
+    }
+    if (element == elements_.end()) {
+      element = elements_.begin();
+    } else {
+      ++element;
+    }
+    if (element == elements_.end()) {
+      return -ENOENT;
+    }
+    std::memcpy(next_key, element->first.data(), element->first.size());
+    return 0;
+  }
+
+  void Reclaim() override { retired_.clear(); }
+
+ private:
+  static uint32_t GetPrefixLength(const void* const key) {
+    uint32_t length;
+    std::memcpy(&length, key, sizeof(length));
+    return length;
+  }
+
+  // Return 'key' with 'length' as prefix length and the data past it zeroed.
+  std::string MakeKey(const void* const key, const uint32_t length) const {
+    std::string bytes(static_cast<const char*>(key), GetSpec().key_size);
+    std::memcpy(&bytes[0], &length, sizeof(length));
+    for (uint32_t bit = length; bit < data_bits_; ++bit) {
+      if (bit % 8 == 0 && bit + 8 <= data_bits_) {
+        bytes[sizeof(uint32_t) + bit / 8] = 0;
+        bit += 7;
+      } else {
+        bytes[sizeof(uint32_t) + bit / 8] &= ~(0x80 >> (bit % 8));
+      }
+    }
+    return bytes;
+  }
+
+  const uint32_t data_bits_;
+  std::map<std::string, std::unique_ptr<uint8_t[]>> elements_;
+  // Number of elements by prefix length.
+  std::map<uint32_t, size_t> lengths_;
+  std::vector<std::unique_ptr<uint8_t[]>> retired_;
+};
+
+// Maps programs send records to userspace through: perf event arrays, whose
+// elements userspace sets to perf events, and ring buffers of max_entries
+// bytes, which have no elements.
+class RecordMap : public Map {
+ public:
+  explicit RecordMap(MapSpec spec) : Map(std::move(spec)) {}
+
+  void* LookupElement(const void*) override { return nullptr; }
+
+  int UpdateElement(const void* const key, const void*, uint64_t) override {
+    return CheckIndex(key);
+  }
+
+  int DeleteElement(const void* const key) override { return CheckIndex(key); }
+
+  int GetNextKey(const void* const key, void* const next_key) override {
+    if (IsRingBuffer()) {
+      return -EINVAL;
+    }
+    uint32_t next = 0;
+    if (key) {
+      std::memcpy(&next, key, sizeof(next));
+      next = next >= GetSpec().max_entries ? 0 : next + 1;
+    }
+    if (next >= GetSpec().max_entries) {
+      return -ENOENT;
+    }
+    std::memcpy(next_key, &next, sizeof(next));
+    return 0;
+  }
+
+  int OutputRecord(const void* const data, const uint64_t size) override {
+    // Ring buffer records take an 8 byte header and are 8 byte aligned.
+    const uint64_t bytes = IsRingBuffer() ? (size + 15) / 8 * 8 : size;
+    if (IsRingBuffer() && record_bytes_ + bytes > GetSpec().max_entries) {
+      return -EAGAIN;
+    }
+    const auto* const begin = static_cast<const uint8_t*>(data);
+    records_.emplace_back(begin, begin + size);
+    record_bytes_ += bytes;
+    return 0;
+  }
+
+ private:
+  bool IsRingBuffer() const { return GetSpec().type == kMapTypeRingbuf; }
+
+  int CheckIndex(const void* const key) const {
+    if (IsRingBuffer()) {
+      return -EINVAL;
+    }
+    uint32_t index;
+    std::memcpy(&index, key, sizeof(index));
+    return index < GetSpec().max_entries ? 0 : -E2BIG;
+  }
+};
+
+// Return whether the kernel takes maps of 'spec', as far as sizes go.
+bool IsValidSpec(const MapSpec& spec) {
+  switch (spec.type) {
+    case kMapTypeRingbuf:
+      return spec.key_size == 0 && spec.value_size == 0 &&
+             spec.max_entries >= 4096 &&
+             (spec.max_entries & (spec.max_entries - 1)) == 0;
+    case BPF_MAP_TYPE_ARRAY:
+    case BPF_MAP_TYPE_PERCPU_ARRAY:
+    case BPF_MAP_TYPE_PROG_ARRAY:
+    case BPF_MAP_TYPE_PERF_EVENT_ARRAY:
+    case BPF_MAP_TYPE_DEVMAP:
+    case BPF_MAP_TYPE_CPUMAP:
+    case BPF_MAP_TYPE_XSKMAP:
+      if (spec.key_size != sizeof(uint32_t)) {
+        return false;
+      }
+      break;
+    case BPF_MAP_TYPE_LPM_TRIE:
+      // The kernel only has tries allocating elements as they come.
+      if (spec.key_size <= sizeof(uint32_t) || spec.key_size > 256 + 4 ||
+          !(spec.flags & BPF_F_NO_PREALLOC)) {
+        return false;
+      }
+      break;
+  }
+  return spec.key_size > 0 && spec.value_size > 0 && spec.max_entries > 0;
+}
+
+}  // namespace
+
+int Map::OutputRecord(const void*, uint64_t) {
+  return -EINVAL;
+}
+
+error::StatusOr<std::unique_ptr<Map>> CreateMap(const MapSpec& spec) {
+  switch (spec.type) {
+    case BPF_MAP_TYPE_ARRAY:
+    case BPF_MAP_TYPE_PERCPU_ARRAY:
+    case BPF_MAP_TYPE_PROG_ARRAY:
+    case BPF_MAP_TYPE_DEVMAP:
+    case BPF_MAP_TYPE_CPUMAP:
+    case BPF_MAP_TYPE_XSKMAP:
+    case BPF_MAP_TYPE_HASH:
+    case BPF_MAP_TYPE_PERCPU_HASH:
+    case kMapTypeDevmapHash:
+    case BPF_MAP_TYPE_LRU_HASH:
+    case BPF_MAP_TYPE_LRU_PERCPU_HASH:
+    case BPF_MAP_TYPE_LPM_TRIE:
+    case BPF_MAP_TYPE_PERF_EVENT_ARRAY:
+    case kMapTypeRingbuf:
+      break;
+    default:
+      return MakeStatus(ENOTSUP, "map type not supported: " + spec.name);
+  }
+  if (!IsValidSpec(spec)) {
+    return MakeStatus(EINVAL, "invalid map definition: " + spec.name);
+  }
+  switch (spec.type) {
+    case BPF_MAP_TYPE_ARRAY:
+    case BPF_MAP_TYPE_PERCPU_ARRAY:
+      return std::unique_ptr<Map>(new ArrayMap(spec, false));
+    case BPF_MAP_TYPE_PROG_ARRAY:
+    case BPF_MAP_TYPE_DEVMAP:
+    case BPF_MAP_TYPE_CPUMAP:
+    case BPF_MAP_TYPE_XSKMAP:
+      return std::unique_ptr<Map>(new ArrayMap(spec, true));
+    case BPF_MAP_TYPE_LRU_HASH:
+    case BPF_MAP_TYPE_LRU_PERCPU_HASH:
+      return std::unique_ptr<Map>(new HashMap(spec, true));
+    case BPF_MAP_TYPE_LPM_TRIE:
+      return std::unique_ptr<Map>(new LpmTrieMap(spec));
+    case BPF_MAP_TYPE_PERF_EVENT_ARRAY:
+    case kMapTypeRingbuf:
+      return std::unique_ptr<Map>(new RecordMap(spec));
+  }
+  return std::unique_ptr<Map>(new HashMap(spec, false));
+}
+
+}  // namespace vm
@@ -0,0 +1,132 @@
+#ifndef LIB_VM_MAP_H_
+#define LIB_VM_MAP_H_
+
+#include <linux/bpf.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "lib/error/return_if_error.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/errno.h"
+#include "lib/vm/elf.h"
+
+namespace vm {
+
+// Map types of linux 5.4+ missing from the uapi headers we build against.
+constexpr uint32_t kMapTypeDevmapHash = 25;
+constexpr uint32_t kMapTypeRingbuf = 27;
+
+// A map of programs run in userspace, the counterpart of a kernel map of the
+// same type. There is a single CPU: per-CPU maps hold one value per key, and
+// userspace sees that value rather than an array of them.
+//
+// The Element methods are those of helpers, returning negative errnos: use
+// the typed methods from userspace. Maps are not thread safe.
+class Map {
+ public:
+  virtual ~Map() = default;
+
+  const MapSpec& GetSpec() const { return spec_; }
+
+  // Return the value of 'key', nullptr if none. The value stays valid until
+  // Reclaim(), even if the element is deleted.
+  virtual void* LookupElement(const void* key) = 0;
+  // Set the value of 'key', with 'flags' BPF_ANY, BPF_NOEXIST or BPF_EXIST.
+  virtual int UpdateElement(const void* key, const void* value,
+                            uint64_t flags) = 0;
+  virtual int DeleteElement(const void* key) = 0;
+  // Set 'next_key' to the key after 'key', or the first key if 'key' is
+  // nullptr or missing. Returns -ENOENT after the last key.
+  virtual int GetNextKey(const void* key, void* next_key) = 0;
+  // Append a record to maps of events, ring buffers and perf event arrays.
+  virtual int OutputRecord(const void* data, uint64_t size);
+  // Free the values of deleted elements: programs using them are done.
+  virtual void Reclaim() {}
+
+  // Return the records output to the map so far, and forget them.
+  std::vector<std::vector<uint8_t>> TakeRecords() {
+    std::vector<std::vector<uint8_t>> records;
+    records.swap(records_);
+    record_bytes_ = 0;
+    return records;
+  }
+
+  // Return the bytes of records output and not taken yet.
+  uint64_t GetRecordBytes() const { return record_bytes_; }
+
+  template <typename V, typename K>
+  error::StatusOr<V> Lookup(const K& key) {
+    RETURN_IF_ERROR((CheckSizes<K, V>()));
+    const void* const value = LookupElement(&key);
+    if (!value) {
+      return MakeStatus(-ENOENT);
+    }
+    V copy;
+    std::memcpy(&copy, value, sizeof(copy));
+    return copy;
+  }
+
+  template <typename K, typename V>
+  error::Status Update(const K& key, const V& value,
+                       const uint64_t flags = BPF_ANY) {
+    RETURN_IF_ERROR((CheckSizes<K, V>()));
+    return MakeStatus(UpdateElement(&key, &value, flags));
+  }
+
+  template <typename K>
+  error::Status Delete(const K& key) {
+    RETURN_IF_ERROR(CheckKeySize<K>());
+    return MakeStatus(DeleteElement(&key));
+  }
+
+  // Return the key after '*key', or the first key if 'key' is nullptr.
+  template <typename K>
+  error::StatusOr<K> GetNextKey(const K* const key) {
+    RETURN_IF_ERROR(CheckKeySize<K>());
+    K next_key;
+    RETURN_IF_ERROR(MakeStatus(GetNextKey(key, &next_key)));
+    return next_key;
+  }
+
+ protected:
+  explicit Map(MapSpec spec) : spec_(std::move(spec)) {}
+
+  std::vector<std::vector<uint8_t>> records_;
+  uint64_t record_bytes_ = 0;
+
+ private:
+  static error::Status MakeStatus(const int rv) {
+    return rv < 0 ? error::Status(posix::MakeCodeFromErrno(-rv),
+                                  "map operation failed")
+                  : error::kOkStatus;
+  }
+
+  template <typename K>
+  error::Status CheckKeySize() const {
+    static_assert(std::is_trivially_copyable_v<K>, "keys are copied as bytes");
+    return MakeStatus(sizeof(K) == spec_.key_size ? 0 : -EINVAL);
+  }
+
+  template <typename K, typename V>
+  error::Status CheckSizes() const {
+    static_assert(std::is_trivially_copyable_v<V>,
+                  "values are copied as bytes");
+    RETURN_IF_ERROR(CheckKeySize<K>());
+    return MakeStatus(sizeof(V) == spec_.value_size ? 0 : -EINVAL);
+  }
+
+  const MapSpec spec_;
+};
+
+// Create an empty map of 'spec'. Fails with ENOTSUP on types not supported,
+// and EINVAL on sizes invalid for the type.
+error::StatusOr<std::unique_ptr<Map>> CreateMap(const MapSpec& spec);
+
+}  // namespace vm
+
+#endif  // LIB_VM_MAP_H_
@@ -0,0 +1,168 @@
+#include "lib/vm/map.h"
+
+#include <linux/bpf.h>
+
+#include <set>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "lib/posix/errno.h"
+
+namespace vm {
+namespace {
+
+MapSpec MakeSpec(const uint32_t type, const uint32_t key_size,
+                 const uint32_t value_size, const uint32_t max_entries,
+                 const uint32_t flags = 0) {
+  MapSpec spec;
+  spec.name = "test";
+  spec.type = type;
+  spec.key_size = key_size;
+  spec.value_size = value_size;
+  spec.max_entries = max_entries;
+  spec.flags = flags;
+  return spec;
+}
+
+std::unique_ptr<Map> MustCreateMap(const MapSpec& spec) {
+  auto map_or = CreateMap(spec);
+  EXPECT_TRUE(IsOk(map_or)) << GetText(GetStatus(map_or));
+  return IsOk(map_or) ? std::move(GetValue(map_or)) : nullptr;
+}
+
+struct LpmKey {
+  uint32_t prefix_length;
+  uint8_t address[4];
+};
+
+TEST(MapTest, ArraysHoldEveryKey) {
+  const auto map = MustCreateMap(MakeSpec(BPF_MAP_TYPE_ARRAY, 4, 8, 4));
+  ASSERT_NE(nullptr, map);
+  const auto value_or = map->Lookup<uint64_t>(3u);
+  ASSERT_TRUE(IsOk(value_or));
+  EXPECT_EQ(0, GetValue(value_or));
+  EXPECT_TRUE(IsOk(map->Update(3u, uint64_t{42})));
+  EXPECT_EQ(42, GetValue(map->Lookup<uint64_t>(3u)));
+  EXPECT_TRUE(posix::IsErrno(map->Update(4u, uint64_t{1}), E2BIG));
+  EXPECT_TRUE(
+      posix::IsErrno(map->Update(0u, uint64_t{1}, BPF_NOEXIST), EEXIST));
+  EXPECT_TRUE(posix::IsErrno(map->Delete(0u), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(map->Lookup<uint32_t>(0u)), EINVAL));
+}
+
+TEST(MapTest, ProgramArraysOnlyHoldKeysSet) {
+  const auto map = MustCreateMap(MakeSpec(BPF_MAP_TYPE_PROG_ARRAY, 4, 4, 4));
+  ASSERT_NE(nullptr, map);
+  EXPECT_TRUE(posix::IsErrno(GetStatus(map->Lookup<uint32_t>(1u)), ENOENT));
+  EXPECT_TRUE(IsOk(map->Update(1u, 7u)));
+  EXPECT_EQ(7, GetValue(map->Lookup<uint32_t>(1u)));
+  EXPECT_TRUE(IsOk(map->Delete(1u)));
+  EXPECT_TRUE(posix::IsErrno(map->Delete(1u), ENOENT));
+}
+
+TEST(MapTest, HashesFailWhenFull) {
+  const auto map = MustCreateMap(MakeSpec(BPF_MAP_TYPE_HASH, 4, 4, 2));
+  ASSERT_NE(nullptr, map);
+  EXPECT_TRUE(IsOk(map->Update(1u, 10u)));
+  EXPECT_TRUE(IsOk(map->Update(2u, 20u)));
+  EXPECT_TRUE(posix::IsErrno(map->Update(3u, 30u), E2BIG));
+  EXPECT_TRUE(IsOk(map->Update(2u, 21u, BPF_EXIST)));
+  EXPECT_EQ(21, GetValue(map->Lookup<uint32_t>(2u)));
+  EXPECT_TRUE(IsOk(map->Delete(1u)));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(map->Lookup<uint32_t>(1u)), ENOENT));
+  EXPECT_TRUE(IsOk(map->Update(3u, 30u)));
+}
+
+TEST(MapTest, HashesIterateOverKeys) {
+  const auto map = MustCreateMap(MakeSpec(BPF_MAP_TYPE_HASH, 4, 4, 8));
+  ASSERT_NE(nullptr, map);
+  for (uint32_t key = 0; key < 5; ++key) {
+    ASSERT_TRUE(IsOk(map->Update(key, key)));
+  }
+  std::set<uint32_t> keys;
+  auto key_or = map->GetNextKey<uint32_t>(nullptr);
+  while (IsOk(key_or)) {
+    keys.insert(GetValue(key_or));
+    key_or = map->GetNextKey(&GetValue(key_or));
+  }
+  EXPECT_TRUE(posix::IsErrno(GetStatus(key_or), ENOENT));
+  EXPECT_EQ((std::set<uint32_t>{0, 1, 2, 3, 4}), keys);
+}
+
+TEST(MapTest, LruHashesEvictLeastRecentlyUsed) {
+  const auto map = MustCreateMap(MakeSpec(BPF_MAP_TYPE_LRU_HASH, 4, 4, 2));
+  ASSERT_NE(nullptr, map);
+  EXPECT_TRUE(IsOk(map->Update(1u, 10u)));
+  EXPECT_TRUE(IsOk(map->Update(2u, 20u)));
+  EXPECT_TRUE(IsOk(map->Lookup<uint32_t>(1u)));
+  EXPECT_TRUE(IsOk(map->Update(3u, 30u)));
+  EXPECT_TRUE(IsOk(map->Lookup<uint32_t>(1u)));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(map->Lookup<uint32_t>(2u)), ENOENT));
+  EXPECT_TRUE(IsOk(map->Lookup<uint32_t>(3u)));
+}
+
+TEST(MapTest, DeletedValuesLastUntilReclaimed) {
+  const auto map = MustCreateMap(MakeSpec(BPF_MAP_TYPE_HASH, 4, 4, 2));
+  ASSERT_NE(nullptr, map);
+  const uint32_t key = 1;
+  const uint32_t value = 10;
+  ASSERT_EQ(0, map->UpdateElement(&key, &value, BPF_ANY));
+  const auto* const found =
+      static_cast<const uint32_t*>(map->LookupElement(&key));
+  ASSERT_NE(nullptr, found);
+  ASSERT_EQ(0, map->DeleteElement(&key));
+  EXPECT_EQ(10, *found);
+  map->Reclaim();
+}
+
+TEST(MapTest, LpmTriesMatchLongestPrefix) {
+  const auto map = MustCreateMap(MakeSpec(
+      BPF_MAP_TYPE_LPM_TRIE, sizeof(LpmKey), 4, 8, BPF_F_NO_PREALLOC));
+  ASSERT_NE(nullptr, map);
+  EXPECT_TRUE(IsOk(map->Update(LpmKey{8, {10, 0, 0, 0}}, 1u)));
+  EXPECT_TRUE(IsOk(map->Update(LpmKey{24, {10, 1, 2, 99}}, 2u)));
+  EXPECT_TRUE(IsOk(map->Update(LpmKey{0, {}}, 3u)));
+
+  EXPECT_EQ(2, GetValue(map->Lookup<uint32_t>(LpmKey{32, {10, 1, 2, 3}})));
+  EXPECT_EQ(1, GetValue(map->Lookup<uint32_t>(LpmKey{32, {10, 1, 3, 3}})));
+  EXPECT_EQ(3, GetValue(map->Lookup<uint32_t>(LpmKey{32, {11, 1, 2, 3}})));
+  EXPECT_EQ(1, GetValue(map->Lookup<uint32_t>(LpmKey{16, {10, 1, 2, 3}})));
+
+  EXPECT_TRUE(IsOk(map->Delete(LpmKey{24, {10, 1, 2, 0}})));
+  EXPECT_EQ(1, GetValue(map->Lookup<uint32_t>(LpmKey{32, {10, 1, 2, 3}})));
+  EXPECT_TRUE(posix::IsErrno(map->Update(LpmKey{33, {}}, 4u), EINVAL));
+}
+
+TEST(MapTest, RingBuffersKeepRecords) {
+  const auto map = MustCreateMap(MakeSpec(kMapTypeRingbuf, 0, 0, 4096));
+  ASSERT_NE(nullptr, map);
+  const std::string record = "record";
+  ASSERT_EQ(0, map->OutputRecord(record.data(), record.size()));
+  EXPECT_EQ(16, map->GetRecordBytes());
+  const std::string big(4096, 'x');
+  EXPECT_EQ(-EAGAIN, map->OutputRecord(big.data(), big.size()));
+
+  const auto records = map->TakeRecords();
+  ASSERT_EQ(1, records.size());
+  EXPECT_EQ(record, std::string(records[0].begin(), records[0].end()));
+  EXPECT_EQ(0, map->GetRecordBytes());
+  EXPECT_TRUE(map->TakeRecords().empty());
+}
+
+TEST(MapTest, FailsOnBadSpecs) {
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(CreateMap(MakeSpec(BPF_MAP_TYPE_STACK_TRACE, 4, 8, 1))),
+      ENOTSUP));
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(CreateMap(MakeSpec(BPF_MAP_TYPE_ARRAY, 8, 8, 1))), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(CreateMap(MakeSpec(BPF_MAP_TYPE_HASH, 4, 8, 0))), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(CreateMap(MakeSpec(BPF_MAP_TYPE_LPM_TRIE, 8, 8, 1))),
+      EINVAL));
+  EXPECT_TRUE(posix::IsErrno(
+      GetStatus(CreateMap(MakeSpec(kMapTypeRingbuf, 0, 0, 1000))), EINVAL));
+}
+
+}  // namespace
+}  // namespace vm
@@ -0,0 +1,64 @@
+#include "lib/vm/run.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sstream>
+
+#include "lib/posix/errno.h"
+
+namespace vm {
+namespace impl {
+namespace {
+
+bool Contains(const uintptr_t begin, const uintptr_t end,
+              const uintptr_t address, const uint64_t size) {
+  return address >= begin && address <= end && size <= end - address;
+}
+
+}  // namespace
+
+bool IsAccessible(const Run& run, const uintptr_t address, const uint64_t size,
+                  const bool write) {
+  const XdpContext& ctx = *run.ctx;
+  if (Contains(ctx.data_meta, ctx.data_end, address, size)) {
+    return true;
+  }
+  if (!write && Contains(reinterpret_cast<uintptr_t>(run.ctx),
+                         reinterpret_cast<uintptr_t>(run.ctx + 1), address,
+                         size)) {
+    return true;
+  }
+  for (const auto& region : run.regions) {
+    if (Contains(region.begin, region.end, address, size)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<size_t> GetFunctionStarts(const std::vector<bpf_insn>& insns) {
+  std::vector<size_t> starts = {0};
+  for (size_t pc = 0; pc < insns.size(); ++pc) {
+    const bpf_insn& insn = insns[pc];
+    if (insn.code == (BPF_JMP | BPF_CALL) &&
+        insn.src_reg == BPF_PSEUDO_CALL) {
+      starts.push_back(pc + 1 + insn.imm);
+    }
+  }
+  std::sort(starts.begin(), starts.end());
+  starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+  return starts;
+}
+
+void SetAccessFault(Run* const run, const uintptr_t address,
+                    const uint64_t size) {
+  if (IsError(run->fault)) {
+    return;
+  }
+  std::ostringstream text;
+  text << "bad access to " << size << " bytes at 0x" << std::hex << address;
+  run->fault = error::Status(posix::MakeCodeFromErrno(EFAULT), text.str());
+}
+
+}  // namespace impl
+}  // namespace vm
@@ -0,0 +1,101 @@
+#ifndef LIB_VM_RUN_H_
+#define LIB_VM_RUN_H_
+
+#include <linux/bpf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "lib/error/status.h"
+#include "lib/vm/map.h"
+
+// State of a program run, shared by the engines and the helpers. Internal
+// to lib/vm.
+
+namespace vm {
+
+class Vm;
+
+namespace impl {
+
+// struct xdp_md, with the fields of linux 5.8. Packet pointers are 32 bits:
+// packets live in the low 4 GB of the address space.
+struct XdpContext {
+  uint32_t data;
+  uint32_t data_end;
+  uint32_t data_meta;
+  uint32_t ingress_ifindex;
+  uint32_t rx_queue_index;
+  uint32_t egress_ifindex;
+};
+
+// BPF_JMP32 of linux 5.1, missing from the uapi headers we build against.
+constexpr uint8_t kClassJmp32 = 0x06;
+
+// Bytes of stack of each function of a program, and the most functions a
+// program may nest, itself included.
+constexpr size_t kStackSize = 512;
+constexpr size_t kMaxCallDepth = 8;
+
+// Size of the struct xdp_frame kept at the start of packet buffers, which
+// bpf_xdp_adjust_head() and bpf_xdp_adjust_meta() cannot move into.
+constexpr uintptr_t kXdpFrameSize = 40;
+
+// Bytes of memory programs may access, [begin, end).
+struct Region {
+  uintptr_t begin;
+  uintptr_t end;
+};
+
+// A ring buffer record reserved by a program.
+struct Reservation {
+  Map* map;
+  std::unique_ptr<uint8_t[]> data;
+  uint64_t size;
+};
+
+struct Run {
+  Vm* vm = nullptr;
+  XdpContext* ctx = nullptr;
+  // The packet buffer, headroom and tailroom included.
+  uint8_t* buffer_begin = nullptr;
+  uint8_t* buffer_end = nullptr;
+  // Target of bpf_redirect_map(), or of bpf_redirect() without a map.
+  const Map* redirect_map = nullptr;
+  uint32_t redirect_key = 0;
+  uint32_t tail_calls = 0;
+
+  // Whether to check memory accesses, both of programs and of the memory
+  // they pass helpers; the interpreter does.
+  bool check_memory = false;
+  // Instructions left to run, for the interpreter.
+  uint64_t insns_left = 0;
+  // Memory programs may access but for their context and packet: stacks,
+  // and the map values and records helpers returned.
+  std::vector<Region> regions;
+  std::vector<Reservation> reservations;
+  // First error of the run, e.g. a bad memory access.
+  error::Status fault;
+};
+
+// The run of the calling thread, nullptr if none.
+inline thread_local Run* current_run = nullptr;
+
+// Return whether the program of 'run' may access the 'size' bytes at
+// 'address'.
+bool IsAccessible(const Run& run, uintptr_t address, uint64_t size,
+                  bool write);
+
+// Return the index of the first instruction of each function of 'insns', a
+// program followed by the functions it calls: 0, then the targets of calls.
+std::vector<size_t> GetFunctionStarts(const std::vector<bpf_insn>& insns);
+
+// Record in 'run' a bad memory access at 'address', if the first fault.
+void SetAccessFault(Run* run, uintptr_t address, uint64_t size);
+
+}  // namespace impl
+}  // namespace vm
+
+#endif  // LIB_VM_RUN_H_
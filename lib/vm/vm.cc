@@ -0,0 +1,441 @@
+#include "lib/vm/vm.h"
+
+#include <linux/bpf.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+#include "lib/posix/mmap.h"
+#include "lib/vm/interpreter.h"
+#include "lib/vm/jit.h"
+#include "lib/vm/run.h"
+
+namespace vm {
+namespace {
+
+using impl::kClassJmp32;
+using impl::kMaxCallDepth;
+
+// Room before packets, XDP_PACKET_HEADROOM, and after them, that of
+// bpf::TestRun().
+constexpr size_t kHeadroom = 256;
+constexpr size_t kTailroom = 4096;
+
+// Tail calls a run makes at most, MAX_TAIL_CALL_CNT.
+constexpr uint32_t kMaxTailCalls = 32;
+
+error::Status MakeStatus(const int e, const std::string_view text) {
+  return error::Status(posix::MakeCodeFromErrno(e), text);
+}
+
+error::Status MakeInsnStatus(const std::string& section, const size_t pc,
+                             const std::string_view text) {
+  std::ostringstream out;
+  out << section << ": insn " << pc << ": " << text;
+  return MakeStatus(EINVAL, out.str());
+}
+
+bool IsValidAluOp(const uint8_t op) { return op <= BPF_END; }
+
+bool IsValidJmpOp(const uint8_t op) { return op <= BPF_JSLE; }
+
+bool IsExit(const bpf_insn& insn) {
+  return insn.code == (BPF_JMP | BPF_EXIT) || insn.code == (BPF_JMP | BPF_JA);
+}
+
+// Check 'insns' is a program the engines can run: made of known
+// instructions, with jumps within functions and calls to known helpers.
+class Validator {
+ public:
+  Validator(const std::string& section, const std::vector<bpf_insn>& insns,
+            const HelperTable& helpers)
+      : section_(section),
+        insns_(insns),
+        helpers_(helpers),
+        starts_(impl::GetFunctionStarts(insns)) {}
+
+  error::Status Validate() {
+    if (insns_.empty()) {
+      return MakeInsnStatus(section_, 0, "empty program");
+    }
+    for (const size_t start : starts_) {
+      if (start >= insns_.size()) {
+        return MakeInsnStatus(section_, start, "call out of bounds");
+      }
+    }
+    for (size_t pc = 0; pc < insns_.size(); ++pc) {
+      const size_t end = GetFunctionEnd(pc);
+      if (pc + 1 == end && !IsExit(insns_[pc])) {
+        return MakeInsnStatus(section_, pc, "function does not end in exit");
+      }
+      RETURN_IF_ERROR(ValidateInsn(pc, end));
+      if (insns_[pc].code == (BPF_LD | BPF_IMM | BPF_DW)) {
+        ++pc;
+      }
+    }
+    std::vector<int> depths(starts_.size(), 0);
+    for (size_t i = 0; i < starts_.size(); ++i) {
+      RETURN_IF_ERROR(ValidateDepth(i, &depths));
+    }
+    return error::kOkStatus;
+  }
+
+ private:
+  // Return the index of the function of 'pc' in starts_.
+  size_t GetFunction(const size_t pc) const {
+    return std::upper_bound(starts_.begin(), starts_.end(), pc) -
+           starts_.begin() - 1;
+  }
+
+  // Return the end of the function of 'pc', one past its last instruction.
+  size_t GetFunctionEnd(const size_t pc) const {
+    const size_t next = GetFunction(pc) + 1;
+    return next < starts_.size() ? starts_[next] : insns_.size();
+  }
+
+  error::Status ValidateInsn(const size_t pc, const size_t end) const {
+    const bpf_insn& insn = insns_[pc];
+    const uint8_t cls = BPF_CLASS(insn.code);
+    const uint8_t op = BPF_OP(insn.code);
+    const auto fail = [&](const std::string_view text) {
+      return MakeInsnStatus(section_, pc, text);
+    };
+    if (insn.dst_reg >= MAX_BPF_REG || insn.src_reg >= MAX_BPF_REG) {
+      return fail("invalid register");
+    }
+    const bool writes_dst = cls == BPF_ALU || cls == BPF_ALU64 ||
+                            cls == BPF_LD || cls == BPF_LDX;
+    if (writes_dst && insn.dst_reg == BPF_REG_10) {
+      return fail("frame pointer is read only");
+    }
+
+    switch (cls) {
+      case BPF_ALU:
+      case BPF_ALU64:
+        if (!IsValidAluOp(op) || insn.off != 0 ||
+            (op == BPF_NEG && BPF_SRC(insn.code) != BPF_K) ||
+            (op == BPF_END && cls != BPF_ALU)) {
+          return fail("invalid alu instruction");
+        }
+        if (op == BPF_END && insn.imm != 16 && insn.imm != 32 &&
+            insn.imm != 64) {
+          return fail("invalid byte swap");
+        }
+        return error::kOkStatus;
+
+      case BPF_JMP:
+      case kClassJmp32:
+        if (!IsValidJmpOp(op) ||
+            (cls == kClassJmp32 &&
+             (op == BPF_JA || op == BPF_CALL || op == BPF_EXIT))) {
+          return fail("invalid jump instruction");
+        }
+        if (op == BPF_CALL) {
+          if (insn.src_reg == BPF_PSEUDO_CALL) {
+            return error::kOkStatus;
+          }
+          if (insn.src_reg != 0 || insn.imm < 0 ||
+              static_cast<uint32_t>(insn.imm) >= kMaxHelpers ||
+              !helpers_[insn.imm]) {
+            return MakeStatus(ENOTSUP, section_ + ": insn " +
+                                           std::to_string(pc) +
+                                           ": unknown helper " +
+                                           std::to_string(insn.imm));
+          }
+          return error::kOkStatus;
+        }
+        if (op != BPF_EXIT) {
+          const int64_t target = static_cast<int64_t>(pc) + 1 + insn.off;
+          if (target < static_cast<int64_t>(starts_[GetFunction(pc)]) ||
+              target >= static_cast<int64_t>(end)) {
+            return fail("jump out of function");
+          }
+        }
+        return error::kOkStatus;
+
+      case BPF_LD:
+        if (insn.code != (BPF_LD | BPF_IMM | BPF_DW)) {
+          return fail("unsupported load");
+        }
+        if (insn.src_reg != 0) {
+          return fail("unsupported ld_imm64 source");
+        }
+        if (pc + 1 >= end || insns_[pc + 1].code != 0 ||
+            insns_[pc + 1].dst_reg != 0 || insns_[pc + 1].src_reg != 0 ||
+            insns_[pc + 1].off != 0) {
+          return fail("invalid ld_imm64");
+        }
+        return error::kOkStatus;
+
+      case BPF_LDX:
+      case BPF_ST:
+        if (BPF_MODE(insn.code) != BPF_MEM) {
+          return fail("invalid memory access");
+        }
+        return error::kOkStatus;
+
+      case BPF_STX:
+        if (BPF_MODE(insn.code) != BPF_MEM &&
+            !(BPF_MODE(insn.code) == BPF_XADD &&
+              (BPF_SIZE(insn.code) == BPF_W ||
+               BPF_SIZE(insn.code) == BPF_DW))) {
+          return fail("invalid memory access");
+        }
+        // Of the atomic operations, only the add of BPF_XADD, without
+        // BPF_FETCH: what clang emits for __sync_fetch_and_add() when the
+        // result is unused.
+        if (BPF_MODE(insn.code) == BPF_XADD && insn.imm != BPF_ADD) {
+          return fail("unsupported atomic operation");
+        }
+        return error::kOkStatus;
+    }
+    return fail("invalid instruction class");
+  }
+
+  // Check the calls of function 'function' nest at most kMaxCallDepth deep
+  // and do not recurse, setting (*depths)[function] to how deep they nest.
+  // Depth -1 marks functions being checked.
+  error::Status ValidateDepth(const size_t function,
+                              std::vector<int>* const depths) const {
+    int& depth = (*depths)[function];
+    if (depth < 0) {
+      return MakeInsnStatus(section_, starts_[function], "recursive call");
+    }
+    if (depth > 0) {
+      return error::kOkStatus;
+    }
+    depth = -1;
+    int deepest = 0;
+    const size_t end = function + 1 < starts_.size() ? starts_[function + 1]
+                                                     : insns_.size();
+    for (size_t pc = starts_[function]; pc < end; ++pc) {
+      const bpf_insn& insn = insns_[pc];
+      if (insn.code != (BPF_JMP | BPF_CALL) ||
+          insn.src_reg != BPF_PSEUDO_CALL) {
+        continue;
+      }
+      const size_t callee = GetFunction(pc + 1 + insn.imm);
+      RETURN_IF_ERROR(ValidateDepth(callee, depths));
+      deepest = std::max(deepest, (*depths)[callee]);
+    }
+    depth = deepest + 1;
+    if (depth > static_cast<int>(kMaxCallDepth)) {
+      return MakeInsnStatus(section_, starts_[function], "calls nest too deep");
+    }
+    return error::kOkStatus;
+  }
+
+  const std::string& section_;
+  const std::vector<bpf_insn>& insns_;
+  const HelperTable& helpers_;
+  const std::vector<size_t> starts_;
+};
+
+}  // namespace
+
+struct Vm::State {
+  struct Program {
+    std::string section;
+    std::vector<bpf_insn> insns;
+    std::optional<impl::JitProgram> jit;
+  };
+
+  VmOptions options;
+  HelperTable helpers;
+  std::vector<std::unique_ptr<Map>> maps;
+  std::vector<Program> programs;
+  // Buffer packets are copied to, in the low 4 GB for xdp_md to point to.
+  std::optional<posix::UniqueMapping> buffer;
+};
+
+namespace impl {
+
+uint64_t TailCall(const uint64_t ctx, const uint64_t map,
+                  const uint64_t index, uint64_t, uint64_t) {
+  Run* const run = current_run;
+  Map* const prog_array = reinterpret_cast<Map*>(map);
+  const uint32_t key = index;
+  if (prog_array->GetSpec().type != BPF_MAP_TYPE_PROG_ARRAY ||
+      run->tail_calls == kMaxTailCalls) {
+    return -1;
+  }
+  const void* const value = prog_array->LookupElement(&key);
+  if (!value) {
+    return -1;
+  }
+  uint32_t id;
+  std::memcpy(&id, value, sizeof(id));
+  ++run->tail_calls;
+  const uint64_t rv =
+      run->vm->RunProgram(id, reinterpret_cast<void*>(ctx), run);
+  return rv == static_cast<uint64_t>(-1) ? rv : static_cast<uint32_t>(rv);
+}
+
+}  // namespace impl
+
+Vm::Vm(std::unique_ptr<State> state) : state_(std::move(state)) {}
+Vm::Vm(Vm&&) = default;
+Vm& Vm::operator=(Vm&&) = default;
+Vm::~Vm() = default;
+
+Map* Vm::GetMap(const std::string_view name) const {
+  for (const auto& map : state_->maps) {
+    if (map->GetSpec().name == name) {
+      return map.get();
+    }
+  }
+  return nullptr;
+}
+
+error::StatusOr<uint32_t> Vm::GetProgramId(
+    const std::string_view section) const {
+  const auto& programs = state_->programs;
+  for (size_t i = 0; i < programs.size(); ++i) {
+    if (section.empty() || programs[i].section == section) {
+      return static_cast<uint32_t>(i);
+    }
+  }
+  return MakeStatus(ENOENT, "no such program");
+}
+
+uint64_t Vm::RunProgram(const uint32_t id, void* const ctx,
+                        impl::Run* const run) const {
+  if (id >= state_->programs.size()) {
+    return -1;
+  }
+  const State::Program& program = state_->programs[id];
+  if (program.jit) {
+    return program.jit->Run(ctx);
+  }
+  return impl::Interpret(program.insns, state_->helpers, ctx, run);
+}
+
+error::StatusOr<XdpRunResult> Vm::RunXdp(const uint32_t id,
+                                         const base::Span<const uint8_t> packet,
+                                         const XdpRunOptions& options) {
+  if (id >= state_->programs.size()) {
+    return MakeStatus(ENOENT, "no such program");
+  }
+  const size_t size = kHeadroom + GetSize(packet) + kTailroom;
+  auto& buffer = state_->buffer;
+  if (!buffer || GetSize(GetValue(*buffer)) < size) {
+    buffer.reset();
+    ASSIGN_OR_RETURN(
+        auto mapping,
+        posix::Mmap(posix::RoundUpToPageSize(size), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT,
+                    posix::kInvalidFileDescriptor, 0));
+    const auto end = reinterpret_cast<uintptr_t>(GetBase(GetValue(mapping))) +
+                     GetSize(GetValue(mapping));
+    if (end > UINT32_MAX) {
+      return MakeStatus(ENOMEM, "no packet buffer in the low 4 GB");
+    }
+    buffer = std::move(mapping);
+  }
+  uint8_t* const begin = GetBase(GetValue(*buffer));
+  uint8_t* const data = begin + kHeadroom;
+  std::memcpy(data, GetBase(packet), GetSize(packet));
+
+  impl::XdpContext ctx = {};
+  ctx.data = reinterpret_cast<uintptr_t>(data);
+  ctx.data_end = ctx.data + GetSize(packet);
+  ctx.data_meta = ctx.data;
+  ctx.ingress_ifindex = options.ingress_ifindex;
+  ctx.rx_queue_index = options.rx_queue_index;
+
+  impl::Run run;
+  run.vm = this;
+  run.ctx = &ctx;
+  run.buffer_begin = begin;
+  run.buffer_end = begin + size;
+  run.check_memory = !state_->programs[id].jit;
+
+  XdpRunResult result;
+  impl::Run* const previous_run = impl::current_run;
+  impl::current_run = &run;
+  const uint32_t repeat = std::max(options.repeat, uint32_t{1});
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < repeat && !IsError(run.fault); ++i) {
+    run.insns_left = state_->options.max_insns;
+    run.tail_calls = 0;
+    run.redirect_map = nullptr;
+    result.retval = RunProgram(id, &ctx, &run);
+    run.reservations.clear();
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  impl::current_run = previous_run;
+  for (const auto& map : state_->maps) {
+    map->Reclaim();
+  }
+  RETURN_IF_ERROR(run.fault);
+
+  result.duration =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed) / repeat;
+  result.packet.assign(reinterpret_cast<uint8_t*>(uintptr_t{ctx.data}),
+                       reinterpret_cast<uint8_t*>(uintptr_t{ctx.data_end}));
+  if (result.retval == XDP_REDIRECT) {
+    result.redirect_map = run.redirect_map;
+    result.redirect_key = run.redirect_key;
+  }
+  return result;
+}
+
+error::StatusOr<Vm> CreateVm(Object object, VmOptions options) {
+  auto state = std::make_unique<Vm::State>();
+  state->helpers = GetBuiltinHelpers();
+  state->helpers[BPF_FUNC_tail_call] = impl::TailCall;
+  for (const auto& [id, helper] : options.helpers) {
+    if (id >= kMaxHelpers) {
+      return MakeStatus(EINVAL, "helper id out of range");
+    }
+    state->helpers[id] = helper;
+  }
+
+  for (const auto& spec : object.maps) {
+    ASSIGN_OR_RETURN(auto map, CreateMap(spec));
+    state->maps.push_back(std::move(map));
+  }
+
+  for (auto& spec : object.programs) {
+    auto& insns = spec.insns;
+    for (const auto& [pc, index] : spec.map_references) {
+      if (pc + 1 >= insns.size() || index >= state->maps.size()) {
+        return MakeInsnStatus(spec.section, pc, "invalid map reference");
+      }
+      const auto map = reinterpret_cast<uint64_t>(state->maps[index].get());
+      insns[pc].src_reg = 0;
+      insns[pc].imm = static_cast<uint32_t>(map);
+      insns[pc + 1].imm = static_cast<uint32_t>(map >> 32);
+    }
+    RETURN_IF_ERROR(
+        Validator(spec.section, insns, state->helpers).Validate());
+
+    Vm::State::Program program;
+    program.section = std::move(spec.section);
+    program.insns = std::move(insns);
+    if (options.engine == Engine::kJit) {
+      ASSIGN_OR_RETURN(auto jit, impl::Compile(program.insns, state->helpers));
+      program.jit = std::move(jit);
+    }
+    state->programs.push_back(std::move(program));
+  }
+
+  state->options = std::move(options);
+  return Vm(std::move(state));
+}
+
+error::StatusOr<Vm> CreateVm(const std::string_view elf, VmOptions options) {
+  ASSIGN_OR_RETURN(auto object, ParseObject(elf));
+  return CreateVm(std::move(object), std::move(options));
+}
+
+}  // namespace vm
@@ -0,0 +1,131 @@
+#ifndef LIB_VM_VM_H_
+#define LIB_VM_VM_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "lib/base/span.h"
+#include "lib/error/status_or.h"
+#include "lib/vm/elf.h"
+#include "lib/vm/helpers.h"
+#include "lib/vm/map.h"
+
+// Userspace eBPF: load and run the xdp programs of an eBPF ELF object
+// without the bpf() syscall, for tests and machines where loading programs
+// is not allowed.
+//
+// Example usage:
+//   ASSIGN_OR_RETURN(auto vm, vm::CreateVm(ebpf::counter));
+//   ASSIGN_OR_RETURN(const auto id, vm.GetProgramId("xdp"));
+//   ASSIGN_OR_RETURN(const auto result, vm.RunXdp(id, packet));
+//   ASSIGN_OR_RETURN(const auto count,
+//                    vm.GetMap("counters")->Lookup<uint64_t>(0u));
+//
+// Programs run the way the kernel would run them, on a single CPU, with the
+// helpers of GetBuiltinHelpers(). Differences to look out for:
+//  - Programs are validated but not verified: the interpreter checks memory
+//    accesses as they happen instead, and fails the run with EFAULT.
+//  - Per-CPU maps hold a single value.
+//  - Redirects are only reported: see XdpRunResult.
+
+namespace vm {
+
+namespace impl {
+struct Run;
+uint64_t TailCall(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
+}  // namespace impl
+
+enum class Engine {
+  // Checks memory accesses and counts instructions. Runs anywhere.
+  kInterpreter,
+  // Compiles programs to native code, for speed: x86-64 only. Programs are
+  // trusted, as after the kernel verifier; test them with the interpreter
+  // first.
+  kJit,
+};
+
+struct VmOptions {
+  Engine engine = Engine::kInterpreter;
+  // Instructions the interpreter runs at most per run, tail calls included,
+  // before failing the run with ELOOP.
+  uint64_t max_insns = uint64_t{1} << 20;
+  // Helpers adding to or replacing those built in, by id.
+  std::map<uint32_t, Helper> helpers;
+};
+
+struct XdpRunOptions {
+  uint32_t ingress_ifindex = 1;
+  uint32_t rx_queue_index = 0;
+  // Runs, back to back on the same packet as with bpf::TestRun().
+  uint32_t repeat = 1;
+};
+
+// The result of XDP runs, that of bpf::TestRunResult and where the packet
+// was redirected to.
+struct XdpRunResult {
+  uint32_t retval = 0;
+  // Mean run time of the program.
+  std::chrono::nanoseconds duration{0};
+  // The packet as the program left it.
+  std::vector<uint8_t> packet;
+  // On XDP_REDIRECT, the map and key of bpf_redirect_map(); or nullptr and
+  // the ifindex of bpf_redirect().
+  const Map* redirect_map = nullptr;
+  uint32_t redirect_key = 0;
+};
+
+// The maps and programs of an object. Movable, not copyable.
+class Vm {
+ public:
+  Vm(Vm&&);
+  Vm& operator=(Vm&&);
+  ~Vm();
+
+  // Return the map named 'name', nullptr if none.
+  Map* GetMap(std::string_view name) const;
+
+  // Return the id of the program of 'section', or of the first program if
+  // empty. Program arrays hold these ids, as they hold file descriptors of
+  // programs in the kernel.
+  error::StatusOr<uint32_t> GetProgramId(std::string_view section = "") const;
+
+  // Run program 'id', an xdp program, on a copy of 'packet' 'options.repeat'
+  // times. Fails with EFAULT on bad memory accesses and ELOOP on runs of
+  // more than VmOptions::max_insns instructions, as caught by the
+  // interpreter.
+  error::StatusOr<XdpRunResult> RunXdp(uint32_t id,
+                                       base::Span<const uint8_t> packet,
+                                       const XdpRunOptions& options = {});
+
+ private:
+  struct State;
+
+  explicit Vm(std::unique_ptr<State> state);
+
+  // Run program 'id' on 'ctx' within 'run', and return its r0; -1 if there
+  // is no such program.
+  uint64_t RunProgram(uint32_t id, void* ctx, impl::Run* run) const;
+
+  std::unique_ptr<State> state_;
+
+  friend error::StatusOr<Vm> CreateVm(Object, VmOptions);
+  friend uint64_t impl::TailCall(uint64_t, uint64_t, uint64_t, uint64_t,
+                                 uint64_t);
+};
+
+// Create the maps and load the programs of 'object'. Fails with EINVAL on
+// invalid programs, and ENOTSUP on maps of types not supported or calls to
+// helpers missing.
+error::StatusOr<Vm> CreateVm(Object object, VmOptions options = {});
+
+// Parse 'elf', an eBPF ELF object as built by cc_ebpf(), and create its
+// maps and load its programs.
+error::StatusOr<Vm> CreateVm(std::string_view elf, VmOptions options = {});
+
+}  // namespace vm
+
+#endif  // LIB_VM_VM_H_
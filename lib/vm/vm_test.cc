@@ -0,0 +1,640 @@
+#include "lib/vm/vm.h"
+
+#include <linux/bpf.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/ebpf/counter.h"
+#include "lib/posix/errno.h"
+
+namespace vm {
+namespace {
+
+bpf_insn MakeInsn(const uint8_t code, const uint8_t dst, const uint8_t src,
+                  const int16_t off, const int32_t imm) {
+  bpf_insn insn = {};
+  insn.code = code;
+  insn.dst_reg = dst;
+  insn.src_reg = src;
+  insn.off = off;
+  insn.imm = imm;
+  return insn;
+}
+
+bpf_insn Alu64(const uint8_t op, const uint8_t dst, const int32_t imm) {
+  return MakeInsn(BPF_ALU64 | op | BPF_K, dst, 0, 0, imm);
+}
+
+bpf_insn Alu64Reg(const uint8_t op, const uint8_t dst, const uint8_t src) {
+  return MakeInsn(BPF_ALU64 | op | BPF_X, dst, src, 0, 0);
+}
+
+bpf_insn Alu32(const uint8_t op, const uint8_t dst, const int32_t imm) {
+  return MakeInsn(BPF_ALU | op | BPF_K, dst, 0, 0, imm);
+}
+
+bpf_insn Alu32Reg(const uint8_t op, const uint8_t dst, const uint8_t src) {
+  return MakeInsn(BPF_ALU | op | BPF_X, dst, src, 0, 0);
+}
+
+bpf_insn Mov(const uint8_t dst, const int32_t imm) {
+  return Alu64(BPF_MOV, dst, imm);
+}
+
+bpf_insn Call(const int32_t helper) {
+  return MakeInsn(BPF_JMP | BPF_CALL, 0, 0, 0, helper);
+}
+
+bpf_insn Swap(const uint8_t order, const int32_t bits) {
+  return MakeInsn(BPF_ALU | BPF_END | order, BPF_REG_1, 0, 0, bits);
+}
+
+bpf_insn Exit() { return MakeInsn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0); }
+
+// Append the two instructions loading 'imm' to 'dst' to 'insns'.
+void LoadImm64(const uint8_t dst, const uint64_t imm,
+               std::vector<bpf_insn>* const insns) {
+  insns->push_back(MakeInsn(BPF_LD | BPF_IMM | BPF_DW, dst, 0, 0,
+                            static_cast<uint32_t>(imm)));
+  insns->push_back(MakeInsn(0, 0, 0, 0, static_cast<uint32_t>(imm >> 32)));
+}
+
+// Append the two instructions loading map 'map' to 'dst' to 'program'.
+void LoadMap(const uint8_t dst, const size_t map,
+             ProgramSpec* const program) {
+  program->map_references[program->insns.size()] = map;
+  program->insns.push_back(
+      MakeInsn(BPF_LD | BPF_IMM | BPF_DW, dst, BPF_PSEUDO_MAP_FD, 0, 0));
+  program->insns.push_back(MakeInsn(0, 0, 0, 0, 0));
+}
+
+ProgramSpec MakeProgram(std::vector<bpf_insn> insns,
+                        const std::string& section = "xdp") {
+  ProgramSpec program;
+  program.section = section;
+  program.insns = std::move(insns);
+  return program;
+}
+
+MapSpec MakeMapSpec(const std::string& name, const uint32_t type,
+                    const uint32_t key_size, const uint32_t value_size,
+                    const uint32_t max_entries) {
+  MapSpec spec;
+  spec.name = name;
+  spec.type = type;
+  spec.key_size = key_size;
+  spec.value_size = value_size;
+  spec.max_entries = max_entries;
+  return spec;
+}
+
+// A program incrementing the first byte of packets and returning XDP_TX.
+std::vector<bpf_insn> MakeIncrementProg() {
+  return {
+      // r2 = ctx->data, r3 = ctx->data_end
+      MakeInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, 0, 0),
+      MakeInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_1, 4, 0),
+      // r0 = XDP_TX
+      Mov(BPF_REG_0, XDP_TX),
+      // if r2 + 1 > r3 goto exit
+      Alu64Reg(BPF_MOV, BPF_REG_4, BPF_REG_2),
+      Alu64(BPF_ADD, BPF_REG_4, 1),
+      MakeInsn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 3, 0),
+      // ++*(u8 *)r2
+      MakeInsn(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 0, 0),
+      Alu64(BPF_ADD, BPF_REG_5, 1),
+      MakeInsn(BPF_STX | BPF_MEM | BPF_B, BPF_REG_2, BPF_REG_5, 0, 0),
+      Exit(),
+  };
+}
+
+class VmTest : public testing::TestWithParam<Engine> {
+ protected:
+  error::StatusOr<Vm> Create(Object object, VmOptions options = {}) {
+    options.engine = GetParam();
+    return CreateVm(std::move(object), std::move(options));
+  }
+
+  // Run 'body', instructions setting r0, and return r0: the program stores
+  // it to the packet.
+  uint64_t Compute(const std::vector<bpf_insn>& body) {
+    std::vector<bpf_insn> insns = {
+        MakeInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_9, BPF_REG_1, 0, 0)};
+    insns.insert(insns.end(), body.begin(), body.end());
+    insns.push_back(
+        MakeInsn(BPF_STX | BPF_MEM | BPF_DW, BPF_REG_9, BPF_REG_0, 0, 0));
+    insns.push_back(Mov(BPF_REG_0, XDP_PASS));
+    insns.push_back(Exit());
+
+    Object object;
+    object.programs.push_back(MakeProgram(std::move(insns)));
+    auto vm_or = Create(std::move(object));
+    EXPECT_TRUE(IsOk(vm_or)) << GetText(GetStatus(vm_or));
+    if (!IsOk(vm_or)) {
+      return 0;
+    }
+    const std::vector<uint8_t> packet(sizeof(uint64_t));
+    const auto result_or = GetValue(vm_or).RunXdp(0, base::MakeSpan(packet));
+    EXPECT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+    if (!IsOk(result_or) ||
+        GetValue(result_or).packet.size() != sizeof(uint64_t)) {
+      return 0;
+    }
+    uint64_t r0;
+    std::memcpy(&r0, GetValue(result_or).packet.data(), sizeof(r0));
+    return r0;
+  }
+
+  // Same, with 'r1' and 'r2' set first.
+  uint64_t Compute(const uint64_t r1, const uint64_t r2,
+                   const std::vector<bpf_insn>& body) {
+    std::vector<bpf_insn> insns;
+    LoadImm64(BPF_REG_1, r1, &insns);
+    LoadImm64(BPF_REG_2, r2, &insns);
+    insns.insert(insns.end(), body.begin(), body.end());
+    return Compute(insns);
+  }
+
+  // Return r1 after 'insn'.
+  uint64_t Apply(const uint64_t r1, const uint64_t r2, const bpf_insn& insn) {
+    return Compute(r1, r2, {insn, Alu64Reg(BPF_MOV, BPF_REG_0, BPF_REG_1)});
+  }
+};
+
+TEST_P(VmTest, RunsPrograms) {
+  Object object;
+  object.programs.push_back(MakeProgram(MakeIncrementProg()));
+  auto vm_or = Create(std::move(object));
+  ASSERT_TRUE(IsOk(vm_or)) << GetText(GetStatus(vm_or));
+  const std::vector<uint8_t> packet = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                       13, 14};
+
+  const auto result_or = GetValue(vm_or).RunXdp(0, base::MakeSpan(packet));
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  EXPECT_EQ(XDP_TX, GetValue(result_or).retval);
+  ASSERT_EQ(packet.size(), GetValue(result_or).packet.size());
+  EXPECT_EQ(2, GetValue(result_or).packet[0]);
+  EXPECT_TRUE(std::equal(packet.begin() + 1, packet.end(),
+                         GetValue(result_or).packet.begin() + 1));
+
+  XdpRunOptions options;
+  options.repeat = 10;
+  const auto repeated_or =
+      GetValue(vm_or).RunXdp(0, base::MakeSpan(packet), options);
+  ASSERT_TRUE(IsOk(repeated_or)) << GetText(GetStatus(repeated_or));
+  EXPECT_EQ(11, GetValue(repeated_or).packet[0]);
+}
+
+TEST_P(VmTest, RunsObjects) {
+  VmOptions options;
+  options.engine = GetParam();
+  auto vm_or = CreateVm(ebpf::counter, options);
+  ASSERT_TRUE(IsOk(vm_or)) << GetText(GetStatus(vm_or));
+  auto& vm = GetValue(vm_or);
+  const auto id_or = vm.GetProgramId("xdp");
+  ASSERT_TRUE(IsOk(id_or));
+  EXPECT_TRUE(posix::IsErrno(GetStatus(vm.GetProgramId("tc")), ENOENT));
+  Map* const packets = vm.GetMap("packets");
+  ASSERT_NE(nullptr, packets);
+  EXPECT_EQ(nullptr, vm.GetMap("bytes"));
+
+  const std::vector<uint8_t> packet(64);
+  XdpRunOptions run_options;
+  run_options.repeat = 3;
+  const auto result_or =
+      vm.RunXdp(GetValue(id_or), base::MakeSpan(packet), run_options);
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  EXPECT_EQ(XDP_PASS, GetValue(result_or).retval);
+  EXPECT_EQ(packet, GetValue(result_or).packet);
+  EXPECT_EQ(3, GetValue(packets->Lookup<uint64_t>(0u)));
+}
+
+TEST_P(VmTest, ComputesLikeTheKernel) {
+  const uint64_t kMax = ~uint64_t{0};
+  const uint8_t r1 = BPF_REG_1;
+  const uint8_t r2 = BPF_REG_2;
+
+  EXPECT_EQ(5, Apply(2, 3, Alu64Reg(BPF_ADD, r1, r2)));
+  EXPECT_EQ(kMax, Apply(2, 3, Alu64Reg(BPF_SUB, r1, r2)));
+  EXPECT_EQ(0xffffffff, Apply(2, 3, Alu32Reg(BPF_SUB, r1, r2)));
+  EXPECT_EQ(0x300000000, Apply(0x100000000, 3, Alu64Reg(BPF_MUL, r1, r2)));
+  EXPECT_EQ(kMax - 6, Apply(kMax, 0, Alu64(BPF_MUL, r1, 7)));
+  EXPECT_EQ(0xe0, Apply(0xff, 0, Alu64(BPF_AND, r1, 0xe0)));
+  EXPECT_EQ(0xff, Apply(0xf0, 0x0f, Alu64Reg(BPF_OR, r1, r2)));
+  EXPECT_EQ(0xf0, Apply(0xff, 0x0f, Alu64Reg(BPF_XOR, r1, r2)));
+  EXPECT_EQ(kMax, Apply(1, 0, Alu64(BPF_NEG, r1, 0)));
+  EXPECT_EQ(0xffffffff, Apply(1, 0, Alu32(BPF_NEG, r1, 0)));
+
+  // Moves: 32 bit ones zero extend, 64 bit ones sign extend immediates.
+  EXPECT_EQ(0x12345678,
+            Apply(0xffffffff12345678, 0, Alu32Reg(BPF_MOV, r1, r1)));
+  EXPECT_EQ(kMax - 1, Apply(0, 0, Alu64(BPF_MOV, r1, -2)));
+  EXPECT_EQ(0xfffffffe, Apply(0, 0, Alu32(BPF_MOV, r1, -2)));
+
+  // Division is unsigned. By zero, it gives zero and modulo leaves as is.
+  EXPECT_EQ(kMax / 3, Apply(kMax, 3, Alu64Reg(BPF_DIV, r1, r2)));
+  EXPECT_EQ(kMax % 10, Apply(kMax, 10, Alu64Reg(BPF_MOD, r1, r2)));
+  EXPECT_EQ(0xffffffffu / 3, Apply(kMax, 0, Alu32(BPF_DIV, r1, 3)));
+  EXPECT_EQ(0, Apply(kMax, 0, Alu64Reg(BPF_DIV, r1, r2)));
+  EXPECT_EQ(kMax, Apply(kMax, 0, Alu64Reg(BPF_MOD, r1, r2)));
+  EXPECT_EQ(0xffffffff, Apply(kMax, 0, Alu32Reg(BPF_MOD, r1, r2)));
+  // With r0 and r3, the registers x86 divides with.
+  EXPECT_EQ(3, Compute(10, 3, {Alu64Reg(BPF_MOV, BPF_REG_0, r1),
+                               Alu64Reg(BPF_MOV, BPF_REG_3, r2),
+                               Alu64Reg(BPF_DIV, BPF_REG_0, BPF_REG_3)}));
+  EXPECT_EQ(1, Compute(10, 3, {Alu64Reg(BPF_MOV, BPF_REG_3, r1),
+                               Alu64Reg(BPF_MOV, BPF_REG_0, r2),
+                               Alu64Reg(BPF_MOD, BPF_REG_3, BPF_REG_0),
+                               Alu64Reg(BPF_MOV, BPF_REG_0, BPF_REG_3)}));
+
+  // Shifts, masked. With r4, the register x86 shifts by.
+  EXPECT_EQ(uint64_t{1} << 40, Apply(1, 40, Alu64Reg(BPF_LSH, r1, r2)));
+  EXPECT_EQ(uint64_t{1} << 40, Apply(1, 104, Alu64Reg(BPF_LSH, r1, r2)));
+  EXPECT_EQ(1, Apply(kMax, 63, Alu64Reg(BPF_RSH, r1, r2)));
+  EXPECT_EQ(kMax, Apply(kMax, 63, Alu64Reg(BPF_ARSH, r1, r2)));
+  EXPECT_EQ(0xffffffff, Apply(0x80000000, 0, Alu32(BPF_ARSH, r1, 31)));
+  EXPECT_EQ(0x80000000, Apply(1, 63, Alu32Reg(BPF_LSH, r1, r2)));
+  EXPECT_EQ(uint64_t{1} << 40,
+            Compute(1, 40, {Alu64Reg(BPF_MOV, BPF_REG_4, r2),
+                            Alu64Reg(BPF_LSH, r1, BPF_REG_4),
+                            Alu64Reg(BPF_MOV, BPF_REG_0, r1)}));
+  EXPECT_EQ(uint64_t{1} << 40,
+            Compute(1, 40, {Alu64Reg(BPF_MOV, BPF_REG_4, r1),
+                            Alu64Reg(BPF_LSH, BPF_REG_4, r2),
+                            Alu64Reg(BPF_MOV, BPF_REG_0, BPF_REG_4)}));
+  EXPECT_EQ(42, Compute(1, 40, {Mov(BPF_REG_4, 42),
+                                Alu64Reg(BPF_LSH, r1, r2),
+                                Alu64Reg(BPF_MOV, BPF_REG_0, BPF_REG_4)}));
+
+  // Byte swaps, the host being little endian.
+  const uint64_t bytes = 0x0102030405060708;
+  EXPECT_EQ(0x0807, Apply(bytes, 0, Swap(BPF_TO_BE, 16)));
+  EXPECT_EQ(0x08070605, Apply(bytes, 0, Swap(BPF_TO_BE, 32)));
+  EXPECT_EQ(0x0807060504030201, Apply(bytes, 0, Swap(BPF_TO_BE, 64)));
+  EXPECT_EQ(0x0708, Apply(bytes, 0, Swap(BPF_TO_LE, 16)));
+  EXPECT_EQ(0x05060708, Apply(bytes, 0, Swap(BPF_TO_LE, 32)));
+  EXPECT_EQ(bytes, Apply(bytes, 0, Swap(BPF_TO_LE, 64)));
+}
+
+TEST_P(VmTest, JumpsLikeTheKernel) {
+  // 1 if the jump is taken, 0 if not.
+  const auto jump = [this](const bpf_insn& insn, const uint64_t r1,
+                           const uint64_t r2) {
+    return Compute(r1, r2, {Mov(BPF_REG_0, 1), insn, Mov(BPF_REG_0, 0)});
+  };
+  const auto x = [](const uint8_t code) {
+    return MakeInsn(code | BPF_X, BPF_REG_1, BPF_REG_2, 1, 0);
+  };
+  const auto k = [](const uint8_t code, const int32_t imm) {
+    return MakeInsn(code | BPF_K, BPF_REG_1, 0, 1, imm);
+  };
+  const uint64_t kMinus1 = ~uint64_t{0};
+  const uint8_t kJmp32 = 0x06;
+
+  EXPECT_EQ(1, jump(x(BPF_JMP | BPF_JEQ), 7, 7));
+  EXPECT_EQ(0, jump(x(BPF_JMP | BPF_JNE), 7, 7));
+  EXPECT_EQ(1, jump(x(BPF_JMP | BPF_JGT), kMinus1, 1));
+  EXPECT_EQ(0, jump(x(BPF_JMP | BPF_JSGT), kMinus1, 1));
+  EXPECT_EQ(1, jump(x(BPF_JMP | BPF_JSLT), kMinus1, 1));
+  EXPECT_EQ(1, jump(x(BPF_JMP | BPF_JGE), 1, 1));
+  EXPECT_EQ(1, jump(x(BPF_JMP | BPF_JLE), 1, 1));
+  EXPECT_EQ(0, jump(x(BPF_JMP | BPF_JLT), 1, 1));
+  EXPECT_EQ(1, jump(x(BPF_JMP | BPF_JSGE), 1, kMinus1));
+  EXPECT_EQ(1, jump(x(BPF_JMP | BPF_JSLE), kMinus1, kMinus1));
+  EXPECT_EQ(1, jump(x(BPF_JMP | BPF_JSET), 6, 3));
+  EXPECT_EQ(0, jump(x(BPF_JMP | BPF_JSET), 4, 3));
+
+  // 32 bit jumps only look at the lower halves.
+  EXPECT_EQ(1, jump(x(kJmp32 | BPF_JEQ), 0x100000007, 7));
+  EXPECT_EQ(1, jump(x(kJmp32 | BPF_JSLT), 0xffffffff, 0));
+  EXPECT_EQ(0, jump(x(BPF_JMP | BPF_JSLT), 0xffffffff, 0));
+
+  // Immediates are sign extended.
+  EXPECT_EQ(1, jump(k(BPF_JMP | BPF_JEQ, -1), kMinus1, 0));
+  EXPECT_EQ(0, jump(k(BPF_JMP | BPF_JEQ, -1), 0xffffffff, 0));
+  EXPECT_EQ(1, jump(k(kJmp32 | BPF_JEQ, -1), 0xffffffff, 0));
+  EXPECT_EQ(1, jump(k(BPF_JMP | BPF_JSET, 2), 6, 0));
+  EXPECT_EQ(1, jump(k(BPF_JMP | BPF_JSLT, 0), kMinus1, 0));
+}
+
+TEST_P(VmTest, AccessesMemoryLikeTheKernel) {
+  const auto st = [](const uint8_t size, const int16_t off,
+                     const int32_t imm) {
+    return MakeInsn(BPF_ST | BPF_MEM | size, BPF_REG_10, 0, off, imm);
+  };
+  const auto ldx = [](const uint8_t size, const int16_t off) {
+    return MakeInsn(BPF_LDX | BPF_MEM | size, BPF_REG_0, BPF_REG_10, off, 0);
+  };
+  const auto xadd = [](const uint8_t size, const uint8_t src) {
+    return MakeInsn(BPF_STX | BPF_XADD | size, BPF_REG_10, src, -8, 0);
+  };
+
+  const uint64_t value = 0x0102030405060708;
+  EXPECT_EQ(2 * value + 5,
+            Compute(value, 5,
+                    {MakeInsn(BPF_STX | BPF_MEM | BPF_DW, BPF_REG_10,
+                              BPF_REG_1, -8, 0),
+                     xadd(BPF_DW, BPF_REG_1), xadd(BPF_W, BPF_REG_2),
+                     ldx(BPF_DW, -8)}));
+  EXPECT_EQ(0x0304, Compute({st(BPF_W, -4, 0x01020304), ldx(BPF_H, -4)}));
+  EXPECT_EQ(0xffffffffffff0000, Compute({st(BPF_DW, -8, -1),
+                                         st(BPF_H, -8, 0), ldx(BPF_DW, -8)}));
+  EXPECT_EQ(0xff00, Compute({st(BPF_DW, -8, -1), st(BPF_B, -8, 0),
+                             ldx(BPF_H, -8)}));
+}
+
+TEST_P(VmTest, CallsFunctions) {
+  Object object;
+  object.programs.push_back(MakeProgram({
+      // r0 = f(5) + r6 + *(u64 *)(r10 - 8), with f clobbering r6 and its
+      // own stack.
+      MakeInsn(BPF_ST | BPF_MEM | BPF_DW, BPF_REG_10, 0, -8, 1000),
+      Mov(BPF_REG_6, 100),
+      Mov(BPF_REG_1, 5),
+      MakeInsn(BPF_JMP | BPF_CALL, 0, BPF_PSEUDO_CALL, 0, 4),
+      Alu64Reg(BPF_ADD, BPF_REG_0, BPF_REG_6),
+      MakeInsn(BPF_LDX | BPF_MEM | BPF_DW, BPF_REG_7, BPF_REG_10, -8, 0),
+      Alu64Reg(BPF_ADD, BPF_REG_0, BPF_REG_7),
+      Exit(),
+      // f(x) = x + 7.
+      MakeInsn(BPF_ST | BPF_MEM | BPF_DW, BPF_REG_10, 0, -8, 7),
+      Mov(BPF_REG_6, 1),
+      MakeInsn(BPF_LDX | BPF_MEM | BPF_DW, BPF_REG_0, BPF_REG_10, -8, 0),
+      Alu64Reg(BPF_ADD, BPF_REG_0, BPF_REG_1),
+      Exit(),
+  }));
+  auto vm_or = Create(std::move(object));
+  ASSERT_TRUE(IsOk(vm_or)) << GetText(GetStatus(vm_or));
+  const std::vector<uint8_t> packet(64);
+  const auto result_or = GetValue(vm_or).RunXdp(0, base::MakeSpan(packet));
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  EXPECT_EQ(5 + 7 + 100 + 1000, GetValue(result_or).retval);
+}
+
+TEST_P(VmTest, TailCalls) {
+  Object object;
+  object.maps.push_back(
+      MakeMapSpec("progs", BPF_MAP_TYPE_PROG_ARRAY, 4, 4, 4));
+  ProgramSpec first = MakeProgram({}, "xdp");
+  LoadMap(BPF_REG_2, 0, &first);
+  first.insns.push_back(Mov(BPF_REG_3, 1));
+  first.insns.push_back(Call(BPF_FUNC_tail_call));
+  first.insns.push_back(Mov(BPF_REG_0, XDP_DROP));
+  first.insns.push_back(Exit());
+  object.programs.push_back(std::move(first));
+  object.programs.push_back(
+      MakeProgram({Mov(BPF_REG_0, XDP_TX), Exit()}, "xdp/next"));
+
+  auto vm_or = Create(std::move(object));
+  ASSERT_TRUE(IsOk(vm_or)) << GetText(GetStatus(vm_or));
+  auto& vm = GetValue(vm_or);
+  const std::vector<uint8_t> packet(64);
+
+  auto result_or = vm.RunXdp(0, base::MakeSpan(packet));
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  EXPECT_EQ(XDP_DROP, GetValue(result_or).retval);
+
+  const auto next_or = vm.GetProgramId("xdp/next");
+  ASSERT_TRUE(IsOk(next_or));
+  ASSERT_TRUE(IsOk(vm.GetMap("progs")->Update(1u, GetValue(next_or))));
+  result_or = vm.RunXdp(0, base::MakeSpan(packet));
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  EXPECT_EQ(XDP_TX, GetValue(result_or).retval);
+
+  // Tail calls to itself stop after 32.
+  ASSERT_TRUE(IsOk(vm.GetMap("progs")->Update(1u, 0u)));
+  result_or = vm.RunXdp(0, base::MakeSpan(packet));
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  EXPECT_EQ(XDP_DROP, GetValue(result_or).retval);
+}
+
+TEST_P(VmTest, AdjustsPackets) {
+  Object object;
+  object.programs.push_back(MakeProgram({
+      // Push 4 bytes of header, then grow the tail by 10.
+      Alu64Reg(BPF_MOV, BPF_REG_6, BPF_REG_1),
+      Mov(BPF_REG_2, -4),
+      Call(BPF_FUNC_xdp_adjust_head),
+      MakeInsn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_0, 0, 8, 0),
+      Alu64Reg(BPF_MOV, BPF_REG_1, BPF_REG_6),
+      Mov(BPF_REG_2, 10),
+      Call(kHelperXdpAdjustTail),
+      MakeInsn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_0, 0, 5, 0),
+      // Write the new header.
+      MakeInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, 0, 0),
+      MakeInsn(BPF_ST | BPF_MEM | BPF_W, BPF_REG_2, 0, 0, -1),
+      Mov(BPF_REG_0, XDP_TX),
+      Exit(),
+      Mov(BPF_REG_0, XDP_ABORTED),
+      Exit(),
+  }));
+  auto vm_or = Create(std::move(object));
+  ASSERT_TRUE(IsOk(vm_or)) << GetText(GetStatus(vm_or));
+  const std::vector<uint8_t> packet(64, 1);
+
+  const auto result_or = GetValue(vm_or).RunXdp(0, base::MakeSpan(packet));
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  EXPECT_EQ(XDP_TX, GetValue(result_or).retval);
+  std::vector<uint8_t> expected(4, 0xff);
+  expected.insert(expected.end(), packet.begin(), packet.end());
+  expected.insert(expected.end(), 10, 0);
+  EXPECT_EQ(expected, GetValue(result_or).packet);
+}
+
+TEST_P(VmTest, ReportsRedirects) {
+  Object object;
+  object.maps.push_back(MakeMapSpec("ports", BPF_MAP_TYPE_DEVMAP, 4, 4, 4));
+  // redirect_map(ports, ctx->rx_queue_index, XDP_PASS)
+  ProgramSpec program = MakeProgram({Alu64Reg(BPF_MOV, BPF_REG_6, BPF_REG_1)});
+  LoadMap(BPF_REG_1, 0, &program);
+  program.insns.push_back(
+      MakeInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, 16, 0));
+  program.insns.push_back(Mov(BPF_REG_3, XDP_PASS));
+  program.insns.push_back(Call(BPF_FUNC_redirect_map));
+  program.insns.push_back(Exit());
+  object.programs.push_back(std::move(program));
+
+  auto vm_or = Create(std::move(object));
+  ASSERT_TRUE(IsOk(vm_or)) << GetText(GetStatus(vm_or));
+  auto& vm = GetValue(vm_or);
+  ASSERT_TRUE(IsOk(vm.GetMap("ports")->Update(1u, 7u)));
+  const std::vector<uint8_t> packet(64);
+
+  XdpRunOptions options;
+  options.rx_queue_index = 1;
+  auto result_or = vm.RunXdp(0, base::MakeSpan(packet), options);
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  EXPECT_EQ(XDP_REDIRECT, GetValue(result_or).retval);
+  EXPECT_EQ(vm.GetMap("ports"), GetValue(result_or).redirect_map);
+  EXPECT_EQ(1, GetValue(result_or).redirect_key);
+
+  options.rx_queue_index = 2;
+  result_or = vm.RunXdp(0, base::MakeSpan(packet), options);
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  EXPECT_EQ(XDP_PASS, GetValue(result_or).retval);
+  EXPECT_EQ(nullptr, GetValue(result_or).redirect_map);
+}
+
+TEST_P(VmTest, OutputsRecords) {
+  Object object;
+  object.maps.push_back(MakeMapSpec("events", kMapTypeRingbuf, 0, 0, 4096));
+  ProgramSpec program = MakeProgram({});
+  // Output 8 bytes from the stack.
+  program.insns.push_back(
+      MakeInsn(BPF_ST | BPF_MEM | BPF_DW, BPF_REG_10, 0, -8, 42));
+  LoadMap(BPF_REG_1, 0, &program);
+  program.insns.push_back(Alu64Reg(BPF_MOV, BPF_REG_2, BPF_REG_10));
+  program.insns.push_back(Alu64(BPF_ADD, BPF_REG_2, -8));
+  program.insns.push_back(Mov(BPF_REG_3, 8));
+  program.insns.push_back(Mov(BPF_REG_4, 0));
+  program.insns.push_back(Call(kHelperRingbufOutput));
+  // Reserve 4 bytes, fill and submit them.
+  LoadMap(BPF_REG_1, 0, &program);
+  program.insns.push_back(Mov(BPF_REG_2, 4));
+  program.insns.push_back(Mov(BPF_REG_3, 0));
+  program.insns.push_back(Call(kHelperRingbufReserve));
+  program.insns.push_back(
+      MakeInsn(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, 4, 0));
+  program.insns.push_back(
+      MakeInsn(BPF_ST | BPF_MEM | BPF_W, BPF_REG_0, 0, 0, 7));
+  program.insns.push_back(Alu64Reg(BPF_MOV, BPF_REG_1, BPF_REG_0));
+  program.insns.push_back(Mov(BPF_REG_2, 0));
+  program.insns.push_back(Call(kHelperRingbufSubmit));
+  program.insns.push_back(Mov(BPF_REG_0, XDP_PASS));
+  program.insns.push_back(Exit());
+  object.programs.push_back(std::move(program));
+
+  auto vm_or = Create(std::move(object));
+  ASSERT_TRUE(IsOk(vm_or)) << GetText(GetStatus(vm_or));
+  auto& vm = GetValue(vm_or);
+  const std::vector<uint8_t> packet(64);
+  const auto result_or = vm.RunXdp(0, base::MakeSpan(packet));
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+
+  const auto records = vm.GetMap("events")->TakeRecords();
+  ASSERT_EQ(2, records.size());
+  EXPECT_EQ((std::vector<uint8_t>{42, 0, 0, 0, 0, 0, 0, 0}), records[0]);
+  EXPECT_EQ((std::vector<uint8_t>{7, 0, 0, 0}), records[1]);
+}
+
+uint64_t ReturnSeven(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t) {
+  return 7;
+}
+
+TEST_P(VmTest, CallsHelpersGiven) {
+  Object object;
+  object.programs.push_back(
+      MakeProgram({Call(kHelperFibLookup), Exit()}));
+  VmOptions options;
+  options.helpers[kHelperFibLookup] = ReturnSeven;
+  auto vm_or = Create(std::move(object), options);
+  ASSERT_TRUE(IsOk(vm_or)) << GetText(GetStatus(vm_or));
+  const std::vector<uint8_t> packet(64);
+  const auto result_or = GetValue(vm_or).RunXdp(0, base::MakeSpan(packet));
+  ASSERT_TRUE(IsOk(result_or)) << GetText(GetStatus(result_or));
+  EXPECT_EQ(7, GetValue(result_or).retval);
+}
+
+TEST_P(VmTest, FailsOnInvalidPrograms) {
+  const auto load = [this](std::vector<bpf_insn> insns) {
+    Object object;
+    object.programs.push_back(MakeProgram(std::move(insns)));
+    return GetStatus(Create(std::move(object)));
+  };
+  EXPECT_TRUE(IsOk(load({Mov(BPF_REG_0, 0), Exit()})));
+  EXPECT_TRUE(posix::IsErrno(load({}), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(load({Mov(BPF_REG_0, 0)}), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(load({MakeInsn(0xff, 0, 0, 0, 0), Exit()}),
+                             EINVAL));
+  EXPECT_TRUE(posix::IsErrno(load({Mov(BPF_REG_10, 0), Exit()}), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(load({Mov(11, 0), Exit()}), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(
+      load({MakeInsn(BPF_JMP | BPF_JA, 0, 0, 1, 0), Exit()}), EINVAL));
+  EXPECT_TRUE(posix::IsErrno(
+      load({MakeInsn(BPF_LD | BPF_IMM | BPF_DW, 0, 0, 0, 0), Exit()}),
+      EINVAL));
+  EXPECT_TRUE(posix::IsErrno(load({Call(200), Exit()}), ENOTSUP));
+  // Atomic operations other than add, e.g. BPF_FETCH | BPF_ADD.
+  EXPECT_TRUE(IsOk(
+      load({MakeInsn(BPF_STX | BPF_XADD | BPF_DW, BPF_REG_10, BPF_REG_1, -8,
+                     BPF_ADD),
+            Mov(BPF_REG_0, 0), Exit()})));
+  EXPECT_TRUE(posix::IsErrno(
+      load({MakeInsn(BPF_STX | BPF_XADD | BPF_DW, BPF_REG_10, BPF_REG_1, -8,
+                     BPF_ADD | 0x01),
+            Mov(BPF_REG_0, 0), Exit()}),
+      EINVAL));
+  EXPECT_TRUE(posix::IsErrno(
+      load({MakeInsn(BPF_STX | BPF_XADD | BPF_W, BPF_REG_10, BPF_REG_1, -8,
+                     BPF_OR),
+            Mov(BPF_REG_0, 0), Exit()}),
+      EINVAL));
+  // f calls itself.
+  EXPECT_TRUE(posix::IsErrno(
+      load({MakeInsn(BPF_JMP | BPF_CALL, 0, BPF_PSEUDO_CALL, 0, 1), Exit(),
+            MakeInsn(BPF_JMP | BPF_CALL, 0, BPF_PSEUDO_CALL, 0, -1), Exit()}),
+      EINVAL));
+}
+
+INSTANTIATE_TEST_SUITE_P(Engines, VmTest,
+                         testing::Values(Engine::kInterpreter, Engine::kJit));
+
+// The interpreter checks what the kernel verifier would have.
+class InterpreterTest : public testing::Test {
+ protected:
+  error::Status Run(std::vector<bpf_insn> insns) {
+    Object object;
+    object.programs.push_back(MakeProgram(std::move(insns)));
+    VmOptions options;
+    options.max_insns = 1000;
+    auto vm_or = CreateVm(std::move(object), options);
+    EXPECT_TRUE(IsOk(vm_or)) << GetText(GetStatus(vm_or));
+    if (!IsOk(vm_or)) {
+      return GetStatus(vm_or);
+    }
+    const std::vector<uint8_t> packet(64);
+    return GetStatus(GetValue(vm_or).RunXdp(0, base::MakeSpan(packet)));
+  }
+};
+
+TEST_F(InterpreterTest, FailsOnBadAccesses) {
+  // Past the end of the packet.
+  EXPECT_TRUE(posix::IsErrno(
+      Run({MakeInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, 0, 0),
+           MakeInsn(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_0, BPF_REG_2, 64, 0),
+           Exit()}),
+      EFAULT));
+  // Writes to the context.
+  EXPECT_TRUE(posix::IsErrno(
+      Run({MakeInsn(BPF_ST | BPF_MEM | BPF_W, BPF_REG_1, 0, 0, 0), Exit()}),
+      EFAULT));
+  // Below the stack.
+  EXPECT_TRUE(posix::IsErrno(
+      Run({MakeInsn(BPF_LDX | BPF_MEM | BPF_DW, BPF_REG_0, BPF_REG_10,
+                    -512 - 8, 0),
+           Exit()}),
+      EFAULT));
+  // Through a null pointer of a lookup.
+  EXPECT_TRUE(posix::IsErrno(
+      Run({Mov(BPF_REG_0, 0),
+           MakeInsn(BPF_LDX | BPF_MEM | BPF_DW, BPF_REG_0, BPF_REG_0, 0, 0),
+           Exit()}),
+      EFAULT));
+  EXPECT_TRUE(IsOk(
+      Run({MakeInsn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, 0, 0),
+           MakeInsn(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_0, BPF_REG_2, 63, 0),
+           Exit()})));
+}
+
+TEST_F(InterpreterTest, FailsOnEndlessLoops) {
+  EXPECT_TRUE(posix::IsErrno(
+      Run({Mov(BPF_REG_0, 0), MakeInsn(BPF_JMP | BPF_JA, 0, 0, -2, 0),
+           Exit()}),
+      ELOOP));
+}
+
+}  // namespace
+}  // namespace vm
@@ -0,0 +1,103 @@
+#include "lib/xdp_bulk_loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <thread>
+#include <utility>
+
+#include "lib/posix/errno.h"
+
+namespace {
+
+// Run 'task' on indexes 0 to 'count' - 1 from up to 'threads' threads.
+void RunParallel(const size_t count, unsigned threads,
+                 const std::function<void(size_t)>& task) {
+  if (threads == 0) {
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  threads = std::min<size_t>(threads, count);
+  std::atomic<size_t> next{0};
+  const auto run = [&] {
+    for (size_t i = next++; i < count; i = next++) {
+      task(i);
+    }
+  };
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; ++i) {
+    pool.emplace_back(run);
+  }
+  run();
+  for (auto& thread : pool) {
+    thread.join();
+  }
+}
+
+// Loader calls return negative errnos, or libbpf's own codes above 4000.
+error::Status MakeStatus(const int ret, const std::string_view text) {
+  return error::Status(posix::MakeCodeFromErrno(ret < 0 ? -ret : ret), text);
+}
+
+error::StatusOr<XdpHandle> LoadAndAttach(const XdpLoadSpec& spec) {
+  auto xdph = std::make_unique<XdpLoader>();
+  const int ret = spec.shared
+                      ? xdph->LoadFrmSharedBuffer(spec.buffer, spec.name)
+                      : xdph->LoadFrmBuffer(spec.buffer, spec.name);
+  if (ret) {
+    return MakeStatus(ret, "loading xdp program failed");
+  }
+  const int attach_ret = xdph->Attach(spec.ifindex, spec.mode);
+  if (attach_ret) {
+    return MakeStatus(attach_ret, "attaching xdp program failed");
+  }
+  return std::move(xdph);
+}
+
+}  // namespace
+
+XdpBulkLoadResult LoadAndAttachXdpBulk(const std::vector<XdpLoadSpec>& specs,
+                                       const XdpBulkLoadOptions& options) {
+  const auto start = std::chrono::steady_clock::now();
+  XdpBulkLoadResult result;
+  result.handles.resize(specs.size());
+
+  // Round one: load each distinct shared object once, keeping it alive in
+  // 'objects' until all its specs got their handle.
+  std::map<std::pair<std::string_view, std::string_view>, size_t> index;
+  std::vector<const XdpLoadSpec*> distinct;
+  for (const auto& spec : specs) {
+    if (spec.shared &&
+        index.emplace(std::make_pair(spec.buffer, spec.name), distinct.size())
+            .second) {
+      distinct.push_back(&spec);
+    }
+  }
+  std::vector<error::StatusOr<XdpHandle>> objects(distinct.size());
+  RunParallel(distinct.size(), options.threads, [&](const size_t i) {
+    auto xdph = std::make_unique<XdpLoader>();
+    const int ret =
+        xdph->LoadFrmSharedBuffer(distinct[i]->buffer, distinct[i]->name);
+    objects[i] = ret ? error::StatusOr<XdpHandle>(
+                           MakeStatus(ret, "loading xdp program failed"))
+                     : std::move(xdph);
+  });
+
+  // Round two: attach every spec, failing those whose object did not load
+  // without trying again.
+  RunParallel(specs.size(), options.threads, [&](const size_t i) {
+    const auto& spec = specs[i];
+    if (spec.shared) {
+      const auto& object =
+          objects[index.at(std::make_pair(spec.buffer, spec.name))];
+      if (IsError(object)) {
+        result.handles[i] = GetStatus(object);
+        return;
+      }
+    }
+    result.handles[i] = LoadAndAttach(spec);
+  });
+
+  result.wall_time = std::chrono::steady_clock::now() - start;
+  return result;
+}
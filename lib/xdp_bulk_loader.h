@@ -0,0 +1,62 @@
+#ifndef LIB_XDP_BULK_LOADER_H_
+#define LIB_XDP_BULK_LOADER_H_
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lib/error/status_or.h"
+#include "lib/xdp_loader.h"
+
+// One program to load and attach to one link.
+struct XdpLoadSpec {
+  // ELF object, e.g. ebpf::sample. Must stay valid during the bulk load.
+  std::string_view buffer;
+  std::string name;
+
+  int ifindex = 0;
+  XdpMode mode = XdpMode::kAuto;
+
+  // Share the loaded object with the other shared specs of the same buffer
+  // and name, see LoadSharedXdpBuffer(): the program is verified once for
+  // all of their links, which then also share its maps.
+  bool shared = false;
+};
+
+struct XdpBulkLoadOptions {
+  // Threads loading in parallel, 0 for one per CPU. Never more than there
+  // are objects to load.
+  unsigned threads = 0;
+};
+
+struct XdpBulkLoadResult {
+  // Handle of each spec, in order, or why it failed to load or attach.
+  std::vector<error::StatusOr<XdpHandle>> handles;
+
+  // Time taken by the whole bulk load.
+  std::chrono::nanoseconds wall_time{0};
+};
+
+// Load and attach all 'specs' concurrently, so startup time is bounded by the
+// slowest verification rather than their sum. Each spec succeeds or fails on
+// its own.
+//
+// Shared specs are loaded in two rounds: every distinct object first, then the
+// handles of all specs, which only attach from the cache. Without that, specs
+// of the same object would each run the verifier in parallel.
+//
+// Example usage:
+//
+// std::vector<XdpLoadSpec> specs;
+// for (const int ifindex : ifindexes) {
+//   specs.push_back({ebpf::sample, "sample", ifindex, XdpMode::kNative, true});
+// }
+// auto result = LoadAndAttachXdpBulk(specs);
+// for (auto& handle_or : result.handles) RETURN_IF_ERROR(GetStatus(handle_or));
+//
+XdpBulkLoadResult LoadAndAttachXdpBulk(
+    const std::vector<XdpLoadSpec>& specs,
+    const XdpBulkLoadOptions& options = XdpBulkLoadOptions());
+
+#endif  // LIB_XDP_BULK_LOADER_H_
@@ -0,0 +1,117 @@
+#include "lib/xdp_chain.h"
+
+#include <cerrno>
+
+#include "lib/bpf/map.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+
+namespace {
+
+error::Status MakeStatus(const int e, const std::string_view text) {
+  return error::Status(posix::MakeCodeFromErrno(e < 0 ? -e : e), text);
+}
+
+}  // namespace
+
+error::StatusOr<XdpLoader*> XdpChain::FindObject(
+    const std::string& name) const {
+  const auto it = objects_.find(name);
+  if (it == objects_.end()) {
+    return MakeStatus(ENOENT, "no such object in chain");
+  }
+  return it->second.get();
+}
+
+error::Status XdpChain::AddObject(const std::string_view buffer,
+                                  const std::string& name) {
+  if (objects_.count(name)) {
+    return MakeStatus(EEXIST, "object already in chain");
+  }
+  auto xdph = std::make_unique<XdpLoader>();
+  const int ret = xdph->LoadFrmBufferWithMaps(
+      buffer, name, {{kXdpChainMapName, GetValue(GetValue(prog_array_))}});
+  if (ret) {
+    return MakeStatus(ret, "loading chain object failed");
+  }
+  objects_.emplace(name, std::move(xdph));
+  return error::kOkStatus;
+}
+
+error::Status XdpChain::RemoveObject(const std::string& name) {
+  ASSIGN_OR_RETURN(const XdpLoader* const xdph, FindObject(name));
+  for (const auto& object : stages_) {
+    if (object == name) {
+      return MakeStatus(EBUSY, "object still runs a stage");
+    }
+  }
+  if (xdph->AttachedIfindex()) {
+    return MakeStatus(EBUSY, "object still attached");
+  }
+  objects_.erase(name);
+  return error::kOkStatus;
+}
+
+error::Status XdpChain::SetStage(const uint32_t stage,
+                                 const std::string& object,
+                                 const std::string& section) {
+  if (stage >= stages_.size()) {
+    return MakeStatus(EINVAL, "no such stage");
+  }
+  ASSIGN_OR_RETURN(const int prog_fd, GetProgFd(object, section));
+  RETURN_IF_ERROR(bpf::impl::UpdateElement(GetValue(prog_array_), &stage,
+                                           &prog_fd, BPF_ANY));
+  stages_[stage] = object;
+  return error::kOkStatus;
+}
+
+error::Status XdpChain::ClearStage(const uint32_t stage) {
+  if (stage >= stages_.size()) {
+    return MakeStatus(EINVAL, "no such stage");
+  }
+  const auto status = bpf::impl::DeleteElement(GetValue(prog_array_), &stage);
+  if (IsError(status) && !posix::IsErrno(status, ENOENT)) {
+    return status;
+  }
+  stages_[stage].clear();
+  return error::kOkStatus;
+}
+
+error::Status XdpChain::Attach(const int ifindex, const XdpMode mode,
+                               const std::string& object,
+                               const std::string& section) {
+  ASSIGN_OR_RETURN(XdpLoader* const xdph, FindObject(object));
+  const int ret = xdph->Attach(ifindex, mode, section);
+  if (ret) {
+    return MakeStatus(ret, "attaching chain entry failed");
+  }
+  return error::kOkStatus;
+}
+
+error::Status XdpChain::Detach(const std::string& object) {
+  ASSIGN_OR_RETURN(XdpLoader* const xdph, FindObject(object));
+  const int ret = xdph->Detach();
+  if (ret) {
+    return MakeStatus(ret, "detaching chain entry failed");
+  }
+  return error::kOkStatus;
+}
+
+error::StatusOr<int> XdpChain::GetProgFd(const std::string& object,
+                                         const std::string& section) const {
+  ASSIGN_OR_RETURN(const XdpLoader* const xdph, FindObject(object));
+  const int prog_fd = xdph->GetProgFd(section);
+  if (prog_fd < 0) {
+    return MakeStatus(prog_fd, "no such program in object");
+  }
+  return prog_fd;
+}
+
+error::StatusOr<XdpChain> CreateXdpChain() {
+  ASSIGN_OR_RETURN(auto prog_array,
+                   bpf::impl::CreateMap(BPF_MAP_TYPE_PROG_ARRAY,
+                                        sizeof(uint32_t), sizeof(uint32_t),
+                                        kXdpChainMaxStages, 0));
+  return XdpChain(std::move(prog_array));
+}
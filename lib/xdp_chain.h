@@ -0,0 +1,111 @@
+#ifndef LIB_XDP_CHAIN_H_
+#define LIB_XDP_CHAIN_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lib/error/status.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/file_descriptor.h"
+#include "lib/posix/unique_file_descriptor.h"
+#include "lib/xdp_loader.h"
+
+// Name and size of the BPF_MAP_TYPE_PROG_ARRAY stages are chained through,
+// see lib/ebpf/chain.h.
+constexpr char kXdpChainMapName[] = "chain";
+constexpr uint32_t kXdpChainMaxStages = 8;
+
+// Pipeline of xdp programs chained with tail calls, e.g. parse, classify,
+// ACL, NAT and forward stages each in their own program. Programs come from
+// any number of objects, all sharing the chain's prog array; each is verified
+// on its own, never as part of one monolithic program.
+//
+// Stages are slots of the prog array. Filling, swapping or clearing a slot is
+// a single map update, atomic for packets in flight: they run either the old
+// or the new stage. Packets skip empty slots.
+//
+// Example usage:
+//
+// ASSIGN_OR_RETURN(auto chain, CreateXdpChain());
+// RETURN_IF_ERROR(chain.AddObject(ebpf::pipeline, "pipeline"));
+// RETURN_IF_ERROR(chain.AddObject(ebpf::acl, "acl"));
+// RETURN_IF_ERROR(chain.SetStage(kParse, "pipeline", "xdp/parse"));
+// RETURN_IF_ERROR(chain.SetStage(kAcl, "acl", "xdp/acl"));
+// RETURN_IF_ERROR(chain.Attach(ifindex, XdpMode::kNative, "pipeline",
+//                              "xdp/entry"));
+// ...
+// // Upgrade the ACL stage without touching the rest.
+// RETURN_IF_ERROR(chain.AddObject(ebpf::acl_v2, "acl_v2"));
+// RETURN_IF_ERROR(chain.SetStage(kAcl, "acl_v2", "xdp/acl"));
+// RETURN_IF_ERROR(chain.RemoveObject("acl"));
+//
+class XdpChain {
+ public:
+  XdpChain() = default;
+
+  // Take ownership of 'prog_array'. Prefer CreateXdpChain().
+  explicit XdpChain(posix::UniqueFileDescriptor prog_array)
+      : prog_array_(std::move(prog_array)), stages_(kXdpChainMaxStages) {}
+
+  // Default move constructor.
+  XdpChain(XdpChain&&) = default;
+
+  // Default move assignment operator.
+  XdpChain& operator=(XdpChain&&) = default;
+
+  // Load 'buffer' as object 'name', its "chain" map being the chain's prog
+  // array. Fails with EEXIST if 'name' is taken.
+  error::Status AddObject(std::string_view buffer, const std::string& name);
+
+  // Unload object 'name'. Fails with EBUSY while one of its programs is a
+  // stage or attached.
+  error::Status RemoveObject(const std::string& name);
+
+  // Run program 'section' of 'object' as stage 'stage', in place of the stage
+  // there if any.
+  error::Status SetStage(uint32_t stage, const std::string& object,
+                         const std::string& section);
+
+  // Empty slot 'stage', packets skip it from now on.
+  error::Status ClearStage(uint32_t stage);
+
+  // Attach program 'section' of 'object', which starts the pipeline, to link
+  // 'ifindex'. Attaching another object to the same link is allowed, detach
+  // first to switch links.
+  error::Status Attach(int ifindex, XdpMode mode, const std::string& object,
+                       const std::string& section);
+
+  // Detach the program attached by 'object', if any.
+  error::Status Detach(const std::string& object);
+
+  // Return the fd of program 'section' of 'object', owned by the chain.
+  error::StatusOr<int> GetProgFd(const std::string& object,
+                                 const std::string& section) const;
+
+ private:
+  // Return the prog array of 'chain'.
+  friend posix::FileDescriptor GetFileDescriptor(const XdpChain& chain) {
+    return GetValue(chain.prog_array_);
+  }
+
+  // Return the object whose program is stage 'stage' of 'chain', empty if
+  // none.
+  friend const std::string& GetStageObject(const XdpChain& chain,
+                                           const uint32_t stage) {
+    return chain.stages_.at(stage);
+  }
+
+  error::StatusOr<XdpLoader*> FindObject(const std::string& name) const;
+
+  posix::UniqueFileDescriptor prog_array_;
+  std::map<std::string, XdpHandle> objects_;
+  std::vector<std::string> stages_;  // Object of each stage.
+};
+
+// Create a chain with an empty prog array and no objects.
+error::StatusOr<XdpChain> CreateXdpChain();
+
+#endif  // LIB_XDP_CHAIN_H_
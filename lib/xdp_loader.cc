@@ -1,39 +1,461 @@
+#include <cerrno>
+#include <chrono>
+#include <functional>
 #include <iostream>
 #include <string>
 #include <memory>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <linux/if_link.h>
+#include "lib/btf/btf.h"
+#include "lib/btf/core.h"
+#include "lib/ebpd_link.h"
 #include "lib/ebpd_utils.h"
 #include "lib/ebpd.h"
+#include "lib/verifier/verifier.h"
 #include "lib/xdp_loader.h"
 
 using namespace std;
 
+static void
+UnloadObject(void *handle) {
+    ebpd_unload(handle);
+    cout << "eBPF program unloaded, obj: " << handle << "\n";
+}
+
 int
 XdpLoader::LoadFrmFile(const string& filepath, const int ifindex) {
-    int ret = ebpd_load_xdp_prog(filepath.c_str(), ifindex, &handle_);
+    void *handle = nullptr;
+    int ret = ebpd_load_xdp_prog(filepath.c_str(), ifindex, &handle);
     if (ret) {
         cout << "Error: eBPF program " << filepath << " load failed " << ret << "\n";
         return ret;
     }
-    cout << "eBPF program load succeeded, obj: " << handle_ << "\n";
+    handle_.reset(handle, UnloadObject);
+    cout << "eBPF program load succeeded, obj: " << handle << "\n";
     return 0;
 }
 
+/*
+ * Buffers relocated against the BTF of a kernel, keyed by a hash of the
+ * elf. Buffers are embedded in the binary, so there are few of them and
+ * entries live as long as the process: each is relocated once per BTF.
+ * Entries don't keep a copy of the elf, only where the caller's buffer
+ * was: a hit needs the same hash and size at the same place, and a copy
+ * of the elf elsewhere is relocated again, taking over the entry.
+ */
+namespace {
+
+struct RelocatedObject {
+    string btf_path;
+    const char *elf_data;  /* compared on hits, hashes can collide */
+    size_t elf_size;
+    shared_ptr<const string> relocated;
+};
+
+mutex relocated_objects_lock;
+unordered_multimap<size_t, RelocatedObject> relocated_objects;
+
+/* Caller holds relocated_objects_lock */
+shared_ptr<const string>
+FindRelocatedObject(const size_t hash, const string_view& buffer,
+                    const string& btf_path) {
+    auto range = relocated_objects.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.btf_path == btf_path &&
+            it->second.elf_data == buffer.data() &&
+            it->second.elf_size == buffer.size()) {
+            return it->second.relocated;
+        }
+    }
+    return nullptr;
+}
+
 int
-XdpLoader::LoadFrmBuffer(const string_view& buffer, const string& name) {
-    int ret = ebpd_load_xdp_buffer((void *)buffer.data(), buffer.size(), name.c_str(), &handle_);
+StatusToErrno(const error::Status& status) {
+    return -GetCode(status).value();
+}
+
+}  // namespace
+
+/*
+ * Apply the CO-RE relocations of 'buffer' against the BTF at 'btf_path'.
+ * On success *relocated holds the relocated elf, or nullptr if 'buffer'
+ * has no relocations and loads as is.
+ */
+static int
+RelocateBuffer(const string_view& buffer, const string& btf_path,
+               shared_ptr<const string> *relocated) {
+    *relocated = nullptr;
+    const auto has_relocations_or = btf::HasCoreRelocations(buffer);
+    if (IsError(has_relocations_or)) {
+        cout << "Error: eBPF buffer malformed: "
+             << GetText(GetStatus(has_relocations_or)) << "\n";
+        return StatusToErrno(GetStatus(has_relocations_or));
+    }
+    if (!GetValue(has_relocations_or)) {
+        return 0;
+    }
+    const size_t hash = std::hash<string_view>()(buffer);
+    {
+        lock_guard<mutex> lock(relocated_objects_lock);
+        *relocated = FindRelocatedObject(hash, buffer, btf_path);
+    }
+    if (*relocated) {
+        return 0;
+    }
+    /*
+     * Parse the BTF without the lock, and anew for each buffer: the BTF
+     * of a kernel is large, and only needed until all buffers are
+     * relocated.
+     */
+    const auto target_or = btf::ReadBtfFile(btf_path);
+    if (IsError(target_or)) {
+        cout << "Error: BTF " << btf_path << " unusable: "
+             << GetText(GetStatus(target_or)) << "\n";
+        return StatusToErrno(GetStatus(target_or));
+    }
+    auto relocated_or = btf::RelocateObject(buffer, GetValue(target_or));
+    if (IsError(relocated_or)) {
+        cout << "Error: eBPF buffer relocation against BTF " << btf_path
+             << " failed: " << GetText(GetStatus(relocated_or)) << "\n";
+        return StatusToErrno(GetStatus(relocated_or));
+    }
+    *relocated = make_shared<const string>(move(GetValue(relocated_or)));
+    cout << "eBPF buffer relocated against BTF " << btf_path << "\n";
+    lock_guard<mutex> lock(relocated_objects_lock);
+    if (FindRelocatedObject(hash, buffer, btf_path)) {
+        return 0;
+    }
+    /* Likely the same elf at another place: keep one entry per elf */
+    auto range = relocated_objects.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.btf_path == btf_path &&
+            it->second.elf_size == buffer.size()) {
+            it->second.elf_data = buffer.data();
+            it->second.relocated = *relocated;
+            return 0;
+        }
+    }
+    relocated_objects.emplace(
+        hash, RelocatedObject{btf_path, buffer.data(), buffer.size(),
+                              *relocated});
+    return 0;
+}
+
+string
+XdpLoader::BtfPath() const {
+    return btf_path_.empty() ? btf::kKernelBtfPath : btf_path_;
+}
+
+int
+XdpLoader::Relocate(const string_view& buffer,
+                    shared_ptr<const string> *relocated) const {
+    return RelocateBuffer(buffer, BtfPath(), relocated);
+}
+
+void
+XdpLoader::Verify(const string_view& elf, const string& name) {
+    verifier_stats_.clear();
+    if (!verifier_log_level_) {
+        return;
+    }
+    /*
+     * Not a failure of the load: the load below decides, and loads what
+     * VerifyObject() cannot, e.g. maps of maps.
+     */
+    auto stats_or = verifier::VerifyObject(elf, verifier_log_level_);
+    if (IsError(stats_or)) {
+        cout << "Error: eBPF program " << name << " verification failed: "
+             << GetText(GetStatus(stats_or)) << "\n";
+        return;
+    }
+    verifier_stats_ = move(GetValue(stats_or));
+    for (const auto& entry : verifier_stats_) {
+        const verifier::Stats& stats = entry.second;
+        cout << "eBPF program " << name << " section " << entry.first
+             << " verified: " << stats.processed_insns
+             << " insns processed, " << stats.total_states << " states, in "
+             << chrono::duration_cast<chrono::microseconds>(stats.load_time)
+                    .count()
+             << " us\n";
+    }
+}
+
+int
+XdpLoader::LoadElf(const string_view& buffer, const string& name,
+                   const function<int(const string_view& elf, void **handle)>& load) {
+    shared_ptr<const string> relocated;
+    int ret = Relocate(buffer, &relocated);
+    if (ret) {
+        return ret;
+    }
+    const string_view elf = relocated ? *relocated : buffer;
+    Verify(elf, name);
+    void *handle = nullptr;
+    ret = load(elf, &handle);
     if (ret) {
         cout << "Error: eBPF program " << name << " load failed " << ret << "\n";
         return ret;
     }
-    cout << "eBPF buffer load succeeded, obj: " << handle_ << "\n";
+    handle_.reset(handle, UnloadObject);
+    cout << "eBPF buffer load succeeded, obj: " << handle << "\n";
     return 0;
 }
 
-XdpLoader::~XdpLoader() {
+int
+XdpLoader::LoadFrmBuffer(const string_view& buffer, const string& name) {
+    return LoadElf(buffer, name, [&](const string_view& elf, void **handle) {
+        return ebpd_load_xdp_buffer((void *)elf.data(), elf.size(), name.c_str(),
+                                    handle);
+    });
+}
+
+int
+XdpLoader::LoadFrmPinnedBuffer(const string_view& buffer, const string& name) {
+    if (name.empty() || name.find('/') != string::npos) {
+        return -EINVAL;
+    }
+    const string pin_dir = PinnedMapsDir(name);
+    cout << "eBPF program " << name << " pinning maps in " << pin_dir << "\n";
+    return LoadElf(buffer, name, [&](const string_view& elf, void **handle) {
+        return ebpd_load_xdp_buffer_pinned((void *)elf.data(), elf.size(),
+                                           name.c_str(), pin_dir.c_str(), handle);
+    });
+}
+
+int
+XdpLoader::LoadFrmBufferWithMaps(const string_view& buffer, const string& name,
+                                 const map<string, int>& maps) {
+    vector<ebpd_map_reuse> reuse;
+    for (const auto& entry : maps) {
+        reuse.push_back({entry.first.c_str(), entry.second});
+    }
+    return LoadElf(buffer, name, [&](const string_view& elf, void **handle) {
+        return ebpd_load_xdp_buffer_reuse((void *)elf.data(), elf.size(),
+                                          name.c_str(), reuse.data(),
+                                          reuse.size(), handle);
+    });
+}
+
+/*
+ * Objects loaded from shared buffers, keyed by a hash of the elf, and
+ * shared by loaders of the same name relocating for the same BTF.
+ * Entries only hold weak references: the sharing loaders own the objects,
+ * and expired entries are dropped on the next load.
+ */
+namespace {
+
+struct SharedObject {
+    string name;
+    string btf_path;
+    string elf;  /* compared on hits, hashes can collide */
+    weak_ptr<void> handle;
+};
+
+mutex shared_objects_lock;
+unordered_multimap<size_t, SharedObject> shared_objects;
+
+/* Caller holds shared_objects_lock */
+shared_ptr<void>
+FindSharedObject(const size_t hash, const string_view& buffer, const string& name,
+                 const string& btf_path) {
+    auto range = shared_objects.equal_range(hash);
+    for (auto it = range.first; it != range.second;) {
+        shared_ptr<void> handle = it->second.handle.lock();
+        if (!handle) {
+            it = shared_objects.erase(it);
+            continue;
+        }
+        if (it->second.name == name && it->second.btf_path == btf_path &&
+            it->second.elf == buffer) {
+            return handle;
+        }
+        ++it;
+    }
+    return nullptr;
+}
+
+}  // namespace
+
+int
+XdpLoader::LoadFrmSharedBuffer(const string_view& buffer, const string& name) {
+    const size_t hash = std::hash<string_view>()(buffer);
+    const string btf_path = BtfPath();
+    {
+        lock_guard<mutex> lock(shared_objects_lock);
+        handle_ = FindSharedObject(hash, buffer, name, btf_path);
+    }
     if (handle_) {
-        ebpd_unload(handle_);
-        cout << "eBPF program unloaded, obj: " << handle_ << "\n";
+        cout << "eBPF buffer shared, obj: " << handle_.get() << "\n";
+        return 0;
+    }
+    /*
+     * Load without the lock so loads of different buffers run in
+     * parallel. Should another loader of this buffer win the race, use
+     * its object and drop ours.
+     */
+    int ret = LoadFrmBuffer(buffer, name);
+    if (ret) {
+        return ret;
+    }
+    lock_guard<mutex> lock(shared_objects_lock);
+    shared_ptr<void> winner = FindSharedObject(hash, buffer, name, btf_path);
+    if (winner) {
+        handle_ = move(winner);
+        return 0;
+    }
+    shared_objects.emplace(
+        hash, SharedObject{name, btf_path, string(buffer), handle_});
+    return 0;
+}
+
+static __u32
+XdpModeToFlags(const XdpMode mode) {
+    switch (mode) {
+    case XdpMode::kGeneric:
+        return XDP_FLAGS_SKB_MODE;
+    case XdpMode::kNative:
+        return XDP_FLAGS_DRV_MODE;
+    case XdpMode::kOffload:
+        return XDP_FLAGS_HW_MODE;
+    default:
+        return 0;
+    }
+}
+
+static XdpMode
+XdpModeFromAttached(const __u8 attach_mode) {
+    switch (attach_mode) {
+    case XDP_ATTACHED_SKB:
+        return XdpMode::kGeneric;
+    case XDP_ATTACHED_DRV:
+        return XdpMode::kNative;
+    case XDP_ATTACHED_HW:
+        return XdpMode::kOffload;
+    default:
+        return XdpMode::kNone;
+    }
+}
+
+int
+XdpLoader::Attach(const int ifindex, const XdpMode mode, const string& section) {
+    if (mode == XdpMode::kNone) {
+        return -EINVAL;
+    }
+    int prog_fd = GetProgFd(section);
+    if (prog_fd < 0) {
+        cout << "Error: no eBPF program " << section << " to attach " << prog_fd << "\n";
+        return prog_fd;
+    }
+    if (ifindex_ && ifindex_ != ifindex) {
+        int ret = Detach();
+        if (ret) {
+            return ret;
+        }
+    }
+    const __u32 flags = XdpModeToFlags(mode);
+    int ret = ebpd_link_set_xdp(ifindex, prog_fd, flags);
+    if (ret) {
+        cout << "Error: eBPF program attach to ifindex " << ifindex << " failed " << ret << "\n";
+        return ret;
+    }
+    prog_fd_ = prog_fd;
+    ifindex_ = ifindex;
+    __u8 attach_mode = XDP_ATTACHED_NONE;
+    ret = ebpd_link_xdp_mode(ifindex, prog_fd, &attach_mode);
+    if (ret) {
+        cout << "Error: eBPF program attach mode query failed " << ret << "\n";
+        /*
+         * Don't leave the program running unaccounted for. The same flags
+         * select the mode the kernel attached in; if even this fails, the
+         * destructor tries again.
+         */
+        if (ebpd_link_set_xdp(ifindex, -1, flags) == 0) {
+            ifindex_ = 0;
+            prog_fd_ = -1;
+        }
+        return ret;
     }
+    attached_mode_ = XdpModeFromAttached(attach_mode);
+    cout << "eBPF program attached to ifindex " << ifindex
+         << " in mode " << static_cast<int>(attached_mode_) << "\n";
+    return 0;
+}
+
+int
+XdpLoader::Detach() {
+    if (!ifindex_) {
+        return 0;
+    }
+    int ret = ebpd_link_detach_xdp(ifindex_, prog_fd_);
+    if (ret) {
+        cout << "Error: eBPF program detach from ifindex " << ifindex_ << " failed " << ret << "\n";
+        return ret;
+    }
+    ifindex_ = 0;
+    prog_fd_ = -1;
+    attached_mode_ = XdpMode::kNone;
+    return 0;
+}
+
+int
+XdpLoader::Replace(XdpHandle next, const string& section) {
+    if (!ifindex_ || !next || next->ifindex_) {
+        return -EINVAL;
+    }
+    int prog_fd = next->GetProgFd(section);
+    if (prog_fd < 0) {
+        cout << "Error: no eBPF program " << section << " to replace with " << prog_fd << "\n";
+        return prog_fd;
+    }
+    const __u32 flags = XdpModeToFlags(attached_mode_);
+    int ret = ebpd_link_replace_xdp(ifindex_, prog_fd, prog_fd_, flags);
+    if (ret) {
+        cout << "Error: eBPF program replace on ifindex " << ifindex_ << " failed " << ret << "\n";
+        return ret;
+    }
+    /*
+     * The new program must land exactly where the old one was; anything
+     * else (e.g. the driver refusing it natively) is rolled back.
+     */
+    __u8 attach_mode = XDP_ATTACHED_NONE;
+    ret = ebpd_link_xdp_mode(ifindex_, prog_fd, &attach_mode);
+    if (!ret && XdpModeFromAttached(attach_mode) != attached_mode_) {
+        ret = -EINVAL;
+    }
+    if (ret) {
+        cout << "Error: eBPF program replace on ifindex " << ifindex_ << " rolled back " << ret << "\n";
+        if (ebpd_link_replace_xdp(ifindex_, prog_fd_, prog_fd, flags)) {
+            cout << "Error: eBPF program rollback on ifindex " << ifindex_ << " failed\n";
+        }
+        return ret;
+    }
+    /*
+     * Hand the old object to 'next', which unloads it when it goes out
+     * of scope; only now is it safe to let go of it.
+     */
+    swap(handle_, next->handle_);
+    prog_fd_ = prog_fd;
+    cout << "eBPF program replaced on ifindex " << ifindex_ << "\n";
+    return 0;
+}
+
+int
+XdpLoader::GetMapFd(const string& name) const {
+    return ebpd_get_map_fd(handle_.get(), name.c_str());
+}
+
+int
+XdpLoader::GetProgFd(const string& section) const {
+    return ebpd_get_prog_fd(handle_.get(), section.empty() ? nullptr : section.c_str());
+}
+
+XdpLoader::~XdpLoader() {
+    /* The object goes with the last loader sharing it */
+    Detach();
 }
 
 XdpHandle
@@ -54,3 +476,67 @@ LoadXdpBuffer(const string_view& buffer, const string& name) {
     return nullptr;
 }
 
+XdpHandle
+LoadSharedXdpBuffer(const string_view& buffer, const string& name) {
+    XdpHandle xdph = make_unique<XdpLoader>();
+    if (xdph->LoadFrmSharedBuffer(buffer, name) == 0) {
+        return xdph;
+    }
+    return nullptr;
+}
+
+size_t
+SharedXdpObjectCount() {
+    lock_guard<mutex> lock(shared_objects_lock);
+    size_t count = 0;
+    for (const auto& entry : shared_objects) {
+        if (!entry.second.handle.expired()) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+XdpHandle
+LoadPinnedXdpBuffer(const string_view& buffer, const string& name) {
+    XdpHandle xdph = make_unique<XdpLoader>();
+    if (xdph->LoadFrmPinnedBuffer(buffer, name) == 0) {
+        return xdph;
+    }
+    return nullptr;
+}
+
+string
+PinnedMapsDir(const string& name) {
+    return string(EBPD_PIN_ROOT) + "/" + name;
+}
+
+int
+UnpinXdpMaps(const string& name) {
+    if (name.empty() || name.find('/') != string::npos) {
+        return -EINVAL;
+    }
+    return ebpd_unpin_maps(PinnedMapsDir(name).c_str());
+}
+
+XdpHandle
+LoadAndAttachXdpBuffer(const string_view& buffer, const string& name,
+                       const int ifindex, const XdpMode mode) {
+    XdpHandle xdph = LoadXdpBuffer(buffer, name);
+    if (xdph && xdph->Attach(ifindex, mode) == 0) {
+        return xdph;
+    }
+    return nullptr;
+}
+
+int
+ReplaceXdpBuffer(const XdpHandle& xdph, const string_view& buffer, const string& name) {
+    if (!xdph) {
+        return -EINVAL;
+    }
+    XdpHandle next = LoadXdpBuffer(buffer, name);
+    if (!next) {
+        return -EINVAL;
+    }
+    return xdph->Replace(move(next));
+}
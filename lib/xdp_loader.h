@@ -1,14 +1,154 @@
 #ifndef LIB_XDP_LOADER_H_
 #define LIB_XDP_LOADER_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "lib/verifier/verifier.h"
+
+/*
+ * Modes an xdp program can be attached to a link in.
+ * See XDP_FLAGS_*_MODE in linux/if_link.h
+ */
+enum class XdpMode {
+    kNone,      // not attached; only ever reported, never requested
+    kAuto,      // kernel picks: native if the driver supports it, else generic
+    kGeneric,   // XDP_FLAGS_SKB_MODE, runs after skb allocation (slowest)
+    kNative,    // XDP_FLAGS_DRV_MODE, runs in the driver rx path
+    kOffload,   // XDP_FLAGS_HW_MODE, runs on the NIC
+};
+
 class XdpLoader {
     public:
         XdpLoader() { };
         ~XdpLoader();
         int LoadFrmFile(const std::string& filepath, const int ifindex);
         int LoadFrmBuffer(const std::string_view& buffer, const std::string& name);
+        /*
+         * Like LoadFrmBuffer, but share the object with every other loader
+         * of the same buffer and name, relocating for the same BTF: the elf
+         * is parsed and its programs verified once, by the first loader. All sharers see the same
+         * program and map fds; the object is unloaded with the last of them.
+         */
+        int LoadFrmSharedBuffer(const std::string_view& buffer,
+                                const std::string& name);
+        /*
+         * Like LoadFrmBuffer, but keep the maps pinned in bpffs under
+         * PinnedMapsDir(name), so their contents survive restarts. Maps
+         * pinned there by a previous load with the same definition are
+         * reused as they are; maps whose definition changed start empty.
+         */
+        int LoadFrmPinnedBuffer(const std::string_view& buffer,
+                                const std::string& name);
+        /*
+         * Like LoadFrmBuffer, but the maps of the object named in 'maps'
+         * use the given map fds, which stay owned by the caller, instead of
+         * new maps. Lets objects loaded separately share maps.
+         */
+        int LoadFrmBufferWithMaps(const std::string_view& buffer,
+                                  const std::string& name,
+                                  const std::map<std::string, int>& maps);
+        /*
+         * Attach a loaded program to a link. Attaching to another ifindex
+         * detaches from the previous one. On failure the program is not
+         * left attached.
+         * ifindex - link to attach to
+         * mode - requested attach mode, kAuto lets the kernel choose
+         * section (optional) - elf section of the program, defaults to first
+         */
+        int Attach(const int ifindex, const XdpMode mode,
+                   const std::string& section = "");
+        /*
+         * Detach the program from its link, if still attached there
+         */
+        int Detach();
+        /*
+         * Atomically swap the attached program for one loaded in 'next',
+         * on the same link and in the same mode. Traffic never sees the
+         * link without a program. On success this loader owns the new
+         * object and the old one is unloaded; on failure the old program
+         * stays attached and 'next' is unloaded.
+         * next - loaded, unattached program to switch to
+         * section (optional) - elf section of the program in 'next'
+         */
+        int Replace(std::unique_ptr<XdpLoader> next,
+                    const std::string& section = "");
+        /*
+         * Mode the kernel actually attached the program in, kNone if not
+         * attached. Compare against the requested mode to catch drivers
+         * silently falling back to generic mode.
+         */
+        XdpMode AttachedMode() const { return attached_mode_; }
+        /*
+         * fd of a map of the loaded object, negative errno if not found.
+         * The fd stays owned by this loader; use bpf::OpenMap() for a
+         * typed view with its own lifetime.
+         */
+        int GetMapFd(const std::string& name) const;
+        /*
+         * fd of a program of the loaded object, negative errno if not found.
+         * The fd stays owned by this loader.
+         * section (optional) - elf section of the program, defaults to first
+         */
+        int GetProgFd(const std::string& section = "") const;
+        int AttachedIfindex() const { return ifindex_; }
+        /*
+         * Raw BTF of the kernel to load for: buffers with CO-RE
+         * relocations are relocated against it before loading. Defaults
+         * to the BTF of the running kernel, /sys/kernel/btf/vmlinux.
+         */
+        void SetBtfPath(const std::string& path) { btf_path_ = path; }
+        /*
+         * Verifier log level of buffer loads, verifier::kLogLevel* ORed
+         * together, 0 (the default) for none. With a level set, each
+         * program of a buffer is first loaded on its own, with maps of its
+         * own, for what the verifier reports: see VerifierStats(). Loads
+         * take about twice as long, sharers of a shared buffer load it
+         * once.
+         */
+        void SetVerifierLogLevel(const uint32_t level) {
+            verifier_log_level_ = level;
+        }
+        /*
+         * What the verifier reported for each program, by elf section, on
+         * the last buffer load with a log level set. Empty if the
+         * verifier rejected a program: its log is printed instead.
+         */
+        const std::map<std::string, verifier::Stats>& VerifierStats() const {
+            return verifier_stats_;
+        }
     private:
-        void *handle_ = nullptr;
+        /*
+         * 'buffer' relocated for btf_path_ in *relocated, nullptr if it
+         * needs no relocation
+         */
+        int Relocate(const std::string_view& buffer,
+                     std::shared_ptr<const std::string> *relocated) const;
+        /* BTF buffers are relocated for: btf_path_, or the running kernel's */
+        std::string BtfPath() const;
+        /* Collect verifier_stats_ for 'elf', if verifier_log_level_ is set */
+        void Verify(const std::string_view& elf, const std::string& name);
+        /*
+         * Relocate and verify 'buffer', then load the elf with 'load', which
+         * sets the handle of the object it loads and returns 0 or a negative
+         * errno, and keep the object in handle_
+         */
+        int LoadElf(const std::string_view& buffer, const std::string& name,
+                    const std::function<int(const std::string_view& elf,
+                                            void **handle)>& load);
+        /* bpf object, shared by loaders of a shared buffer */
+        std::shared_ptr<void> handle_;
+        int prog_fd_ = -1;
+        int ifindex_ = 0;
+        XdpMode attached_mode_ = XdpMode::kNone;
+        std::string btf_path_;  /* empty for the running kernel */
+        uint32_t verifier_log_level_ = 0;
+        std::map<std::string, verifier::Stats> verifier_stats_;
 };
 
 using XdpHandle = std::unique_ptr<XdpLoader>;
@@ -25,5 +165,57 @@ XdpHandle LoadXdpFile(const std::string& filepath, const int ifindex);
  * name (optional) - user given program name
  */
 XdpHandle LoadXdpBuffer(const std::string_view& buffer, const std::string& name);
+/*
+ * API to load an xdp program from buffer into kernel, sharing the loaded
+ * object with other handles of the same buffer; see
+ * XdpLoader::LoadFrmSharedBuffer. Use it to attach one program to many
+ * links without verifying it for each.
+ * buffer - buffer containing xdp code
+ * name - user given program name
+ */
+XdpHandle LoadSharedXdpBuffer(const std::string_view& buffer,
+                              const std::string& name);
+/*
+ * Number of distinct objects currently shared by LoadSharedXdpBuffer
+ * handles
+ */
+size_t SharedXdpObjectCount();
+/*
+ * API to load an xdp program from buffer into kernel, reusing and pinning
+ * its maps; see XdpLoader::LoadFrmPinnedBuffer
+ * buffer - buffer containing xdp code
+ * name - user given program name, also names the pin directory
+ */
+XdpHandle LoadPinnedXdpBuffer(const std::string_view& buffer,
+                              const std::string& name);
+/*
+ * bpffs directory the maps of program 'name' are pinned in:
+ * /sys/fs/bpf/ebplane/<name>
+ */
+std::string PinnedMapsDir(const std::string& name);
+/*
+ * API to unpin the maps of program 'name', discarding their contents once
+ * no program uses them anymore. Missing pins are not an error.
+ */
+int UnpinXdpMaps(const std::string& name);
+/*
+ * API to load an xdp program from buffer and attach it to a link
+ * buffer - buffer containing xdp code
+ * name - user given program name
+ * ifindex - link to attach to
+ * mode - requested attach mode
+ */
+XdpHandle LoadAndAttachXdpBuffer(const std::string_view& buffer,
+                                 const std::string& name,
+                                 const int ifindex, const XdpMode mode);
+/*
+ * API to load an xdp program from buffer and atomically replace the one
+ * attached by xdph with it; see XdpLoader::Replace. Returns -EINVAL if
+ * xdph is null
+ * buffer - buffer containing xdp code
+ * name - user given program name
+ */
+int ReplaceXdpBuffer(const XdpHandle& xdph, const std::string_view& buffer,
+                     const std::string& name);
 
 #endif
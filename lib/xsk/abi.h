@@ -0,0 +1,105 @@
+#ifndef LIB_XSK_ABI_H_
+#define LIB_XSK_ABI_H_
+
+#include <sys/types.h>
+
+#include <cstdint>
+
+// AF_XDP ABI (linux/if_xdp.h, linux 4.18+), spelled out so the module does not
+// depend on the uapi headers we happen to build against, which predate it.
+// Values and layouts are ABI and never change; later kernels only append.
+
+namespace xsk {
+
+constexpr int kAfXdp = 44;
+constexpr int kSolXdp = 283;
+
+// Socket options.
+constexpr int kXdpMmapOffsets = 1;
+constexpr int kXdpRxRing = 2;
+constexpr int kXdpTxRing = 3;
+constexpr int kXdpUmemReg = 4;
+constexpr int kXdpUmemFillRing = 5;
+constexpr int kXdpUmemCompletionRing = 6;
+constexpr int kXdpStatistics = 7;
+constexpr int kXdpOptions = 8;  // linux 5.3
+
+// Flags for sockaddr_xdp.sxdp_flags.
+constexpr uint16_t kXdpSharedUmem = 1 << 0;
+constexpr uint16_t kXdpCopy = 1 << 1;
+constexpr uint16_t kXdpZeroCopy = 1 << 2;
+constexpr uint16_t kXdpUseNeedWakeup = 1 << 3;  // linux 5.4
+
+// Bits of the ring 'flags' word.
+constexpr uint32_t kXdpRingNeedWakeup = 1 << 0;
+
+// Bits of XdpOptions.flags.
+constexpr uint32_t kXdpOptionsZeroCopy = 1 << 0;
+
+// mmap() offsets selecting the ring to map.
+constexpr off_t kXdpPgoffRxRing = 0;
+constexpr off_t kXdpPgoffTxRing = 0x80000000;
+constexpr off_t kXdpUmemPgoffFillRing = 0x100000000ULL;
+constexpr off_t kXdpUmemPgoffCompletionRing = 0x180000000ULL;
+
+// struct xdp_desc: a packet in the RX or TX ring. 'addr' is the offset of the
+// packet data in the UMEM.
+struct XdpDesc {
+  uint64_t addr;
+  uint32_t len;
+  uint32_t options;
+};
+
+// struct sockaddr_xdp.
+struct SockaddrXdp {
+  uint16_t sxdp_family;
+  uint16_t sxdp_flags;
+  uint32_t sxdp_ifindex;
+  uint32_t sxdp_queue_id;
+  uint32_t sxdp_shared_umem_fd;
+};
+
+// struct xdp_umem_reg as of linux 4.18. Later fields (flags for unaligned
+// chunks) are optional and unused, passing the short layout works everywhere.
+struct XdpUmemReg {
+  uint64_t addr;
+  uint64_t len;
+  uint32_t chunk_size;
+  uint32_t headroom;
+};
+
+// struct xdp_ring_offset. 'flags' is linux 5.4+, older kernels return the
+// short layout without it.
+struct XdpRingOffset {
+  uint64_t producer;
+  uint64_t consumer;
+  uint64_t desc;
+  uint64_t flags;
+};
+
+// struct xdp_mmap_offsets.
+struct XdpMmapOffsets {
+  XdpRingOffset rx;
+  XdpRingOffset tx;
+  XdpRingOffset fr;  // Fill ring.
+  XdpRingOffset cr;  // Completion ring.
+};
+
+// Size of struct xdp_mmap_offsets before linux 5.4 (3 words per ring).
+constexpr size_t kXdpMmapOffsetsV1Size = 4 * 3 * sizeof(uint64_t);
+
+// struct xdp_statistics, first 3 fields (linux 4.18).
+struct XdpStatistics {
+  uint64_t rx_dropped;        // Dropped for reasons other than invalid desc.
+  uint64_t rx_invalid_descs;  // Dropped due to invalid descriptor.
+  uint64_t tx_invalid_descs;  // Dropped due to invalid descriptor.
+};
+
+// struct xdp_options.
+struct XdpOptions {
+  uint32_t flags;
+};
+
+}  // namespace xsk
+
+#endif  // LIB_XSK_ABI_H_
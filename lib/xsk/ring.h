@@ -0,0 +1,159 @@
+#ifndef LIB_XSK_RING_H_
+#define LIB_XSK_RING_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+#include "lib/base/invariant.h"
+#include "lib/base/span.h"
+#include "lib/posix/mmap.h"
+#include "lib/xsk/abi.h"
+
+namespace xsk {
+namespace impl {
+
+// Single producer, single consumer ring shared with the kernel, as mapped from
+// an AF_XDP socket. Userspace is the producer of the fill and TX rings and the
+// consumer of the RX and completion rings.
+//
+// Indexes are free running 32 bit counters; entries live at index & mask. The
+// side that owns an index publishes it with release semantics after touching
+// the entries, and reads the other side's with acquire semantics before.
+template <typename T>
+class Ring {
+ public:
+  static_assert(std::is_trivially_copyable_v<T>, "entries are shared bytes");
+
+  Ring() = default;
+
+  // Take ownership of 'mapping', laid out as described by 'offsets', holding
+  // 'size' entries. 'size' must be a power of two.
+  Ring(posix::UniqueMapping mapping, const XdpRingOffset& offsets,
+       const bool has_flags, const uint32_t size)
+      : mapping_(std::move(mapping)), size_(size), mask_(size - 1) {
+    INVARIANT_T(size && (size & mask_) == 0);
+    uint8_t* const base = GetBase(GetValue(mapping_));
+    producer_ = reinterpret_cast<uint32_t*>(base + offsets.producer);
+    consumer_ = reinterpret_cast<uint32_t*>(base + offsets.consumer);
+    flags_ = has_flags ? reinterpret_cast<uint32_t*>(base + offsets.flags)
+                       : nullptr;
+    entries_ = reinterpret_cast<T*>(base + offsets.desc);
+    cached_producer_ = LoadAcquire(producer_);
+    cached_consumer_ = LoadAcquire(consumer_);
+  }
+
+  // Default move constructor. The pointers into the mapping stay valid.
+  Ring(Ring&&) = default;
+
+  // Default move assignment operator.
+  Ring& operator=(Ring&&) = default;
+
+  // Return true if the kernel asked to be woken up to process this ring. Always
+  // false on kernels without XDP_USE_NEED_WAKEUP support.
+  bool NeedsWakeup() const {
+    return flags_ &&
+           (__atomic_load_n(flags_, __ATOMIC_RELAXED) & kXdpRingNeedWakeup);
+  }
+
+  // Return the number of entries the ring holds.
+  friend uint32_t GetSize(const Ring& ring) { return ring.size_; }
+
+ protected:
+  static uint32_t LoadAcquire(const uint32_t* const index) {
+    return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+  }
+
+  static void StoreRelease(uint32_t* const index, const uint32_t value) {
+    __atomic_store_n(index, value, __ATOMIC_RELEASE);
+  }
+
+  posix::UniqueMapping mapping_;
+  uint32_t size_ = 0;
+  uint32_t mask_ = 0;
+  uint32_t* producer_ = nullptr;
+  uint32_t* consumer_ = nullptr;
+  uint32_t* flags_ = nullptr;
+  T* entries_ = nullptr;
+
+  // Local copies of the indexes, so the shared cache lines are only touched
+  // once per batch.
+  uint32_t cached_producer_ = 0;
+  uint32_t cached_consumer_ = 0;
+};
+
+}  // namespace impl
+
+// Ring userspace produces entries into: the fill ring (UMEM addresses handed
+// to the kernel for RX) and the TX ring (packets to send).
+template <typename T>
+class ProducerRing : public impl::Ring<T> {
+ public:
+  using impl::Ring<T>::Ring;
+
+  // Copy as many entries from the front of 'entries' as there is room for
+  // into the ring and publish them to the kernel. Returns the number of
+  // entries produced.
+  size_t Produce(const base::Span<const T> entries) {
+    const uint32_t count = GetFree(GetSize(entries));
+    for (uint32_t i = 0; i < count; ++i) {
+      this->entries_[(this->cached_producer_ + i) & this->mask_] =
+          GetBase(entries)[i];
+    }
+    if (count) {
+      this->cached_producer_ += count;
+      this->StoreRelease(this->producer_, this->cached_producer_);
+    }
+    return count;
+  }
+
+  // Return the number of entries that can be produced right now, at most
+  // 'wanted'. Only reads the kernel's index when the cached one does not
+  // leave enough room.
+  uint32_t GetFree(const size_t wanted = UINT32_MAX) {
+    uint32_t used = this->cached_producer_ - this->cached_consumer_;
+    if (this->size_ - used < wanted) {
+      this->cached_consumer_ = this->LoadAcquire(this->consumer_);
+      used = this->cached_producer_ - this->cached_consumer_;
+    }
+    return std::min<size_t>(this->size_ - used, wanted);
+  }
+};
+
+// Ring userspace consumes entries from: the RX ring (received packets) and the
+// completion ring (UMEM addresses of packets sent).
+template <typename T>
+class ConsumerRing : public impl::Ring<T> {
+ public:
+  using impl::Ring<T>::Ring;
+
+  // Copy up to GetSize('entries') entries from the ring into 'entries' and
+  // release them back to the kernel. Returns the number of entries consumed.
+  size_t Consume(const base::Span<T> entries) {
+    const uint32_t count = GetAvailable(GetSize(entries));
+    for (uint32_t i = 0; i < count; ++i) {
+      GetBase(entries)[i] =
+          this->entries_[(this->cached_consumer_ + i) & this->mask_];
+    }
+    if (count) {
+      this->cached_consumer_ += count;
+      this->StoreRelease(this->consumer_, this->cached_consumer_);
+    }
+    return count;
+  }
+
+  // Return the number of entries ready to be consumed, at most 'wanted'. Only
+  // reads the kernel's index when the cached one does not cover 'wanted'.
+  uint32_t GetAvailable(const size_t wanted = UINT32_MAX) {
+    uint32_t available = this->cached_producer_ - this->cached_consumer_;
+    if (available < wanted) {
+      this->cached_producer_ = this->LoadAcquire(this->producer_);
+      available = this->cached_producer_ - this->cached_consumer_;
+    }
+    return std::min<size_t>(available, wanted);
+  }
+};
+
+}  // namespace xsk
+
+#endif  // LIB_XSK_RING_H_
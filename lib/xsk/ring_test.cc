@@ -0,0 +1,97 @@
+#include "lib/xsk/ring.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <array>
+#include <numeric>
+
+#include "gtest/gtest.h"
+#include "lib/posix/unique_file_descriptor.h"
+
+namespace xsk {
+namespace {
+
+constexpr uint32_t kSize = 8;
+constexpr XdpRingOffset kOffsets = {0, 64, 192, 128};
+
+// Ring memory shared by two mappings, standing in for the kernel side.
+class RingTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    const int fd = memfd_create("ring_test", MFD_CLOEXEC);
+    ASSERT_LE(0, fd);
+    fd_ = posix::UniqueFileDescriptor(posix::FileDescriptor(fd));
+    ASSERT_EQ(0, ftruncate(fd, posix::GetPageSize()));
+  }
+
+  posix::UniqueMapping Map() {
+    auto mapping_or = posix::Mmap(posix::GetPageSize(), PROT_READ | PROT_WRITE,
+                                  MAP_SHARED, GetValue(fd_), 0);
+    EXPECT_TRUE(IsOk(mapping_or));
+    return std::move(GetValue(mapping_or));
+  }
+
+  posix::UniqueFileDescriptor fd_;
+};
+
+TEST_F(RingTest, ProduceConsume) {
+  ProducerRing<uint64_t> producer(Map(), kOffsets, true, kSize);
+  ConsumerRing<uint64_t> consumer(Map(), kOffsets, true, kSize);
+  EXPECT_EQ(kSize, GetSize(producer));
+  EXPECT_EQ(kSize, producer.GetFree());
+  EXPECT_EQ(0, consumer.GetAvailable());
+
+  const std::array<uint64_t, 3> in = {10, 20, 30};
+  EXPECT_EQ(3, producer.Produce(base::MakeSpan(in)));
+  EXPECT_EQ(3, consumer.GetAvailable());
+
+  std::array<uint64_t, 2> out = {};
+  EXPECT_EQ(2, consumer.Consume(base::MakeSpan(out)));
+  EXPECT_EQ(10, out[0]);
+  EXPECT_EQ(20, out[1]);
+  EXPECT_EQ(1, consumer.Consume(base::MakeSpan(out)));
+  EXPECT_EQ(30, out[0]);
+  EXPECT_EQ(0, consumer.Consume(base::MakeSpan(out)));
+}
+
+TEST_F(RingTest, FullAndWrapAround) {
+  ProducerRing<uint64_t> producer(Map(), kOffsets, true, kSize);
+  ConsumerRing<uint64_t> consumer(Map(), kOffsets, true, kSize);
+
+  std::array<uint64_t, kSize + 3> in;
+  std::iota(in.begin(), in.end(), 0);
+  // Only kSize fit until the consumer catches up.
+  EXPECT_EQ(kSize, producer.Produce(base::MakeSpan(in)));
+  EXPECT_EQ(0, producer.GetFree());
+
+  std::array<uint64_t, 5> out;
+  EXPECT_EQ(5, consumer.Consume(base::MakeSpan(out)));
+  EXPECT_EQ(4, out[4]);
+
+  // The rest wraps around the end of the entries.
+  EXPECT_EQ(3, producer.Produce(base::MakeSpan(in.data() + kSize, 3)));
+  std::array<uint64_t, kSize> rest;
+  EXPECT_EQ(6, consumer.Consume(base::MakeSpan(rest)));
+  for (size_t i = 0; i < 6; ++i) {
+    EXPECT_EQ(5 + i, rest[i]);
+  }
+}
+
+TEST_F(RingTest, NeedsWakeup) {
+  ProducerRing<uint64_t> producer(Map(), kOffsets, true, kSize);
+  auto mapping = Map();
+  auto* const flags =
+      reinterpret_cast<uint32_t*>(GetBase(GetValue(mapping)) + kOffsets.flags);
+
+  EXPECT_FALSE(producer.NeedsWakeup());
+  *flags = kXdpRingNeedWakeup;
+  EXPECT_TRUE(producer.NeedsWakeup());
+
+  // Kernels without the flags word never ask.
+  ProducerRing<uint64_t> old(Map(), kOffsets, false, kSize);
+  EXPECT_FALSE(old.NeedsWakeup());
+}
+
+}  // namespace
+}  // namespace xsk
@@ -0,0 +1,241 @@
+#include "lib/xsk/socket.h"
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "lib/bpf/map.h"
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+#include "lib/posix/mmap.h"
+
+namespace xsk {
+namespace {
+
+template <typename T>
+error::Status SetSocketOption(const posix::FileDescriptor fd, const int name,
+                              const T& value) {
+  const int rv = ::setsockopt(GetValue(fd), kSolXdp, name, &value,
+                              sizeof(value));
+  return posix::OkStatusOrCaptureErrnoIf(-1 == rv, "setsockopt() failed");
+}
+
+// Read the ring layout of 'fd' into 'offsets'. Returns true if the kernel
+// reported the ring 'flags' word (linux 5.4+).
+error::StatusOr<bool> GetMmapOffsets(const posix::FileDescriptor fd,
+                                     XdpMmapOffsets* const offsets) {
+  std::memset(offsets, 0, sizeof(*offsets));
+  socklen_t size = sizeof(*offsets);
+  const int rv =
+      ::getsockopt(GetValue(fd), kSolXdp, kXdpMmapOffsets, offsets, &size);
+  RETURN_IF_ERROR(
+      posix::OkStatusOrCaptureErrnoIf(-1 == rv, "getsockopt() failed"));
+  if (size == sizeof(*offsets)) {
+    return true;
+  }
+  if (size != kXdpMmapOffsetsV1Size) {
+    return error::Status(posix::MakeCodeFromErrno(EINVAL),
+                         "unknown xdp_mmap_offsets layout");
+  }
+  // Old kernels pack 3 words per ring; spread them out to the new layout.
+  uint64_t words[12];
+  std::memcpy(words, offsets, sizeof(words));
+  XdpRingOffset* const rings[] = {&offsets->rx, &offsets->tx, &offsets->fr,
+                                  &offsets->cr};
+  for (int i = 0; i < 4; ++i) {
+    *rings[i] = {words[3 * i], words[3 * i + 1], words[3 * i + 2], 0};
+  }
+  return false;
+}
+
+template <typename RingT, typename T>
+error::StatusOr<RingT> MapRing(const posix::FileDescriptor fd,
+                               const off_t pgoff, const XdpRingOffset& offset,
+                               const bool has_flags, const uint32_t size) {
+  ASSIGN_OR_RETURN(auto mapping,
+                   posix::Mmap(offset.desc + size * sizeof(T),
+                               PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd, pgoff));
+  return RingT(std::move(mapping), offset, has_flags, size);
+}
+
+uint16_t GetBindFlags(const BindMode mode) {
+  switch (mode) {
+    case BindMode::kAuto:
+      return 0;
+    case BindMode::kCopy:
+      return kXdpCopy;
+    case BindMode::kZeroCopy:
+      return kXdpZeroCopy;
+  }
+  return 0;
+}
+
+// Return true if the kernel reports 'fd' as zero-copy. Kernels before 5.3
+// cannot tell, in which case only an explicit kZeroCopy bind is known to be.
+bool QueryZeroCopy(const posix::FileDescriptor fd, const BindMode mode) {
+  XdpOptions options = {};
+  socklen_t size = sizeof(options);
+  if (::getsockopt(GetValue(fd), kSolXdp, kXdpOptions, &options, &size) != 0) {
+    return mode == BindMode::kZeroCopy;
+  }
+  return options.flags & kXdpOptionsZeroCopy;
+}
+
+// Socket options newer than the oldest headers we build against.
+constexpr int kSoBusyPoll = 46;         // linux 3.11
+constexpr int kSoPreferBusyPoll = 69;   // linux 5.11
+constexpr int kSoBusyPollBudget = 70;   // linux 5.11
+
+// Return true for wakeup errors that only mean "try again later".
+bool IsTransientWakeupError(const int e) {
+  return e == EAGAIN || e == EBUSY || e == ENOBUFS || e == ENETDOWN;
+}
+
+}  // namespace
+
+error::StatusOr<size_t> Socket::Fill(const base::Span<const uint64_t> addrs) {
+  const size_t count = fill_.Produce(addrs);
+  if (need_wakeup_ && fill_.NeedsWakeup()) {
+    RETURN_IF_ERROR(Poll());
+  }
+  return count;
+}
+
+error::Status Socket::Poll() {
+  // Any receive call runs the driver's RX processing.
+  const auto rv = ::recvfrom(GetValue(GetValue(fd_)), nullptr, 0,
+                             MSG_DONTWAIT, nullptr, nullptr);
+  if (-1 == rv && !IsTransientWakeupError(errno)) {
+    return posix::CaptureErrnoAsStatus("recvfrom() failed");
+  }
+  return error::kOkStatus;
+}
+
+error::StatusOr<size_t> Socket::Transmit(
+    const base::Span<const XdpDesc> descs) {
+  const size_t count = tx_.Produce(descs);
+  if (count && (!need_wakeup_ || tx_.NeedsWakeup())) {
+    RETURN_IF_ERROR(Kick());
+  }
+  return count;
+}
+
+error::Status Socket::Kick() {
+  const auto rv = ::sendto(GetValue(GetValue(fd_)), nullptr, 0, MSG_DONTWAIT,
+                           nullptr, 0);
+  if (-1 == rv && !IsTransientWakeupError(errno)) {
+    return posix::CaptureErrnoAsStatus("sendto() failed");
+  }
+  return error::kOkStatus;
+}
+
+error::StatusOr<Socket> CreateSocket(const Umem& umem, const int ifindex,
+                                     const SocketOptions& options) {
+  const int rv = ::socket(kAfXdp, SOCK_RAW | SOCK_CLOEXEC, 0);
+  RETURN_IF_ERROR(posix::OkStatusOrCaptureErrnoIf(-1 == rv, "socket() failed"));
+  posix::UniqueFileDescriptor fd((posix::FileDescriptor(rv)));
+
+  const auto memory = GetMemory(umem);
+  XdpUmemReg reg = {};
+  reg.addr = reinterpret_cast<uintptr_t>(GetBase(memory));
+  reg.len = GetSize(memory);
+  reg.chunk_size = GetFrameSize(umem);
+  reg.headroom = GetHeadroom(umem);
+  RETURN_IF_ERROR(SetSocketOption(GetValue(fd), kXdpUmemReg, reg));
+  RETURN_IF_ERROR(
+      SetSocketOption(GetValue(fd), kXdpUmemFillRing, options.fill_size));
+  RETURN_IF_ERROR(SetSocketOption(GetValue(fd), kXdpUmemCompletionRing,
+                                  options.completion_size));
+  RETURN_IF_ERROR(SetSocketOption(GetValue(fd), kXdpRxRing, options.rx_size));
+  RETURN_IF_ERROR(SetSocketOption(GetValue(fd), kXdpTxRing, options.tx_size));
+
+  XdpMmapOffsets offsets;
+  ASSIGN_OR_RETURN(const bool has_flags,
+                   GetMmapOffsets(GetValue(fd), &offsets));
+  ASSIGN_OR_RETURN(auto fill, (MapRing<ProducerRing<uint64_t>, uint64_t>(
+                                  GetValue(fd), kXdpUmemPgoffFillRing,
+                                  offsets.fr, has_flags, options.fill_size)));
+  ASSIGN_OR_RETURN(
+      auto completion,
+      (MapRing<ConsumerRing<uint64_t>, uint64_t>(
+          GetValue(fd), kXdpUmemPgoffCompletionRing, offsets.cr, has_flags,
+          options.completion_size)));
+  ASSIGN_OR_RETURN(auto rx, (MapRing<ConsumerRing<XdpDesc>, XdpDesc>(
+                                GetValue(fd), kXdpPgoffRxRing, offsets.rx,
+                                has_flags, options.rx_size)));
+  ASSIGN_OR_RETURN(auto tx, (MapRing<ProducerRing<XdpDesc>, XdpDesc>(
+                                GetValue(fd), kXdpPgoffTxRing, offsets.tx,
+                                has_flags, options.tx_size)));
+
+  SockaddrXdp address = {};
+  address.sxdp_family = kAfXdp;
+  address.sxdp_ifindex = ifindex;
+  address.sxdp_queue_id = options.queue;
+  address.sxdp_flags = GetBindFlags(options.mode);
+  // The ring flags word and XDP_USE_NEED_WAKEUP came together in linux 5.4.
+  const bool need_wakeup = has_flags;
+  if (need_wakeup) {
+    address.sxdp_flags |= kXdpUseNeedWakeup;
+  }
+  const int bound = ::bind(GetValue(GetValue(fd)),
+                           reinterpret_cast<const sockaddr*>(&address),
+                           sizeof(address));
+  RETURN_IF_ERROR(
+      posix::OkStatusOrCaptureErrnoIf(-1 == bound, "bind() failed"));
+
+  const bool zero_copy = QueryZeroCopy(GetValue(fd), options.mode);
+  return Socket(std::move(fd), options.queue, std::move(fill),
+                std::move(completion), std::move(rx), std::move(tx),
+                need_wakeup, zero_copy);
+}
+
+error::StatusOr<XdpStatistics> GetStatistics(const Socket& socket) {
+  XdpStatistics statistics = {};
+  socklen_t size = sizeof(statistics);
+  const int rv = ::getsockopt(GetValue(GetFileDescriptor(socket)), kSolXdp,
+                              kXdpStatistics, &statistics, &size);
+  RETURN_IF_ERROR(
+      posix::OkStatusOrCaptureErrnoIf(-1 == rv, "getsockopt() failed"));
+  return statistics;
+}
+
+error::Status EnableBusyPoll(const Socket& socket, const uint32_t usecs,
+                             const uint32_t budget) {
+  const int fd = GetValue(GetFileDescriptor(socket));
+  const int value = usecs;
+  int rv = ::setsockopt(fd, SOL_SOCKET, kSoBusyPoll, &value, sizeof(value));
+  RETURN_IF_ERROR(
+      posix::OkStatusOrCaptureErrnoIf(-1 == rv, "setsockopt() failed"));
+
+  const int prefer = 1;
+  rv = ::setsockopt(fd, SOL_SOCKET, kSoPreferBusyPoll, &prefer,
+                    sizeof(prefer));
+  if (-1 == rv && errno == ENOPROTOOPT) {
+    return error::kOkStatus;  // Before linux 5.11, plain busy polling.
+  }
+  RETURN_IF_ERROR(
+      posix::OkStatusOrCaptureErrnoIf(-1 == rv, "setsockopt() failed"));
+  const int packets = budget;
+  rv = ::setsockopt(fd, SOL_SOCKET, kSoBusyPollBudget, &packets,
+                    sizeof(packets));
+  return posix::OkStatusOrCaptureErrnoIf(-1 == rv, "setsockopt() failed");
+}
+
+error::StatusOr<posix::UniqueFileDescriptor> CreateXskMap(
+    const uint32_t max_entries) {
+  return bpf::impl::CreateMap(static_cast<bpf_map_type>(kMapTypeXskMap),
+                              sizeof(uint32_t), sizeof(int), max_entries, 0);
+}
+
+error::Status RegisterSocket(const posix::FileDescriptor xskmap,
+                             const Socket& socket) {
+  const uint32_t queue = GetQueue(socket);
+  const int fd = GetValue(GetFileDescriptor(socket));
+  return bpf::impl::UpdateElement(xskmap, &queue, &fd, BPF_ANY);
+}
+
+}  // namespace xsk
@@ -0,0 +1,170 @@
+#ifndef LIB_XSK_SOCKET_H_
+#define LIB_XSK_SOCKET_H_
+
+#include <cstdint>
+
+#include "lib/base/span.h"
+#include "lib/error/status.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/file_descriptor.h"
+#include "lib/posix/unique_file_descriptor.h"
+#include "lib/xsk/abi.h"
+#include "lib/xsk/ring.h"
+#include "lib/xsk/umem.h"
+
+namespace xsk {
+
+// BPF_MAP_TYPE_XSKMAP (linux 4.18), newer than the oldest uapi headers we
+// build against.
+constexpr uint32_t kMapTypeXskMap = 17;
+
+// How packets get from the NIC into the UMEM.
+enum class BindMode {
+  kAuto,      // Zero-copy if the driver supports it, copy otherwise.
+  kCopy,      // Kernel copies packets; works on any link, veth included.
+  kZeroCopy,  // NIC DMAs straight into the UMEM; fails if unsupported.
+};
+
+struct SocketOptions {
+  // Receive queue of the link to bind to. The XDP program redirects packets
+  // of this queue to the socket.
+  uint32_t queue = 0;
+
+  BindMode mode = BindMode::kAuto;
+
+  // Ring sizes, in entries. Must be powers of two.
+  uint32_t rx_size = 2048;
+  uint32_t tx_size = 2048;
+  uint32_t fill_size = 2048;
+  uint32_t completion_size = 2048;
+};
+
+// AF_XDP socket bound to one queue of a link, with its four rings:
+//
+// - fill: UMEM frames handed to the kernel to receive into (Fill()).
+// - RX: received packets (Receive()).
+// - TX: packets to send (Transmit()).
+// - completion: UMEM frames of sent packets, free again (Complete()).
+//
+// All calls are batched: each takes a span of entries and moves as many as
+// the ring allows with a single index update, returning the count moved.
+// Descriptors are copied in and out of the rings, so spans can be reused
+// across calls. A Socket is meant to be driven by a single thread.
+//
+// Example usage:
+//
+// ASSIGN_OR_RETURN(auto umem, CreateUmem());
+// ASSIGN_OR_RETURN(auto socket, CreateSocket(umem, ifindex, SocketOptions()));
+// RETURN_IF_ERROR(RegisterSocket(xskmap_fd, socket));
+// std::array<XdpDesc, 64> descs;
+// const size_t count = socket.Receive(base::MakeSpan(descs));
+// for (size_t i = 0; i < count; ++i) Process(GetPacket(umem, descs[i]));
+//
+class Socket {
+ public:
+  Socket() = default;
+
+  // Take ownership of a bound AF_XDP socket 'fd' and its rings. Prefer
+  // CreateSocket().
+  Socket(posix::UniqueFileDescriptor fd, const uint32_t queue,
+         ProducerRing<uint64_t> fill, ConsumerRing<uint64_t> completion,
+         ConsumerRing<XdpDesc> rx, ProducerRing<XdpDesc> tx,
+         const bool need_wakeup, const bool zero_copy)
+      : fd_(std::move(fd)),
+        queue_(queue),
+        fill_(std::move(fill)),
+        completion_(std::move(completion)),
+        rx_(std::move(rx)),
+        tx_(std::move(tx)),
+        need_wakeup_(need_wakeup),
+        zero_copy_(zero_copy) {}
+
+  // Default move constructor.
+  Socket(Socket&&) = default;
+
+  // Default move assignment operator.
+  Socket& operator=(Socket&&) = default;
+
+  // Hand the UMEM frames at 'addrs' to the kernel to receive packets into,
+  // waking it up if it ran out. Returns the number of frames handed over.
+  error::StatusOr<size_t> Fill(base::Span<const uint64_t> addrs);
+
+  // Read up to GetSize('descs') received packets into 'descs'. Their frames
+  // belong to userspace until passed to Fill() or Transmit() again.
+  size_t Receive(const base::Span<XdpDesc> descs) {
+    return rx_.Consume(descs);
+  }
+
+  // Queue the packets described by 'descs' for sending and kick the kernel if
+  // needed. Returns the number of packets queued. Their frames come back
+  // through Complete() once sent.
+  error::StatusOr<size_t> Transmit(base::Span<const XdpDesc> descs);
+
+  // Read up to GetSize('addrs') frames of sent packets into 'addrs'.
+  size_t Complete(const base::Span<uint64_t> addrs) {
+    return completion_.Consume(addrs);
+  }
+
+  // Let the kernel process the RX side of the queue now: required after
+  // EnableBusyPoll(), where nothing else drives the driver.
+  error::Status Poll();
+
+  // Ask the kernel to process the TX ring. Transmit() does this already when
+  // needed, but packets queued while the kernel reported busy need another
+  // kick later.
+  error::Status Kick();
+
+ private:
+  // Return the file descriptor of 'socket', e.g. to poll() it for RX.
+  friend posix::FileDescriptor GetFileDescriptor(const Socket& socket) {
+    return GetValue(socket.fd_);
+  }
+
+  // Return the receive queue 'socket' is bound to.
+  friend uint32_t GetQueue(const Socket& socket) { return socket.queue_; }
+
+  // Return true if 'socket' runs in zero-copy mode.
+  friend bool IsZeroCopy(const Socket& socket) { return socket.zero_copy_; }
+
+  posix::UniqueFileDescriptor fd_;
+  uint32_t queue_ = 0;
+  ProducerRing<uint64_t> fill_;
+  ConsumerRing<uint64_t> completion_;
+  ConsumerRing<XdpDesc> rx_;
+  ProducerRing<XdpDesc> tx_;
+
+  // Bound with XDP_USE_NEED_WAKEUP: the kernel flags rings it stopped
+  // polling. Without it TX always needs a kick.
+  bool need_wakeup_ = false;
+  bool zero_copy_ = false;
+};
+
+// Create an AF_XDP socket using 'umem' for its packets, bound to queue
+// 'options.queue' of 'ifindex'. 'umem' must not back any other socket and must
+// outlive the returned socket.
+error::StatusOr<Socket> CreateSocket(const Umem& umem, int ifindex,
+                                     const SocketOptions& options);
+
+// Return the drop counters of 'socket'.
+error::StatusOr<XdpStatistics> GetStatistics(const Socket& socket);
+
+// Make the kernel busy poll the queue of 'socket' from the calling thread's
+// syscalls instead of interrupts plus softirq, for up to 'usecs' per call
+// and 'budget' packets per poll. The worker then has to keep calling into
+// the kernel (see Socket::Poll()) or the queue stalls. Preferred busy
+// polling and the budget need linux 5.11; older kernels get plain
+// SO_BUSY_POLL.
+error::Status EnableBusyPoll(const Socket& socket, uint32_t usecs,
+                             uint32_t budget);
+
+// Create an XSKMAP with room for sockets on 'max_entries' queues.
+error::StatusOr<posix::UniqueFileDescriptor> CreateXskMap(uint32_t max_entries);
+
+// Make the XSKMAP 'xskmap' redirect the queue of 'socket' to it. See
+// lib/ebpf/xsk_redirect.c for the program side.
+error::Status RegisterSocket(posix::FileDescriptor xskmap,
+                             const Socket& socket);
+
+}  // namespace xsk
+
+#endif  // LIB_XSK_SOCKET_H_
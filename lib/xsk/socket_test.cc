@@ -0,0 +1,207 @@
+#include "lib/xsk/socket.h"
+
+#include <arpa/inet.h>
+#include <linux/if_link.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/ebpd_link.h"
+#include "lib/tests/xdp_test_utils.h"
+
+namespace xsk {
+namespace {
+
+// IEEE local experimental ethertype, so stray traffic is easy to tell apart.
+constexpr uint16_t kEtherType = 0x88b5;
+constexpr uint32_t kFrameCount = 64;
+
+// Build a broadcast frame of kEtherType carrying 'tag'.
+std::vector<uint8_t> MakeFrame(const uint8_t tag) {
+  std::vector<uint8_t> frame(60, tag);
+  std::memset(frame.data(), 0xff, ETH_ALEN);
+  const uint8_t source[ETH_ALEN] = {0x02, 0, 0, 0, 0, 0x01};
+  std::memcpy(frame.data() + ETH_ALEN, source, ETH_ALEN);
+  const uint16_t type = htons(kEtherType);
+  std::memcpy(frame.data() + 2 * ETH_ALEN, &type, sizeof(type));
+  return frame;
+}
+
+bool IsTestFrame(const base::Span<const uint8_t> packet) {
+  uint16_t type;
+  if (GetSize(packet) < ETH_HLEN) {
+    return false;
+  }
+  std::memcpy(&type, GetBase(packet) + 2 * ETH_ALEN, sizeof(type));
+  return ntohs(type) == kEtherType;
+}
+
+// An AF_XDP socket on veth1 fed by a redirect program, and a packet socket
+// on its peer veth0 to inject and capture traffic.
+class SocketTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(EnterNewNetns());
+    peer_ifindex_ = CreateVethPair("veth0", "veth1");
+    ASSERT_NE(0, peer_ifindex_);
+    ifindex_ = if_nametoindex("veth1");
+
+    UmemOptions umem_options;
+    umem_options.frame_count = kFrameCount;
+    auto umem_or = CreateUmem(umem_options);
+    ASSERT_TRUE(IsOk(umem_or));
+    umem_ = std::move(GetValue(umem_or));
+
+    auto map_or = CreateXskMap(4);
+    ASSERT_TRUE(IsOk(map_or));
+    map_ = std::move(GetValue(map_or));
+    prog_fd_ = LoadXskRedirectProg(GetValue(GetValue(map_)));
+    ASSERT_LE(0, prog_fd_);
+    ASSERT_EQ(0, ebpd_link_set_xdp(ifindex_, prog_fd_, XDP_FLAGS_SKB_MODE));
+
+    packet_fd_ = socket(AF_PACKET, SOCK_RAW, htons(kEtherType));
+    ASSERT_LE(0, packet_fd_);
+    sockaddr_ll address = {};
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(kEtherType);
+    address.sll_ifindex = peer_ifindex_;
+    ASSERT_EQ(0, bind(packet_fd_, reinterpret_cast<sockaddr*>(&address),
+                      sizeof(address)));
+    const timeval timeout = {1, 0};
+    ASSERT_EQ(0, setsockopt(packet_fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                            sizeof(timeout)));
+  }
+
+  void TearDown() override {
+    if (packet_fd_ >= 0) {
+      close(packet_fd_);
+    }
+    if (prog_fd_ >= 0) {
+      close(prog_fd_);
+    }
+  }
+
+  Socket MakeSocket(const BindMode mode) {
+    SocketOptions options;
+    options.mode = mode;
+    options.rx_size = options.tx_size = kFrameCount;
+    options.fill_size = options.completion_size = kFrameCount;
+    auto socket_or = CreateSocket(umem_, ifindex_, options);
+    EXPECT_TRUE(IsOk(socket_or)) << GetText(GetStatus(socket_or));
+    return std::move(GetValue(socket_or));
+  }
+
+  // Wait for a test frame on 'socket', returning its descriptor.
+  bool ReceiveTestFrame(Socket* const socket, XdpDesc* const found) {
+    for (int attempt = 0; attempt < 10; ++attempt) {
+      pollfd events = {GetValue(GetFileDescriptor(*socket)), POLLIN, 0};
+      poll(&events, 1, 100);
+      std::array<XdpDesc, 8> descs;
+      const size_t count = socket->Receive(base::MakeSpan(descs));
+      for (size_t i = 0; i < count; ++i) {
+        if (IsTestFrame(GetPacket(umem_, descs[i]))) {
+          *found = descs[i];
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  int ifindex_ = 0;
+  int peer_ifindex_ = 0;
+  Umem umem_;
+  posix::UniqueFileDescriptor map_;
+  int prog_fd_ = -1;
+  int packet_fd_ = -1;
+};
+
+TEST_F(SocketTest, ReceiveAndTransmitCopyMode) {
+  auto socket = MakeSocket(BindMode::kCopy);
+  EXPECT_FALSE(IsZeroCopy(socket));
+  ASSERT_TRUE(IsOk(RegisterSocket(GetValue(map_), socket)));
+
+  // Frames 0..31 receive, 32..63 transmit.
+  std::vector<uint64_t> addrs;
+  for (uint32_t i = 0; i < kFrameCount / 2; ++i) {
+    addrs.push_back(GetFrameAddress(umem_, i));
+  }
+  auto filled_or = socket.Fill(base::MakeSpan(addrs));
+  ASSERT_TRUE(IsOk(filled_or));
+  EXPECT_EQ(addrs.size(), GetValue(filled_or));
+
+  const auto in = MakeFrame(0x42);
+  ASSERT_EQ(in.size(), send(packet_fd_, in.data(), in.size(), 0));
+  XdpDesc desc;
+  ASSERT_TRUE(ReceiveTestFrame(&socket, &desc));
+  const auto packet = GetPacket(umem_, desc);
+  ASSERT_EQ(in.size(), GetSize(packet));
+  EXPECT_EQ(0, std::memcmp(in.data(), GetBase(packet), in.size()));
+
+  const auto out = MakeFrame(0x24);
+  const uint64_t tx_addr = GetFrameAddress(umem_, kFrameCount / 2);
+  std::memcpy(GetBase(GetMemory(umem_)) + tx_addr, out.data(), out.size());
+  const XdpDesc tx = {tx_addr, static_cast<uint32_t>(out.size()), 0};
+  auto sent_or = socket.Transmit(base::MakeSpan(&tx, 1));
+  ASSERT_TRUE(IsOk(sent_or));
+  EXPECT_EQ(1, GetValue(sent_or));
+
+  std::array<uint8_t, 128> buffer;
+  bool captured = false;
+  for (int attempt = 0; attempt < 10 && !captured; ++attempt) {
+    sockaddr_ll from = {};
+    socklen_t from_size = sizeof(from);
+    const auto size =
+        recvfrom(packet_fd_, buffer.data(), buffer.size(), 0,
+                 reinterpret_cast<sockaddr*>(&from), &from_size);
+    ASSERT_LT(0, size);
+    captured = from.sll_pkttype != PACKET_OUTGOING &&
+               static_cast<size_t>(size) == out.size() &&
+               std::memcmp(buffer.data(), out.data(), out.size()) == 0;
+  }
+  EXPECT_TRUE(captured);
+
+  std::array<uint64_t, 4> completed;
+  size_t count = 0;
+  for (int attempt = 0; attempt < 10 && count == 0; ++attempt) {
+    count = socket.Complete(base::MakeSpan(completed));
+    if (count == 0) {
+      ASSERT_TRUE(IsOk(socket.Kick()));
+      usleep(10000);
+    }
+  }
+  ASSERT_EQ(1, count);
+  EXPECT_EQ(tx_addr, completed[0]);
+
+  auto statistics_or = GetStatistics(socket);
+  ASSERT_TRUE(IsOk(statistics_or));
+  EXPECT_EQ(0, GetValue(statistics_or).tx_invalid_descs);
+}
+
+TEST_F(SocketTest, AutoModeFallsBackToCopy) {
+  // veth has no zero-copy support, auto mode must still bind.
+  auto socket = MakeSocket(BindMode::kAuto);
+  EXPECT_FALSE(IsZeroCopy(socket));
+}
+
+TEST_F(SocketTest, RejectsBadRingSize) {
+  SocketOptions options;
+  options.rx_size = 1000;
+  EXPECT_TRUE(IsError(CreateSocket(umem_, ifindex_, options)));
+}
+
+TEST_F(SocketTest, RejectsMissingQueue) {
+  SocketOptions options;
+  options.queue = 100;
+  EXPECT_TRUE(IsError(CreateSocket(umem_, ifindex_, options)));
+}
+
+}  // namespace
+}  // namespace xsk
@@ -0,0 +1,105 @@
+#ifndef LIB_XSK_SPSC_RING_H_
+#define LIB_XSK_SPSC_RING_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "lib/base/span.h"
+
+namespace xsk {
+
+// Lock-free single producer, single consumer ring handing entries from a
+// packet worker to a control plane thread (or back) without syscalls or
+// locks on either side.
+//
+// Exactly one thread may call Push() and exactly one thread may call Pop().
+// Each side keeps its own index on its own cache line, plus a cached copy of
+// the other side's index refreshed only when it runs out, so in steady state
+// a batch costs one shared cache line transfer.
+//
+// Example usage:
+//
+// SpscRing<Event> events(1024);
+// // Worker thread:
+// const size_t pushed = events.Push(base::MakeSpan(batch));
+// // Control plane thread:
+// const size_t popped = events.Pop(base::MakeSpan(buffer));
+//
+template <typename T>
+class SpscRing {
+ public:
+  // Create a ring holding at least 'capacity' entries, rounded up to a power
+  // of two.
+  explicit SpscRing(const size_t capacity)
+      : entries_(RoundUpToPowerOfTwo(capacity)), mask_(entries_.size() - 1) {}
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  // Copy as many entries from the front of 'entries' as there is room for
+  // into the ring. Returns the number of entries pushed. Producer only.
+  size_t Push(const base::Span<const T> entries) {
+    const size_t write = write_.load(std::memory_order_relaxed);
+    size_t free = entries_.size() - (write - cached_read_);
+    if (free < GetSize(entries)) {
+      cached_read_ = read_.load(std::memory_order_acquire);
+      free = entries_.size() - (write - cached_read_);
+    }
+    const size_t count = std::min(free, GetSize(entries));
+    for (size_t i = 0; i < count; ++i) {
+      entries_[(write + i) & mask_] = GetBase(entries)[i];
+    }
+    write_.store(write + count, std::memory_order_release);
+    return count;
+  }
+
+  // Move up to GetSize('entries') entries out of the ring into 'entries'.
+  // Returns the number of entries popped. Consumer only.
+  size_t Pop(const base::Span<T> entries) {
+    const size_t read = read_.load(std::memory_order_relaxed);
+    size_t available = cached_write_ - read;
+    if (available < GetSize(entries)) {
+      cached_write_ = write_.load(std::memory_order_acquire);
+      available = cached_write_ - read;
+    }
+    const size_t count = std::min(available, GetSize(entries));
+    for (size_t i = 0; i < count; ++i) {
+      GetBase(entries)[i] = std::move(entries_[(read + i) & mask_]);
+    }
+    read_.store(read + count, std::memory_order_release);
+    return count;
+  }
+
+  // Return the number of entries the ring holds.
+  friend size_t GetCapacity(const SpscRing& ring) {
+    return ring.entries_.size();
+  }
+
+ private:
+  static size_t RoundUpToPowerOfTwo(const size_t value) {
+    size_t rounded = 1;
+    while (rounded < value) {
+      rounded <<= 1;
+    }
+    return rounded;
+  }
+
+  static constexpr size_t kCacheLineSize = 64;
+
+  std::vector<T> entries_;
+  const size_t mask_;
+
+  // Producer side.
+  alignas(kCacheLineSize) std::atomic<size_t> write_{0};
+  size_t cached_read_ = 0;
+
+  // Consumer side.
+  alignas(kCacheLineSize) std::atomic<size_t> read_{0};
+  size_t cached_write_ = 0;
+};
+
+}  // namespace xsk
+
+#endif  // LIB_XSK_SPSC_RING_H_
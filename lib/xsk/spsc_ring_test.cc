@@ -0,0 +1,75 @@
+#include "lib/xsk/spsc_ring.h"
+
+#include <array>
+#include <cstdint>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace xsk {
+namespace {
+
+TEST(SpscRingTest, CapacityRoundsUp) {
+  EXPECT_EQ(1, GetCapacity(SpscRing<int>(1)));
+  EXPECT_EQ(8, GetCapacity(SpscRing<int>(5)));
+  EXPECT_EQ(64, GetCapacity(SpscRing<int>(64)));
+}
+
+TEST(SpscRingTest, PushPop) {
+  SpscRing<int> ring(4);
+  const std::array<int, 6> in = {1, 2, 3, 4, 5, 6};
+  EXPECT_EQ(4, ring.Push(base::MakeSpan(in)));
+  EXPECT_EQ(0, ring.Push(base::MakeSpan(in)));
+
+  std::array<int, 3> out;
+  EXPECT_EQ(3, ring.Pop(base::MakeSpan(out)));
+  EXPECT_EQ(1, out[0]);
+  EXPECT_EQ(3, out[2]);
+
+  // Wraps around the end of the entries.
+  EXPECT_EQ(2, ring.Push(base::MakeSpan(in.data() + 4, 2)));
+  EXPECT_EQ(3, ring.Pop(base::MakeSpan(out)));
+  EXPECT_EQ(4, out[0]);
+  EXPECT_EQ(5, out[1]);
+  EXPECT_EQ(6, out[2]);
+  EXPECT_EQ(0, ring.Pop(base::MakeSpan(out)));
+}
+
+TEST(SpscRingTest, ConcurrentProducerConsumer) {
+  constexpr uint64_t kCount = 1 << 18;
+  SpscRing<uint64_t> ring(256);
+
+  std::thread producer([&ring] {
+    std::array<uint64_t, 32> batch;
+    uint64_t next = 0;
+    while (next < kCount) {
+      size_t size = 0;
+      for (; size < batch.size() && next + size < kCount; ++size) {
+        batch[size] = next + size;
+      }
+      const size_t pushed = ring.Push(base::MakeSpan(batch.data(), size));
+      if (pushed == 0) {
+        std::this_thread::yield();
+      }
+      next += pushed;
+    }
+  });
+
+  std::array<uint64_t, 64> batch;
+  uint64_t expected = 0;
+  bool in_order = true;
+  while (expected < kCount) {
+    const size_t count = ring.Pop(base::MakeSpan(batch));
+    if (count == 0) {
+      std::this_thread::yield();
+    }
+    for (size_t i = 0; i < count; ++i) {
+      in_order &= batch[i] == expected++;
+    }
+  }
+  producer.join();
+  EXPECT_TRUE(in_order);
+}
+
+}  // namespace
+}  // namespace xsk
@@ -0,0 +1,48 @@
+#include "lib/xsk/umem.h"
+
+#include <sys/mman.h>
+
+#include "lib/error/assign_or_return.h"
+#include "lib/posix/errno.h"
+
+namespace xsk {
+namespace {
+
+// Default huge page size on x86_64 and arm64. Huge page mappings must be
+// multiples of it.
+constexpr size_t kHugePageSize = 2 << 20;
+
+}  // namespace
+
+error::StatusOr<Umem> CreateUmem(const UmemOptions& options) {
+  const uint32_t frame_size = options.frame_size;
+  if (frame_size < 2048 || frame_size > posix::GetPageSize() ||
+      (frame_size & (frame_size - 1)) != 0 ||
+      options.headroom >= frame_size) {
+    return error::Status(posix::MakeCodeFromErrno(EINVAL),
+                         "unsupported umem frame size or headroom");
+  }
+  const size_t size = size_t{frame_size} * options.frame_count;
+  constexpr int kProt = PROT_READ | PROT_WRITE;
+  constexpr int kFlags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+  if (options.hugepages) {
+    const size_t rounded = (size + kHugePageSize - 1) / kHugePageSize *
+                           kHugePageSize;
+    auto mapping_or = posix::Mmap(rounded, kProt, kFlags | MAP_HUGETLB,
+                                  posix::kInvalidFileDescriptor, 0);
+    if (IsOk(mapping_or)) {
+      return Umem(std::move(GetValue(mapping_or)), frame_size,
+                  options.frame_count, options.headroom, true);
+    }
+    // No huge pages reserved (or none left): regular pages still work.
+  }
+
+  ASSIGN_OR_RETURN(auto mapping,
+                   posix::Mmap(posix::RoundUpToPageSize(size), kProt, kFlags,
+                               posix::kInvalidFileDescriptor, 0));
+  return Umem(std::move(mapping), frame_size, options.frame_count,
+              options.headroom, false);
+}
+
+}  // namespace xsk
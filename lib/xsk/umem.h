@@ -0,0 +1,96 @@
+#ifndef LIB_XSK_UMEM_H_
+#define LIB_XSK_UMEM_H_
+
+#include <cstdint>
+
+#include "lib/base/span.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/mmap.h"
+#include "lib/xsk/abi.h"
+
+namespace xsk {
+
+struct UmemOptions {
+  // Number of frames, each holding one packet.
+  uint32_t frame_count = 4096;
+
+  // Size of each frame. Must be a power of two between 2048 and the page size.
+  uint32_t frame_size = 4096;
+
+  // Bytes the kernel leaves free in front of each received packet, e.g. to
+  // push encapsulation headers without copying.
+  uint32_t headroom = 0;
+
+  // Back the UMEM with huge pages, falling back to regular pages if none are
+  // available. Fewer TLB misses on the packet path and, in zero-copy mode,
+  // fewer pages for the driver to pin and DMA map.
+  bool hugepages = true;
+};
+
+// Packet buffer area (UMEM) of an AF_XDP socket: one contiguous mapping split
+// into fixed size frames, identified by their offset ("address") in the UMEM.
+// Frames move between userspace and the kernel through the socket rings; the
+// Umem itself does not track who owns which frame.
+//
+// A Umem must outlive the Socket it is registered with.
+class Umem {
+ public:
+  Umem() = default;
+
+  // Take ownership of 'mapping', split into frames of 'frame_size' bytes.
+  // Prefer CreateUmem().
+  Umem(posix::UniqueMapping mapping, const uint32_t frame_size,
+       const uint32_t frame_count, const uint32_t headroom,
+       const bool hugepages)
+      : mapping_(std::move(mapping)),
+        frame_size_(frame_size),
+        frame_count_(frame_count),
+        headroom_(headroom),
+        hugepages_(hugepages) {}
+
+  // Default move constructor.
+  Umem(Umem&&) = default;
+
+  // Default move assignment operator.
+  Umem& operator=(Umem&&) = default;
+
+ private:
+  // Return the whole packet buffer area of 'umem'.
+  friend base::Span<uint8_t> GetMemory(const Umem& umem) {
+    return base::MakeSpan(GetBase(GetValue(umem.mapping_)),
+                          GetFrameSize(umem) * GetFrameCount(umem));
+  }
+
+  // Return the address of frame number 'index', as handed to the fill ring or
+  // used for TX descriptors.
+  friend uint64_t GetFrameAddress(const Umem& umem, const uint32_t index) {
+    return uint64_t{index} * umem.frame_size_;
+  }
+
+  // Return the bytes of the packet described by 'desc'.
+  friend base::Span<uint8_t> GetPacket(const Umem& umem, const XdpDesc& desc) {
+    return base::MakeSpan(GetBase(GetValue(umem.mapping_)) + desc.addr,
+                          desc.len);
+  }
+
+  friend uint32_t GetFrameSize(const Umem& umem) { return umem.frame_size_; }
+  friend uint32_t GetFrameCount(const Umem& umem) { return umem.frame_count_; }
+  friend uint32_t GetHeadroom(const Umem& umem) { return umem.headroom_; }
+
+  // Return true if 'umem' ended up backed by huge pages.
+  friend bool IsHugepageBacked(const Umem& umem) { return umem.hugepages_; }
+
+  posix::UniqueMapping mapping_;
+  uint32_t frame_size_ = 0;
+  uint32_t frame_count_ = 0;
+  uint32_t headroom_ = 0;
+  bool hugepages_ = false;
+};
+
+// Allocate a zeroed UMEM as described by 'options'. Fails with EINVAL if the
+// frame size is not supported.
+error::StatusOr<Umem> CreateUmem(const UmemOptions& options = UmemOptions());
+
+}  // namespace xsk
+
+#endif  // LIB_XSK_UMEM_H_
@@ -0,0 +1,52 @@
+#include "lib/xsk/umem.h"
+
+#include "gtest/gtest.h"
+
+namespace xsk {
+namespace {
+
+TEST(UmemTest, Create) {
+  UmemOptions options;
+  options.frame_count = 16;
+  options.frame_size = 2048;
+  auto umem_or = CreateUmem(options);
+  ASSERT_TRUE(IsOk(umem_or));
+  const auto& umem = GetValue(umem_or);
+
+  EXPECT_EQ(2048, GetFrameSize(umem));
+  EXPECT_EQ(16, GetFrameCount(umem));
+  EXPECT_EQ(16 * 2048, GetSize(GetMemory(umem)));
+  EXPECT_EQ(3 * 2048, GetFrameAddress(umem, 3));
+
+  const auto memory = GetMemory(umem);
+  for (size_t i = 0; i < GetSize(memory); ++i) {
+    ASSERT_EQ(0, GetBase(memory)[i]);
+  }
+
+  const XdpDesc desc = {GetFrameAddress(umem, 3) + 10, 60, 0};
+  const auto packet = GetPacket(umem, desc);
+  EXPECT_EQ(GetBase(memory) + 3 * 2048 + 10, GetBase(packet));
+  EXPECT_EQ(60, GetSize(packet));
+}
+
+TEST(UmemTest, RegularPages) {
+  UmemOptions options;
+  options.hugepages = false;
+  auto umem_or = CreateUmem(options);
+  ASSERT_TRUE(IsOk(umem_or));
+  EXPECT_FALSE(IsHugepageBacked(GetValue(umem_or)));
+}
+
+TEST(UmemTest, RejectsBadFrameSize) {
+  UmemOptions options;
+  options.frame_size = 3000;
+  EXPECT_TRUE(IsError(CreateUmem(options)));
+  options.frame_size = 1024;
+  EXPECT_TRUE(IsError(CreateUmem(options)));
+  options.frame_size = 2048;
+  options.headroom = 2048;
+  EXPECT_TRUE(IsError(CreateUmem(options)));
+}
+
+}  // namespace
+}  // namespace xsk
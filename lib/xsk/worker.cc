@@ -0,0 +1,148 @@
+#include "lib/xsk/worker.h"
+
+#include <poll.h>
+#include <sched.h>
+
+#include <vector>
+
+#include "lib/error/assign_or_return.h"
+#include "lib/error/return_if_error.h"
+#include "lib/posix/errno.h"
+
+namespace xsk {
+namespace {
+
+// How long an idle, non busy polling worker sleeps before checking whether it
+// was asked to stop.
+constexpr int kIdleTimeoutMs = 100;
+
+uint32_t RoundUpToPowerOfTwo(const uint32_t value) {
+  uint32_t rounded = 1;
+  while (rounded < value) {
+    rounded <<= 1;
+  }
+  return rounded;
+}
+
+error::Status PinToCpu(const int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  const int rv = ::sched_setaffinity(0, sizeof(set), &set);
+  return posix::OkStatusOrCaptureErrnoIf(-1 == rv,
+                                         "sched_setaffinity() failed");
+}
+
+}  // namespace
+
+Worker::Worker(Umem umem, Socket socket, const WorkerOptions& options,
+               PacketHandler handler)
+    : umem_(std::move(umem)),
+      socket_(std::move(socket)),
+      options_(options),
+      handler_(std::move(handler)) {
+  thread_ = std::thread(&Worker::Run, this);
+}
+
+Worker::~Worker() { Stop(); }
+
+void Worker::Stop() {
+  stop_.store(true, std::memory_order_relaxed);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+WorkerStats GetStats(const Worker& worker) {
+  WorkerStats stats;
+  stats.packets = worker.stats_.packets.load(std::memory_order_relaxed);
+  stats.batches = worker.stats_.batches.load(std::memory_order_relaxed);
+  stats.polls = worker.stats_.polls.load(std::memory_order_relaxed);
+  stats.idle_polls = worker.stats_.idle_polls.load(std::memory_order_relaxed);
+  return stats;
+}
+
+error::Status GetExitStatus(const Worker& worker) {
+  return worker.exited_.load(std::memory_order_acquire) ? worker.exit_status_
+                                                        : error::kOkStatus;
+}
+
+void Worker::Run() {
+  exit_status_ = Loop();
+  exited_.store(true, std::memory_order_release);
+}
+
+error::Status Worker::Loop() {
+  if (options_.cpu >= 0) {
+    RETURN_IF_ERROR(PinToCpu(options_.cpu));
+  }
+  std::vector<XdpDesc> descs(options_.batch_size);
+  std::vector<uint64_t> frames(options_.batch_size);
+  const uint64_t frame_mask = ~uint64_t{GetFrameSize(umem_) - 1};
+  const pollfd idle_events = {GetValue(GetFileDescriptor(socket_)), POLLIN,
+                              0};
+
+  // Counters live in locals, published with plain stores: no locked
+  // instructions on the packet path.
+  WorkerStats stats;
+  while (!stop_.load(std::memory_order_relaxed)) {
+    if (options_.busy_poll) {
+      RETURN_IF_ERROR(socket_.Poll());
+    }
+    const size_t count = socket_.Receive(base::MakeSpan(descs));
+    Publish(&stats_.polls, ++stats.polls);
+    if (count == 0) {
+      Publish(&stats_.idle_polls, ++stats.idle_polls);
+      if (!options_.busy_poll) {
+        pollfd events = idle_events;
+        ::poll(&events, 1, kIdleTimeoutMs);
+      }
+      continue;
+    }
+
+    handler_(base::MakeSpan(descs.data(), count), umem_);
+
+    // Frames are aligned to their power of two size; the kernel reports
+    // packet addresses, past any headroom.
+    for (size_t i = 0; i < count; ++i) {
+      frames[i] = descs[i].addr & frame_mask;
+    }
+    // The fill ring has room for every frame, so this never comes up short.
+    RETURN_IF_ERROR(
+        GetStatus(socket_.Fill(base::MakeSpan(frames.data(), count))));
+    stats.packets += count;
+    Publish(&stats_.packets, stats.packets);
+    Publish(&stats_.batches, ++stats.batches);
+  }
+  return error::kOkStatus;
+}
+
+error::StatusOr<std::unique_ptr<Worker>> StartWorker(
+    const WorkerOptions& options, PacketHandler handler) {
+  ASSIGN_OR_RETURN(auto umem, CreateUmem(options.umem));
+
+  SocketOptions socket_options;
+  socket_options.queue = options.queue;
+  socket_options.mode = options.mode;
+  socket_options.fill_size = RoundUpToPowerOfTwo(GetFrameCount(umem));
+  socket_options.rx_size = socket_options.fill_size;
+  ASSIGN_OR_RETURN(auto socket,
+                   CreateSocket(umem, options.ifindex, socket_options));
+  if (options.busy_poll) {
+    RETURN_IF_ERROR(EnableBusyPoll(socket, options.busy_poll_usecs,
+                                   options.busy_poll_budget));
+  }
+
+  // Every frame starts out in the fill ring, ready for the first packets.
+  std::vector<uint64_t> frames(GetFrameCount(umem));
+  for (uint32_t i = 0; i < frames.size(); ++i) {
+    frames[i] = GetFrameAddress(umem, i);
+  }
+  RETURN_IF_ERROR(GetStatus(socket.Fill(base::MakeSpan(frames))));
+  RETURN_IF_ERROR(RegisterSocket(options.xskmap, socket));
+
+  return std::make_unique<Worker>(std::move(umem), std::move(socket), options,
+                                  std::move(handler));
+}
+
+}  // namespace xsk
@@ -0,0 +1,120 @@
+#ifndef LIB_XSK_WORKER_H_
+#define LIB_XSK_WORKER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "lib/base/span.h"
+#include "lib/error/status.h"
+#include "lib/error/status_or.h"
+#include "lib/posix/file_descriptor.h"
+#include "lib/xsk/socket.h"
+#include "lib/xsk/umem.h"
+
+namespace xsk {
+
+struct WorkerOptions {
+  // Link and receive queue to serve.
+  int ifindex = 0;
+  uint32_t queue = 0;
+
+  // XSKMAP of the redirect program to register the socket in.
+  posix::FileDescriptor xskmap = posix::kInvalidFileDescriptor;
+
+  // CPU to pin the worker thread to, -1 to let the scheduler decide. Pick the
+  // core the queue's interrupt is steered to, or one next to it.
+  int cpu = -1;
+
+  // Maximum number of packets handled per iteration.
+  uint32_t batch_size = 64;
+
+  // Busy poll the queue instead of sleeping in poll() when idle: lower and
+  // steadier latency at the cost of a core spinning at 100%. See
+  // EnableBusyPoll().
+  bool busy_poll = false;
+  uint32_t busy_poll_usecs = 20;
+  uint32_t busy_poll_budget = 64;
+
+  UmemOptions umem;
+  BindMode mode = BindMode::kAuto;
+};
+
+// Counters of a worker, written by the worker thread only and readable from
+// any thread at any time.
+struct WorkerStats {
+  uint64_t packets = 0;     // Packets received.
+  uint64_t batches = 0;     // Iterations that received at least one packet.
+  uint64_t polls = 0;       // Iterations, busy or not.
+  uint64_t idle_polls = 0;  // Iterations that received nothing.
+};
+
+// Called by the worker thread with each batch of received packets, whose data
+// is in 'umem'. Frames go back to the kernel when the handler returns, so
+// anything needed later must be copied out, e.g. into an SpscRing.
+using PacketHandler =
+    std::function<void(base::Span<const XdpDesc> descs, const Umem& umem)>;
+
+// Thread serving one receive queue through its own AF_XDP socket and UMEM:
+// receives a batch, runs the handler on it, hands the frames back to the fill
+// ring, repeat. Run one per queue, so queues never share state and workers
+// never synchronize with each other.
+class Worker {
+ public:
+  Worker(Umem umem, Socket socket, const WorkerOptions& options,
+         PacketHandler handler);
+  ~Worker();
+
+  Worker(const Worker&) = delete;
+  Worker& operator=(const Worker&) = delete;
+
+  // Stop the worker thread and wait for it to exit. Safe to call repeatedly.
+  void Stop();
+
+ private:
+  // Return a snapshot of the counters of 'worker'.
+  friend WorkerStats GetStats(const Worker& worker);
+
+  // Return the error the worker thread exited with, kOkStatus while it runs.
+  friend error::Status GetExitStatus(const Worker& worker);
+
+  void Run();
+  error::Status Loop();
+
+  // Store 'value' in 'counter', which only the worker thread writes.
+  static void Publish(std::atomic<uint64_t>* counter, uint64_t value) {
+    counter->store(value, std::memory_order_relaxed);
+  }
+
+  Umem umem_;
+  Socket socket_;
+  const WorkerOptions options_;
+  const PacketHandler handler_;
+
+  std::atomic<bool> stop_{false};
+  error::Status exit_status_ = error::kOkStatus;
+  std::atomic<bool> exited_{false};
+
+  // On their own cache line: written on every iteration by the worker and
+  // read by whoever reports them.
+  struct alignas(64) {
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> polls{0};
+    std::atomic<uint64_t> idle_polls{0};
+  } stats_;
+
+  std::thread thread_;
+};
+
+// Create the UMEM and socket of one queue as described by 'options', register
+// the socket in 'options.xskmap' and start a worker thread calling 'handler'
+// for every batch of packets received.
+error::StatusOr<std::unique_ptr<Worker>> StartWorker(
+    const WorkerOptions& options, PacketHandler handler);
+
+}  // namespace xsk
+
+#endif  // LIB_XSK_WORKER_H_
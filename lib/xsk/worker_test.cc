@@ -0,0 +1,155 @@
+#include "lib/xsk/worker.h"
+
+#include <arpa/inet.h>
+#include <linux/if_link.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/ebpd_link.h"
+#include "lib/tests/xdp_test_utils.h"
+
+namespace xsk {
+namespace {
+
+constexpr uint16_t kEtherType = 0x88b5;
+constexpr int kPackets = 100;
+
+// Workers on queue 0 of veth1, fed through a packet socket on veth0.
+class WorkerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(EnterNewNetns());
+    const int peer_ifindex = CreateVethPair("veth0", "veth1");
+    ASSERT_NE(0, peer_ifindex);
+    ifindex_ = if_nametoindex("veth1");
+
+    auto map_or = CreateXskMap(1);
+    ASSERT_TRUE(IsOk(map_or));
+    map_ = std::move(GetValue(map_or));
+    prog_fd_ = LoadXskRedirectProg(GetValue(GetValue(map_)));
+    ASSERT_LE(0, prog_fd_);
+    ASSERT_EQ(0, ebpd_link_set_xdp(ifindex_, prog_fd_, XDP_FLAGS_SKB_MODE));
+
+    packet_fd_ = socket(AF_PACKET, SOCK_RAW, htons(kEtherType));
+    ASSERT_LE(0, packet_fd_);
+    sockaddr_ll address = {};
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(kEtherType);
+    address.sll_ifindex = peer_ifindex;
+    ASSERT_EQ(0, bind(packet_fd_, reinterpret_cast<sockaddr*>(&address),
+                      sizeof(address)));
+  }
+
+  void TearDown() override {
+    if (packet_fd_ >= 0) {
+      close(packet_fd_);
+    }
+    if (prog_fd_ >= 0) {
+      close(prog_fd_);
+    }
+  }
+
+  WorkerOptions MakeOptions() {
+    WorkerOptions options;
+    options.ifindex = ifindex_;
+    options.xskmap = GetValue(map_);
+    options.umem.frame_count = 256;
+    options.mode = BindMode::kCopy;
+    return options;
+  }
+
+  void SendPackets(const int count) {
+    std::vector<uint8_t> frame(60, 0);
+    std::memset(frame.data(), 0xff, ETH_ALEN);
+    const uint16_t type = htons(kEtherType);
+    std::memcpy(frame.data() + 2 * ETH_ALEN, &type, sizeof(type));
+    for (int i = 0; i < count; ++i) {
+      ASSERT_EQ(frame.size(), send(packet_fd_, frame.data(), frame.size(), 0));
+    }
+  }
+
+  // Handler counting test packets into 'received_'.
+  PacketHandler CountingHandler() {
+    return [this](const base::Span<const XdpDesc> descs, const Umem& umem) {
+      for (const XdpDesc* desc = GetBase(descs); desc != GetLimit(descs);
+           ++desc) {
+        uint16_t type;
+        std::memcpy(&type, GetBase(GetPacket(umem, *desc)) + 2 * ETH_ALEN,
+                    sizeof(type));
+        if (ntohs(type) == kEtherType) {
+          received_.fetch_add(1);
+        }
+      }
+    };
+  }
+
+  bool WaitForPackets(const int count) {
+    for (int i = 0; i < 200 && received_.load() < count; ++i) {
+      usleep(10000);
+    }
+    return received_.load() >= count;
+  }
+
+  int ifindex_ = 0;
+  posix::UniqueFileDescriptor map_;
+  int prog_fd_ = -1;
+  int packet_fd_ = -1;
+  std::atomic<int> received_{0};
+};
+
+TEST_F(WorkerTest, ReceivesAndRecyclesFrames) {
+  auto options = MakeOptions();
+  options.cpu = 0;
+  auto worker_or = StartWorker(options, CountingHandler());
+  ASSERT_TRUE(IsOk(worker_or));
+  auto& worker = *GetValue(worker_or);
+
+  // More packets than frames: only works if frames go back to the kernel.
+  for (int round = 0; round < 4; ++round) {
+    SendPackets(kPackets);
+    ASSERT_TRUE(WaitForPackets((round + 1) * kPackets));
+  }
+
+  worker.Stop();
+  EXPECT_TRUE(IsOk(GetExitStatus(worker)));
+  const auto stats = GetStats(worker);
+  EXPECT_LE(4 * kPackets, stats.packets);
+  EXPECT_LE(1, stats.batches);
+  EXPECT_LE(stats.batches, stats.packets);
+  EXPECT_EQ(stats.polls, stats.batches + stats.idle_polls);
+}
+
+TEST_F(WorkerTest, BusyPoll) {
+  auto options = MakeOptions();
+  options.busy_poll = true;
+  auto worker_or = StartWorker(options, CountingHandler());
+  ASSERT_TRUE(IsOk(worker_or));
+  auto& worker = *GetValue(worker_or);
+
+  SendPackets(kPackets);
+  ASSERT_TRUE(WaitForPackets(kPackets));
+  worker.Stop();
+  EXPECT_TRUE(IsOk(GetExitStatus(worker)));
+}
+
+TEST_F(WorkerTest, BadCpuStopsWorker) {
+  auto options = MakeOptions();
+  options.cpu = CPU_SETSIZE - 1;
+  auto worker_or = StartWorker(options, CountingHandler());
+  ASSERT_TRUE(IsOk(worker_or));
+  auto& worker = *GetValue(worker_or);
+  for (int i = 0; i < 100 && IsOk(GetExitStatus(worker)); ++i) {
+    usleep(10000);
+  }
+  EXPECT_TRUE(IsError(GetExitStatus(worker)));
+}
+
+}  // namespace
+}  // namespace xsk